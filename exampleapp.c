@@ -5,6 +5,10 @@
 #include "exampleapp.h"
 #include "lazytreeview.h"
 #include "lazystore.h"
+#include "lazycsvstore.h"
+#include "lazycolumnstore.h"
+#include "lazybulkstore.h"
+#include "lazyexpandmodel.h"
 
 
 struct _ExampleApp
@@ -56,48 +60,211 @@ create_model (void)
   return GTK_TREE_MODEL (store);
 }
 
+/* The same table as create_model in one string arena, loads faster
+   and needs a fraction of the memory */
+static GtkTreeModel *
+create_bulk_store (void)
+{
+  const gint cell_size = 32;
+  LazyBulkStore *store = lazy_bulk_store_new (nr_of_columns, FALSE);
+  const gchar **values = g_new (const gchar *, nr_of_columns);
+  gchar *text = g_malloc (nr_of_columns * cell_size);
+  gint i, c;
+
+  lazy_bulk_store_reserve (store, nr_of_rows, (gsize) nr_of_rows * nr_of_columns * 24);
+  for (i = 0; i < nr_of_rows; i++)
+    {
+      for (c = 0; c < nr_of_columns; c++)
+        {
+          values[c] = text + c * cell_size;
+          g_snprintf (text + c * cell_size, cell_size, "Row: %d, Column: %d", i, c);
+        }
+      lazy_bulk_store_append_row (store, values);
+    }
+  lazy_bulk_store_commit (store);
+  g_free (text);
+  g_free (values);
+  return GTK_TREE_MODEL (store);
+}
+
+/* Typed columns, the values are only formatted when shown */
+static GtkTreeModel *
+create_column_store (void)
+{
+  const LazyColumnType types[] = {
+    LAZY_COLUMN_INT64, LAZY_COLUMN_DOUBLE, LAZY_COLUMN_TIMESTAMP, LAZY_COLUMN_STRING
+  };
+  const gchar *levels[] = { "debug", "info", "warning", "error" };
+  LazyColumnStore *store = lazy_column_store_new (G_N_ELEMENTS (types), types);
+  gint64 now = g_get_real_time ();
+  gint64 i;
+
+  for (i = 0; i < 1000000; i++)
+    {
+      gint64 row = lazy_column_store_append_row (store);
+
+      lazy_column_store_set_int64 (store, row, 0, i);
+      lazy_column_store_set_double (store, row, 1, g_random_double_range (-1000, 1000));
+      lazy_column_store_set_timestamp (store, row, 2, now + i * 1000);
+      lazy_column_store_set_string (store, row, 3, levels[g_random_int_range (0, 4)]);
+    }
+  lazy_column_store_commit (store);
+  return GTK_TREE_MODEL (store);
+}
+
+/* The lazystore with a million children per row, shown through an
+   expand model. Clicking the first column expands a row. */
+static GtkTreeModel *
+create_expand_model (void)
+{
+  LazyStore *store = lazy_store_new ();
+  LazyExpandModel *expand_model;
+
+  lazy_store_set_n_children (store, 1000000);
+  expand_model = lazy_expand_model_new (GTK_TREE_MODEL (store));
+  g_object_unref (store);
+  return GTK_TREE_MODEL (expand_model);
+}
+
 static void
-example_app_init (ExampleApp *app)
+pressed_cb (GtkGestureMultiPress *gesture,
+            gint                  n_press,
+            gdouble               x,
+            gdouble               y,
+            LazyExpandModel      *expand_model)
 {
+  GtkWidget *treeview = gtk_event_controller_get_widget (GTK_EVENT_CONTROLLER (gesture));
+  gint64 row;
+  gint col;
+
+  if (lazy_tree_view_get_cell_at_pos (LAZY_TREE_VIEW (treeview), x, y, &row, &col) &&
+      col == 0)
+    lazy_expand_model_toggle_row (expand_model, row);
 }
 
 static void
-example_app_activate (GApplication *app)
+example_app_init (ExampleApp *app)
+{
+}
+
+static GtkWidget *
+show_model (GApplication *app,
+            GtkTreeModel *model)
 {
   GtkWidget *window;
-  GtkWidget *label;
   GtkWidget *sw;
   GtkWidget *treeview;
-  GtkTreeModel *model;
-  GtkAdjustment *adj;
-  GtkTreeSelection *selection;
-
-  printf("%s\n",__FUNCTION__);
 
   window = gtk_application_window_new (GTK_APPLICATION (app));
   gtk_window_set_default_size ( GTK_WINDOW (window), 800, 480);
 
-  /* Choose beetween the gkt list store via create_model
-     or the lazystore*/
-#if 0
-  model = create_model();
-#else
-  model = GTK_TREE_MODEL (lazy_store_new());
-#endif
-
   treeview = lazy_tree_view_new();
+  /* Fetch on worker threads if the model allows it. Set a latency on
+     the lazystore with lazy_store_set_latency to see the effect. */
+  lazy_tree_view_set_async_fetch ( LAZY_TREE_VIEW (treeview), TRUE);
+  /* Keep the last row in view when rows are appended while the
+     end is shown */
+  lazy_tree_view_set_follow ( LAZY_TREE_VIEW (treeview), TRUE);
+  /* Fit the columns to a sample of their cells */
+  lazy_tree_view_set_auto_size_columns ( LAZY_TREE_VIEW (treeview), TRUE);
+  /* Show what each frame cost in the upper left corner */
+  if (g_getenv ("LAZYTREE_STATS"))
+    lazy_tree_view_set_show_stats ( LAZY_TREE_VIEW (treeview), TRUE);
   lazy_tree_view_set_model ( LAZY_TREE_VIEW (treeview), model);
+  if (IS_LAZY_EXPAND_MODEL (model))
+    {
+      GtkGesture *gesture = gtk_gesture_multi_press_new (treeview);
+
+      g_signal_connect (gesture, "pressed", G_CALLBACK (pressed_cb), model);
+      g_object_set_data_full (G_OBJECT (treeview), "expand-gesture",
+                              gesture, g_object_unref);
+    }
   sw = gtk_scrolled_window_new(NULL,NULL);
   gtk_container_add (GTK_CONTAINER (sw), treeview);
   gtk_container_add (GTK_CONTAINER (window), sw);
   gtk_widget_show_all (window);
   gtk_window_present (GTK_WINDOW (window));
+  return window;
+}
+
+/* Show the indexing progress in the window title */
+static void
+progress_cb (GObject    *object,
+             GParamSpec *pspec,
+             GtkWindow  *window)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (object);
+  gchar *title;
+
+  title = g_strdup_printf ("%.0f%% indexed",
+                           lazy_csv_store_get_progress (csv_store) * 100);
+  gtk_window_set_title (window, title);
+  g_free (title);
+}
+
+static void
+example_app_activate (GApplication *app)
+{
+  GtkTreeModel *model;
+
+  printf("%s\n",__FUNCTION__);
+
+  /* Choose beetween the gkt list store via create_model,
+     the bulk store, the typed column store, the lazystore as a tree
+     or the lazystore*/
+#if 0
+  model = create_model();
+#elif 0
+  model = create_bulk_store ();
+#elif 0
+  model = create_column_store ();
+#elif 0
+  model = create_expand_model ();
+#else
+  model = GTK_TREE_MODEL (lazy_store_new());
+#endif
+
+  show_model (app, model);
+}
+
+/* Show csv or tsv files given on the command line */
+static void
+example_app_open (GApplication  *app,
+                  GFile        **files,
+                  gint           n_files,
+                  const gchar   *hint)
+{
+  gint i;
+
+  for (i = 0; i < n_files; i++)
+    {
+      gchar *filename = g_file_get_path (files[i]);
+      GError *error = NULL;
+      LazyCsvStore *csv_store;
+
+      csv_store = lazy_csv_store_new (filename, '\0', FALSE, &error);
+      if (csv_store)
+        {
+          GtkWidget *window = show_model (app, GTK_TREE_MODEL (csv_store));
+
+          g_signal_connect_object (csv_store, "notify::progress",
+                                   G_CALLBACK (progress_cb), window, 0);
+          lazy_csv_store_set_follow (csv_store, TRUE);
+        }
+      else
+        {
+          g_printerr ("%s\n", error->message);
+          g_error_free (error);
+        }
+      g_free (filename);
+    }
 }
 
 static void
 example_app_class_init (ExampleAppClass *class)
 {
   G_APPLICATION_CLASS (class)->activate = example_app_activate;
+  G_APPLICATION_CLASS (class)->open = example_app_open;
 }
 
 ExampleApp *
@@ -105,5 +272,6 @@ example_app_new (void)
 {
   return g_object_new (EXAMPLE_APP_TYPE,
                        "application-id", "org.gtk.exampleapp",
+                       "flags", G_APPLICATION_HANDLES_OPEN,
                        NULL);
 }
@@ -0,0 +1,328 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* A LazyAxis holds the sizes of the rows or the columns of the view
+   and maps between item index and pixel offset. As long as all items
+   have the default size no memory per item is used and all lookups are
+   plain arithmetic. The first explicit size switches to a Fenwick tree
+   over the sizes, which gives O(log n) offset lookup, offset to index
+   search and size update. Appending and truncating stay O(log n), an
+   insert or remove in the middle rebuilds the tree in O(n), once for
+   a whole range of items. Indices and offsets are 64 bit, an axis
+   with billions of items works as long as the items keep the default
+   size. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "lazyaxis.h"
+
+/* The largest axis which may switch to individual sizes, 12 bytes are
+   needed per item */
+#define LAZY_AXIS_MAX_DENSE (64 * 1024 * 1024)
+
+struct _LazyAxis
+{
+  gint64 n;
+  gint default_size;
+  gint64 total;
+
+  /* NULL while all items have the default size */
+  gint *sizes;
+  gint64 *tree;     /* Fenwick tree, 1 based */
+  gint64 capacity;
+};
+
+LazyAxis *
+lazy_axis_new (gint64 n,
+               gint default_size)
+{
+  LazyAxis *axis;
+
+  g_return_val_if_fail (default_size > 0, NULL);
+
+  axis = g_slice_new0 (LazyAxis);
+  axis->n = MAX (n, 0);
+  axis->default_size = default_size;
+  axis->total = (gint64) axis->n * default_size;
+  return axis;
+}
+
+void
+lazy_axis_free (LazyAxis *axis)
+{
+  if (axis == NULL)
+    return;
+  g_free (axis->sizes);
+  g_free (axis->tree);
+  g_slice_free (LazyAxis, axis);
+}
+
+gint64
+lazy_axis_get_n (LazyAxis *axis)
+{
+  return axis->n;
+}
+
+gint
+lazy_axis_get_default_size (LazyAxis *axis)
+{
+  return axis->default_size;
+}
+
+static void
+reserve (LazyAxis *axis,
+         gint64    n)
+{
+  if (n <= axis->capacity)
+    return;
+  axis->capacity = MAX (n, axis->capacity * 2);
+  axis->sizes = g_renew (gint, axis->sizes, axis->capacity);
+  axis->tree = g_renew (gint64, axis->tree, axis->capacity + 1);
+}
+
+/* Build the Fenwick tree from the sizes in O(n) */
+static void
+rebuild (LazyAxis *axis)
+{
+  gint64 k;
+
+  axis->total = 0;
+  for (k = 1; k <= axis->n; k++)
+    {
+      axis->tree[k] = axis->sizes[k - 1];
+      axis->total += axis->sizes[k - 1];
+    }
+  for (k = 1; k <= axis->n; k++)
+    {
+      gint64 parent = k + (k & -k);
+      if (parent <= axis->n)
+        axis->tree[parent] += axis->tree[k];
+    }
+}
+
+/* Switch from the uniform to the per item representation */
+static gboolean
+materialize (LazyAxis *axis)
+{
+  gint64 i;
+
+  if (axis->sizes)
+    return TRUE;
+  if (axis->n > LAZY_AXIS_MAX_DENSE)
+    {
+      g_warning ("%s: %" G_GINT64_FORMAT " items are too many for individual sizes",
+                 G_STRFUNC, axis->n);
+      return FALSE;
+    }
+  reserve (axis, MAX (axis->n, 16));
+  for (i = 0; i < axis->n; i++)
+    axis->sizes[i] = axis->default_size;
+  rebuild (axis);
+  return TRUE;
+}
+
+/* Sum of the sizes of the first k items */
+static gint64
+prefix (LazyAxis *axis,
+        gint64    k)
+{
+  gint64 sum = 0;
+
+  for (; k > 0; k -= k & -k)
+    sum += axis->tree[k];
+  return sum;
+}
+
+static void
+append (LazyAxis *axis,
+        gint      size)
+{
+  gint64 k = axis->n + 1;
+
+  reserve (axis, k);
+  axis->sizes[k - 1] = size;
+  axis->tree[k] = size + prefix (axis, k - 1) - prefix (axis, k - (k & -k));
+  axis->n = k;
+  axis->total += size;
+}
+
+void
+lazy_axis_set_n (LazyAxis *axis,
+                 gint64    n)
+{
+  n = MAX (n, 0);
+  if (axis->sizes == NULL)
+    {
+      axis->n = n;
+      axis->total = (gint64) n * axis->default_size;
+      return;
+    }
+
+  if (n < axis->n)
+    {
+      /* Tree nodes only cover ranges ending at their own index */
+      axis->total = prefix (axis, n);
+      axis->n = n;
+    }
+  while (axis->n < n)
+    append (axis, axis->default_size);
+}
+
+/* Insert n_items items of the default size before index. Without
+   individual sizes this is O(1) also for millions of items. */
+void
+lazy_axis_insert_range (LazyAxis *axis,
+                        gint64    index,
+                        gint64    n_items)
+{
+  gint64 i;
+
+  g_return_if_fail (index >= 0 && index <= axis->n);
+  g_return_if_fail (n_items >= 0);
+
+  if (axis->sizes == NULL || index == axis->n)
+    {
+      lazy_axis_set_n (axis, axis->n + n_items);
+      return;
+    }
+
+  reserve (axis, axis->n + n_items);
+  memmove (axis->sizes + index + n_items, axis->sizes + index,
+           (axis->n - index) * sizeof (gint));
+  for (i = index; i < index + n_items; i++)
+    axis->sizes[i] = axis->default_size;
+  axis->n += n_items;
+  rebuild (axis);
+}
+
+void
+lazy_axis_insert (LazyAxis *axis,
+                  gint64    index)
+{
+  lazy_axis_insert_range (axis, index, 1);
+}
+
+/* Remove n_items items starting at index */
+void
+lazy_axis_remove_range (LazyAxis *axis,
+                        gint64    index,
+                        gint64    n_items)
+{
+  g_return_if_fail (index >= 0 && n_items >= 0 && index + n_items <= axis->n);
+
+  if (axis->sizes == NULL || index + n_items == axis->n)
+    {
+      lazy_axis_set_n (axis, axis->n - n_items);
+      return;
+    }
+
+  memmove (axis->sizes + index, axis->sizes + index + n_items,
+           (axis->n - index - n_items) * sizeof (gint));
+  axis->n -= n_items;
+  rebuild (axis);
+}
+
+void
+lazy_axis_remove (LazyAxis *axis,
+                  gint64    index)
+{
+  lazy_axis_remove_range (axis, index, 1);
+}
+
+gint
+lazy_axis_get_size (LazyAxis *axis,
+                    gint64    index)
+{
+  g_return_val_if_fail (index >= 0 && index < axis->n, 0);
+
+  if (axis->sizes == NULL)
+    return axis->default_size;
+  return axis->sizes[index];
+}
+
+void
+lazy_axis_set_size (LazyAxis *axis,
+                    gint64    index,
+                    gint      size)
+{
+  gint64 delta;
+  gint64 k;
+
+  g_return_if_fail (index >= 0 && index < axis->n);
+  g_return_if_fail (size >= 0);
+
+  if (axis->sizes == NULL)
+    {
+      if (size == axis->default_size || !materialize (axis))
+        return;
+    }
+
+  delta = size - axis->sizes[index];
+  if (delta == 0)
+    return;
+  axis->sizes[index] = size;
+  for (k = index + 1; k <= axis->n; k += k & -k)
+    axis->tree[k] += delta;
+  axis->total += delta;
+}
+
+/* The offset of the start of item index. index may be n which gives
+   the total size. */
+gint64
+lazy_axis_get_offset (LazyAxis *axis,
+                      gint64    index)
+{
+  index = CLAMP (index, 0, axis->n);
+
+  if (axis->sizes == NULL)
+    return (gint64) index * axis->default_size;
+  return prefix (axis, index);
+}
+
+/* The index of the item which contains offset. Offsets before the
+   first item give 0, offsets behind the last item give n. */
+gint64
+lazy_axis_find (LazyAxis *axis,
+                gint64    offset)
+{
+  gint64 pos, step;
+
+  if (offset < 0)
+    return 0;
+  if (offset >= axis->total)
+    return axis->n;
+
+  if (axis->sizes == NULL)
+    return offset / axis->default_size;
+
+  /* Descend the Fenwick tree */
+  pos = 0;
+  for (step = 1; step <= axis->n / 2; step <<= 1)
+    ;
+  for (; step > 0; step >>= 1)
+    if (pos + step <= axis->n && axis->tree[pos + step] <= offset)
+      {
+        pos += step;
+        offset -= axis->tree[pos];
+      }
+  return pos;
+}
+
+gint64
+lazy_axis_get_total (LazyAxis *axis)
+{
+  return axis->total;
+}
@@ -0,0 +1,59 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_AXIS_H__
+#define __LAZY_AXIS_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LazyAxis LazyAxis;
+
+LazyAxis     *lazy_axis_new              (gint64     n,
+                                          gint       default_size);
+void          lazy_axis_free             (LazyAxis  *axis);
+
+gint64        lazy_axis_get_n            (LazyAxis  *axis);
+void          lazy_axis_set_n            (LazyAxis  *axis,
+                                          gint64     n);
+void          lazy_axis_insert           (LazyAxis  *axis,
+                                          gint64     index);
+void          lazy_axis_remove           (LazyAxis  *axis,
+                                          gint64     index);
+void          lazy_axis_insert_range     (LazyAxis  *axis,
+                                          gint64     index,
+                                          gint64     n_items);
+void          lazy_axis_remove_range     (LazyAxis  *axis,
+                                          gint64     index,
+                                          gint64     n_items);
+
+gint          lazy_axis_get_default_size (LazyAxis  *axis);
+gint          lazy_axis_get_size         (LazyAxis  *axis,
+                                          gint64     index);
+void          lazy_axis_set_size         (LazyAxis  *axis,
+                                          gint64     index,
+                                          gint       size);
+
+gint64        lazy_axis_get_offset       (LazyAxis  *axis,
+                                          gint64     index);
+gint64        lazy_axis_find             (LazyAxis  *axis,
+                                          gint64     offset);
+gint64        lazy_axis_get_total        (LazyAxis  *axis);
+
+G_END_DECLS
+
+#endif /* __LAZY_AXIS_H__ */
@@ -0,0 +1,615 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The rendering benchmark behind make bench. A LazyTreeView in an
+   offscreen window is drawn into a cairo image surface while scroll
+   traces are replayed on its adjustments, nothing is shown on the
+   screen. For every model backend and trace the percentiles of the
+   frame time, the cells per second and the allocations per frame are
+   printed. With --load the time and the heap memory of loading
+   tables into a GtkListStore and into a LazyBulkStore are reported
+   instead.
+
+   GTK still needs a display connection for fonts and styles. Without
+   one the benchmark is skipped, run it with xvfb-run or
+   GDK_BACKEND=broadway on machines without a display. */
+
+#include <gtk/gtk.h>
+#include <glib/gprintf.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lazytreeview.h"
+#include "lazystore.h"
+#include "lazycolumnstore.h"
+#include "lazybulkstore.h"
+
+/* automake treats this exit status as a skipped test, so does the
+   bench target of Makefile.am */
+#define EXIT_SKIP 77
+#define VIEW_WIDTH 1280
+#define VIEW_HEIGHT 800
+
+typedef struct _Trace Trace;
+typedef struct _Backend Backend;
+
+/* A scroll trace yields the scroll position of every frame */
+struct _Trace
+{
+  const gchar *name;
+  void (* position) (gint     frame,
+                     gint     n_frames,
+                     GRand   *rand,
+                     gdouble  width,
+                     gdouble  height,
+                     gdouble *x,
+                     gdouble *y);
+};
+
+struct _Backend
+{
+  const gchar *name;
+  GtkTreeModel *(* create) (void);
+};
+
+/* Allocations through malloc and the bytes in use, counted by the
+   wrappers below */
+static gint n_allocs;
+static gssize heap_bytes;
+
+#ifdef __GLIBC__
+#include <errno.h>
+#include <malloc.h>
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+extern void __libc_free (void *ptr);
+
+static void *
+counted (void *ptr)
+{
+  if (ptr)
+    g_atomic_pointer_add (&heap_bytes, malloc_usable_size (ptr));
+  return ptr;
+}
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return counted (__libc_malloc (size));
+}
+
+void *
+calloc (size_t n,
+        size_t size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return counted (__libc_calloc (n, size));
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  gsize old_size = ptr ? malloc_usable_size (ptr) : 0;
+  void *new_ptr;
+
+  g_atomic_int_inc (&n_allocs);
+  new_ptr = __libc_realloc (ptr, size);
+  /* A failed realloc keeps the old block */
+  if (new_ptr || size == 0)
+    g_atomic_pointer_add (&heap_bytes, -(gssize) old_size);
+  return counted (new_ptr);
+}
+
+/* GSlice and cairo allocate aligned blocks, they are freed with free */
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return counted (__libc_memalign (alignment, size));
+}
+
+int
+posix_memalign (void   **ptr,
+                size_t   alignment,
+                size_t   size)
+{
+  *ptr = memalign (alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+
+void *
+aligned_alloc (size_t alignment,
+               size_t size)
+{
+  return memalign (alignment, size);
+}
+
+void
+free (void *ptr)
+{
+  if (ptr)
+    g_atomic_pointer_add (&heap_bytes, -(gssize) malloc_usable_size (ptr));
+  __libc_free (ptr);
+}
+#define COUNTS_ALLOCS TRUE
+#else
+#define COUNTS_ALLOCS FALSE
+#endif
+
+
+/* Traces */
+
+/* Flicks down and up, the speed decays like kinetic scrolling */
+static void
+flick_position (gint     frame,
+                gint     n_frames,
+                GRand   *rand,
+                gdouble  width,
+                gdouble  height,
+                gdouble *x,
+                gdouble *y)
+{
+  static gdouble position, velocity;
+  const gint flick_frames = 60;
+
+  if (frame == 0)
+    position = 0;
+  if (frame % flick_frames == 0)
+    velocity = (frame / flick_frames) % 2 ? -4000 : 6000;
+  position = CLAMP (position + velocity, 0, height);
+  velocity *= 0.93;
+  *x = 0;
+  *y = position;
+}
+
+/* Across all columns and back at constant speed */
+static void
+sweep_position (gint     frame,
+                gint     n_frames,
+                GRand   *rand,
+                gdouble  width,
+                gdouble  height,
+                gdouble *x,
+                gdouble *y)
+{
+  gdouble t = (gdouble) frame / MAX (n_frames - 1, 1) * 2;
+
+  *x = (t <= 1 ? t : 2 - t) * width;
+  *y = 0;
+}
+
+/* Random jumps, nothing can be reused between frames */
+static void
+jump_position (gint     frame,
+               gint     n_frames,
+               GRand   *rand,
+               gdouble  width,
+               gdouble  height,
+               gdouble *x,
+               gdouble *y)
+{
+  *x = g_rand_double_range (rand, 0, MAX (width, 1));
+  *y = g_rand_double_range (rand, 0, MAX (height, 1));
+}
+
+static const Trace traces[] = {
+  { "flick", flick_position },
+  { "sweep", sweep_position },
+  { "jump", jump_position },
+};
+
+
+/* Backends */
+
+static GtkTreeModel *
+create_lazy_store (void)
+{
+  return GTK_TREE_MODEL (lazy_store_new_with_size (30000, 1000000));
+}
+
+/* The same text as the lazystore, stored in a GtkListStore. Fewer
+   cells, all of them are created upfront. */
+static GtkTreeModel *
+create_list_store (void)
+{
+  const gint n_columns = 300, n_rows = 2000;
+  GType *types = g_new (GType, n_columns);
+  GtkListStore *store;
+  GtkTreeIter iter;
+  gchar string[100];
+  gint row, col;
+
+  for (col = 0; col < n_columns; col++)
+    types[col] = G_TYPE_STRING;
+  store = gtk_list_store_newv (n_columns, types);
+  g_free (types);
+
+  for (row = 0; row < n_rows; row++)
+    {
+      gtk_list_store_append (store, &iter);
+      for (col = 0; col < n_columns; col++)
+        {
+          GValue value = G_VALUE_INIT;
+
+          g_value_init (&value, G_TYPE_STRING);
+          g_sprintf (string, "Row: %d, Column: %d", row, col);
+          g_value_set_string (&value, string);
+          gtk_list_store_set_value (store, &iter, col, &value);
+          g_value_unset (&value);
+        }
+    }
+  return GTK_TREE_MODEL (store);
+}
+
+/* Typed columns, repeated to a wide table */
+static GtkTreeModel *
+create_column_store (void)
+{
+  const gint n_columns = 200, n_rows = 50000;
+  const gchar *levels[] = { "debug", "info", "warning", "error" };
+  LazyColumnType *types = g_new (LazyColumnType, n_columns);
+  LazyColumnStore *store;
+  GRand *rand = g_rand_new_with_seed (1);
+  gint64 now = G_GINT64_CONSTANT (1500000000000000);
+  gint64 row;
+  gint col;
+
+  for (col = 0; col < n_columns; col++)
+    types[col] = col % 4;
+  store = lazy_column_store_new (n_columns, types);
+  g_free (types);
+
+  for (row = 0; row < n_rows; row++)
+    {
+      lazy_column_store_append_row (store);
+      for (col = 0; col < n_columns; col++)
+        switch (col % 4)
+          {
+          case LAZY_COLUMN_INT64:
+            lazy_column_store_set_int64 (store, row, col, row * n_columns + col);
+            break;
+          case LAZY_COLUMN_DOUBLE:
+            lazy_column_store_set_double (store, row, col, g_rand_double_range (rand, -1e3, 1e3));
+            break;
+          case LAZY_COLUMN_TIMESTAMP:
+            lazy_column_store_set_timestamp (store, row, col, now + row * 1000);
+            break;
+          case LAZY_COLUMN_STRING:
+            lazy_column_store_set_string (store, row, col, levels[g_rand_int_range (rand, 0, 4)]);
+            break;
+          }
+    }
+  lazy_column_store_commit (store);
+  g_rand_free (rand);
+  return GTK_TREE_MODEL (store);
+}
+
+static const Backend backends[] = {
+  { "lazystore", create_lazy_store },
+  { "liststore", create_list_store },
+  { "columnstore", create_column_store },
+};
+
+
+/* Running */
+
+static gint
+compare_times (gconstpointer a,
+               gconstpointer b)
+{
+  gint64 ta = *(const gint64 *) a, tb = *(const gint64 *) b;
+
+  return ta < tb ? -1 : ta > tb;
+}
+
+static gdouble
+percentile (gint64 *sorted,
+            gint    n,
+            gdouble p)
+{
+  return sorted[MIN ((gint) (p * n), n - 1)] / 1000.0;
+}
+
+/* Let the view handle pending updates outside of the measured frame */
+static void
+flush_events (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+static void
+run_trace (GtkWidget     *view,
+           GtkTreeModel  *model,
+           const Backend *backend,
+           const Trace   *trace,
+           gint           n_frames)
+{
+  GtkAdjustment *hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (view));
+  GtkAdjustment *vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view));
+  cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                                         VIEW_WIDTH, VIEW_HEIGHT);
+  gint64 *times = g_new (gint64, n_frames);
+  GRand *rand = g_rand_new_with_seed (42);
+  gdouble width, height, total_ms = 0;
+  gint64 cells = 0, allocs;
+  gint n_columns = gtk_tree_model_get_n_columns (model);
+  gint64 n_rows = gtk_tree_model_iter_n_children (model, NULL);
+  gint col_width = lazy_tree_view_get_column_width (LAZY_TREE_VIEW (view), 0);
+  gint row_height = lazy_tree_view_get_row_height (LAZY_TREE_VIEW (view), 0);
+  gint frame;
+
+  lazy_tree_view_set_model (LAZY_TREE_VIEW (view), model);
+  flush_events ();
+  width = gtk_adjustment_get_upper (hadj) - gtk_adjustment_get_page_size (hadj);
+  height = gtk_adjustment_get_upper (vadj) - gtk_adjustment_get_page_size (vadj);
+
+  allocs = g_atomic_int_get (&n_allocs);
+  for (frame = 0; frame < n_frames; frame++)
+    {
+      cairo_t *cr = cairo_create (surface);
+      gdouble x, y;
+      gint64 start;
+
+      trace->position (frame, n_frames, rand, width, height, &x, &y);
+      start = g_get_monotonic_time ();
+      gtk_adjustment_set_value (hadj, x);
+      gtk_adjustment_set_value (vadj, y);
+      gtk_widget_draw (view, cr);
+      cairo_surface_flush (surface);
+      times[frame] = g_get_monotonic_time () - start;
+      total_ms += times[frame] / 1000.0;
+      cairo_destroy (cr);
+
+      /* The cells in view, all sizes are the defaults */
+      cells += MIN (VIEW_WIDTH / col_width + 1, n_columns) *
+               MIN (VIEW_HEIGHT / row_height + 1, n_rows);
+      flush_events ();
+    }
+  allocs = g_atomic_int_get (&n_allocs) - allocs;
+
+  qsort (times, n_frames, sizeof (gint64), compare_times);
+  g_print ("%-12s %-6s %7d %8.2f %8.2f %10.2f ",
+           backend->name, trace->name, n_frames,
+           percentile (times, n_frames, 0.5), percentile (times, n_frames, 0.99),
+           cells / MAX (total_ms, 0.001) / 1000.0);
+  if (COUNTS_ALLOCS)
+    g_print ("%12.1f\n", (gdouble) allocs / n_frames);
+  else
+    g_print ("%12s\n", "n/a");
+
+  lazy_tree_view_set_model (LAZY_TREE_VIEW (view), NULL);
+  g_rand_free (rand);
+  g_free (times);
+  cairo_surface_destroy (surface);
+}
+
+/* Loading
+
+   The tables are loaded cell by cell like create_model of the demo
+   does it, into a GtkListStore with one gtk_list_store_set_value per
+   cell and into a LazyBulkStore with one append per row. */
+
+typedef struct _Table Table;
+
+struct _Table
+{
+  const gchar *name;
+  gint n_rows;
+  gint n_columns;
+  gboolean repeated;        /* Four distinct values */
+};
+
+static const Table tables[] = {
+  { "demo", 15, 20000, FALSE },
+  { "tall", 200000, 20, FALSE },
+  { "repeated", 200000, 20, TRUE },
+};
+
+static const gchar *
+table_cell (const Table *table,
+            gint         row,
+            gint         col,
+            gchar       *buf)
+{
+  static const gchar *levels[] = { "debug", "info", "warning", "error" };
+
+  if (table->repeated)
+    return levels[(row + col) % 4];
+  g_sprintf (buf, "Row: %d, Column: %d", row, col);
+  return buf;
+}
+
+static GtkTreeModel *
+load_list_store (const Table *table,
+                 gboolean     intern)
+{
+  GType *types = g_new (GType, table->n_columns);
+  GtkListStore *store;
+  GtkTreeIter iter;
+  gchar buf[100];
+  gint row, col;
+
+  for (col = 0; col < table->n_columns; col++)
+    types[col] = G_TYPE_STRING;
+  store = gtk_list_store_newv (table->n_columns, types);
+  g_free (types);
+
+  for (row = 0; row < table->n_rows; row++)
+    {
+      gtk_list_store_append (store, &iter);
+      for (col = 0; col < table->n_columns; col++)
+        {
+          GValue value = G_VALUE_INIT;
+
+          g_value_init (&value, G_TYPE_STRING);
+          g_value_set_string (&value, table_cell (table, row, col, buf));
+          gtk_list_store_set_value (store, &iter, col, &value);
+          g_value_unset (&value);
+        }
+    }
+  return GTK_TREE_MODEL (store);
+}
+
+static GtkTreeModel *
+load_bulk_store (const Table *table,
+                 gboolean     intern)
+{
+  const gint cell_size = 32;
+  LazyBulkStore *store = lazy_bulk_store_new (table->n_columns, intern);
+  const gchar **values = g_new (const gchar *, table->n_columns);
+  gchar *text = g_malloc (table->n_columns * cell_size);
+  gint row, col;
+
+  for (row = 0; row < table->n_rows; row++)
+    {
+      for (col = 0; col < table->n_columns; col++)
+        values[col] = table_cell (table, row, col, text + col * cell_size);
+      lazy_bulk_store_append_row (store, values);
+    }
+  lazy_bulk_store_commit (store);
+  g_free (text);
+  g_free (values);
+  return GTK_TREE_MODEL (store);
+}
+
+static void
+run_load (const Table  *table,
+          const gchar  *store_name,
+          GtkTreeModel *(* load) (const Table *table,
+                                  gboolean     intern),
+          gboolean      intern)
+{
+  gssize bytes = g_atomic_pointer_get (&heap_bytes);
+  gint64 start = g_get_monotonic_time ();
+  GtkTreeModel *model = load (table, intern);
+  gdouble seconds = (g_get_monotonic_time () - start) / 1e6;
+
+  bytes = g_atomic_pointer_get (&heap_bytes) - bytes;
+  g_print ("%-9s %8d %6d  %-12s %8.3f ",
+           table->name, table->n_rows, table->n_columns, store_name, seconds);
+  if (COUNTS_ALLOCS)
+    g_print ("%10.1f\n", bytes / (1024.0 * 1024.0));
+  else
+    g_print ("%10s\n", "n/a");
+  g_object_unref (model);
+}
+
+static void
+run_loads (void)
+{
+  guint i;
+
+  g_print ("%-9s %8s %6s  %-12s %8s %10s\n",
+           "table", "rows", "cols", "store", "seconds", "heap MB");
+  for (i = 0; i < G_N_ELEMENTS (tables); i++)
+    {
+      run_load (&tables[i], "liststore", load_list_store, FALSE);
+      run_load (&tables[i], "bulkstore", load_bulk_store, FALSE);
+      run_load (&tables[i], "bulk+intern", load_bulk_store, TRUE);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *backend_name = NULL, *trace_name = NULL;
+  gint n_frames = 300;
+  gboolean no_tiles = FALSE;
+  gboolean cell_renderer = FALSE;
+  gboolean load = FALSE;
+  gint n_threads = -1;
+  GOptionEntry entries[] = {
+    { "backend", 'b', 0, G_OPTION_ARG_STRING, &backend_name,
+      "Only run the backend lazystore, liststore or columnstore", "NAME" },
+    { "trace", 't', 0, G_OPTION_ARG_STRING, &trace_name,
+      "Only run the trace flick, sweep or jump", "NAME" },
+    { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Frames per trace", "N" },
+    { "no-tiles", 0, 0, G_OPTION_ARG_NONE, &no_tiles,
+      "Draw without the tile cache", NULL },
+    { "cell-renderer", 0, 0, G_OPTION_ARG_NONE, &cell_renderer,
+      "Draw cells with GtkCellRendererText instead of Pango", NULL },
+    { "threads", 'j', 0, G_OPTION_ARG_INT, &n_threads,
+      "Render tiles on N threads, default one per core", "N" },
+    { "load", 0, 0, G_OPTION_ARG_NONE, &load,
+      "Report load time and memory of the stores instead", NULL },
+    { NULL }
+  };
+  GError *error = NULL;
+  GtkWidget *window, *view;
+  guint b, t;
+
+  if (!gtk_init_with_args (&argc, &argv, NULL, entries, NULL, &error))
+    {
+      if (error)
+        {
+          g_printerr ("%s\n", error->message);
+          return EXIT_FAILURE;
+        }
+      /* Loading needs no display */
+      if (!load)
+        {
+          g_printerr ("No display, benchmark skipped. Use xvfb-run or GDK_BACKEND=broadway.\n");
+          return EXIT_SKIP;
+        }
+    }
+  if (load)
+    {
+      run_loads ();
+      return EXIT_SUCCESS;
+    }
+  n_frames = MAX (n_frames, 1);
+
+  window = gtk_offscreen_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), VIEW_WIDTH, VIEW_HEIGHT);
+  view = lazy_tree_view_new ();
+  gtk_widget_set_size_request (view, VIEW_WIDTH, VIEW_HEIGHT);
+  if (no_tiles)
+    lazy_tree_view_set_tile_cache_size (LAZY_TREE_VIEW (view), 0);
+  if (cell_renderer)
+    lazy_tree_view_set_use_cell_renderer (LAZY_TREE_VIEW (view), TRUE);
+  if (n_threads >= 0)
+    lazy_tree_view_set_render_threads (LAZY_TREE_VIEW (view), n_threads);
+  gtk_container_add (GTK_CONTAINER (window), view);
+  gtk_widget_show_all (window);
+  flush_events ();
+
+  g_print ("%-12s %-6s %7s %8s %8s %10s %12s\n",
+           "backend", "trace", "frames", "p50 ms", "p99 ms", "Mcells/s", "allocs/frame");
+  for (b = 0; b < G_N_ELEMENTS (backends); b++)
+    {
+      GtkTreeModel *model;
+
+      if (backend_name && strcmp (backend_name, backends[b].name) != 0)
+        continue;
+      model = backends[b].create ();
+      for (t = 0; t < G_N_ELEMENTS (traces); t++)
+        if (trace_name == NULL || strcmp (trace_name, traces[t].name) == 0)
+          run_trace (view, model, &backends[b], &traces[t], n_frames);
+      g_object_unref (model);
+    }
+
+  gtk_widget_destroy (window);
+  g_free (backend_name);
+  g_free (trace_name);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,448 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The block source interface lets a model hand out a whole rectangle
+   of cells with one call. The treeview fetches one block per frame
+   instead of one GValue per cell.
+
+   A block source announces new rows with the rows-inserted signal
+   and removed rows with rows-deleted, one emission for a whole range
+   of rows. The per row row-inserted and row-deleted of GtkTreeModel
+   are only emitted if somebody listens to them, the treeview listens
+   to the range signals instead.
+
+   Likewise a new order of all rows is announced with the reordered
+   signal, without the new_order array of rows-reordered which has
+   one entry per row, and a complete change of the rows, including
+   their number, with the reset signal. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "lazyblocksource.h"
+
+/* Offset marking a cell which was not filled by the source */
+#define NO_CELL G_MAXUINT
+
+G_DEFINE_INTERFACE (LazyBlockSource, lazy_block_source, G_TYPE_OBJECT)
+
+static void
+lazy_block_source_default_init (LazyBlockSourceInterface *iface)
+{
+  /* Emitted with the first new row and the number of new rows */
+  g_signal_new ("rows-inserted",
+                TYPE_LAZY_BLOCK_SOURCE,
+                G_SIGNAL_RUN_LAST,
+                0,
+                NULL, NULL,
+                NULL,
+                G_TYPE_NONE, 2,
+                G_TYPE_INT64, G_TYPE_INT64);
+
+  /* Emitted with the first removed row and the number of removed
+     rows, after they are gone */
+  g_signal_new ("rows-deleted",
+                TYPE_LAZY_BLOCK_SOURCE,
+                G_SIGNAL_RUN_LAST,
+                0,
+                NULL, NULL,
+                NULL,
+                G_TYPE_NONE, 2,
+                G_TYPE_INT64, G_TYPE_INT64);
+
+  /* Emitted when all rows may have moved */
+  g_signal_new ("reordered",
+                TYPE_LAZY_BLOCK_SOURCE,
+                G_SIGNAL_RUN_LAST,
+                0,
+                NULL, NULL,
+                NULL,
+                G_TYPE_NONE, 0);
+
+  /* Emitted when all rows changed, also their number */
+  g_signal_new ("reset",
+                TYPE_LAZY_BLOCK_SOURCE,
+                G_SIGNAL_RUN_LAST,
+                0,
+                NULL, NULL,
+                NULL,
+                G_TYPE_NONE, 0);
+}
+
+void
+lazy_block_source_fetch_block (LazyBlockSource *source,
+                               LazyBlock       *block)
+{
+  g_return_if_fail (IS_LAZY_BLOCK_SOURCE (source));
+  g_return_if_fail (block != NULL);
+
+  LAZY_BLOCK_SOURCE_GET_IFACE (source)->fetch_block (source, block);
+}
+
+gint64
+lazy_block_source_get_n_rows (LazyBlockSource *source)
+{
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (source), 0);
+
+  return LAZY_BLOCK_SOURCE_GET_IFACE (source)->get_n_rows (source);
+}
+
+/* Fill numbers with the native values of the cells of a numeric
+   column, e.g. to sort or aggregate without parsing text. Returns
+   FALSE if the source only has text for the column. */
+gboolean
+lazy_block_source_fetch_numbers (LazyBlockSource *source,
+                                 gint             column,
+                                 gint64           row0,
+                                 gint             n_rows,
+                                 gdouble         *numbers)
+{
+  LazyBlockSourceInterface *iface;
+
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (source), FALSE);
+  g_return_val_if_fail (numbers != NULL || n_rows == 0, FALSE);
+
+  iface = LAZY_BLOCK_SOURCE_GET_IFACE (source);
+  if (iface->fetch_numbers == NULL)
+    return FALSE;
+  return iface->fetch_numbers (source, column, row0, n_rows, numbers);
+}
+
+/* A copy of the strings of a dictionary encoded column, the index is
+   the code of lazy_block_source_fetch_codes and 0 is the empty cell.
+   Codes only grow, so the copy covers all rows committed when it was
+   taken. Returns NULL if the column is not dictionary encoded. Free
+   with g_ptr_array_unref. */
+GPtrArray *
+lazy_block_source_dup_dictionary (LazyBlockSource *source,
+                                  gint             column)
+{
+  LazyBlockSourceInterface *iface;
+
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (source), NULL);
+
+  iface = LAZY_BLOCK_SOURCE_GET_IFACE (source);
+  if (iface->dup_dictionary == NULL)
+    return NULL;
+  return iface->dup_dictionary (source, column);
+}
+
+/* The dictionary codes of n_rows cells of column starting at row0,
+   such that a query can be answered once per distinct string instead
+   of once per cell. Returns FALSE if the column is not dictionary
+   encoded, e.g. because it got too many distinct strings since the
+   dictionary was taken. Safe on worker threads. */
+gboolean
+lazy_block_source_fetch_codes (LazyBlockSource *source,
+                               gint             column,
+                               gint64           row0,
+                               gint             n_rows,
+                               guint16         *codes)
+{
+  LazyBlockSourceInterface *iface;
+
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (source), FALSE);
+  g_return_val_if_fail (codes != NULL || n_rows == 0, FALSE);
+
+  iface = LAZY_BLOCK_SOURCE_GET_IFACE (source);
+  if (iface->fetch_codes == NULL)
+    return FALSE;
+  return iface->fetch_codes (source, column, row0, n_rows, codes);
+}
+
+/* Announce n_rows new rows starting at row. Must be called after the
+   rows are visible through the source, on the main thread. */
+void
+lazy_block_source_rows_inserted (LazyBlockSource *source,
+                                 gint64           row,
+                                 gint64           n_rows)
+{
+  GtkTreeModel *model;
+  gint64 r;
+
+  g_return_if_fail (IS_LAZY_BLOCK_SOURCE (source));
+
+  if (n_rows <= 0)
+    return;
+
+  g_signal_emit_by_name (source, "rows-inserted", row, n_rows);
+
+  /* Plain GtkTreeModel users, paths only reach G_MAXINT */
+  if (!GTK_IS_TREE_MODEL (source) ||
+      !g_signal_has_handler_pending (source,
+                                     g_signal_lookup ("row-inserted", GTK_TYPE_TREE_MODEL),
+                                     0, FALSE))
+    return;
+
+  model = GTK_TREE_MODEL (source);
+  for (r = row; r < row + n_rows && r <= G_MAXINT; r++)
+    {
+      GtkTreePath *path = gtk_tree_path_new_from_indices ((gint) r, -1);
+      GtkTreeIter iter;
+
+      if (gtk_tree_model_get_iter (model, &iter, path))
+        gtk_tree_model_row_inserted (model, path, &iter);
+      gtk_tree_path_free (path);
+    }
+}
+
+/* Announce that n_rows rows starting at row were removed. Must be
+   called after the rows are gone from the source, on the main
+   thread. */
+void
+lazy_block_source_rows_deleted (LazyBlockSource *source,
+                                gint64           row,
+                                gint64           n_rows)
+{
+  GtkTreeModel *model;
+  GtkTreePath *path;
+  gint64 r;
+
+  g_return_if_fail (IS_LAZY_BLOCK_SOURCE (source));
+
+  if (n_rows <= 0)
+    return;
+
+  g_signal_emit_by_name (source, "rows-deleted", row, n_rows);
+
+  /* Plain GtkTreeModel users, every removal shifts the next row to
+     the same path */
+  if (!GTK_IS_TREE_MODEL (source) || row > G_MAXINT ||
+      !g_signal_has_handler_pending (source,
+                                     g_signal_lookup ("row-deleted", GTK_TYPE_TREE_MODEL),
+                                     0, FALSE))
+    return;
+
+  model = GTK_TREE_MODEL (source);
+  path = gtk_tree_path_new_from_indices ((gint) row, -1);
+  for (r = 0; r < n_rows; r++)
+    gtk_tree_model_row_deleted (model, path);
+  gtk_tree_path_free (path);
+}
+
+/* Announce that the rows have a new order. Must be called after the
+   new order is visible through the source, on the main thread. */
+void
+lazy_block_source_reordered (LazyBlockSource *source)
+{
+  g_return_if_fail (IS_LAZY_BLOCK_SOURCE (source));
+
+  g_signal_emit_by_name (source, "reordered");
+}
+
+/* Announce that all rows were replaced. Must be called after the new
+   rows are visible through the source, on the main thread. */
+void
+lazy_block_source_reset (LazyBlockSource *source)
+{
+  g_return_if_fail (IS_LAZY_BLOCK_SOURCE (source));
+
+  g_signal_emit_by_name (source, "reset");
+}
+
+/* Fill the block with the rows rows[0 .. block->n_rows) of the
+   source, for models which show the rows of another model in a
+   different order or a subset of them. Runs of consecutive source
+   rows are fetched with one block. */
+void
+lazy_block_source_fetch_rows (LazyBlockSource *source,
+                              LazyBlock       *block,
+                              const gint64    *rows)
+{
+  LazyBlock *source_block;
+  gint i, run_end, r, col;
+
+  g_return_if_fail (IS_LAZY_BLOCK_SOURCE (source));
+  g_return_if_fail (block != NULL);
+
+  source_block = lazy_block_new ();
+  for (i = 0; i < block->n_rows; i = run_end)
+    {
+      for (run_end = i + 1; run_end < block->n_rows; run_end++)
+        if (rows[run_end] != rows[i] + (run_end - i))
+          break;
+      if (rows[i] < 0)
+        continue;
+
+      lazy_block_reset (source_block, rows[i], run_end - i, block->col0, block->n_cols);
+      lazy_block_source_fetch_block (source, source_block);
+      for (r = 0; r < run_end - i; r++)
+        for (col = block->col0; col < block->col0 + block->n_cols; col++)
+          lazy_block_set (block, block->row0 + i + r, col,
+                          lazy_block_get (source_block, rows[i] + r, col), -1);
+    }
+  lazy_block_free (source_block);
+}
+
+/* The slow path for models which only know GtkTreeModel */
+static void
+fetch_block_from_tree_model (GtkTreeModel *model,
+                             LazyBlock    *block)
+{
+  GtkTreeIter iter;
+  gboolean valid = FALSE;
+  gint r, c;
+
+  /* GtkTreeModel can only address gint rows */
+  if (block->row0 <= G_MAXINT)
+    valid = gtk_tree_model_iter_nth_child (model, &iter, NULL, block->row0);
+  for (r = 0; valid && r < block->n_rows; r++)
+    {
+      for (c = 0; c < block->n_cols; c++)
+        {
+          GValue val = G_VALUE_INIT;
+
+          gtk_tree_model_get_value (model, &iter, block->col0 + c, &val);
+          if (G_VALUE_HOLDS_STRING (&val))
+            lazy_block_set (block, block->row0 + r, block->col0 + c,
+                            g_value_get_string (&val), -1);
+          else
+            {
+              GValue text = G_VALUE_INIT;
+
+              /* Other types are shown the way GValue transforms them */
+              g_value_init (&text, G_TYPE_STRING);
+              if (g_value_transform (&val, &text))
+                lazy_block_set (block, block->row0 + r, block->col0 + c,
+                                g_value_get_string (&text), -1);
+              g_value_unset (&text);
+            }
+          g_value_unset (&val);
+        }
+      valid = gtk_tree_model_iter_next (model, &iter);
+    }
+}
+
+void
+lazy_block_fetch (GtkTreeModel *model,
+                  LazyBlock    *block)
+{
+  g_return_if_fail (GTK_IS_TREE_MODEL (model));
+  g_return_if_fail (block != NULL);
+
+  if (block->n_rows <= 0 || block->n_cols <= 0)
+    return;
+
+  if (IS_LAZY_BLOCK_SOURCE (model))
+    lazy_block_source_fetch_block (LAZY_BLOCK_SOURCE (model), block);
+  else
+    fetch_block_from_tree_model (model, block);
+}
+
+/* The number of rows of any GtkTreeModel */
+gint64
+lazy_block_n_rows (GtkTreeModel *model)
+{
+  g_return_val_if_fail (GTK_IS_TREE_MODEL (model), 0);
+
+  if (IS_LAZY_BLOCK_SOURCE (model))
+    return lazy_block_source_get_n_rows (LAZY_BLOCK_SOURCE (model));
+  return gtk_tree_model_iter_n_children (model, NULL);
+}
+
+
+/* LazyBlock */
+
+LazyBlock *
+lazy_block_new (void)
+{
+  LazyBlock *block = g_slice_new0 (LazyBlock);
+
+  block->arena = g_string_sized_new (4096);
+  return block;
+}
+
+void
+lazy_block_free (LazyBlock *block)
+{
+  if (block == NULL)
+    return;
+  g_free (block->offsets);
+  g_string_free (block->arena, TRUE);
+  g_slice_free (LazyBlock, block);
+}
+
+/* Prepare the block for a new rectangle. The memory of the previous
+   fetch is reused such that a steady state draw loop does not
+   allocate. */
+void
+lazy_block_reset (LazyBlock *block,
+                  gint64     row0,
+                  gint       n_rows,
+                  gint       col0,
+                  gint       n_cols)
+{
+  guint n_cells;
+
+  g_return_if_fail (block != NULL);
+
+  block->row0 = row0;
+  block->n_rows = MAX (n_rows, 0);
+  block->col0 = col0;
+  block->n_cols = MAX (n_cols, 0);
+
+  n_cells = block->n_rows * block->n_cols;
+  if (n_cells > block->offsets_size)
+    {
+      block->offsets = g_renew (guint, block->offsets, n_cells);
+      block->offsets_size = n_cells;
+    }
+  memset (block->offsets, 0xff, n_cells * sizeof (guint));
+  g_string_truncate (block->arena, 0);
+}
+
+void
+lazy_block_set (LazyBlock   *block,
+                gint64       row,
+                gint         col,
+                const gchar *string,
+                gssize       len)
+{
+  gint64 r = row - block->row0;
+  gint c = col - block->col0;
+
+  g_return_if_fail (r >= 0 && r < block->n_rows);
+  g_return_if_fail (c >= 0 && c < block->n_cols);
+
+  if (string == NULL)
+    return;
+  if (len < 0)
+    len = strlen (string);
+
+  block->offsets[r * block->n_cols + c] = block->arena->len;
+  g_string_append_len (block->arena, string, len);
+  g_string_append_c (block->arena, '\0');
+}
+
+/* Returns the string of the cell or NULL if the source did not
+   provide it. The string is owned by the block and valid until the
+   next lazy_block_reset. */
+const gchar *
+lazy_block_get (LazyBlock *block,
+                gint64     row,
+                gint       col)
+{
+  gint64 r = row - block->row0;
+  gint c = col - block->col0;
+  guint offset;
+
+  if (r < 0 || r >= block->n_rows || c < 0 || c >= block->n_cols)
+    return NULL;
+
+  offset = block->offsets[r * block->n_cols + c];
+  if (offset == NO_CELL)
+    return NULL;
+  return block->arena->str + offset;
+}
@@ -0,0 +1,138 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_BLOCK_SOURCE_H__
+#define __LAZY_BLOCK_SOURCE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_BLOCK_SOURCE            (lazy_block_source_get_type ())
+#define LAZY_BLOCK_SOURCE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_BLOCK_SOURCE, LazyBlockSource))
+#define IS_LAZY_BLOCK_SOURCE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_BLOCK_SOURCE))
+#define LAZY_BLOCK_SOURCE_GET_IFACE(obj)  (G_TYPE_INSTANCE_GET_INTERFACE ((obj), TYPE_LAZY_BLOCK_SOURCE, LazyBlockSourceInterface))
+
+typedef struct _LazyBlockSource          LazyBlockSource; /* Dummy typedef */
+typedef struct _LazyBlockSourceInterface LazyBlockSourceInterface;
+typedef struct _LazyBlock                LazyBlock;
+
+/* A rectangular block of cell strings. All strings of the block live
+   in one arena, the offsets table maps (row, col) to the start of the
+   NUL terminated string in the arena. */
+struct _LazyBlock
+{
+  gint64 row0;
+  gint n_rows;
+  gint col0;
+  gint n_cols;
+
+  /* private */
+  guint *offsets;
+  guint offsets_size;
+  GString *arena;
+};
+
+struct _LazyBlockSourceInterface
+{
+  GTypeInterface g_iface;
+
+  /* Fill all cells of the block rectangle with one call */
+  void   (* fetch_block) (LazyBlockSource *source,
+                          LazyBlock       *block);
+
+  /* The number of rows, not limited to the gint range of GtkTreeModel */
+  gint64 (* get_n_rows)  (LazyBlockSource *source);
+
+  /* Optional, the native values of a numeric column for sorting and
+     statistics, NAN for empty cells. Returns FALSE if the column is
+     not numeric. */
+  gboolean (* fetch_numbers) (LazyBlockSource *source,
+                              gint             column,
+                              gint64           row0,
+                              gint             n_rows,
+                              gdouble         *numbers);
+
+  /* Optional, for columns of few distinct strings. The strings of the
+     column as an array of copies, index 0 is the empty cell, or NULL
+     if the column is not dictionary encoded. Main thread only. */
+  GPtrArray * (* dup_dictionary) (LazyBlockSource *source,
+                                  gint             column);
+
+  /* Optional, the dictionary codes of the cells. Returns FALSE if the
+     column is not dictionary encoded. */
+  gboolean (* fetch_codes)   (LazyBlockSource *source,
+                              gint             column,
+                              gint64           row0,
+                              gint             n_rows,
+                              guint16         *codes);
+};
+
+GType         lazy_block_source_get_type    (void) G_GNUC_CONST;
+
+void          lazy_block_source_fetch_block (LazyBlockSource *source,
+                                             LazyBlock       *block);
+gint64        lazy_block_source_get_n_rows  (LazyBlockSource *source);
+void          lazy_block_source_rows_inserted (LazyBlockSource *source,
+                                             gint64           row,
+                                             gint64           n_rows);
+void          lazy_block_source_rows_deleted (LazyBlockSource *source,
+                                             gint64           row,
+                                             gint64           n_rows);
+void          lazy_block_source_reordered (LazyBlockSource *source);
+void          lazy_block_source_reset     (LazyBlockSource *source);
+void          lazy_block_source_fetch_rows (LazyBlockSource *source,
+                                             LazyBlock       *block,
+                                             const gint64    *rows);
+gboolean      lazy_block_source_fetch_numbers (LazyBlockSource *source,
+                                             gint             column,
+                                             gint64           row0,
+                                             gint             n_rows,
+                                             gdouble         *numbers);
+GPtrArray    *lazy_block_source_dup_dictionary (LazyBlockSource *source,
+                                             gint             column);
+gboolean      lazy_block_source_fetch_codes (LazyBlockSource *source,
+                                             gint             column,
+                                             gint64           row0,
+                                             gint             n_rows,
+                                             guint16         *codes);
+
+/* Fetch the block from any GtkTreeModel. Uses the block source
+   interface if the model implements it and falls back to one
+   gtk_tree_model_get_value per cell otherwise. */
+void          lazy_block_fetch              (GtkTreeModel    *model,
+                                             LazyBlock       *block);
+gint64        lazy_block_n_rows             (GtkTreeModel    *model);
+
+LazyBlock    *lazy_block_new                (void);
+void          lazy_block_free               (LazyBlock       *block);
+void          lazy_block_reset              (LazyBlock       *block,
+                                             gint64           row0,
+                                             gint             n_rows,
+                                             gint             col0,
+                                             gint             n_cols);
+void          lazy_block_set                (LazyBlock       *block,
+                                             gint64           row,
+                                             gint             col,
+                                             const gchar     *string,
+                                             gssize           len);
+const gchar  *lazy_block_get                (LazyBlock       *block,
+                                             gint64           row,
+                                             gint             col);
+
+G_END_DECLS
+
+#endif /* __LAZY_BLOCK_SOURCE_H__ */
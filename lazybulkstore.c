@@ -0,0 +1,955 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The bulk store keeps text tables compact. All strings live in one
+   arena and each column stores its cells in one array. A column
+   starts dictionary encoded: every distinct string of the column is
+   stored once and a cell is an 8 bit code, widened to 16 bit once the
+   column has more than 255 distinct strings. Columns with few
+   distinct strings, like levels, states or names, thus cost 1 or 2
+   bytes per cell instead of a GValue, a list node and a heap string
+   per cell as in the GtkListStore. Code 0 is the empty cell.
+
+   A column whose strings are mostly distinct, or which runs out of
+   16 bit codes, drops its dictionary and stores a 32 bit offset into
+   the arena per cell from then on, offset 0 being the empty cell.
+   With interning a string which is already in the arena is not
+   stored again in such columns.
+
+   Searches and sorts ask for the codes and the dictionary of a
+   column through the block source, see
+   lazy_block_source_fetch_codes, and evaluate their query once per
+   distinct string instead of once per cell.
+
+   Rows are appended in bulk, row by row from an array of strings,
+   and become visible with lazy_bulk_store_commit. The store is
+   append only, committed cells do not change. The arena is limited
+   to 4 GiB of text. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "lazybulkstore.h"
+#include "lazyblocksource.h"
+
+/* Initial sizes of the cell arrays in rows, of the arena in bytes, of
+   the intern table in slots and of a dictionary in codes */
+#define MIN_ROWS 1024
+#define MIN_TEXT (64 * 1024)
+#define MIN_SLOTS 1024
+#define MIN_CODES 16
+
+/* Codes of 8 and 16 bit, including the empty cell */
+#define MAX_CODES8 256
+#define MAX_CODES16 65536
+
+/* Once a column has DETECT_ROWS rows, it keeps its dictionary while
+   at most one in DISTINCT_RATIO of its cells brought a new string */
+#define DETECT_ROWS 4096
+#define DISTINCT_RATIO 8
+
+typedef enum
+{
+  ENCODING_CODES8,          /* guint8 codes */
+  ENCODING_CODES16,         /* guint16 codes */
+  ENCODING_OFFSETS          /* guint32 offsets into the arena */
+} Encoding;
+
+typedef struct _Column Column;
+
+struct _Column
+{
+  Encoding encoding;
+  gpointer cells;
+
+  /* The dictionary, arena offsets by code, values[0] is 0 */
+  guint32 *values;
+  guint n_values;
+  guint values_capacity;
+
+  /* The codes in an open addressing table, 0 is a free slot. Main
+     thread only. */
+  guint16 *slots;
+  guint n_slots;
+};
+
+struct _LazyBulkStore
+{
+  GObject parent;
+
+  /* private */
+  gint n_columns;
+  Column *columns;
+  gint64 n_rows;            /* Committed rows */
+  gint64 n_appended;        /* Including the rows not committed yet */
+  gint64 capacity;
+  guint stamp;
+
+  /* The arena, text[0] is the empty string */
+  gchar *text;
+  gsize text_len;
+  gsize text_capacity;
+
+  /* Offsets of the distinct strings of the columns without
+     dictionary in an open addressing table, 0 is a free slot. Main
+     thread only. */
+  gboolean intern;
+  guint32 *slots;
+  guint n_slots;
+  guint n_interned;
+
+  /* Taken for writing when the arrays move, fetches on worker
+     threads take it for reading */
+  GRWLock lock;
+};
+
+/* The row id is 64 bit, see lazystore.c */
+static inline gint64
+iter_get_row (GtkTreeIter *iter)
+{
+  return (gint64) (((guint64) GPOINTER_TO_UINT (iter->user_data2) << 32) |
+                   GPOINTER_TO_UINT (iter->user_data));
+}
+
+static inline void
+iter_set_row (GtkTreeIter *iter,
+              gint64       row)
+{
+  iter->user_data = GUINT_TO_POINTER ((guint) ((guint64) row & 0xffffffff));
+  iter->user_data2 = GUINT_TO_POINTER ((guint) ((guint64) row >> 32));
+}
+
+static void         lazy_bulk_store_tree_model_init   (GtkTreeModelIface *iface);
+static GtkTreeModelFlags lazy_bulk_store_get_flags    (GtkTreeModel      *tree_model);
+static gint         lazy_bulk_store_get_n_columns     (GtkTreeModel      *tree_model);
+static GType        lazy_bulk_store_get_column_type   (GtkTreeModel      *tree_model,
+                                                       gint               index);
+static gboolean     lazy_bulk_store_get_iter          (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreePath       *path);
+static GtkTreePath *lazy_bulk_store_get_path          (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static void         lazy_bulk_store_get_value         (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       gint               column,
+                                                       GValue            *value);
+static gboolean     lazy_bulk_store_iter_next         (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_bulk_store_iter_previous     (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_bulk_store_iter_children     (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent);
+static gboolean     lazy_bulk_store_iter_has_child    (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gint         lazy_bulk_store_iter_n_children   (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_bulk_store_iter_nth_child    (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent,
+                                                       gint               n);
+static gboolean     lazy_bulk_store_iter_parent       (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *child);
+
+static void         lazy_bulk_store_block_source_init   (LazyBlockSourceInterface *iface);
+static void         lazy_bulk_store_fetch_block       (LazyBlockSource   *source,
+                                                       LazyBlock         *block);
+static gint64       lazy_bulk_store_get_n_rows        (LazyBlockSource   *source);
+static GPtrArray   *lazy_bulk_store_dup_dictionary    (LazyBlockSource   *source,
+                                                       gint               column);
+static gboolean     lazy_bulk_store_fetch_codes       (LazyBlockSource   *source,
+                                                       gint               column,
+                                                       gint64             row0,
+                                                       gint               n_rows,
+                                                       guint16           *codes);
+
+static void         lazy_bulk_store_finalize          (GObject           *object);
+
+G_DEFINE_TYPE_WITH_CODE (LazyBulkStore, lazy_bulk_store, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                lazy_bulk_store_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (TYPE_LAZY_BLOCK_SOURCE,
+                                                lazy_bulk_store_block_source_init))
+
+
+static void
+lazy_bulk_store_class_init (LazyBulkStoreClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->finalize = lazy_bulk_store_finalize;
+}
+
+static void
+lazy_bulk_store_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = lazy_bulk_store_get_flags;
+  iface->get_n_columns = lazy_bulk_store_get_n_columns;
+  iface->get_column_type = lazy_bulk_store_get_column_type;
+  iface->get_iter = lazy_bulk_store_get_iter;
+  iface->get_path = lazy_bulk_store_get_path;
+  iface->get_value = lazy_bulk_store_get_value;
+  iface->iter_next = lazy_bulk_store_iter_next;
+  iface->iter_previous = lazy_bulk_store_iter_previous;
+  iface->iter_children = lazy_bulk_store_iter_children;
+  iface->iter_has_child = lazy_bulk_store_iter_has_child;
+  iface->iter_n_children = lazy_bulk_store_iter_n_children;
+  iface->iter_nth_child = lazy_bulk_store_iter_nth_child;
+  iface->iter_parent = lazy_bulk_store_iter_parent;
+}
+
+static void
+lazy_bulk_store_block_source_init (LazyBlockSourceInterface *iface)
+{
+  iface->fetch_block = lazy_bulk_store_fetch_block;
+  iface->get_n_rows = lazy_bulk_store_get_n_rows;
+  iface->dup_dictionary = lazy_bulk_store_dup_dictionary;
+  iface->fetch_codes = lazy_bulk_store_fetch_codes;
+}
+
+static void
+lazy_bulk_store_init (LazyBulkStore *bulk_store)
+{
+  g_rw_lock_init (&bulk_store->lock);
+  bulk_store->stamp = g_random_int ();
+  bulk_store->text_capacity = MIN_TEXT;
+  bulk_store->text = g_malloc (bulk_store->text_capacity);
+  bulk_store->text[0] = '\0';
+  bulk_store->text_len = 1;
+}
+
+static void
+lazy_bulk_store_finalize (GObject *object)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (object);
+  gint i;
+
+  for (i = 0; i < bulk_store->n_columns; i++)
+    {
+      g_free (bulk_store->columns[i].cells);
+      g_free (bulk_store->columns[i].values);
+      g_free (bulk_store->columns[i].slots);
+    }
+  g_free (bulk_store->columns);
+  g_free (bulk_store->text);
+  g_free (bulk_store->slots);
+  g_rw_lock_clear (&bulk_store->lock);
+
+  G_OBJECT_CLASS (lazy_bulk_store_parent_class)->finalize (object);
+}
+
+static gsize
+cell_size (Encoding encoding)
+{
+  switch (encoding)
+    {
+    case ENCODING_CODES8:
+      return sizeof (guint8);
+    case ENCODING_CODES16:
+      return sizeof (guint16);
+    default:
+      return sizeof (guint32);
+    }
+}
+
+/* The arena offset of a cell. Must be called with the lock held or on
+   the main thread. */
+static inline guint32
+get_offset (const Column *column,
+            gint64        row)
+{
+  switch (column->encoding)
+    {
+    case ENCODING_CODES8:
+      return column->values[((const guint8 *) column->cells)[row]];
+    case ENCODING_CODES16:
+      return column->values[((const guint16 *) column->cells)[row]];
+    default:
+      return ((const guint32 *) column->cells)[row];
+    }
+}
+
+/* Make room for n_rows more rows and bytes more text. Fetch threads
+   read the arrays, so they only move with the lock held. */
+static void
+grow (LazyBulkStore *bulk_store,
+      gint64         n_rows,
+      gsize          bytes)
+{
+  gint64 capacity = bulk_store->capacity;
+  gsize text_capacity = bulk_store->text_capacity;
+  gint i;
+
+  while (capacity < bulk_store->n_appended + n_rows)
+    capacity = MAX (capacity * 2, MIN_ROWS);
+  while (text_capacity < bulk_store->text_len + bytes)
+    text_capacity *= 2;
+  if (capacity == bulk_store->capacity && text_capacity == bulk_store->text_capacity)
+    return;
+
+  g_rw_lock_writer_lock (&bulk_store->lock);
+  if (capacity != bulk_store->capacity)
+    {
+      for (i = 0; i < bulk_store->n_columns; i++)
+        {
+          Column *column = &bulk_store->columns[i];
+
+          column->cells = g_realloc_n (column->cells, capacity, cell_size (column->encoding));
+        }
+      bulk_store->capacity = capacity;
+    }
+  if (text_capacity != bulk_store->text_capacity)
+    {
+      bulk_store->text = g_realloc (bulk_store->text, text_capacity);
+      bulk_store->text_capacity = text_capacity;
+    }
+  g_rw_lock_writer_unlock (&bulk_store->lock);
+}
+
+/* Copy the string into the arena, returns its offset */
+static guint32
+store_string (LazyBulkStore *bulk_store,
+              const gchar   *string)
+{
+  gsize len = strlen (string) + 1;
+  guint32 offset;
+
+  g_return_val_if_fail (bulk_store->text_len + len <= G_MAXUINT32, 0);
+  if (bulk_store->text_len + len > bulk_store->text_capacity)
+    grow (bulk_store, 0, len);
+  offset = bulk_store->text_len;
+  memcpy (bulk_store->text + offset, string, len);
+  bulk_store->text_len += len;
+  return offset;
+}
+
+
+/* Interning */
+
+/* The slot of string, either holding its offset or free */
+static guint
+find_slot (LazyBulkStore *bulk_store,
+           const gchar   *string,
+           guint          hash)
+{
+  guint mask = bulk_store->n_slots - 1;
+  guint slot = hash & mask;
+
+  while (bulk_store->slots[slot] &&
+         strcmp (bulk_store->text + bulk_store->slots[slot], string) != 0)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+/* Keep the table at most half full */
+static void
+grow_slots (LazyBulkStore *bulk_store)
+{
+  guint32 *old_slots = bulk_store->slots;
+  guint old_n_slots = bulk_store->n_slots;
+  guint i;
+
+  bulk_store->n_slots = MAX (old_n_slots * 2, MIN_SLOTS);
+  bulk_store->slots = g_new0 (guint32, bulk_store->n_slots);
+  for (i = 0; i < old_n_slots; i++)
+    if (old_slots[i])
+      {
+        const gchar *string = bulk_store->text + old_slots[i];
+
+        bulk_store->slots[find_slot (bulk_store, string, g_str_hash (string))] = old_slots[i];
+      }
+  g_free (old_slots);
+}
+
+/* Copy the string into the arena, or find it there with interning.
+   Returns its offset. */
+static guint32
+add_string (LazyBulkStore *bulk_store,
+            const gchar   *string)
+{
+  guint32 offset;
+  guint slot = 0;
+
+  if (string == NULL || *string == '\0')
+    return 0;
+
+  if (bulk_store->intern)
+    {
+      if (2 * (bulk_store->n_interned + 1) > bulk_store->n_slots)
+        grow_slots (bulk_store);
+      slot = find_slot (bulk_store, string, g_str_hash (string));
+      if (bulk_store->slots[slot])
+        return bulk_store->slots[slot];
+    }
+
+  offset = store_string (bulk_store, string);
+  if (bulk_store->intern)
+    {
+      bulk_store->slots[slot] = offset;
+      bulk_store->n_interned++;
+    }
+  return offset;
+}
+
+
+/* Dictionaries */
+
+/* The slot of string in the codes of the column, either holding its
+   code or free */
+static guint
+find_code (LazyBulkStore *bulk_store,
+           Column        *column,
+           const gchar   *string,
+           guint          hash)
+{
+  guint mask = column->n_slots - 1;
+  guint slot = hash & mask;
+
+  while (column->slots[slot] &&
+         strcmp (bulk_store->text + column->values[column->slots[slot]], string) != 0)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+/* Keep the table at most half full */
+static void
+grow_codes (LazyBulkStore *bulk_store,
+            Column        *column)
+{
+  guint16 *old_slots = column->slots;
+  guint old_n_slots = column->n_slots;
+  guint i;
+
+  column->n_slots = MAX (old_n_slots * 2, 2 * MIN_CODES);
+  column->slots = g_new0 (guint16, column->n_slots);
+  for (i = 0; i < old_n_slots; i++)
+    if (old_slots[i])
+      {
+        const gchar *string = bulk_store->text + column->values[old_slots[i]];
+
+        column->slots[find_code (bulk_store, column, string, g_str_hash (string))] = old_slots[i];
+      }
+  g_free (old_slots);
+}
+
+/* Switch from 8 to 16 bit codes */
+static void
+widen_codes (LazyBulkStore *bulk_store,
+             Column        *column)
+{
+  guint8 *old_cells = column->cells;
+  guint16 *cells = g_new (guint16, bulk_store->capacity);
+  gint64 row;
+
+  for (row = 0; row < bulk_store->n_appended; row++)
+    cells[row] = old_cells[row];
+
+  g_rw_lock_writer_lock (&bulk_store->lock);
+  column->cells = cells;
+  column->encoding = ENCODING_CODES16;
+  g_rw_lock_writer_unlock (&bulk_store->lock);
+  g_free (old_cells);
+}
+
+/* Replace the codes by arena offsets for good */
+static void
+drop_dictionary (LazyBulkStore *bulk_store,
+                 Column        *column)
+{
+  gpointer old_cells = column->cells;
+  guint32 *old_values = column->values;
+  guint32 *cells = g_new (guint32, bulk_store->capacity);
+  gint64 row;
+
+  for (row = 0; row < bulk_store->n_appended; row++)
+    cells[row] = get_offset (column, row);
+
+  g_rw_lock_writer_lock (&bulk_store->lock);
+  column->cells = cells;
+  column->encoding = ENCODING_OFFSETS;
+  column->values = NULL;
+  column->n_values = 0;
+  column->values_capacity = 0;
+  g_rw_lock_writer_unlock (&bulk_store->lock);
+  g_free (old_cells);
+  g_free (old_values);
+  g_clear_pointer (&column->slots, g_free);
+  column->n_slots = 0;
+}
+
+/* The code of string in the column, added to the dictionary if it is
+   new. Drops the dictionary instead if the column has too many
+   distinct strings for it. */
+static guint
+add_code (LazyBulkStore *bulk_store,
+          Column        *column,
+          const gchar   *string)
+{
+  guint slot, code;
+
+  if (string == NULL || *string == '\0')
+    return 0;
+
+  if (2 * column->n_values > column->n_slots)
+    grow_codes (bulk_store, column);
+  slot = find_code (bulk_store, column, string, g_str_hash (string));
+  if (column->slots[slot])
+    return column->slots[slot];
+
+  if (column->n_values == MAX_CODES16 ||
+      (bulk_store->n_appended >= DETECT_ROWS &&
+       (gint64) column->n_values * DISTINCT_RATIO > bulk_store->n_appended))
+    {
+      drop_dictionary (bulk_store, column);
+      return 0;
+    }
+  if (column->n_values == MAX_CODES8)
+    widen_codes (bulk_store, column);
+  if (column->n_values == column->values_capacity)
+    {
+      g_rw_lock_writer_lock (&bulk_store->lock);
+      column->values_capacity *= 2;
+      column->values = g_renew (guint32, column->values, column->values_capacity);
+      g_rw_lock_writer_unlock (&bulk_store->lock);
+    }
+
+  code = column->n_values++;
+  column->values[code] = store_string (bulk_store, string);
+  column->slots[slot] = code;
+  return code;
+}
+
+/* Store a cell of a row which is not committed yet */
+static void
+set_cell (LazyBulkStore *bulk_store,
+          Column        *column,
+          gint64         row,
+          const gchar   *string)
+{
+  guint code;
+
+  if (column->encoding != ENCODING_OFFSETS)
+    {
+      code = add_code (bulk_store, column, string);
+      if (column->encoding == ENCODING_CODES8)
+        ((guint8 *) column->cells)[row] = code;
+      else if (column->encoding == ENCODING_CODES16)
+        ((guint16 *) column->cells)[row] = code;
+    }
+  /* Also when add_code just dropped the dictionary */
+  if (column->encoding == ENCODING_OFFSETS)
+    ((guint32 *) column->cells)[row] = add_string (bulk_store, string);
+}
+
+
+/* Public API */
+
+/* A store for n_columns text columns. With intern repeated strings
+   are stored once also in the columns without dictionary. */
+LazyBulkStore *
+lazy_bulk_store_new (gint     n_columns,
+                     gboolean intern)
+{
+  LazyBulkStore *bulk_store;
+  gint i;
+
+  g_return_val_if_fail (n_columns >= 0, NULL);
+
+  bulk_store = g_object_new (TYPE_LAZY_BULK_STORE, NULL);
+  bulk_store->n_columns = n_columns;
+  bulk_store->intern = intern != FALSE;
+  bulk_store->columns = g_new0 (Column, n_columns);
+  for (i = 0; i < n_columns; i++)
+    {
+      Column *column = &bulk_store->columns[i];
+
+      column->encoding = ENCODING_CODES8;
+      column->values_capacity = MIN_CODES;
+      column->values = g_new (guint32, column->values_capacity);
+      column->values[0] = 0;
+      column->n_values = 1;
+    }
+  return bulk_store;
+}
+
+/* Make room for n_rows more rows with text_bytes of text in total,
+   such that a load of known size does not copy the arrays while it
+   grows */
+void
+lazy_bulk_store_reserve (LazyBulkStore *bulk_store,
+                         gint64         n_rows,
+                         gsize          text_bytes)
+{
+  g_return_if_fail (IS_LAZY_BULK_STORE (bulk_store));
+  g_return_if_fail (n_rows >= 0);
+
+  grow (bulk_store, n_rows, text_bytes);
+}
+
+/* Append n_rows rows. values holds n_columns strings per row, row
+   after row, NULL and "" are empty cells. The rows are not visible
+   before the next lazy_bulk_store_commit. Returns the first new
+   row. */
+gint64
+lazy_bulk_store_append_rows (LazyBulkStore       *bulk_store,
+                             const gchar * const *values,
+                             gint64               n_rows)
+{
+  gint64 row0, i;
+  gint n_columns, col;
+
+  g_return_val_if_fail (IS_LAZY_BULK_STORE (bulk_store), -1);
+  g_return_val_if_fail (n_rows >= 0, -1);
+  g_return_val_if_fail (n_rows == 0 || values != NULL, -1);
+
+  n_columns = bulk_store->n_columns;
+  row0 = bulk_store->n_appended;
+  grow (bulk_store, n_rows, 0);
+  /* Rows past n_rows are not read by fetch threads. n_appended counts
+     the finished rows, which a column converts when it changes its
+     encoding. */
+  for (i = 0; i < n_rows; i++)
+    {
+      for (col = 0; col < n_columns; col++)
+        set_cell (bulk_store, &bulk_store->columns[col], row0 + i,
+                  values[i * n_columns + col]);
+      bulk_store->n_appended++;
+    }
+  return row0;
+}
+
+gint64
+lazy_bulk_store_append_row (LazyBulkStore       *bulk_store,
+                            const gchar * const *values)
+{
+  return lazy_bulk_store_append_rows (bulk_store, values, 1);
+}
+
+/* Show the appended rows */
+void
+lazy_bulk_store_commit (LazyBulkStore *bulk_store)
+{
+  gint64 old_n_rows;
+
+  g_return_if_fail (IS_LAZY_BULK_STORE (bulk_store));
+
+  if (bulk_store->n_appended == bulk_store->n_rows)
+    return;
+  g_rw_lock_writer_lock (&bulk_store->lock);
+  old_n_rows = bulk_store->n_rows;
+  bulk_store->n_rows = bulk_store->n_appended;
+  g_rw_lock_writer_unlock (&bulk_store->lock);
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (bulk_store), old_n_rows,
+                                   bulk_store->n_rows - old_n_rows);
+}
+
+/* The number of distinct strings of a dictionary encoded column, or
+   -1 if the column stores arena offsets */
+gint
+lazy_bulk_store_get_n_distinct (LazyBulkStore *bulk_store,
+                                gint           column)
+{
+  g_return_val_if_fail (IS_LAZY_BULK_STORE (bulk_store), -1);
+  g_return_val_if_fail (column >= 0 && column < bulk_store->n_columns, -1);
+
+  if (bulk_store->columns[column].encoding == ENCODING_OFFSETS)
+    return -1;
+  return bulk_store->columns[column].n_values - 1;
+}
+
+/* The memory of the cells, the dictionaries, the arena and the intern
+   table */
+gsize
+lazy_bulk_store_get_bytes (LazyBulkStore *bulk_store)
+{
+  gsize bytes;
+  gint i;
+
+  g_return_val_if_fail (IS_LAZY_BULK_STORE (bulk_store), 0);
+
+  bytes = bulk_store->n_columns * sizeof (Column) +
+          bulk_store->text_capacity +
+          bulk_store->n_slots * sizeof (guint32);
+  for (i = 0; i < bulk_store->n_columns; i++)
+    {
+      Column *column = &bulk_store->columns[i];
+
+      bytes += bulk_store->capacity * cell_size (column->encoding) +
+               column->values_capacity * sizeof (guint32) +
+               column->n_slots * sizeof (guint16);
+    }
+  return bytes;
+}
+
+/* Fulfill the GtkTreeModel requirements */
+static GtkTreeModelFlags
+lazy_bulk_store_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+lazy_bulk_store_get_n_columns (GtkTreeModel *tree_model)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+
+  return bulk_store->n_columns;
+}
+
+static GType
+lazy_bulk_store_get_column_type (GtkTreeModel *tree_model,
+                                 gint          index)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+
+  g_return_val_if_fail (index < bulk_store->n_columns, G_TYPE_INVALID);
+
+  return G_TYPE_STRING;
+}
+
+static gboolean
+lazy_bulk_store_get_iter (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter,
+                          GtkTreePath  *path)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+  gint i;
+
+  i = gtk_tree_path_get_indices (path)[0];
+  if (i < 0 || i >= lazy_bulk_store_get_n_rows (LAZY_BLOCK_SOURCE (bulk_store)))
+    return FALSE;
+
+  iter->stamp = bulk_store->stamp;
+  iter_set_row (iter, i);
+  return TRUE;
+}
+
+static GtkTreePath *
+lazy_bulk_store_get_path (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter)
+{
+  GtkTreePath *path;
+  gint64 row = iter_get_row (iter);
+
+  /* Paths can only address gint rows */
+  if (row > G_MAXINT)
+    return NULL;
+
+  path = gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, row);
+  return path;
+}
+
+static void
+lazy_bulk_store_get_value (GtkTreeModel *tree_model,
+                           GtkTreeIter  *iter,
+                           gint          column,
+                           GValue       *value)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+  gint64 row = iter_get_row (iter);
+
+  g_return_if_fail (column < bulk_store->n_columns);
+  g_return_if_fail (row < bulk_store->n_rows);
+
+  g_value_init (value, G_TYPE_STRING);
+  g_value_set_string (value, bulk_store->text +
+                      get_offset (&bulk_store->columns[column], row));
+}
+
+static gboolean
+lazy_bulk_store_iter_next (GtkTreeModel  *tree_model,
+                           GtkTreeIter   *iter)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+  gint64 row = iter_get_row (iter) + 1;
+
+  iter_set_row (iter, row);
+  if (row >= lazy_bulk_store_get_n_rows (LAZY_BLOCK_SOURCE (bulk_store)))
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+lazy_bulk_store_iter_previous (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+  gint64 row = iter_get_row (iter);
+
+  g_return_val_if_fail (bulk_store->stamp == iter->stamp, FALSE);
+
+  if (row == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  iter_set_row (iter, row - 1);
+  return TRUE;
+}
+
+static gboolean
+lazy_bulk_store_iter_children (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *parent)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+
+  /* this is a list, nodes have no children */
+  if (parent || lazy_bulk_store_get_n_rows (LAZY_BLOCK_SOURCE (bulk_store)) == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->stamp = bulk_store->stamp;
+  iter_set_row (iter, 0);
+  return TRUE;
+}
+
+static gboolean
+lazy_bulk_store_iter_has_child (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+lazy_bulk_store_iter_n_children (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+
+  if (iter == NULL)
+    return MIN (bulk_store->n_rows, G_MAXINT);
+
+  g_return_val_if_fail (bulk_store->stamp == iter->stamp, -1);
+  return 0;
+}
+
+static gboolean
+lazy_bulk_store_iter_nth_child (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter,
+                                GtkTreeIter  *parent,
+                                gint          n)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (tree_model);
+
+  iter->stamp = 0;
+  if (parent)
+    return FALSE;
+  if (n < 0 || n >= lazy_bulk_store_get_n_rows (LAZY_BLOCK_SOURCE (bulk_store)))
+    return FALSE;
+
+  iter->stamp = bulk_store->stamp;
+  iter_set_row (iter, n);
+  return TRUE;
+}
+
+static gboolean
+lazy_bulk_store_iter_parent (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             GtkTreeIter  *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+
+/* Fulfill the LazyBlockSource requirements */
+static void
+lazy_bulk_store_fetch_block (LazyBlockSource *source,
+                             LazyBlock       *block)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (source);
+  gint64 row_end, row;
+  gint col_end, col;
+
+  g_rw_lock_reader_lock (&bulk_store->lock);
+  row_end = MIN (block->row0 + block->n_rows, bulk_store->n_rows);
+  col_end = MIN (block->col0 + block->n_cols, bulk_store->n_columns);
+  for (col = block->col0; col < col_end; col++)
+    {
+      const Column *column = &bulk_store->columns[col];
+
+      for (row = block->row0; row < row_end; row++)
+        {
+          guint32 offset = get_offset (column, row);
+
+          if (offset)
+            lazy_block_set (block, row, col, bulk_store->text + offset, -1);
+        }
+    }
+  g_rw_lock_reader_unlock (&bulk_store->lock);
+}
+
+static gint64
+lazy_bulk_store_get_n_rows (LazyBlockSource *source)
+{
+  return LAZY_BULK_STORE (source)->n_rows;
+}
+
+static GPtrArray *
+lazy_bulk_store_dup_dictionary (LazyBlockSource *source,
+                                gint             column)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (source);
+  const Column *col;
+  GPtrArray *dictionary;
+  guint code;
+
+  g_return_val_if_fail (column >= 0 && column < bulk_store->n_columns, NULL);
+
+  col = &bulk_store->columns[column];
+  if (col->encoding == ENCODING_OFFSETS)
+    return NULL;
+  dictionary = g_ptr_array_new_with_free_func (g_free);
+  for (code = 0; code < col->n_values; code++)
+    g_ptr_array_add (dictionary, g_strdup (bulk_store->text + col->values[code]));
+  return dictionary;
+}
+
+static gboolean
+lazy_bulk_store_fetch_codes (LazyBlockSource *source,
+                             gint             column,
+                             gint64           row0,
+                             gint             n_rows,
+                             guint16         *codes)
+{
+  LazyBulkStore *bulk_store = LAZY_BULK_STORE (source);
+  const Column *col;
+  gboolean coded;
+  gint i;
+
+  g_return_val_if_fail (column >= 0 && column < bulk_store->n_columns, FALSE);
+
+  g_rw_lock_reader_lock (&bulk_store->lock);
+  col = &bulk_store->columns[column];
+  coded = col->encoding != ENCODING_OFFSETS;
+  for (i = 0; coded && i < n_rows; i++)
+    if (row0 + i >= bulk_store->n_rows)
+      codes[i] = 0;
+    else if (col->encoding == ENCODING_CODES8)
+      codes[i] = ((const guint8 *) col->cells)[row0 + i];
+    else
+      codes[i] = ((const guint16 *) col->cells)[row0 + i];
+  g_rw_lock_reader_unlock (&bulk_store->lock);
+  return coded;
+}
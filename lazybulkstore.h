@@ -0,0 +1,63 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_BULK_STORE_H__
+#define __LAZY_BULK_STORE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_BULK_STORE             (lazy_bulk_store_get_type ())
+#define LAZY_BULK_STORE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_BULK_STORE, LazyBulkStore))
+#define LAZY_BULK_STORE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_BULK_STORE, LazyBulkStoreClass))
+#define IS_LAZY_BULK_STORE(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_BULK_STORE))
+#define IS_LAZY_BULK_STORE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_BULK_STORE))
+#define LAZY_BULK_STORE_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_BULK_STORE, LazyBulkStoreClass))
+
+typedef struct _LazyBulkStore        LazyBulkStore;
+typedef struct _LazyBulkStoreClass   LazyBulkStoreClass;
+
+struct _LazyBulkStoreClass
+{
+  GObjectClass parent_class;
+
+};
+
+GType          lazy_bulk_store_get_type    (void) G_GNUC_CONST;
+
+LazyBulkStore *lazy_bulk_store_new         (gint                n_columns,
+                                            gboolean            intern);
+void           lazy_bulk_store_reserve     (LazyBulkStore      *bulk_store,
+                                            gint64              n_rows,
+                                            gsize               text_bytes);
+
+gint64         lazy_bulk_store_append_row  (LazyBulkStore      *bulk_store,
+                                            const gchar * const *values);
+gint64         lazy_bulk_store_append_rows (LazyBulkStore      *bulk_store,
+                                            const gchar * const *values,
+                                            gint64              n_rows);
+void           lazy_bulk_store_commit      (LazyBulkStore      *bulk_store);
+
+gint           lazy_bulk_store_get_n_distinct (LazyBulkStore   *bulk_store,
+                                            gint                column);
+
+gsize          lazy_bulk_store_get_bytes   (LazyBulkStore      *bulk_store);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_BULK_STORE_H__ */
@@ -0,0 +1,319 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The cell cache keeps the strings of recently fetched cells keyed by
+   (row, col) such that scrolling back to them does not ask the model
+   again. Every entry is one block holding the key and the string, so
+   there is one allocation per cell and no separate string copy.
+   The least recently used entries are dropped when the memory budget
+   is exceeded.
+
+   Model changes are applied per row. A changed row drops its entries,
+   inserted and deleted rows shift the rows behind them. These walk
+   all entries, which are bounded by the budget, and return early if
+   no cached row is affected, e.g. when rows are appended. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "lazycellcache.h"
+
+/* Rough hash table overhead per entry */
+#define ENTRY_OVERHEAD 32
+
+typedef struct _Entry Entry;
+
+struct _Entry
+{
+  gint64 row;
+  gint col;
+  gboolean null;  /* The model has no string for the cell */
+  gsize size;     /* Size of the slice */
+  GList link;     /* Position in the lru queue, head is most recent */
+  gchar text[1];  /* The string follows the entry in the same slice */
+};
+
+struct _LazyCellCache
+{
+  gsize max_bytes;
+  gsize bytes;
+
+  GHashTable *entries;  /* Entry -> Entry */
+  GQueue lru;
+  gint64 max_row;       /* Upper bound of the cached rows */
+
+  guint64 hits;
+  guint64 misses;
+};
+
+static guint
+entry_hash (gconstpointer key)
+{
+  const Entry *entry = key;
+
+  return (guint) (entry->row ^ (entry->row >> 32)) * 31 +
+         (guint) entry->col * 2654435761u;
+}
+
+static gboolean
+entry_equal (gconstpointer a,
+             gconstpointer b)
+{
+  const Entry *ea = a;
+  const Entry *eb = b;
+
+  return ea->row == eb->row && ea->col == eb->col;
+}
+
+static void
+entry_free (gpointer data)
+{
+  Entry *entry = data;
+
+  g_slice_free1 (entry->size, entry);
+}
+
+LazyCellCache *
+lazy_cell_cache_new (gsize max_bytes)
+{
+  LazyCellCache *cache;
+
+  cache = g_slice_new0 (LazyCellCache);
+  cache->max_bytes = max_bytes;
+  cache->entries = g_hash_table_new_full (entry_hash, entry_equal, NULL, entry_free);
+  g_queue_init (&cache->lru);
+  cache->max_row = -1;
+
+  return cache;
+}
+
+void
+lazy_cell_cache_free (LazyCellCache *cache)
+{
+  if (cache == NULL)
+    return;
+  g_hash_table_destroy (cache->entries);
+  g_slice_free (LazyCellCache, cache);
+}
+
+static void
+remove_entry (LazyCellCache *cache,
+              Entry         *entry)
+{
+  cache->bytes -= entry->size + ENTRY_OVERHEAD;
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_hash_table_remove (cache->entries, entry);
+}
+
+static void
+evict (LazyCellCache *cache)
+{
+  while (cache->lru.length > 1 && cache->bytes > cache->max_bytes)
+    remove_entry (cache, cache->lru.tail->data);
+}
+
+void
+lazy_cell_cache_set_max_bytes (LazyCellCache *cache,
+                               gsize          max_bytes)
+{
+  cache->max_bytes = max_bytes;
+  evict (cache);
+}
+
+void
+lazy_cell_cache_clear (LazyCellCache *cache)
+{
+  g_queue_init (&cache->lru);
+  g_hash_table_remove_all (cache->entries);
+  cache->bytes = 0;
+  cache->max_row = -1;
+}
+
+static Entry *
+find_entry (LazyCellCache *cache,
+            gint64         row,
+            gint           col)
+{
+  Entry key;
+
+  key.row = row;
+  key.col = col;
+  return g_hash_table_lookup (cache->entries, &key);
+}
+
+/* Returns TRUE if the cell is cached. This counts as hit or miss and
+   marks the entry as recently used. */
+gboolean
+lazy_cell_cache_lookup (LazyCellCache *cache,
+                        gint64         row,
+                        gint           col)
+{
+  Entry *entry = find_entry (cache, row, col);
+
+  if (entry == NULL)
+    {
+      cache->misses++;
+      return FALSE;
+    }
+
+  cache->hits++;
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  return TRUE;
+}
+
+/* Returns TRUE and the string, which may be NULL, if the cell is
+   cached. Neither the counters nor the lru order change. The string
+   is valid until the next insert or invalidation. */
+gboolean
+lazy_cell_cache_peek (LazyCellCache *cache,
+                      gint64         row,
+                      gint           col,
+                      const gchar  **text)
+{
+  Entry *entry = find_entry (cache, row, col);
+
+  if (entry == NULL)
+    return FALSE;
+  *text = entry->null ? NULL : entry->text;
+  return TRUE;
+}
+
+void
+lazy_cell_cache_insert (LazyCellCache *cache,
+                        gint64         row,
+                        gint           col,
+                        const gchar   *text)
+{
+  Entry *entry = find_entry (cache, row, col);
+  gsize len = text ? strlen (text) : 0;
+  gsize size = G_STRUCT_OFFSET (Entry, text) + len + 1;
+
+  if (entry)
+    remove_entry (cache, entry);
+
+  entry = g_slice_alloc (size);
+  entry->row = row;
+  entry->col = col;
+  entry->null = text == NULL;
+  entry->size = size;
+  memcpy (entry->text, text ? text : "", len + 1);
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+  g_hash_table_insert (cache->entries, entry, entry);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  cache->bytes += size + ENTRY_OVERHEAD;
+  cache->max_row = MAX (cache->max_row, row);
+
+  evict (cache);
+}
+
+/* Drop the entries of row, or of the -delta rows from row on when
+   rows are removed, and move the entries behind them by delta rows.
+   Entries are stolen before they are reinserted with the new key,
+   the shifted rows never collide with the remaining ones. */
+static void
+shift_rows (LazyCellCache *cache,
+            gint64         row,
+            gint64         delta)
+{
+  gint64 dropped_end = row + MAX (-delta, 1);
+  GList *l, *next;
+  GSList *moved = NULL, *m;
+
+  if (row > cache->max_row)
+    return;
+
+  for (l = cache->lru.head; l; l = next)
+    {
+      Entry *entry = l->data;
+
+      next = l->next;
+      if (delta <= 0 && entry->row >= row && entry->row < dropped_end)
+        remove_entry (cache, entry);
+      else if (entry->row >= row && delta != 0)
+        {
+          g_hash_table_steal (cache->entries, entry);
+          moved = g_slist_prepend (moved, entry);
+        }
+    }
+  for (m = moved; m; m = m->next)
+    {
+      Entry *entry = m->data;
+
+      entry->row += delta;
+      g_hash_table_insert (cache->entries, entry, entry);
+    }
+  g_slist_free (moved);
+  /* The rows before row stay */
+  cache->max_row = MAX (cache->max_row + delta, row - 1);
+}
+
+void
+lazy_cell_cache_row_changed (LazyCellCache *cache,
+                             gint64         row)
+{
+  shift_rows (cache, row, 0);
+}
+
+void
+lazy_cell_cache_row_inserted (LazyCellCache *cache,
+                              gint64         row)
+{
+  shift_rows (cache, row, 1);
+}
+
+void
+lazy_cell_cache_row_deleted (LazyCellCache *cache,
+                             gint64         row)
+{
+  shift_rows (cache, row, -1);
+}
+
+void
+lazy_cell_cache_rows_inserted (LazyCellCache *cache,
+                               gint64         row,
+                               gint64         n_rows)
+{
+  if (n_rows > 0)
+    shift_rows (cache, row, n_rows);
+}
+
+void
+lazy_cell_cache_rows_deleted (LazyCellCache *cache,
+                              gint64         row,
+                              gint64         n_rows)
+{
+  if (n_rows > 0)
+    shift_rows (cache, row, -n_rows);
+}
+
+guint64
+lazy_cell_cache_get_hits (LazyCellCache *cache)
+{
+  return cache->hits;
+}
+
+guint64
+lazy_cell_cache_get_misses (LazyCellCache *cache)
+{
+  return cache->misses;
+}
+
+gsize
+lazy_cell_cache_get_bytes (LazyCellCache *cache)
+{
+  return cache->bytes;
+}
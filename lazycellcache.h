@@ -0,0 +1,64 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_CELL_CACHE_H__
+#define __LAZY_CELL_CACHE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LazyCellCache LazyCellCache;
+
+LazyCellCache   *lazy_cell_cache_new            (gsize          max_bytes);
+void             lazy_cell_cache_free           (LazyCellCache *cache);
+
+void             lazy_cell_cache_set_max_bytes  (LazyCellCache *cache,
+                                                 gsize          max_bytes);
+void             lazy_cell_cache_clear          (LazyCellCache *cache);
+
+gboolean         lazy_cell_cache_lookup         (LazyCellCache *cache,
+                                                 gint64         row,
+                                                 gint           col);
+gboolean         lazy_cell_cache_peek           (LazyCellCache *cache,
+                                                 gint64         row,
+                                                 gint           col,
+                                                 const gchar  **text);
+void             lazy_cell_cache_insert         (LazyCellCache *cache,
+                                                 gint64         row,
+                                                 gint           col,
+                                                 const gchar   *text);
+
+void             lazy_cell_cache_row_changed    (LazyCellCache *cache,
+                                                 gint64         row);
+void             lazy_cell_cache_row_inserted   (LazyCellCache *cache,
+                                                 gint64         row);
+void             lazy_cell_cache_row_deleted    (LazyCellCache *cache,
+                                                 gint64         row);
+void             lazy_cell_cache_rows_inserted  (LazyCellCache *cache,
+                                                 gint64         row,
+                                                 gint64         n_rows);
+void             lazy_cell_cache_rows_deleted   (LazyCellCache *cache,
+                                                 gint64         row,
+                                                 gint64         n_rows);
+
+guint64          lazy_cell_cache_get_hits       (LazyCellCache *cache);
+guint64          lazy_cell_cache_get_misses     (LazyCellCache *cache);
+gsize            lazy_cell_cache_get_bytes      (LazyCellCache *cache);
+
+G_END_DECLS
+
+#endif /* __LAZY_CELL_CACHE_H__ */
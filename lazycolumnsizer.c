@@ -0,0 +1,410 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The column sizer estimates the width of the widest text of every
+   column from a sample of the rows, measuring all rows is out of the
+   question for millions of them. The sample grows in chunks of
+   LAZY_COLUMN_SIZER_CHUNK_ROWS x LAZY_COLUMN_SIZER_CHUNK_COLS cells:
+   the visible chunks first, then the first rows of all columns, then
+   random rows. The widths only grow as more rows are seen.
+
+   The cells are fetched on the main loop from a low priority idle
+   handler, one chunk per iteration, because a GtkTreeModel may not be
+   thread safe. Shaping is the expensive part, it runs on one worker
+   thread with its own PangoContext on the font map of that thread.
+   Measured chunks come back through a mutex protected queue like the
+   chunks of the fetcher. All chunks which arrived are merged at once,
+   and the grown widths are reported in one batch. */
+
+#include <gtk/gtk.h>
+#include "lazycolumnsizer.h"
+#include "lazyblocksource.h"
+
+/* Chunks of the first rows and random chunks per column chunk */
+#define FIRST_CHUNKS  8
+#define RANDOM_CHUNKS 32
+/* Chunks being measured at a time, visible ones overtake the rest */
+#define MAX_IN_FLIGHT 2
+
+typedef struct
+{
+  gint64 chunk_row;
+  gint chunk_col;
+  LazyBlock *block;  /* Fetched on the main thread */
+  gint *widths;      /* Filled by the worker */
+} Chunk;
+
+struct _LazyColumnSizer
+{
+  GtkTreeModel *model;
+  gint n_columns;
+  gint n_col_chunks;
+  LazyColumnSizerFunc func;
+  gpointer user_data;
+
+  /* Widest text per column so far, -1 before the first sample */
+  gint *widths;
+
+  /* Sampled and queued chunks by chunk_row * n_col_chunks + chunk_col */
+  GHashTable *seen;
+  GQueue visible;     /* Requested chunks, newest first */
+  guint plan;         /* Position in the first rows and random plan */
+  guint in_flight;
+  guint fetch_idle;
+
+  GThreadPool *pool;
+  /* Font settings of the widget, the worker sets up its context from
+     them on the first chunk */
+  PangoFontDescription *font;
+  PangoLanguage *language;
+  gdouble resolution;
+  cairo_font_options_t *font_options;
+  PangoContext *context;  /* Worker only */
+  PangoLayout *layout;
+
+  /* Chunks coming back from the worker */
+  GMutex done_lock;
+  GQueue done;
+  guint done_idle;
+};
+
+static void
+chunk_free (Chunk *chunk)
+{
+  lazy_block_free (chunk->block);
+  g_free (chunk->widths);
+  g_slice_free (Chunk, chunk);
+}
+
+static gboolean done_idle_cb (gpointer user_data);
+static void schedule_fetch (LazyColumnSizer *sizer);
+
+/* Runs on the worker thread */
+static void
+measure_func (gpointer data,
+              gpointer user_data)
+{
+  Chunk *chunk = data;
+  LazyColumnSizer *sizer = user_data;
+  LazyBlock *block = chunk->block;
+  gint64 row;
+  gint col;
+
+  if (sizer->context == NULL)
+    {
+      /* The default font map is per thread */
+      sizer->context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+      pango_context_set_font_description (sizer->context, sizer->font);
+      pango_context_set_language (sizer->context, sizer->language);
+      pango_cairo_context_set_resolution (sizer->context, sizer->resolution);
+      pango_cairo_context_set_font_options (sizer->context, sizer->font_options);
+      sizer->layout = pango_layout_new (sizer->context);
+      pango_layout_set_single_paragraph_mode (sizer->layout, TRUE);
+    }
+
+  chunk->widths = g_new0 (gint, block->n_cols);
+  for (row = block->row0; row < block->row0 + block->n_rows; row++)
+    for (col = block->col0; col < block->col0 + block->n_cols; col++)
+      {
+        const gchar *text = lazy_block_get (block, row, col);
+        gint width;
+
+        if (text == NULL || *text == '\0')
+          continue;
+        pango_layout_set_text (sizer->layout, text, -1);
+        pango_layout_get_pixel_size (sizer->layout, &width, NULL);
+        chunk->widths[col - block->col0] = MAX (chunk->widths[col - block->col0], width);
+      }
+
+  /* lazy_column_sizer_free joins the pool before it removes the idle
+     source, so the sizer is alive here */
+  g_mutex_lock (&sizer->done_lock);
+  g_queue_push_tail (&sizer->done, chunk);
+  if (sizer->done_idle == 0)
+    sizer->done_idle = g_idle_add_full (G_PRIORITY_LOW, done_idle_cb, sizer, NULL);
+  g_mutex_unlock (&sizer->done_lock);
+}
+
+/* Mark the chunk as sampled. Returns FALSE if it already was. */
+static gboolean
+claim_chunk (LazyColumnSizer *sizer,
+             gint64           chunk_row,
+             gint             chunk_col)
+{
+  gint64 key = chunk_row * sizer->n_col_chunks + chunk_col;
+  gint64 *seen;
+
+  if (g_hash_table_lookup (sizer->seen, &key))
+    return FALSE;
+  seen = g_new (gint64, 1);
+  *seen = key;
+  g_hash_table_insert (sizer->seen, seen, seen);
+  return TRUE;
+}
+
+/* The next chunk of the plan: the first rows of all columns, then
+   random rows of all columns */
+static gboolean
+next_planned (LazyColumnSizer *sizer,
+              gint64          *chunk_row,
+              gint            *chunk_col)
+{
+  guint n = sizer->n_col_chunks;
+  gint64 n_rows = lazy_block_n_rows (sizer->model);
+  gint64 n_row_chunks = (n_rows + LAZY_COLUMN_SIZER_CHUNK_ROWS - 1) / LAZY_COLUMN_SIZER_CHUNK_ROWS;
+
+  while (n_row_chunks > 0 && sizer->plan < n * (FIRST_CHUNKS + RANDOM_CHUNKS))
+    {
+      guint i = sizer->plan++;
+
+      *chunk_col = i % n;
+      if (i < n * FIRST_CHUNKS)
+        *chunk_row = i / n;
+      else
+        *chunk_row = (gint64) (g_random_double () * n_row_chunks);
+      if (*chunk_row < n_row_chunks && claim_chunk (sizer, *chunk_row, *chunk_col))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Fetch one chunk and hand it to the worker */
+static gboolean
+fetch_idle_cb (gpointer user_data)
+{
+  LazyColumnSizer *sizer = user_data;
+  gint64 chunk_row;
+  gint chunk_col;
+  Chunk *chunk;
+
+  sizer->fetch_idle = 0;
+  if (sizer->in_flight >= MAX_IN_FLIGHT)
+    return G_SOURCE_REMOVE;
+
+  chunk = g_queue_pop_head (&sizer->visible);
+  if (chunk == NULL)
+    {
+      if (!next_planned (sizer, &chunk_row, &chunk_col))
+        return G_SOURCE_REMOVE;
+      chunk = g_slice_new0 (Chunk);
+      chunk->chunk_row = chunk_row;
+      chunk->chunk_col = chunk_col;
+    }
+
+  chunk->block = lazy_block_new ();
+  lazy_block_reset (chunk->block,
+                    chunk->chunk_row * LAZY_COLUMN_SIZER_CHUNK_ROWS,
+                    LAZY_COLUMN_SIZER_CHUNK_ROWS,
+                    chunk->chunk_col * LAZY_COLUMN_SIZER_CHUNK_COLS,
+                    MIN (LAZY_COLUMN_SIZER_CHUNK_COLS,
+                         sizer->n_columns - chunk->chunk_col * LAZY_COLUMN_SIZER_CHUNK_COLS));
+  lazy_block_fetch (sizer->model, chunk->block);
+  sizer->in_flight++;
+  g_thread_pool_push (sizer->pool, chunk, NULL);
+
+  schedule_fetch (sizer);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_fetch (LazyColumnSizer *sizer)
+{
+  if (sizer->fetch_idle == 0 && sizer->in_flight < MAX_IN_FLIGHT)
+    sizer->fetch_idle = g_idle_add_full (G_PRIORITY_LOW, fetch_idle_cb, sizer, NULL);
+}
+
+static gboolean
+done_idle_cb (gpointer user_data)
+{
+  LazyColumnSizer *sizer = user_data;
+  GArray *columns, *widths;
+  GHashTable *changed;
+  GQueue done;
+  Chunk *chunk;
+
+  g_mutex_lock (&sizer->done_lock);
+  done = sizer->done;
+  g_queue_init (&sizer->done);
+  sizer->done_idle = 0;
+  g_mutex_unlock (&sizer->done_lock);
+
+  columns = g_array_new (FALSE, FALSE, sizeof (gint));
+  changed = g_hash_table_new (NULL, NULL);
+  while ((chunk = g_queue_pop_head (&done)))
+    {
+      gint c;
+
+      sizer->in_flight--;
+      for (c = 0; c < chunk->block->n_cols; c++)
+        {
+          gint col = chunk->block->col0 + c;
+
+          /* The first sample sets the width, later ones only widen it */
+          if (sizer->widths[col] >= 0 && chunk->widths[c] <= sizer->widths[col])
+            continue;
+          sizer->widths[col] = chunk->widths[c];
+          if (!g_hash_table_lookup (changed, GINT_TO_POINTER (col + 1)))
+            {
+              g_hash_table_insert (changed, GINT_TO_POINTER (col + 1), GINT_TO_POINTER (1));
+              g_array_append_val (columns, col);
+            }
+        }
+      chunk_free (chunk);
+    }
+  g_hash_table_destroy (changed);
+
+  /* All grown columns in one batch */
+  if (columns->len && sizer->func)
+    {
+      guint i;
+
+      widths = g_array_sized_new (FALSE, FALSE, sizeof (gint), columns->len);
+      for (i = 0; i < columns->len; i++)
+        g_array_append_val (widths, sizer->widths[g_array_index (columns, gint, i)]);
+      sizer->func ((const gint *) columns->data, (const gint *) widths->data,
+                   columns->len, sizer->user_data);
+      g_array_free (widths, TRUE);
+    }
+  g_array_free (columns, TRUE);
+
+  schedule_fetch (sizer);
+  return G_SOURCE_REMOVE;
+}
+
+/* The font settings of context are used for measuring, e.g. the
+   widget context */
+LazyColumnSizer *
+lazy_column_sizer_new (GtkTreeModel        *model,
+                       PangoContext        *context,
+                       LazyColumnSizerFunc  func,
+                       gpointer             user_data)
+{
+  LazyColumnSizer *sizer;
+  const cairo_font_options_t *font_options;
+  gint i;
+
+  g_return_val_if_fail (GTK_IS_TREE_MODEL (model), NULL);
+  g_return_val_if_fail (PANGO_IS_CONTEXT (context), NULL);
+
+  sizer = g_slice_new0 (LazyColumnSizer);
+  sizer->model = g_object_ref (model);
+  sizer->n_columns = gtk_tree_model_get_n_columns (model);
+  sizer->n_col_chunks = (sizer->n_columns + LAZY_COLUMN_SIZER_CHUNK_COLS - 1) /
+    LAZY_COLUMN_SIZER_CHUNK_COLS;
+  sizer->func = func;
+  sizer->user_data = user_data;
+  sizer->widths = g_new (gint, sizer->n_columns);
+  for (i = 0; i < sizer->n_columns; i++)
+    sizer->widths[i] = -1;
+  sizer->seen = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+  g_queue_init (&sizer->visible);
+
+  sizer->font = pango_font_description_copy (pango_context_get_font_description (context));
+  sizer->language = pango_context_get_language (context);
+  sizer->resolution = pango_cairo_context_get_resolution (context);
+  font_options = pango_cairo_context_get_font_options (context);
+  sizer->font_options = font_options ? cairo_font_options_copy (font_options)
+                                     : cairo_font_options_create ();
+  g_mutex_init (&sizer->done_lock);
+  g_queue_init (&sizer->done);
+  /* One exclusive thread, the context belongs to it */
+  sizer->pool = g_thread_pool_new (measure_func, sizer, 1, TRUE, NULL);
+
+  schedule_fetch (sizer);
+  return sizer;
+}
+
+void
+lazy_column_sizer_free (LazyColumnSizer *sizer)
+{
+  if (sizer == NULL)
+    return;
+
+  /* Wait for the worker, it may still push a chunk */
+  g_thread_pool_free (sizer->pool, FALSE, TRUE);
+  if (sizer->fetch_idle)
+    g_source_remove (sizer->fetch_idle);
+  if (sizer->done_idle)
+    g_source_remove (sizer->done_idle);
+  while (!g_queue_is_empty (&sizer->done))
+    chunk_free (g_queue_pop_head (&sizer->done));
+  while (!g_queue_is_empty (&sizer->visible))
+    chunk_free (g_queue_pop_head (&sizer->visible));
+  g_mutex_clear (&sizer->done_lock);
+  g_clear_object (&sizer->layout);
+  g_clear_object (&sizer->context);
+  pango_font_description_free (sizer->font);
+  cairo_font_options_destroy (sizer->font_options);
+  g_hash_table_destroy (sizer->seen);
+  g_free (sizer->widths);
+  g_object_unref (sizer->model);
+  g_slice_free (LazyColumnSizer, sizer);
+}
+
+/* Sample the chunks of the area next, e.g. the visible cells. Chunks
+   which were sampled before are skipped, so this is cheap to call
+   for every frame. */
+void
+lazy_column_sizer_sample_area (LazyColumnSizer *sizer,
+                               gint64           row0,
+                               gint64           row_end,
+                               gint             col0,
+                               gint             col_end)
+{
+  gint64 chunk_row;
+  gint chunk_col;
+
+  g_return_if_fail (sizer != NULL);
+
+  if (row0 >= row_end || col0 >= col_end)
+    return;
+
+  col_end = MIN (col_end, sizer->n_columns);
+  for (chunk_row = row0 / LAZY_COLUMN_SIZER_CHUNK_ROWS;
+       chunk_row <= (row_end - 1) / LAZY_COLUMN_SIZER_CHUNK_ROWS; chunk_row++)
+    for (chunk_col = col0 / LAZY_COLUMN_SIZER_CHUNK_COLS;
+         chunk_col <= (col_end - 1) / LAZY_COLUMN_SIZER_CHUNK_COLS; chunk_col++)
+      if (claim_chunk (sizer, chunk_row, chunk_col))
+        {
+          Chunk *chunk = g_slice_new0 (Chunk);
+
+          chunk->chunk_row = chunk_row;
+          chunk->chunk_col = chunk_col;
+          /* Areas requested later are more likely still shown */
+          g_queue_push_head (&sizer->visible, chunk);
+        }
+  schedule_fetch (sizer);
+}
+
+/* The widest text of the column seen so far, -1 if not sampled yet */
+gint
+lazy_column_sizer_get_width (LazyColumnSizer *sizer,
+                             gint             column)
+{
+  g_return_val_if_fail (sizer != NULL, -1);
+  g_return_val_if_fail (column >= 0 && column < sizer->n_columns, -1);
+
+  return sizer->widths[column];
+}
+
+/* The font the widths are measured with */
+const PangoFontDescription *
+lazy_column_sizer_get_font (LazyColumnSizer *sizer)
+{
+  g_return_val_if_fail (sizer != NULL, NULL);
+
+  return sizer->font;
+}
@@ -0,0 +1,55 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_COLUMN_SIZER_H__
+#define __LAZY_COLUMN_SIZER_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* Cells are sampled in chunks of this size */
+#define LAZY_COLUMN_SIZER_CHUNK_ROWS 8
+#define LAZY_COLUMN_SIZER_CHUNK_COLS 64
+
+typedef struct _LazyColumnSizer LazyColumnSizer;
+
+/* Called on the main loop with the columns whose widest text grew,
+   and the new text widths in pixels */
+typedef void (* LazyColumnSizerFunc) (const gint *columns,
+                                      const gint *widths,
+                                      guint       n_columns,
+                                      gpointer    user_data);
+
+LazyColumnSizer *lazy_column_sizer_new         (GtkTreeModel        *model,
+                                                PangoContext        *context,
+                                                LazyColumnSizerFunc  func,
+                                                gpointer             user_data);
+void             lazy_column_sizer_free        (LazyColumnSizer     *sizer);
+
+void             lazy_column_sizer_sample_area (LazyColumnSizer     *sizer,
+                                                gint64               row0,
+                                                gint64               row_end,
+                                                gint                 col0,
+                                                gint                 col_end);
+gint             lazy_column_sizer_get_width   (LazyColumnSizer     *sizer,
+                                                gint                 column);
+const PangoFontDescription *
+                 lazy_column_sizer_get_font    (LazyColumnSizer     *sizer);
+
+G_END_DECLS
+
+#endif /* __LAZY_COLUMN_SIZER_H__ */
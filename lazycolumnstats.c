@@ -0,0 +1,753 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* LazyColumnStats collects per column statistics of a block source,
+   e.g. a LazyStore or LazyCsvStore: the number of empty cells and of
+   numbers, the smallest and largest number and string, a histogram of
+   the numbers and an estimate of the distinct values. Typed columns
+   are aggregated on their native numbers.
+
+   The cells are split into tiles of up to 64 columns and 256K cells
+   which are fetched and summarized on a thread pool. The summary of
+   a tile is merged into the column summaries right away, so the
+   statistics are usable while the scan runs and updated is emitted
+   once per main loop iteration. Rows appended to the source are
+   scanned on their own, other changes of the rows start over. Changed
+   cells are not scanned again.
+
+   The distinct values are counted with a HyperLogLog sketch of 1024
+   registers per column, the standard error is about 3%. */
+
+#include <gtk/gtk.h>
+#include <math.h>
+#include <string.h>
+#include "lazycolumnstats.h"
+#include "lazyblocksource.h"
+
+/* Cells fetched and summarized per task */
+#define STATS_CHUNK_CELLS (256 * 1024)
+/* Columns per task, bounds the memory of a tile summary */
+#define STATS_GROUP_COLUMNS 64
+#define HLL_BITS 10
+#define HLL_REGISTERS (1 << HLL_BITS)
+/* Numbers are binned by the binary exponent, per sign. The first bin
+   of a sign holds all magnitudes below 2^MAGNITUDE_MIN, the last all
+   from 2^(MAGNITUDE_MIN + N_MAGNITUDES - 2) on. */
+#define N_MAGNITUDES (LAZY_COLUMN_STATS_BINS / 2)
+#define MAGNITUDE_MIN (-20)
+
+/* Properties */
+enum {
+  PROP_0,
+  PROP_SCANNING,
+  PROP_PROGRESS,
+  LAST_PROP,
+};
+
+/* Signals */
+enum {
+  UPDATED,
+  LAST_SIGNAL
+};
+
+static GParamSpec *properties[LAST_PROP];
+static guint signals[LAST_SIGNAL];
+
+typedef struct _ColumnState ColumnState;
+typedef struct _Scan Scan;
+typedef struct _StatsTask StatsTask;
+
+struct _ColumnState
+{
+  gint64 n_cells;
+  gint64 n_nulls;
+  gint64 n_numbers;
+  gdouble min;
+  gdouble max;
+  /* Owned by the scan, point into the block for a tile */
+  gchar *min_string;
+  gchar *max_string;
+  guint64 histogram[LAZY_COLUMN_STATS_BINS];
+  guint8 registers[HLL_REGISTERS];
+};
+
+/* The statistics of all rows since the last structural change. The
+   scan is shared by the stats object, the queued tasks and the idle
+   handler. */
+struct _Scan
+{
+  gint ref_count;
+  LazyColumnStats *stats;   /* NULL when cancelled, main thread only */
+  gint cancelled;
+
+  LazyBlockSource *source;
+  gint n_columns;
+  gint64 n_rows;            /* Rows queued, main thread only */
+
+  GMutex lock;
+  ColumnState *columns;     /* Guarded by lock */
+  gint64 cells_total;       /* Guarded by lock */
+  gint64 cells_done;        /* Guarded by lock */
+  guint idle;               /* Guarded by lock */
+};
+
+/* A tile of the rows */
+struct _StatsTask
+{
+  Scan *scan;
+  gint64 row0;
+  gint n_rows;
+  gint col0;
+  gint n_cols;
+};
+
+struct _LazyColumnStats
+{
+  GObject parent;
+
+  /* private */
+  GtkTreeModel *model;
+  GThreadPool *pool;
+  Scan *scan;
+  gboolean scanning;        /* Last notified state */
+};
+
+static void         lazy_column_stats_finalize     (GObject      *object);
+static void         lazy_column_stats_get_property (GObject      *object,
+                                                    guint         prop_id,
+                                                    GValue       *value,
+                                                    GParamSpec   *pspec);
+static void         stats_func                     (gpointer      data,
+                                                    gpointer      user_data);
+
+G_DEFINE_TYPE (LazyColumnStats, lazy_column_stats, G_TYPE_OBJECT)
+
+
+static void
+lazy_column_stats_class_init (LazyColumnStatsClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->get_property = lazy_column_stats_get_property;
+  o_class->finalize = lazy_column_stats_finalize;
+
+  properties[PROP_SCANNING] =
+    g_param_spec_boolean ("scanning",
+                          "Scanning",
+                          "Whether rows are still being scanned",
+                          FALSE,
+                          G_PARAM_READABLE);
+  properties[PROP_PROGRESS] =
+    g_param_spec_double ("progress",
+                         "Progress",
+                         "Scanned fraction of the cells",
+                         0.0, 1.0, 1.0,
+                         G_PARAM_READABLE);
+  g_object_class_install_properties (o_class, LAST_PROP, properties);
+
+  /* Emitted when the statistics of some columns changed, at most
+     once per main loop iteration */
+  signals[UPDATED] =
+    g_signal_new ("updated",
+                  TYPE_LAZY_COLUMN_STATS,
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 0);
+}
+
+static void
+lazy_column_stats_init (LazyColumnStats *stats)
+{
+  stats->pool = g_thread_pool_new (stats_func, stats,
+                                   g_get_num_processors (), FALSE, NULL);
+}
+
+static void cancel_scan (LazyColumnStats *stats);
+
+static void
+lazy_column_stats_finalize (GObject *object)
+{
+  LazyColumnStats *stats = LAZY_COLUMN_STATS (object);
+
+  cancel_scan (stats);
+  /* The queued tasks of the cancelled scan return at once */
+  g_thread_pool_free (stats->pool, FALSE, TRUE);
+  if (stats->model)
+    {
+      g_signal_handlers_disconnect_by_data (stats->model, stats);
+      g_object_unref (stats->model);
+    }
+
+  G_OBJECT_CLASS (lazy_column_stats_parent_class)->finalize (object);
+}
+
+static void
+lazy_column_stats_get_property (GObject    *object,
+                                guint       prop_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  LazyColumnStats *stats = LAZY_COLUMN_STATS (object);
+
+  switch (prop_id)
+    {
+    case PROP_SCANNING:
+      g_value_set_boolean (value, lazy_column_stats_get_scanning (stats));
+      break;
+    case PROP_PROGRESS:
+      g_value_set_double (value, lazy_column_stats_get_progress (stats));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+
+/* Summaries */
+
+static inline guint
+leading_zeros64 (guint64 word)
+{
+#ifdef __GNUC__
+  return __builtin_clzll (word);
+#else
+  guint i = 0;
+
+  for (; !(word >> 63); word <<= 1)
+    i++;
+  return i;
+#endif
+}
+
+/* FNV-1a with a final mix, HyperLogLog needs well spread high bits */
+static inline guint64
+hash_string (const gchar *string)
+{
+  guint64 h = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+
+  for (; *string; string++)
+    {
+      h ^= (guchar) *string;
+      h *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+  return h;
+}
+
+/* The register is picked by the top bits of the hash and keeps the
+   longest run of leading zeros of the remaining bits */
+static inline void
+hll_add (guint8  *registers,
+         guint64  hash)
+{
+  guint index = hash >> (64 - HLL_BITS);
+  guint64 rest = (hash << HLL_BITS) | (G_GUINT64_CONSTANT (1) << (HLL_BITS - 1));
+  guint8 rank = leading_zeros64 (rest) + 1;
+
+  if (rank > registers[index])
+    registers[index] = rank;
+}
+
+static gint64
+hll_estimate (const guint8 *registers)
+{
+  const gdouble m = HLL_REGISTERS;
+  gdouble sum = 0, estimate;
+  guint zeros = 0, i;
+
+  for (i = 0; i < HLL_REGISTERS; i++)
+    {
+      sum += ldexp (1.0, -registers[i]);
+      if (registers[i] == 0)
+        zeros++;
+    }
+  estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  /* Linear counting is more accurate for few values */
+  if (estimate <= 2.5 * m && zeros)
+    estimate = m * log (m / zeros);
+  return (gint64) (estimate + 0.5);
+}
+
+static inline gint
+number_bin (gdouble number)
+{
+  gint exponent, magnitude = 0;
+
+  if (number != 0)
+    {
+      frexp (number, &exponent);
+      magnitude = CLAMP (exponent - MAGNITUDE_MIN, 0, N_MAGNITUDES - 1);
+    }
+  return number < 0 ? N_MAGNITUDES - 1 - magnitude : N_MAGNITUDES + magnitude;
+}
+
+static inline gboolean
+parse_number (const gchar *string,
+              gdouble     *number)
+{
+  gchar *end;
+
+  /* Most text is rejected without strtod */
+  if (!g_ascii_isdigit (*string) && *string != '-' && *string != '+' && *string != '.')
+    return FALSE;
+  *number = g_ascii_strtod (string, &end);
+  return end != string && *end == '\0' && isfinite (*number);
+}
+
+/* Add a cell to the summary of a tile, strings are not copied. The
+   native number of the cell is used instead of parsing if given. */
+static inline void
+state_add (ColumnState   *state,
+           const gchar   *cell,
+           const gdouble *native)
+{
+  gdouble number;
+  gboolean is_number;
+
+  state->n_cells++;
+  if (cell == NULL || *cell == '\0')
+    {
+      state->n_nulls++;
+      return;
+    }
+
+  hll_add (state->registers, hash_string (cell));
+  if (state->min_string == NULL || strcmp (cell, state->min_string) < 0)
+    state->min_string = (gchar *) cell;
+  if (state->max_string == NULL || strcmp (cell, state->max_string) > 0)
+    state->max_string = (gchar *) cell;
+
+  if (native)
+    {
+      number = *native;
+      is_number = !isnan (number);
+    }
+  else
+    is_number = parse_number (cell, &number);
+  if (is_number)
+    {
+      if (state->n_numbers == 0 || number < state->min)
+        state->min = number;
+      if (state->n_numbers == 0 || number > state->max)
+        state->max = number;
+      state->n_numbers++;
+      state->histogram[number_bin (number)]++;
+    }
+}
+
+/* Merge the summary of a tile into the summary of the column */
+static void
+state_merge (ColumnState       *state,
+             const ColumnState *tile)
+{
+  guint i;
+
+  if (tile->n_numbers)
+    {
+      if (state->n_numbers == 0 || tile->min < state->min)
+        state->min = tile->min;
+      if (state->n_numbers == 0 || tile->max > state->max)
+        state->max = tile->max;
+    }
+  if (tile->min_string &&
+      (state->min_string == NULL || strcmp (tile->min_string, state->min_string) < 0))
+    {
+      g_free (state->min_string);
+      state->min_string = g_strdup (tile->min_string);
+    }
+  if (tile->max_string &&
+      (state->max_string == NULL || strcmp (tile->max_string, state->max_string) > 0))
+    {
+      g_free (state->max_string);
+      state->max_string = g_strdup (tile->max_string);
+    }
+
+  state->n_cells += tile->n_cells;
+  state->n_nulls += tile->n_nulls;
+  state->n_numbers += tile->n_numbers;
+  for (i = 0; i < LAZY_COLUMN_STATS_BINS; i++)
+    state->histogram[i] += tile->histogram[i];
+  for (i = 0; i < HLL_REGISTERS; i++)
+    state->registers[i] = MAX (state->registers[i], tile->registers[i]);
+}
+
+
+/* Scanning */
+
+static Scan *
+scan_ref (Scan *scan)
+{
+  g_atomic_int_inc (&scan->ref_count);
+  return scan;
+}
+
+static void
+scan_unref (Scan *scan)
+{
+  gint i;
+
+  if (!g_atomic_int_dec_and_test (&scan->ref_count))
+    return;
+
+  for (i = 0; i < scan->n_columns; i++)
+    {
+      g_free (scan->columns[i].min_string);
+      g_free (scan->columns[i].max_string);
+    }
+  g_free (scan->columns);
+  g_object_unref (scan->source);
+  g_mutex_clear (&scan->lock);
+  g_slice_free (Scan, scan);
+}
+
+static void
+notify_scanning (LazyColumnStats *stats)
+{
+  gboolean scanning = lazy_column_stats_get_scanning (stats);
+
+  if (scanning != stats->scanning)
+    {
+      stats->scanning = scanning;
+      g_object_notify_by_pspec (G_OBJECT (stats), properties[PROP_SCANNING]);
+    }
+}
+
+static gboolean
+updated_cb (gpointer user_data)
+{
+  Scan *scan = user_data;
+  LazyColumnStats *stats = scan->stats;
+
+  g_mutex_lock (&scan->lock);
+  scan->idle = 0;
+  g_mutex_unlock (&scan->lock);
+
+  if (stats)
+    {
+      g_signal_emit (stats, signals[UPDATED], 0);
+      g_object_notify_by_pspec (G_OBJECT (stats), properties[PROP_PROGRESS]);
+      notify_scanning (stats);
+    }
+  scan_unref (scan);
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs on a worker thread */
+static void
+stats_func (gpointer data,
+            gpointer user_data)
+{
+  StatsTask *task = data;
+  Scan *scan = task->scan;
+  ColumnState *tile;
+  LazyBlock *block;
+  gdouble *numbers;
+  gint64 row;
+  gint col;
+
+  if (g_atomic_int_get (&scan->cancelled))
+    goto done;
+
+  block = lazy_block_new ();
+  lazy_block_reset (block, task->row0, task->n_rows, task->col0, task->n_cols);
+  lazy_block_source_fetch_block (scan->source, block);
+  tile = g_new0 (ColumnState, task->n_cols);
+  numbers = g_new (gdouble, task->n_rows);
+  for (col = 0; col < task->n_cols; col++)
+    {
+      gboolean native = lazy_block_source_fetch_numbers (scan->source, task->col0 + col,
+                                                         task->row0, task->n_rows, numbers);
+
+      for (row = task->row0; row < task->row0 + task->n_rows; row++)
+        state_add (&tile[col], lazy_block_get (block, row, task->col0 + col),
+                   native ? &numbers[row - task->row0] : NULL);
+    }
+
+  g_mutex_lock (&scan->lock);
+  for (col = 0; col < task->n_cols; col++)
+    state_merge (&scan->columns[task->col0 + col], &tile[col]);
+  scan->cells_done += (gint64) task->n_rows * task->n_cols;
+  if (scan->idle == 0)
+    scan->idle = g_idle_add (updated_cb, scan_ref (scan));
+  g_mutex_unlock (&scan->lock);
+
+  g_free (numbers);
+  g_free (tile);
+  lazy_block_free (block);
+
+ done:
+  scan_unref (scan);
+  g_slice_free (StatsTask, task);
+}
+
+/* Queue the tiles of the rows from the end of the scan to n_rows */
+static void
+scan_rows (LazyColumnStats *stats,
+           gint64           n_rows)
+{
+  Scan *scan = stats->scan;
+  gint group = MIN (scan->n_columns, STATS_GROUP_COLUMNS);
+  gint chunk_rows = MAX (STATS_CHUNK_CELLS / MAX (group, 1), 1);
+  gint64 row0;
+  gint col0;
+
+  if (n_rows <= scan->n_rows || scan->n_columns == 0)
+    return;
+
+  g_mutex_lock (&scan->lock);
+  scan->cells_total += (n_rows - scan->n_rows) * scan->n_columns;
+  g_mutex_unlock (&scan->lock);
+
+  for (row0 = scan->n_rows; row0 < n_rows; row0 += chunk_rows)
+    for (col0 = 0; col0 < scan->n_columns; col0 += group)
+      {
+        StatsTask *task = g_slice_new (StatsTask);
+
+        task->scan = scan_ref (scan);
+        task->row0 = row0;
+        task->n_rows = MIN (chunk_rows, n_rows - row0);
+        task->col0 = col0;
+        task->n_cols = MIN (group, scan->n_columns - col0);
+        g_thread_pool_push (stats->pool, task, NULL);
+      }
+  scan->n_rows = n_rows;
+  notify_scanning (stats);
+}
+
+/* Drop the running scan, late results are ignored */
+static void
+cancel_scan (LazyColumnStats *stats)
+{
+  Scan *scan = stats->scan;
+
+  if (scan == NULL)
+    return;
+  g_atomic_int_set (&scan->cancelled, TRUE);
+  scan->stats = NULL;
+  stats->scan = NULL;
+  scan_unref (scan);
+}
+
+/* Scan all rows from scratch */
+static void
+restart (LazyColumnStats *stats)
+{
+  Scan *scan;
+
+  cancel_scan (stats);
+
+  scan = g_slice_new0 (Scan);
+  scan->ref_count = 1;
+  scan->stats = stats;
+  scan->source = g_object_ref (LAZY_BLOCK_SOURCE (stats->model));
+  scan->n_columns = gtk_tree_model_get_n_columns (stats->model);
+  scan->columns = g_new0 (ColumnState, scan->n_columns);
+  g_mutex_init (&scan->lock);
+  stats->scan = scan;
+
+  scan_rows (stats, lazy_block_source_get_n_rows (scan->source));
+  g_signal_emit (stats, signals[UPDATED], 0);
+  g_object_notify_by_pspec (G_OBJECT (stats), properties[PROP_PROGRESS]);
+}
+
+
+/* Changes of the model */
+
+static void
+rows_inserted_cb (LazyBlockSource *source,
+                  gint64           row,
+                  gint64           n_rows,
+                  LazyColumnStats *stats)
+{
+  if (row == stats->scan->n_rows)
+    scan_rows (stats, row + n_rows);
+  else
+    restart (stats);
+}
+
+static void
+reset_cb (LazyBlockSource *source,
+          LazyColumnStats *stats)
+{
+  restart (stats);
+}
+
+static void
+rows_deleted_cb (LazyBlockSource *source,
+                 gint64           row,
+                 gint64           n_rows,
+                 LazyColumnStats *stats)
+{
+  restart (stats);
+}
+
+
+/* Public API */
+
+/* Start scanning all columns of the model, which must be a block
+   source. The statistics of the rows are independent of their
+   order, so new orders are ignored. */
+LazyColumnStats *
+lazy_column_stats_new (GtkTreeModel *model)
+{
+  LazyColumnStats *stats;
+
+  g_return_val_if_fail (GTK_IS_TREE_MODEL (model), NULL);
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (model), NULL);
+
+  stats = g_object_new (TYPE_LAZY_COLUMN_STATS, NULL);
+  stats->model = g_object_ref (model);
+  g_signal_connect (model, "rows-inserted",
+                    G_CALLBACK (rows_inserted_cb), stats);
+  g_signal_connect (model, "reset",
+                    G_CALLBACK (reset_cb), stats);
+  g_signal_connect (model, "rows-deleted",
+                    G_CALLBACK (rows_deleted_cb), stats);
+  restart (stats);
+
+  return stats;
+}
+
+GtkTreeModel *
+lazy_column_stats_get_model (LazyColumnStats *stats)
+{
+  g_return_val_if_fail (IS_LAZY_COLUMN_STATS (stats), NULL);
+
+  return stats->model;
+}
+
+gboolean
+lazy_column_stats_get_scanning (LazyColumnStats *stats)
+{
+  gboolean scanning;
+
+  g_return_val_if_fail (IS_LAZY_COLUMN_STATS (stats), FALSE);
+
+  g_mutex_lock (&stats->scan->lock);
+  scanning = stats->scan->cells_done < stats->scan->cells_total;
+  g_mutex_unlock (&stats->scan->lock);
+  return scanning;
+}
+
+gdouble
+lazy_column_stats_get_progress (LazyColumnStats *stats)
+{
+  gdouble progress = 1.0;
+
+  g_return_val_if_fail (IS_LAZY_COLUMN_STATS (stats), 1.0);
+
+  g_mutex_lock (&stats->scan->lock);
+  if (stats->scan->cells_total)
+    progress = (gdouble) stats->scan->cells_done / stats->scan->cells_total;
+  g_mutex_unlock (&stats->scan->lock);
+  return progress;
+}
+
+/* Copy the statistics of the cells of the column scanned so far.
+   Free the strings with lazy_column_summary_clear. */
+void
+lazy_column_stats_get_summary (LazyColumnStats   *stats,
+                               gint               column,
+                               LazyColumnSummary *summary)
+{
+  ColumnState *state;
+
+  g_return_if_fail (IS_LAZY_COLUMN_STATS (stats));
+  g_return_if_fail (column >= 0 && column < stats->scan->n_columns);
+  g_return_if_fail (summary != NULL);
+
+  g_mutex_lock (&stats->scan->lock);
+  state = &stats->scan->columns[column];
+  summary->n_cells = state->n_cells;
+  summary->n_nulls = state->n_nulls;
+  summary->n_numbers = state->n_numbers;
+  summary->n_distinct = hll_estimate (state->registers);
+  summary->min = state->min;
+  summary->max = state->max;
+  summary->min_string = g_strdup (state->min_string);
+  summary->max_string = g_strdup (state->max_string);
+  memcpy (summary->histogram, state->histogram, sizeof (summary->histogram));
+  g_mutex_unlock (&stats->scan->lock);
+}
+
+/* A one line description of the column for a header or tooltip, e.g.
+   "1000 cells, 3 empty, ~250 distinct, 0.5 .. 99" */
+gchar *
+lazy_column_stats_describe (LazyColumnStats *stats,
+                            gint             column)
+{
+  LazyColumnSummary summary;
+  GString *text;
+
+  g_return_val_if_fail (IS_LAZY_COLUMN_STATS (stats), NULL);
+
+  lazy_column_stats_get_summary (stats, column, &summary);
+  text = g_string_new (NULL);
+  g_string_append_printf (text, "%" G_GINT64_FORMAT " cells", summary.n_cells);
+  if (summary.n_nulls)
+    g_string_append_printf (text, ", %" G_GINT64_FORMAT " empty", summary.n_nulls);
+  g_string_append_printf (text, ", ~%" G_GINT64_FORMAT " distinct", summary.n_distinct);
+  if (summary.n_numbers && summary.n_numbers == summary.n_cells - summary.n_nulls)
+    g_string_append_printf (text, ", %g .. %g", summary.min, summary.max);
+  else if (summary.min_string)
+    g_string_append_printf (text, ", %s .. %s", summary.min_string, summary.max_string);
+  lazy_column_summary_clear (&summary);
+
+  return g_string_free (text, FALSE);
+}
+
+/* The numbers of a histogram bin are in [lower, upper) for positive
+   and in (lower, upper] for negative numbers. Bins from
+   LAZY_COLUMN_STATS_BINS / 2 on hold 0 and the positive numbers. */
+void
+lazy_column_stats_get_bin_range (gint     bin,
+                                 gdouble *lower,
+                                 gdouble *upper)
+{
+  gint magnitude;
+  gdouble low, high;
+
+  g_return_if_fail (bin >= 0 && bin < LAZY_COLUMN_STATS_BINS);
+
+  magnitude = bin >= N_MAGNITUDES ? bin - N_MAGNITUDES : N_MAGNITUDES - 1 - bin;
+  low = magnitude == 0 ? 0 : ldexp (1.0, magnitude + MAGNITUDE_MIN - 1);
+  high = magnitude == N_MAGNITUDES - 1 ? INFINITY : ldexp (1.0, magnitude + MAGNITUDE_MIN);
+  if (bin < N_MAGNITUDES)
+    {
+      gdouble tmp = low;
+
+      low = -high;
+      high = -tmp;
+    }
+  if (lower)
+    *lower = low;
+  if (upper)
+    *upper = high;
+}
+
+void
+lazy_column_summary_clear (LazyColumnSummary *summary)
+{
+  g_clear_pointer (&summary->min_string, g_free);
+  g_clear_pointer (&summary->max_string, g_free);
+}
@@ -0,0 +1,81 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_COLUMN_STATS_H__
+#define __LAZY_COLUMN_STATS_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_COLUMN_STATS            (lazy_column_stats_get_type ())
+#define LAZY_COLUMN_STATS(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_COLUMN_STATS, LazyColumnStats))
+#define LAZY_COLUMN_STATS_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_COLUMN_STATS, LazyColumnStatsClass))
+#define IS_LAZY_COLUMN_STATS(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_COLUMN_STATS))
+#define IS_LAZY_COLUMN_STATS_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_COLUMN_STATS))
+#define LAZY_COLUMN_STATS_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_COLUMN_STATS, LazyColumnStatsClass))
+
+/* Histogram bins of the numbers by sign and binary magnitude, see
+   lazy_column_stats_get_bin_range */
+#define LAZY_COLUMN_STATS_BINS 128
+
+typedef struct _LazyColumnStats        LazyColumnStats;
+typedef struct _LazyColumnStatsClass   LazyColumnStatsClass;
+typedef struct _LazyColumnSummary      LazyColumnSummary;
+
+struct _LazyColumnStatsClass
+{
+  GObjectClass parent_class;
+
+};
+
+/* The statistics of the cells of one column scanned so far */
+struct _LazyColumnSummary
+{
+  gint64 n_cells;
+  gint64 n_nulls;       /* Empty cells */
+  gint64 n_numbers;     /* Cells which are a number */
+  gint64 n_distinct;    /* Estimate of the distinct non-empty cells */
+  gdouble min;          /* Of the numbers */
+  gdouble max;
+  gchar *min_string;    /* Byte wise, of the non-empty cells */
+  gchar *max_string;
+  guint64 histogram[LAZY_COLUMN_STATS_BINS];
+};
+
+GType            lazy_column_stats_get_type    (void) G_GNUC_CONST;
+
+LazyColumnStats *lazy_column_stats_new         (GtkTreeModel      *model);
+GtkTreeModel    *lazy_column_stats_get_model   (LazyColumnStats   *stats);
+
+gboolean         lazy_column_stats_get_scanning (LazyColumnStats  *stats);
+gdouble          lazy_column_stats_get_progress (LazyColumnStats  *stats);
+
+void             lazy_column_stats_get_summary (LazyColumnStats   *stats,
+                                                gint               column,
+                                                LazyColumnSummary *summary);
+gchar           *lazy_column_stats_describe    (LazyColumnStats   *stats,
+                                                gint               column);
+void             lazy_column_stats_get_bin_range (gint             bin,
+                                                gdouble           *lower,
+                                                gdouble           *upper);
+
+void             lazy_column_summary_clear     (LazyColumnSummary *summary);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_COLUMN_STATS_H__ */
@@ -0,0 +1,1019 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The column store keeps typed values in one array per column
+   instead of strings per cell: 8 bytes per number or timestamp and 4
+   bytes per string, strings are stored once per column in a
+   dictionary. The values are formatted to text only for the cells
+   the view fetches, with integer code paths instead of printf.
+
+   Rows are added with lazy_column_store_append_row and the set
+   functions and become visible with lazy_column_store_commit, which
+   announces them with one rows-inserted. The numbers of a column are
+   handed to the sort model and the column statistics without the
+   detour over text, see lazy_block_source_fetch_numbers. String
+   columns with up to 65536 ids hand out the ids as dictionary codes,
+   see lazy_block_source_fetch_codes.
+
+   Empty cells are stored as G_MININT64 in integer and timestamp
+   columns, as NAN in double columns and as string id 0. */
+
+#include <gtk/gtk.h>
+#include <math.h>
+#include <string.h>
+#include "lazycolumnstore.h"
+#include "lazyblocksource.h"
+
+#define NULL_INT64 G_MININT64
+/* Enough for every formatted value, see format_double */
+#define FORMAT_BUF_SIZE 64
+/* String ids fit the 16 bit dictionary codes up to this many */
+#define MAX_CODES 65536
+
+typedef struct _Column Column;
+
+struct _Column
+{
+  LazyColumnType type;
+  gpointer values;          /* gint64, gdouble or guint32 string ids */
+
+  /* The dictionary of a string column, id 0 is the empty cell */
+  GStringChunk *strings;
+  GHashTable *ids;          /* String -> id, main thread only */
+  GPtrArray *dictionary;    /* Id -> string */
+  gsize dictionary_bytes;
+};
+
+struct _LazyColumnStore
+{
+  GObject parent;
+
+  /* private */
+  gint n_columns;
+  Column *columns;
+  gint64 n_rows;            /* Committed rows */
+  gint64 n_appended;        /* Including the rows not committed yet */
+  gint64 capacity;
+  guint stamp;
+
+  /* Taken for writing when the arrays move or committed cells change,
+     fetches on worker threads take it for reading */
+  GRWLock lock;
+};
+
+/* The row id is 64 bit, see lazystore.c */
+static inline gint64
+iter_get_row (GtkTreeIter *iter)
+{
+  return (gint64) (((guint64) GPOINTER_TO_UINT (iter->user_data2) << 32) |
+                   GPOINTER_TO_UINT (iter->user_data));
+}
+
+static inline void
+iter_set_row (GtkTreeIter *iter,
+              gint64       row)
+{
+  iter->user_data = GUINT_TO_POINTER ((guint) ((guint64) row & 0xffffffff));
+  iter->user_data2 = GUINT_TO_POINTER ((guint) ((guint64) row >> 32));
+}
+
+static void         lazy_column_store_tree_model_init (GtkTreeModelIface *iface);
+static GtkTreeModelFlags lazy_column_store_get_flags  (GtkTreeModel      *tree_model);
+static gint         lazy_column_store_get_n_columns   (GtkTreeModel      *tree_model);
+static GType        lazy_column_store_get_column_type (GtkTreeModel      *tree_model,
+                                                       gint               index);
+static gboolean     lazy_column_store_get_iter        (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreePath       *path);
+static GtkTreePath *lazy_column_store_get_path        (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static void         lazy_column_store_get_value       (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       gint               column,
+                                                       GValue            *value);
+static gboolean     lazy_column_store_iter_next       (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_column_store_iter_previous   (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_column_store_iter_children   (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent);
+static gboolean     lazy_column_store_iter_has_child  (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gint         lazy_column_store_iter_n_children (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_column_store_iter_nth_child  (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent,
+                                                       gint               n);
+static gboolean     lazy_column_store_iter_parent     (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *child);
+
+static void         lazy_column_store_block_source_init (LazyBlockSourceInterface *iface);
+static void         lazy_column_store_fetch_block     (LazyBlockSource   *source,
+                                                       LazyBlock         *block);
+static gint64       lazy_column_store_get_n_rows      (LazyBlockSource   *source);
+static gboolean     lazy_column_store_fetch_numbers   (LazyBlockSource   *source,
+                                                       gint               column,
+                                                       gint64             row0,
+                                                       gint               n_rows,
+                                                       gdouble           *numbers);
+static GPtrArray   *lazy_column_store_dup_dictionary  (LazyBlockSource   *source,
+                                                       gint               column);
+static gboolean     lazy_column_store_fetch_codes     (LazyBlockSource   *source,
+                                                       gint               column,
+                                                       gint64             row0,
+                                                       gint               n_rows,
+                                                       guint16           *codes);
+
+static void         lazy_column_store_finalize        (GObject           *object);
+
+G_DEFINE_TYPE_WITH_CODE (LazyColumnStore, lazy_column_store, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                lazy_column_store_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (TYPE_LAZY_BLOCK_SOURCE,
+                                                lazy_column_store_block_source_init))
+
+
+static void
+lazy_column_store_class_init (LazyColumnStoreClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->finalize = lazy_column_store_finalize;
+}
+
+static void
+lazy_column_store_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = lazy_column_store_get_flags;
+  iface->get_n_columns = lazy_column_store_get_n_columns;
+  iface->get_column_type = lazy_column_store_get_column_type;
+  iface->get_iter = lazy_column_store_get_iter;
+  iface->get_path = lazy_column_store_get_path;
+  iface->get_value = lazy_column_store_get_value;
+  iface->iter_next = lazy_column_store_iter_next;
+  iface->iter_previous = lazy_column_store_iter_previous;
+  iface->iter_children = lazy_column_store_iter_children;
+  iface->iter_has_child = lazy_column_store_iter_has_child;
+  iface->iter_n_children = lazy_column_store_iter_n_children;
+  iface->iter_nth_child = lazy_column_store_iter_nth_child;
+  iface->iter_parent = lazy_column_store_iter_parent;
+}
+
+static void
+lazy_column_store_block_source_init (LazyBlockSourceInterface *iface)
+{
+  iface->fetch_block = lazy_column_store_fetch_block;
+  iface->get_n_rows = lazy_column_store_get_n_rows;
+  iface->fetch_numbers = lazy_column_store_fetch_numbers;
+  iface->dup_dictionary = lazy_column_store_dup_dictionary;
+  iface->fetch_codes = lazy_column_store_fetch_codes;
+}
+
+static void
+lazy_column_store_init (LazyColumnStore *column_store)
+{
+  g_rw_lock_init (&column_store->lock);
+  column_store->stamp = g_random_int ();
+}
+
+static void
+lazy_column_store_finalize (GObject *object)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (object);
+  gint i;
+
+  for (i = 0; i < column_store->n_columns; i++)
+    {
+      Column *col = &column_store->columns[i];
+
+      g_free (col->values);
+      if (col->type == LAZY_COLUMN_STRING)
+        {
+          g_string_chunk_free (col->strings);
+          g_hash_table_destroy (col->ids);
+          g_ptr_array_free (col->dictionary, TRUE);
+        }
+    }
+  g_free (column_store->columns);
+  g_rw_lock_clear (&column_store->lock);
+
+  G_OBJECT_CLASS (lazy_column_store_parent_class)->finalize (object);
+}
+
+static inline gsize
+value_size (LazyColumnType type)
+{
+  return type == LAZY_COLUMN_STRING ? sizeof (guint32) : sizeof (gint64);
+}
+
+/* Make the cells of the rows [start, end) empty */
+static void
+column_clear (Column *col,
+              gint64  start,
+              gint64  end)
+{
+  gint64 row;
+
+  switch (col->type)
+    {
+    case LAZY_COLUMN_INT64:
+    case LAZY_COLUMN_TIMESTAMP:
+      for (row = start; row < end; row++)
+        ((gint64 *) col->values)[row] = NULL_INT64;
+      break;
+    case LAZY_COLUMN_DOUBLE:
+      for (row = start; row < end; row++)
+        ((gdouble *) col->values)[row] = NAN;
+      break;
+    case LAZY_COLUMN_STRING:
+      memset ((guint32 *) col->values + start, 0, (end - start) * sizeof (guint32));
+      break;
+    }
+}
+
+
+/* Formatting */
+
+static const gchar digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* Write the decimal digits of value, two at a time from the end */
+static gint
+format_uint64 (gchar   *buf,
+               guint64  value)
+{
+  gchar tmp[20];
+  gchar *p = tmp + sizeof (tmp);
+  gint len;
+
+  while (value >= 100)
+    {
+      guint pair = value % 100;
+
+      value /= 100;
+      *--p = digit_pairs[2 * pair + 1];
+      *--p = digit_pairs[2 * pair];
+    }
+  if (value >= 10)
+    {
+      *--p = digit_pairs[2 * value + 1];
+      *--p = digit_pairs[2 * value];
+    }
+  else
+    *--p = '0' + value;
+
+  len = tmp + sizeof (tmp) - p;
+  memcpy (buf, p, len);
+  return len;
+}
+
+static gint
+format_int64 (gchar  *buf,
+              gint64  value)
+{
+  if (value < 0)
+    {
+      buf[0] = '-';
+      return 1 + format_uint64 (buf + 1, -(guint64) value);
+    }
+  return format_uint64 (buf, value);
+}
+
+/* Exactly width digits with leading zeros */
+static void
+format_digits (gchar   *buf,
+               guint64  value,
+               gint     width)
+{
+  while (width-- > 0)
+    {
+      buf[width] = '0' + value % 10;
+      value /= 10;
+    }
+}
+
+/* Up to six decimals without trailing zeros, like GtkTreeView shows
+   doubles. Values too large for the integer path use the shortest
+   text which reads back the same number. */
+static gint
+format_double (gchar   *buf,
+               gdouble  value)
+{
+  guint64 scaled, fraction;
+  gint len = 0, digits;
+
+  if (isnan (value))
+    return 0;
+  if (!(fabs (value) < 1e12))
+    {
+      g_ascii_dtostr (buf, FORMAT_BUF_SIZE, value);
+      return strlen (buf);
+    }
+
+  scaled = (guint64) (fabs (value) * 1e6 + 0.5);
+  if (value < 0 && scaled)
+    buf[len++] = '-';
+  len += format_uint64 (buf + len, scaled / 1000000);
+  fraction = scaled % 1000000;
+  if (fraction)
+    {
+      for (digits = 6; fraction % 10 == 0; digits--)
+        fraction /= 10;
+      buf[len++] = '.';
+      format_digits (buf + len, fraction, digits);
+      len += digits;
+    }
+  return len;
+}
+
+/* "YYYY-MM-DD HH:MM:SS" in UTC with the microseconds if there are any */
+static gint
+format_timestamp (gchar  *buf,
+                  gint64  microseconds)
+{
+  const gint64 day = G_GINT64_CONSTANT (86400000000);
+  gint64 days = microseconds / day;
+  gint64 rest = microseconds % day;
+  gint64 era, doe, yoe, doy, mp, year, month, mday;
+  gint len = 0;
+
+  if (rest < 0)
+    {
+      rest += day;
+      days--;
+    }
+
+  /* The civil date of the day, proleptic Gregorian calendar */
+  days += 719468;
+  era = (days >= 0 ? days : days - 146096) / 146097;
+  doe = days - era * 146097;
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp = (5 * doy + 2) / 153;
+  mday = doy - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yoe + era * 400 + (month <= 2);
+
+  if (year < 0 || year > 9999)
+    len = format_int64 (buf, year);
+  else
+    {
+      format_digits (buf, year, 4);
+      len = 4;
+    }
+  buf[len++] = '-';
+  format_digits (buf + len, month, 2);
+  buf[len + 2] = '-';
+  format_digits (buf + len + 3, mday, 2);
+  buf[len + 5] = ' ';
+  format_digits (buf + len + 6, rest / 3600000000, 2);
+  buf[len + 8] = ':';
+  format_digits (buf + len + 9, rest / 60000000 % 60, 2);
+  buf[len + 11] = ':';
+  format_digits (buf + len + 12, rest / 1000000 % 60, 2);
+  len += 14;
+  if (rest % 1000000)
+    {
+      buf[len++] = '.';
+      format_digits (buf + len, rest % 1000000, 6);
+      len += 6;
+    }
+  return len;
+}
+
+/* The text of a cell or NULL for an empty cell. The string is either
+   owned by the dictionary or written to buf. Must be called with the
+   lock held. */
+static const gchar *
+format_cell (Column *col,
+             gint64  row,
+             gchar  *buf,
+             gint   *len)
+{
+  gint64 value;
+  guint32 id;
+
+  switch (col->type)
+    {
+    case LAZY_COLUMN_INT64:
+      value = ((gint64 *) col->values)[row];
+      if (value == NULL_INT64)
+        return NULL;
+      *len = format_int64 (buf, value);
+      return buf;
+    case LAZY_COLUMN_DOUBLE:
+      if (isnan (((gdouble *) col->values)[row]))
+        return NULL;
+      *len = format_double (buf, ((gdouble *) col->values)[row]);
+      return buf;
+    case LAZY_COLUMN_TIMESTAMP:
+      value = ((gint64 *) col->values)[row];
+      if (value == NULL_INT64)
+        return NULL;
+      *len = format_timestamp (buf, value);
+      return buf;
+    case LAZY_COLUMN_STRING:
+      id = ((guint32 *) col->values)[row];
+      if (id == 0)
+        return NULL;
+      *len = -1;
+      return g_ptr_array_index (col->dictionary, id);
+    }
+  return NULL;
+}
+
+
+/* Public API */
+
+LazyColumnStore *
+lazy_column_store_new (gint                  n_columns,
+                       const LazyColumnType *types)
+{
+  LazyColumnStore *column_store;
+  gint i;
+
+  g_return_val_if_fail (n_columns >= 0, NULL);
+  g_return_val_if_fail (n_columns == 0 || types != NULL, NULL);
+
+  column_store = g_object_new (TYPE_LAZY_COLUMN_STORE, NULL);
+  column_store->n_columns = n_columns;
+  column_store->columns = g_new0 (Column, n_columns);
+  for (i = 0; i < n_columns; i++)
+    {
+      Column *col = &column_store->columns[i];
+
+      col->type = types[i];
+      if (col->type == LAZY_COLUMN_STRING)
+        {
+          col->strings = g_string_chunk_new (64 * 1024);
+          col->ids = g_hash_table_new (g_str_hash, g_str_equal);
+          col->dictionary = g_ptr_array_new ();
+          g_ptr_array_add (col->dictionary, NULL);
+        }
+    }
+  return column_store;
+}
+
+LazyColumnType
+lazy_column_store_get_storage_type (LazyColumnStore *column_store,
+                                    gint             column)
+{
+  g_return_val_if_fail (IS_LAZY_COLUMN_STORE (column_store), LAZY_COLUMN_STRING);
+  g_return_val_if_fail (column >= 0 && column < column_store->n_columns, LAZY_COLUMN_STRING);
+
+  return column_store->columns[column].type;
+}
+
+/* Add an empty row at the end. It is not visible before the next
+   lazy_column_store_commit. Returns the row. */
+gint64
+lazy_column_store_append_row (LazyColumnStore *column_store)
+{
+  gint i;
+
+  g_return_val_if_fail (IS_LAZY_COLUMN_STORE (column_store), -1);
+
+  if (column_store->n_appended == column_store->capacity)
+    {
+      gint64 capacity = MAX (column_store->capacity * 2, 1024);
+
+      g_rw_lock_writer_lock (&column_store->lock);
+      for (i = 0; i < column_store->n_columns; i++)
+        {
+          Column *col = &column_store->columns[i];
+
+          col->values = g_realloc_n (col->values, capacity, value_size (col->type));
+          column_clear (col, column_store->capacity, capacity);
+        }
+      column_store->capacity = capacity;
+      g_rw_lock_writer_unlock (&column_store->lock);
+    }
+  return column_store->n_appended++;
+}
+
+/* Show the appended rows */
+void
+lazy_column_store_commit (LazyColumnStore *column_store)
+{
+  gint64 old_n_rows;
+
+  g_return_if_fail (IS_LAZY_COLUMN_STORE (column_store));
+
+  if (column_store->n_appended == column_store->n_rows)
+    return;
+
+  g_rw_lock_writer_lock (&column_store->lock);
+  old_n_rows = column_store->n_rows;
+  column_store->n_rows = column_store->n_appended;
+  g_rw_lock_writer_unlock (&column_store->lock);
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (column_store), old_n_rows,
+                                   column_store->n_rows - old_n_rows);
+}
+
+/* Rows which are visible already may be read by fetch threads */
+static gboolean
+begin_set (LazyColumnStore *column_store,
+           gint64           row,
+           gint             column,
+           LazyColumnType   type)
+{
+  g_return_val_if_fail (IS_LAZY_COLUMN_STORE (column_store), FALSE);
+  g_return_val_if_fail (row >= 0 && row < column_store->n_appended, FALSE);
+  g_return_val_if_fail (column >= 0 && column < column_store->n_columns, FALSE);
+  g_return_val_if_fail (column_store->columns[column].type == type, FALSE);
+
+  if (row < column_store->n_rows)
+    g_rw_lock_writer_lock (&column_store->lock);
+  return TRUE;
+}
+
+/* Changes of visible rows are announced with row-changed */
+static void
+end_set (LazyColumnStore *column_store,
+         gint64           row)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  if (row >= column_store->n_rows)
+    return;
+  g_rw_lock_writer_unlock (&column_store->lock);
+
+  if (row > G_MAXINT)
+    return;
+  path = gtk_tree_path_new_from_indices ((gint) row, -1);
+  iter.stamp = column_store->stamp;
+  iter_set_row (&iter, row);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (column_store), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+void
+lazy_column_store_set_null (LazyColumnStore *column_store,
+                            gint64           row,
+                            gint             column)
+{
+  Column *col;
+
+  g_return_if_fail (IS_LAZY_COLUMN_STORE (column_store));
+  g_return_if_fail (column >= 0 && column < column_store->n_columns);
+
+  col = &column_store->columns[column];
+  if (!begin_set (column_store, row, column, col->type))
+    return;
+  column_clear (col, row, row + 1);
+  end_set (column_store, row);
+}
+
+/* G_MININT64 is the empty cell */
+void
+lazy_column_store_set_int64 (LazyColumnStore *column_store,
+                             gint64           row,
+                             gint             column,
+                             gint64           value)
+{
+  if (!begin_set (column_store, row, column, LAZY_COLUMN_INT64))
+    return;
+  ((gint64 *) column_store->columns[column].values)[row] = value;
+  end_set (column_store, row);
+}
+
+void
+lazy_column_store_set_double (LazyColumnStore *column_store,
+                              gint64           row,
+                              gint             column,
+                              gdouble          value)
+{
+  if (!begin_set (column_store, row, column, LAZY_COLUMN_DOUBLE))
+    return;
+  ((gdouble *) column_store->columns[column].values)[row] = value;
+  end_set (column_store, row);
+}
+
+void
+lazy_column_store_set_timestamp (LazyColumnStore *column_store,
+                                 gint64           row,
+                                 gint             column,
+                                 gint64           microseconds)
+{
+  if (!begin_set (column_store, row, column, LAZY_COLUMN_TIMESTAMP))
+    return;
+  ((gint64 *) column_store->columns[column].values)[row] = microseconds;
+  end_set (column_store, row);
+}
+
+/* NULL or "" is the empty cell */
+void
+lazy_column_store_set_string (LazyColumnStore *column_store,
+                              gint64           row,
+                              gint             column,
+                              const gchar     *value)
+{
+  Column *col;
+  guint32 id = 0;
+  gboolean locked;
+
+  if (!begin_set (column_store, row, column, LAZY_COLUMN_STRING))
+    return;
+  locked = row < column_store->n_rows;
+
+  col = &column_store->columns[column];
+  if (value && *value)
+    {
+      id = GPOINTER_TO_UINT (g_hash_table_lookup (col->ids, value));
+      if (id == 0)
+        {
+          gchar *string = g_string_chunk_insert (col->strings, value);
+
+          /* The dictionary may move, fetch threads read it */
+          if (!locked)
+            g_rw_lock_writer_lock (&column_store->lock);
+          id = col->dictionary->len;
+          g_ptr_array_add (col->dictionary, string);
+          if (!locked)
+            g_rw_lock_writer_unlock (&column_store->lock);
+          g_hash_table_insert (col->ids, string, GUINT_TO_POINTER (id));
+          col->dictionary_bytes += strlen (string) + 1;
+        }
+    }
+  ((guint32 *) col->values)[row] = id;
+  end_set (column_store, row);
+}
+
+/* The memory of the values and dictionaries */
+gsize
+lazy_column_store_get_bytes (LazyColumnStore *column_store)
+{
+  gsize bytes = 0;
+  gint i;
+
+  g_return_val_if_fail (IS_LAZY_COLUMN_STORE (column_store), 0);
+
+  for (i = 0; i < column_store->n_columns; i++)
+    {
+      Column *col = &column_store->columns[i];
+
+      bytes += column_store->capacity * value_size (col->type);
+      if (col->type == LAZY_COLUMN_STRING)
+        bytes += col->dictionary_bytes + col->dictionary->len * sizeof (gpointer) +
+                 g_hash_table_size (col->ids) * 3 * sizeof (gpointer);
+    }
+  return bytes;
+}
+
+
+/* Fulfill the GtkTreeModel requirements */
+static GtkTreeModelFlags
+lazy_column_store_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+lazy_column_store_get_n_columns (GtkTreeModel *tree_model)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+
+  return column_store->n_columns;
+}
+
+/* Timestamps are microseconds like g_get_real_time */
+static GType
+lazy_column_store_get_column_type (GtkTreeModel *tree_model,
+                                   gint          index)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+
+  g_return_val_if_fail (index < column_store->n_columns, G_TYPE_INVALID);
+
+  switch (column_store->columns[index].type)
+    {
+    case LAZY_COLUMN_INT64:
+    case LAZY_COLUMN_TIMESTAMP:
+      return G_TYPE_INT64;
+    case LAZY_COLUMN_DOUBLE:
+      return G_TYPE_DOUBLE;
+    case LAZY_COLUMN_STRING:
+      return G_TYPE_STRING;
+    }
+  return G_TYPE_INVALID;
+}
+
+static gboolean
+lazy_column_store_get_iter (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter,
+                            GtkTreePath  *path)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+  gint i;
+
+  i = gtk_tree_path_get_indices (path)[0];
+  if (i < 0 || i >= lazy_column_store_get_n_rows (LAZY_BLOCK_SOURCE (column_store)))
+    return FALSE;
+
+  iter->stamp = column_store->stamp;
+  iter_set_row (iter, i);
+  return TRUE;
+}
+
+static GtkTreePath *
+lazy_column_store_get_path (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter)
+{
+  GtkTreePath *path;
+  gint64 row = iter_get_row (iter);
+
+  /* Paths can only address gint rows */
+  if (row > G_MAXINT)
+    return NULL;
+
+  path = gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, row);
+  return path;
+}
+
+/* The native values, empty numbers read as 0 and NAN */
+static void
+lazy_column_store_get_value (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             gint          column,
+                             GValue       *value)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+  gint64 row = iter_get_row (iter);
+  Column *col;
+  gint64 number;
+
+  g_return_if_fail (column < column_store->n_columns);
+  g_return_if_fail (row < column_store->n_rows);
+
+  col = &column_store->columns[column];
+  g_value_init (value, lazy_column_store_get_column_type (tree_model, column));
+  switch (col->type)
+    {
+    case LAZY_COLUMN_INT64:
+    case LAZY_COLUMN_TIMESTAMP:
+      number = ((gint64 *) col->values)[row];
+      g_value_set_int64 (value, number == NULL_INT64 ? 0 : number);
+      break;
+    case LAZY_COLUMN_DOUBLE:
+      g_value_set_double (value, ((gdouble *) col->values)[row]);
+      break;
+    case LAZY_COLUMN_STRING:
+      g_value_set_string (value, g_ptr_array_index (col->dictionary,
+                                                    ((guint32 *) col->values)[row]));
+      break;
+    }
+}
+
+static gboolean
+lazy_column_store_iter_next (GtkTreeModel  *tree_model,
+                             GtkTreeIter   *iter)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+  gint64 row = iter_get_row (iter) + 1;
+
+  iter_set_row (iter, row);
+  if (row >= lazy_column_store_get_n_rows (LAZY_BLOCK_SOURCE (column_store)))
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+lazy_column_store_iter_previous (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+  gint64 row = iter_get_row (iter);
+
+  g_return_val_if_fail (column_store->stamp == iter->stamp, FALSE);
+
+  if (row == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  iter_set_row (iter, row - 1);
+  return TRUE;
+}
+
+static gboolean
+lazy_column_store_iter_children (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter,
+                                 GtkTreeIter  *parent)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+
+  /* this is a list, nodes have no children */
+  if (parent || lazy_column_store_get_n_rows (LAZY_BLOCK_SOURCE (column_store)) == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->stamp = column_store->stamp;
+  iter_set_row (iter, 0);
+  return TRUE;
+}
+
+static gboolean
+lazy_column_store_iter_has_child (GtkTreeModel *tree_model,
+                                  GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+lazy_column_store_iter_n_children (GtkTreeModel *tree_model,
+                                   GtkTreeIter  *iter)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+
+  if (iter == NULL)
+    return MIN (column_store->n_rows, G_MAXINT);
+
+  g_return_val_if_fail (column_store->stamp == iter->stamp, -1);
+  return 0;
+}
+
+static gboolean
+lazy_column_store_iter_nth_child (GtkTreeModel *tree_model,
+                                  GtkTreeIter  *iter,
+                                  GtkTreeIter  *parent,
+                                  gint          n)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (tree_model);
+
+  iter->stamp = 0;
+  if (parent)
+    return FALSE;
+  if (n < 0 || n >= lazy_column_store_get_n_rows (LAZY_BLOCK_SOURCE (column_store)))
+    return FALSE;
+
+  iter->stamp = column_store->stamp;
+  iter_set_row (iter, n);
+  return TRUE;
+}
+
+static gboolean
+lazy_column_store_iter_parent (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+/* Fulfill the LazyBlockSource requirements */
+static void
+lazy_column_store_fetch_block (LazyBlockSource *source,
+                               LazyBlock       *block)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (source);
+  gchar buf[FORMAT_BUF_SIZE];
+  gint64 row_end, row;
+  gint col_end, col;
+
+  g_rw_lock_reader_lock (&column_store->lock);
+  row_end = MIN (block->row0 + block->n_rows, column_store->n_rows);
+  col_end = MIN (block->col0 + block->n_cols, column_store->n_columns);
+  for (col = block->col0; col < col_end; col++)
+    for (row = block->row0; row < row_end; row++)
+      {
+        const gchar *text;
+        gint len;
+
+        text = format_cell (&column_store->columns[col], row, buf, &len);
+        if (text)
+          lazy_block_set (block, row, col, text, len);
+      }
+  g_rw_lock_reader_unlock (&column_store->lock);
+}
+
+static gint64
+lazy_column_store_get_n_rows (LazyBlockSource *source)
+{
+  return LAZY_COLUMN_STORE (source)->n_rows;
+}
+
+static gboolean
+lazy_column_store_fetch_numbers (LazyBlockSource *source,
+                                 gint             column,
+                                 gint64           row0,
+                                 gint             n_rows,
+                                 gdouble         *numbers)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (source);
+  Column *col;
+  gint i;
+
+  if (column < 0 || column >= column_store->n_columns)
+    return FALSE;
+  col = &column_store->columns[column];
+  if (col->type == LAZY_COLUMN_STRING)
+    return FALSE;
+
+  g_rw_lock_reader_lock (&column_store->lock);
+  for (i = 0; i < n_rows; i++)
+    {
+      gint64 row = row0 + i;
+
+      if (row < 0 || row >= column_store->n_rows)
+        numbers[i] = NAN;
+      else if (col->type == LAZY_COLUMN_DOUBLE)
+        numbers[i] = ((gdouble *) col->values)[row];
+      else
+        {
+          gint64 value = ((gint64 *) col->values)[row];
+
+          numbers[i] = value == NULL_INT64 ? NAN : (gdouble) value;
+        }
+    }
+  g_rw_lock_reader_unlock (&column_store->lock);
+  return TRUE;
+}
+
+static GPtrArray *
+lazy_column_store_dup_dictionary (LazyBlockSource *source,
+                                  gint             column)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (source);
+  Column *col;
+  GPtrArray *dictionary;
+  guint id;
+
+  if (column < 0 || column >= column_store->n_columns)
+    return NULL;
+  col = &column_store->columns[column];
+  if (col->type != LAZY_COLUMN_STRING || col->dictionary->len > MAX_CODES)
+    return NULL;
+
+  /* Id 0 is NULL in the dictionary of the store */
+  dictionary = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (dictionary, g_strdup (""));
+  for (id = 1; id < col->dictionary->len; id++)
+    g_ptr_array_add (dictionary, g_strdup (g_ptr_array_index (col->dictionary, id)));
+  return dictionary;
+}
+
+static gboolean
+lazy_column_store_fetch_codes (LazyBlockSource *source,
+                               gint             column,
+                               gint64           row0,
+                               gint             n_rows,
+                               guint16         *codes)
+{
+  LazyColumnStore *column_store = LAZY_COLUMN_STORE (source);
+  Column *col;
+  gboolean coded;
+  gint i;
+
+  if (column < 0 || column >= column_store->n_columns)
+    return FALSE;
+  col = &column_store->columns[column];
+  if (col->type != LAZY_COLUMN_STRING)
+    return FALSE;
+
+  g_rw_lock_reader_lock (&column_store->lock);
+  coded = col->dictionary->len <= MAX_CODES;
+  for (i = 0; coded && i < n_rows; i++)
+    {
+      gint64 row = row0 + i;
+
+      if (row < 0 || row >= column_store->n_rows)
+        codes[i] = 0;
+      else
+        codes[i] = ((guint32 *) col->values)[row];
+    }
+  g_rw_lock_reader_unlock (&column_store->lock);
+  return coded;
+}
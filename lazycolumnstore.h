@@ -0,0 +1,84 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_COLUMN_STORE_H__
+#define __LAZY_COLUMN_STORE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_COLUMN_STORE             (lazy_column_store_get_type ())
+#define LAZY_COLUMN_STORE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_COLUMN_STORE, LazyColumnStore))
+#define LAZY_COLUMN_STORE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_COLUMN_STORE, LazyColumnStoreClass))
+#define IS_LAZY_COLUMN_STORE(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_COLUMN_STORE))
+#define IS_LAZY_COLUMN_STORE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_COLUMN_STORE))
+#define LAZY_COLUMN_STORE_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_COLUMN_STORE, LazyColumnStoreClass))
+
+typedef struct _LazyColumnStore        LazyColumnStore;
+typedef struct _LazyColumnStoreClass   LazyColumnStoreClass;
+
+struct _LazyColumnStoreClass
+{
+  GObjectClass parent_class;
+
+};
+
+/* How the values of a column are stored */
+typedef enum
+{
+  LAZY_COLUMN_INT64,
+  LAZY_COLUMN_DOUBLE,
+  LAZY_COLUMN_TIMESTAMP,    /* Microseconds since the epoch, shown in UTC */
+  LAZY_COLUMN_STRING        /* Dictionary encoded */
+} LazyColumnType;
+
+GType            lazy_column_store_get_type      (void) G_GNUC_CONST;
+
+LazyColumnStore *lazy_column_store_new           (gint                  n_columns,
+                                                  const LazyColumnType *types);
+LazyColumnType   lazy_column_store_get_storage_type (LazyColumnStore   *column_store,
+                                                  gint                  column);
+
+gint64           lazy_column_store_append_row    (LazyColumnStore      *column_store);
+void             lazy_column_store_commit        (LazyColumnStore      *column_store);
+
+void             lazy_column_store_set_null      (LazyColumnStore      *column_store,
+                                                  gint64                row,
+                                                  gint                  column);
+void             lazy_column_store_set_int64     (LazyColumnStore      *column_store,
+                                                  gint64                row,
+                                                  gint                  column,
+                                                  gint64                value);
+void             lazy_column_store_set_double    (LazyColumnStore      *column_store,
+                                                  gint64                row,
+                                                  gint                  column,
+                                                  gdouble               value);
+void             lazy_column_store_set_timestamp (LazyColumnStore      *column_store,
+                                                  gint64                row,
+                                                  gint                  column,
+                                                  gint64                microseconds);
+void             lazy_column_store_set_string    (LazyColumnStore      *column_store,
+                                                  gint64                row,
+                                                  gint                  column,
+                                                  const gchar          *value);
+
+gsize            lazy_column_store_get_bytes     (LazyColumnStore      *column_store);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_COLUMN_STORE_H__ */
@@ -0,0 +1,1054 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The csv store shows a delimited text file. The file is memory
+   mapped and only the start offset of every row is kept. The fields
+   of a row are split when the row is fetched, so opening the file
+   costs one pass over it for the newlines and nothing per field.
+
+   The row index is built in the background. The file is split into
+   chunks which are scanned for newlines in parallel on a thread
+   pool, the first chunk right away such that the first rows can be
+   shown immediately. The chunk results are appended to the index in
+   file order on the main thread, the new rows are announced with one
+   rows-inserted emission per batch. The progress property follows
+   the indexed part of the file. The index is guarded by a reader
+   writer lock as fetch_block may run on other threads.
+
+   In follow mode the file is watched. Growth is collected for
+   FOLLOW_INTERVAL and then the file is mapped again, only the new
+   bytes are scanned and the new rows are announced as one batch.
+   The columns stay as they were found when the file was opened.
+
+   Rows end at newlines, a trailing carriage return is dropped. Fields
+   may be quoted with '"' to contain the delimiter, a doubled quote
+   stands for one quote. Quoted newlines are not supported, they
+   start a new row. The number of columns is the number of fields in
+   the first line. Missing fields are NULL, extra fields are ignored.
+
+   Fetched cells are copied once from the mapping into the block
+   arena, which gives them the NUL termination the views need. Fields
+   without escaped quotes are copied as they are. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "lazycsvstore.h"
+#include "lazyblocksource.h"
+
+/* Bytes scanned per indexing task */
+#define INDEX_CHUNK_SIZE (16 * 1024 * 1024)
+/* The first chunk is scanned in the constructor */
+#define FIRST_CHUNK_SIZE (1024 * 1024)
+/* Milliseconds to collect file changes in follow mode */
+#define FOLLOW_INTERVAL 50
+
+/* Properties */
+enum {
+  PROP_0,
+  PROP_PROGRESS,
+  PROP_INDEXING,
+  LAST_PROP,
+};
+
+static GParamSpec *properties[LAST_PROP];
+
+struct _LazyCsvStore
+{
+  GObject parent;
+
+  /* private */
+  gchar *filename;
+  GMappedFile *file;
+  const gchar *data;
+  gsize length;
+  gchar delimiter;
+
+  /* Start of the header line or NULL */
+  const gchar *header;
+
+  /* Start offset of every row, guint64. The end of the data is
+     appended when indexing is done. */
+  GArray *index;
+  GRWLock index_lock;
+  gint64 n_rows;
+  guint n_columns;
+  guint stamp;
+
+  /* Background indexing, the chunks after the first one */
+  GThreadPool *pool;
+  guint n_chunks;
+  GArray **results;     /* Row starts per chunk, guarded by lock */
+  guint next_chunk;     /* Next chunk to append to the index */
+  gsize indexed;        /* Bytes appended to the index */
+  gint cancelled;
+  GMutex lock;
+  guint idle;
+
+  /* Follow mode */
+  GFileMonitor *monitor;
+  guint follow_timeout;
+  gboolean follow_pending;  /* Growth seen while indexing */
+};
+
+/* The row id is 64 bit, see lazystore.c */
+static inline gint64
+iter_get_row (GtkTreeIter *iter)
+{
+  return (gint64) (((guint64) GPOINTER_TO_UINT (iter->user_data2) << 32) |
+                   GPOINTER_TO_UINT (iter->user_data));
+}
+
+static inline void
+iter_set_row (GtkTreeIter *iter,
+              gint64       row)
+{
+  iter->user_data = GUINT_TO_POINTER ((guint) ((guint64) row & 0xffffffff));
+  iter->user_data2 = GUINT_TO_POINTER ((guint) ((guint64) row >> 32));
+}
+
+
+/* GtkTreeModel Interface */
+static void         lazy_csv_store_tree_model_init (GtkTreeModelIface *iface);
+static GtkTreeModelFlags lazy_csv_store_get_flags  (GtkTreeModel      *tree_model);
+static gint         lazy_csv_store_get_n_columns   (GtkTreeModel      *tree_model);
+static GType        lazy_csv_store_get_column_type (GtkTreeModel      *tree_model,
+                                                    gint               index);
+static gboolean     lazy_csv_store_get_iter        (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter,
+                                                    GtkTreePath       *path);
+static GtkTreePath *lazy_csv_store_get_path        (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter);
+static void         lazy_csv_store_get_value       (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter,
+                                                    gint               column,
+                                                    GValue            *value);
+static gboolean     lazy_csv_store_iter_next       (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter);
+static gboolean     lazy_csv_store_iter_previous   (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter);
+static gboolean     lazy_csv_store_iter_children   (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter,
+                                                    GtkTreeIter       *parent);
+static gboolean     lazy_csv_store_iter_has_child  (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter);
+static gint         lazy_csv_store_iter_n_children (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter);
+static gboolean     lazy_csv_store_iter_nth_child  (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter,
+                                                    GtkTreeIter       *parent,
+                                                    gint               n);
+static gboolean     lazy_csv_store_iter_parent     (GtkTreeModel      *tree_model,
+                                                    GtkTreeIter       *iter,
+                                                    GtkTreeIter       *child);
+
+/* LazyBlockSource Interface */
+static void         lazy_csv_store_block_source_init (LazyBlockSourceInterface *iface);
+static void         lazy_csv_store_fetch_block     (LazyBlockSource   *source,
+                                                    LazyBlock         *block);
+static gint64       lazy_csv_store_get_n_rows      (LazyBlockSource   *source);
+
+static void         lazy_csv_store_finalize        (GObject           *object);
+static void         lazy_csv_store_get_property    (GObject           *object,
+                                                    guint              prop_id,
+                                                    GValue            *value,
+                                                    GParamSpec        *pspec);
+
+G_DEFINE_TYPE_WITH_CODE (LazyCsvStore, lazy_csv_store, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                lazy_csv_store_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (TYPE_LAZY_BLOCK_SOURCE,
+                                                lazy_csv_store_block_source_init))
+
+
+static void
+lazy_csv_store_class_init (LazyCsvStoreClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->get_property = lazy_csv_store_get_property;
+  o_class->finalize = lazy_csv_store_finalize;
+
+  properties[PROP_PROGRESS] =
+    g_param_spec_double ("progress",
+                         "Progress",
+                         "Indexed fraction of the file",
+                         0.0, 1.0, 0.0,
+                         G_PARAM_READABLE);
+  properties[PROP_INDEXING] =
+    g_param_spec_boolean ("indexing",
+                          "Indexing",
+                          "Whether the rows are still being indexed",
+                          FALSE,
+                          G_PARAM_READABLE);
+  g_object_class_install_properties (o_class, LAST_PROP, properties);
+}
+
+static void
+lazy_csv_store_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = lazy_csv_store_get_flags;
+  iface->get_n_columns = lazy_csv_store_get_n_columns;
+  iface->get_column_type = lazy_csv_store_get_column_type;
+  iface->get_iter = lazy_csv_store_get_iter;
+  iface->get_path = lazy_csv_store_get_path;
+  iface->get_value = lazy_csv_store_get_value;
+  iface->iter_next = lazy_csv_store_iter_next;
+  iface->iter_previous = lazy_csv_store_iter_previous;
+  iface->iter_children = lazy_csv_store_iter_children;
+  iface->iter_has_child = lazy_csv_store_iter_has_child;
+  iface->iter_n_children = lazy_csv_store_iter_n_children;
+  iface->iter_nth_child = lazy_csv_store_iter_nth_child;
+  iface->iter_parent = lazy_csv_store_iter_parent;
+}
+
+static void
+lazy_csv_store_block_source_init (LazyBlockSourceInterface *iface)
+{
+  iface->fetch_block = lazy_csv_store_fetch_block;
+  iface->get_n_rows = lazy_csv_store_get_n_rows;
+}
+
+static void
+lazy_csv_store_init (LazyCsvStore *csv_store)
+{
+  csv_store->index = g_array_new (FALSE, FALSE, sizeof (guint64));
+  g_rw_lock_init (&csv_store->index_lock);
+  g_mutex_init (&csv_store->lock);
+  csv_store->stamp = g_random_int ();
+}
+
+static void
+lazy_csv_store_finalize (GObject *object)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (object);
+  guint i;
+
+  lazy_csv_store_set_follow (csv_store, FALSE);
+  if (csv_store->pool)
+    {
+      g_atomic_int_set (&csv_store->cancelled, TRUE);
+      g_thread_pool_free (csv_store->pool, TRUE, TRUE);
+    }
+  if (csv_store->idle)
+    g_source_remove (csv_store->idle);
+  for (i = 0; i < csv_store->n_chunks; i++)
+    if (csv_store->results[i])
+      g_array_free (csv_store->results[i], TRUE);
+  g_free (csv_store->results);
+
+  g_array_free (csv_store->index, TRUE);
+  g_rw_lock_clear (&csv_store->index_lock);
+  g_mutex_clear (&csv_store->lock);
+  if (csv_store->file)
+    g_mapped_file_unref (csv_store->file);
+  g_free (csv_store->filename);
+
+  G_OBJECT_CLASS (lazy_csv_store_parent_class)->finalize (object);
+}
+
+static void
+lazy_csv_store_get_property (GObject    *object,
+                             guint       prop_id,
+                             GValue     *value,
+                             GParamSpec *pspec)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (object);
+
+  switch (prop_id)
+    {
+    case PROP_PROGRESS:
+      g_value_set_double (value, lazy_csv_store_get_progress (csv_store));
+      break;
+    case PROP_INDEXING:
+      g_value_set_boolean (value, csv_store->pool != NULL);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+
+/* Parsing */
+
+/* The line from start up to but excluding the line end */
+static const gchar *
+line_end (const gchar *start,
+          const gchar *end)
+{
+  const gchar *nl = memchr (start, '\n', end - start);
+
+  end = nl ? nl : end;
+  if (end > start && end[-1] == '\r')
+    end--;
+  return end;
+}
+
+/* The row must be below n_rows and the index lock must be held or
+   the caller must run on the main thread */
+static void
+row_bounds (LazyCsvStore *csv_store,
+            gint64        row,
+            const gchar **start,
+            const gchar **end)
+{
+  const guint64 *offsets = (const guint64 *) csv_store->index->data;
+
+  *start = csv_store->data + offsets[row];
+  *end = line_end (*start, csv_store->data + offsets[row + 1]);
+}
+
+/* Scan the field at p. The field content is returned in start and
+   len, quoted tells whether it may contain doubled quotes. Returns
+   the start of the next field or NULL after the last field. */
+static const gchar *
+scan_field (const gchar  *p,
+            const gchar  *end,
+            gchar         delimiter,
+            const gchar **start,
+            gsize        *len,
+            gboolean     *quoted)
+{
+  const gchar *q;
+
+  if (p < end && *p == '"')
+    {
+      for (q = p + 1; q < end; q++)
+        if (*q == '"')
+          {
+            if (q + 1 < end && q[1] == '"')
+              q++;
+            else
+              break;
+          }
+      *start = p + 1;
+      *len = q - *start;
+      *quoted = TRUE;
+      /* Anything between the closing quote and the delimiter is dropped */
+      p = MIN (q + 1, end);
+      q = memchr (p, delimiter, end - p);
+      return q ? q + 1 : NULL;
+    }
+
+  q = memchr (p, delimiter, end - p);
+  *start = p;
+  *len = (q ? q : end) - p;
+  *quoted = FALSE;
+  return q ? q + 1 : NULL;
+}
+
+/* The field as plain string, doubled quotes are collapsed into
+   scratch. The result is not NUL terminated. */
+static const gchar *
+field_string (const gchar *start,
+              gsize       *len,
+              gboolean     quoted,
+              GString     *scratch)
+{
+  const gchar *p, *end = start + *len;
+
+  if (!quoted || memchr (start, '"', *len) == NULL)
+    return start;
+
+  g_string_truncate (scratch, 0);
+  for (p = start; p < end; p++)
+    {
+      g_string_append_c (scratch, *p);
+      if (*p == '"')
+        p++;
+    }
+  *len = scratch->len;
+  return scratch->str;
+}
+
+static guint
+count_fields (const gchar *start,
+              const gchar *end,
+              gchar        delimiter)
+{
+  const gchar *p = start, *field;
+  gsize len;
+  gboolean quoted;
+  guint n = 0;
+
+  if (start == end)
+    return 0;
+  do
+    {
+      p = scan_field (p, end, delimiter, &field, &len, &quoted);
+      n++;
+    }
+  while (p);
+  return n;
+}
+
+/* Indexing */
+
+static inline void
+add_row_start (GArray *starts,
+               guint64 offset,
+               gsize   length)
+{
+  if (offset < length)
+    g_array_append_val (starts, offset);
+}
+
+/* Collect the start of the row after every newline in [start, end).
+   With SSE2 16 bytes are compared at once and all newlines of them
+   are taken from the bit mask, which is faster than one memchr per
+   line for the typical short lines. */
+static GArray *
+scan_newlines (const gchar *data,
+               gsize        start,
+               gsize        end,
+               gsize        length)
+{
+  GArray *starts = g_array_sized_new (FALSE, FALSE, sizeof (guint64),
+                                      (end - start) / 64 + 1);
+  gsize i = start;
+
+#ifdef __SSE2__
+  const __m128i nl = _mm_set1_epi8 ('\n');
+
+  for (; i + 16 <= end; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (data + i));
+      guint mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, nl));
+
+      while (mask)
+        {
+          add_row_start (starts, i + g_bit_nth_lsf (mask, -1) + 1, length);
+          mask &= mask - 1;
+        }
+    }
+#endif
+  for (; i < end; i++)
+    if (data[i] == '\n')
+      add_row_start (starts, i + 1, length);
+
+  return starts;
+}
+
+/* The rows are complete up to the last known row start, the last row
+   ends with the data */
+static void
+update_n_rows (LazyCsvStore *csv_store)
+{
+  csv_store->n_rows = MAX ((gint64) csv_store->index->len - 1, 0);
+}
+
+static void
+finish_index (LazyCsvStore *csv_store)
+{
+  guint64 offset = csv_store->length;
+
+  g_array_append_val (csv_store->index, offset);
+  update_n_rows (csv_store);
+}
+
+static gboolean append_chunks_cb (gpointer user_data);
+static void     follow_update    (LazyCsvStore *csv_store);
+
+/* Runs on a worker thread */
+static void
+index_func (gpointer data,
+            gpointer user_data)
+{
+  LazyCsvStore *csv_store = user_data;
+  guint chunk = GPOINTER_TO_UINT (data) - 1;
+  gsize start = FIRST_CHUNK_SIZE + (gsize) chunk * INDEX_CHUNK_SIZE;
+  gsize end = MIN (start + INDEX_CHUNK_SIZE, csv_store->length);
+  GArray *starts;
+
+  if (g_atomic_int_get (&csv_store->cancelled))
+    return;
+
+  starts = scan_newlines (csv_store->data, start, end, csv_store->length);
+
+  g_mutex_lock (&csv_store->lock);
+  csv_store->results[chunk] = starts;
+  if (csv_store->idle == 0)
+    csv_store->idle = g_idle_add (append_chunks_cb, csv_store);
+  g_mutex_unlock (&csv_store->lock);
+}
+
+/* Append the finished chunks in file order and announce the rows */
+static gboolean
+append_chunks_cb (gpointer user_data)
+{
+  LazyCsvStore *csv_store = user_data;
+  gint64 old_n_rows = csv_store->n_rows;
+  gboolean done;
+
+  g_mutex_lock (&csv_store->lock);
+  csv_store->idle = 0;
+  while (csv_store->next_chunk < csv_store->n_chunks &&
+         csv_store->results[csv_store->next_chunk])
+    {
+      GArray *starts = csv_store->results[csv_store->next_chunk];
+
+      csv_store->results[csv_store->next_chunk] = NULL;
+      g_mutex_unlock (&csv_store->lock);
+
+      g_rw_lock_writer_lock (&csv_store->index_lock);
+      g_array_append_vals (csv_store->index, starts->data, starts->len);
+      csv_store->next_chunk++;
+      csv_store->indexed = MIN (FIRST_CHUNK_SIZE +
+                                (gsize) csv_store->next_chunk * INDEX_CHUNK_SIZE,
+                                csv_store->length);
+      if (csv_store->next_chunk == csv_store->n_chunks)
+        finish_index (csv_store);
+      else
+        update_n_rows (csv_store);
+      g_rw_lock_writer_unlock (&csv_store->index_lock);
+      g_array_free (starts, TRUE);
+
+      g_mutex_lock (&csv_store->lock);
+    }
+  done = csv_store->next_chunk == csv_store->n_chunks;
+  g_mutex_unlock (&csv_store->lock);
+
+  if (done)
+    {
+      g_thread_pool_free (csv_store->pool, FALSE, TRUE);
+      csv_store->pool = NULL;
+    }
+
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (csv_store),
+                                   old_n_rows, csv_store->n_rows - old_n_rows);
+  g_object_notify_by_pspec (G_OBJECT (csv_store), properties[PROP_PROGRESS]);
+  if (done)
+    g_object_notify_by_pspec (G_OBJECT (csv_store), properties[PROP_INDEXING]);
+  if (done && csv_store->follow_pending)
+    follow_update (csv_store);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Scan the first chunk now and the rest on the thread pool */
+static void
+start_index (LazyCsvStore *csv_store,
+             gboolean      has_header)
+{
+  gsize first = MIN (FIRST_CHUNK_SIZE, csv_store->length);
+  GArray *starts;
+  guint64 offset = 0;
+  guint i;
+
+  /* Without header the first row starts at 0, otherwise after the
+     first newline */
+  if (!has_header && csv_store->length)
+    g_array_append_val (csv_store->index, offset);
+  starts = scan_newlines (csv_store->data, 0, first, csv_store->length);
+  g_array_append_vals (csv_store->index, starts->data, starts->len);
+  g_array_free (starts, TRUE);
+  csv_store->indexed = first;
+
+  if (first == csv_store->length)
+    {
+      finish_index (csv_store);
+      return;
+    }
+  update_n_rows (csv_store);
+
+  csv_store->n_chunks = (csv_store->length - first + INDEX_CHUNK_SIZE - 1) / INDEX_CHUNK_SIZE;
+  csv_store->results = g_new0 (GArray *, csv_store->n_chunks);
+  csv_store->pool = g_thread_pool_new (index_func, csv_store,
+                                       g_get_num_processors (), FALSE, NULL);
+  for (i = 0; i < csv_store->n_chunks; i++)
+    g_thread_pool_push (csv_store->pool, GUINT_TO_POINTER (i + 1), NULL);
+}
+
+/* Open the file. A delimiter of 0 is guessed from the file name, tab
+   for .tsv and .tab files and comma otherwise. With has_header the
+   first line holds the column titles and is not a row. */
+LazyCsvStore *
+lazy_csv_store_new (const gchar  *filename,
+                    gchar         delimiter,
+                    gboolean      has_header,
+                    GError      **error)
+{
+  LazyCsvStore *csv_store;
+  GMappedFile *file;
+  const gchar *first, *end;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (file == NULL)
+    return NULL;
+
+  if (delimiter == '\0')
+    delimiter = (g_str_has_suffix (filename, ".tsv") ||
+                 g_str_has_suffix (filename, ".tab")) ? '\t' : ',';
+
+  csv_store = g_object_new (TYPE_LAZY_CSV_STORE, NULL);
+  csv_store->filename = g_strdup (filename);
+  csv_store->file = file;
+  csv_store->data = g_mapped_file_get_contents (file);
+  csv_store->length = g_mapped_file_get_length (file);
+  csv_store->delimiter = delimiter;
+
+  first = csv_store->data;
+  end = first + csv_store->length;
+  if (csv_store->length)
+    csv_store->n_columns = MAX (count_fields (first, line_end (first, end), delimiter), 1);
+  if (has_header && csv_store->length)
+    csv_store->header = first;
+  start_index (csv_store, has_header);
+
+  return csv_store;
+}
+
+/* Follow mode */
+
+/* Map the grown file and add the rows behind the old end */
+static void
+follow_update (LazyCsvStore *csv_store)
+{
+  GMappedFile *file, *old_file;
+  const gchar *data;
+  gsize length, old_length = csv_store->length;
+  gint64 old_n_rows = csv_store->n_rows;
+  gboolean open_row;
+  GArray *starts;
+
+  /* The index is completed first */
+  csv_store->follow_pending = csv_store->pool != NULL;
+  if (csv_store->follow_pending)
+    return;
+
+  file = g_mapped_file_new (csv_store->filename, FALSE, NULL);
+  if (file == NULL)
+    return;
+  length = g_mapped_file_get_length (file);
+  /* The columns of an empty file are unknown, a shorter file was
+     rewritten and is not followed */
+  if (old_length == 0 || length <= old_length)
+    {
+      g_mapped_file_unref (file);
+      return;
+    }
+  data = g_mapped_file_get_contents (file);
+
+  /* A row behind the final newline starts at the old end, a last row
+     without newline grows */
+  starts = scan_newlines (data, old_length, length, length);
+  open_row = data[old_length - 1] != '\n';
+  if (!open_row)
+    {
+      guint64 offset = old_length;
+
+      g_array_prepend_val (starts, offset);
+    }
+
+  g_rw_lock_writer_lock (&csv_store->index_lock);
+  old_file = csv_store->file;
+  csv_store->file = file;
+  csv_store->data = data;
+  csv_store->length = length;
+  csv_store->indexed = length;
+  if (csv_store->header)
+    csv_store->header = data;
+  /* Replace the end marker */
+  g_array_set_size (csv_store->index, csv_store->index->len - 1);
+  g_array_append_vals (csv_store->index, starts->data, starts->len);
+  finish_index (csv_store);
+  g_rw_lock_writer_unlock (&csv_store->index_lock);
+  g_mapped_file_unref (old_file);
+  g_array_free (starts, TRUE);
+
+  if (open_row && old_n_rows > 0 && old_n_rows - 1 <= G_MAXINT)
+    {
+      GtkTreePath *path = gtk_tree_path_new_from_indices ((gint) old_n_rows - 1, -1);
+      GtkTreeIter iter;
+
+      iter.stamp = csv_store->stamp;
+      iter_set_row (&iter, old_n_rows - 1);
+      gtk_tree_model_row_changed (GTK_TREE_MODEL (csv_store), path, &iter);
+      gtk_tree_path_free (path);
+    }
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (csv_store),
+                                   old_n_rows, csv_store->n_rows - old_n_rows);
+}
+
+static gboolean
+follow_timeout_cb (gpointer user_data)
+{
+  LazyCsvStore *csv_store = user_data;
+
+  csv_store->follow_timeout = 0;
+  follow_update (csv_store);
+  return G_SOURCE_REMOVE;
+}
+
+/* A writer may change the file thousands of times per second, the
+   changes are collected and handled together */
+static void
+monitor_changed_cb (GFileMonitor      *monitor,
+                    GFile             *file,
+                    GFile             *other_file,
+                    GFileMonitorEvent  event_type,
+                    LazyCsvStore      *csv_store)
+{
+  if (event_type != G_FILE_MONITOR_EVENT_CHANGED &&
+      event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+    return;
+  if (csv_store->follow_timeout == 0)
+    csv_store->follow_timeout = g_timeout_add (FOLLOW_INTERVAL, follow_timeout_cb, csv_store);
+}
+
+/* Watch the file and add rows which are appended to it, like tail -f.
+   Rows are only appended, other changes of the file are not
+   detected. */
+void
+lazy_csv_store_set_follow (LazyCsvStore *csv_store,
+                           gboolean      follow)
+{
+  g_return_if_fail (IS_LAZY_CSV_STORE (csv_store));
+
+  if (follow == (csv_store->monitor != NULL))
+    return;
+
+  if (!follow)
+    {
+      g_signal_handlers_disconnect_by_data (csv_store->monitor, csv_store);
+      g_file_monitor_cancel (csv_store->monitor);
+      g_clear_object (&csv_store->monitor);
+      if (csv_store->follow_timeout)
+        g_source_remove (csv_store->follow_timeout);
+      csv_store->follow_timeout = 0;
+      csv_store->follow_pending = FALSE;
+      return;
+    }
+
+  {
+    GFile *file = g_file_new_for_path (csv_store->filename);
+    GError *error = NULL;
+
+    csv_store->monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
+    g_object_unref (file);
+    if (csv_store->monitor == NULL)
+      {
+        g_warning ("Cannot follow %s: %s", csv_store->filename, error->message);
+        g_error_free (error);
+        return;
+      }
+    g_signal_connect (csv_store->monitor, "changed",
+                      G_CALLBACK (monitor_changed_cb), csv_store);
+  }
+  /* The file may have grown since it was opened */
+  follow_update (csv_store);
+}
+
+/* The indexed fraction of the file. Rows appear while the file is
+   indexed, see the indexing property. */
+gdouble
+lazy_csv_store_get_progress (LazyCsvStore *csv_store)
+{
+  g_return_val_if_fail (IS_LAZY_CSV_STORE (csv_store), 0.0);
+
+  if (csv_store->length == 0)
+    return 1.0;
+  return (gdouble) csv_store->indexed / csv_store->length;
+}
+
+/* Returns the title of the column from the header line or NULL. Free
+   it with g_free. */
+gchar *
+lazy_csv_store_get_column_title (LazyCsvStore *csv_store,
+                                 gint          column)
+{
+  const gchar *p, *end, *field;
+  gsize len;
+  gboolean quoted;
+  GString *scratch;
+  gchar *title;
+  gint col;
+
+  g_return_val_if_fail (IS_LAZY_CSV_STORE (csv_store), NULL);
+
+  if (csv_store->header == NULL || column < 0)
+    return NULL;
+
+  p = csv_store->header;
+  end = line_end (p, csv_store->data + csv_store->length);
+  for (col = 0; p; col++)
+    {
+      p = scan_field (p, end, csv_store->delimiter, &field, &len, &quoted);
+      if (col == column)
+        {
+          scratch = g_string_new (NULL);
+          field = field_string (field, &len, quoted, scratch);
+          title = g_strndup (field, len);
+          g_string_free (scratch, TRUE);
+          return title;
+        }
+    }
+  return NULL;
+}
+
+
+/* Fulfill the GtkTreeModel requirements */
+static GtkTreeModelFlags
+lazy_csv_store_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+lazy_csv_store_get_n_columns (GtkTreeModel *tree_model)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+
+  return csv_store->n_columns;
+}
+
+static GType
+lazy_csv_store_get_column_type (GtkTreeModel *tree_model,
+                                gint          index)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+
+  g_return_val_if_fail (index < csv_store->n_columns, G_TYPE_INVALID);
+
+  return G_TYPE_STRING;
+}
+
+static gboolean
+lazy_csv_store_get_iter (GtkTreeModel *tree_model,
+                         GtkTreeIter  *iter,
+                         GtkTreePath  *path)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+  gint i;
+
+  i = gtk_tree_path_get_indices (path)[0];
+
+  if (i < 0 || i >= csv_store->n_rows)
+    return FALSE;
+
+  iter->stamp = csv_store->stamp;
+  iter_set_row (iter, i);
+
+  return TRUE;
+}
+
+static GtkTreePath *
+lazy_csv_store_get_path (GtkTreeModel *tree_model,
+                         GtkTreeIter  *iter)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+  GtkTreePath *path;
+  gint64 row = iter_get_row (iter);
+
+  /* Paths can only address gint rows */
+  if (row >= csv_store->n_rows || row > G_MAXINT)
+    return NULL;
+  path = gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, row);
+  return path;
+}
+
+static void
+lazy_csv_store_get_value (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter,
+                          gint          column,
+                          GValue       *value)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+  gint64 row = iter_get_row (iter);
+  const gchar *p, *end, *field;
+  gsize len;
+  gboolean quoted;
+  gint col;
+
+  g_return_if_fail (column < csv_store->n_columns);
+  g_return_if_fail (row < csv_store->n_rows);
+
+  g_value_init (value, G_TYPE_STRING);
+
+  row_bounds (csv_store, row, &p, &end);
+  for (col = 0; p; col++)
+    {
+      p = scan_field (p, end, csv_store->delimiter, &field, &len, &quoted);
+      if (col == column)
+        {
+          GString *scratch = g_string_new (NULL);
+
+          field = field_string (field, &len, quoted, scratch);
+          g_value_take_string (value, g_strndup (field, len));
+          g_string_free (scratch, TRUE);
+          return;
+        }
+    }
+}
+
+static gboolean
+lazy_csv_store_iter_next (GtkTreeModel  *tree_model,
+                          GtkTreeIter   *iter)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+  gint64 row = iter_get_row (iter) + 1;
+
+  iter_set_row (iter, row);
+
+  if (row >= csv_store->n_rows)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+lazy_csv_store_iter_previous (GtkTreeModel *tree_model,
+                              GtkTreeIter  *iter)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+  gint64 row = iter_get_row (iter);
+
+  g_return_val_if_fail (csv_store->stamp == iter->stamp, FALSE);
+
+  if (row == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter_set_row (iter, row - 1);
+
+  return TRUE;
+}
+
+static gboolean
+lazy_csv_store_iter_children (GtkTreeModel *tree_model,
+                              GtkTreeIter  *iter,
+                              GtkTreeIter  *parent)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+
+  /* this is a list, nodes have no children */
+  if (parent || csv_store->n_rows == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->stamp = csv_store->stamp;
+  iter_set_row (iter, 0);
+  return TRUE;
+}
+
+static gboolean
+lazy_csv_store_iter_has_child (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+lazy_csv_store_iter_n_children (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+
+  /* GtkTreeModel is limited to gint rows */
+  if (iter == NULL)
+    return MIN (csv_store->n_rows, G_MAXINT);
+
+  g_return_val_if_fail (csv_store->stamp == iter->stamp, -1);
+
+  return 0;
+}
+
+static gboolean
+lazy_csv_store_iter_nth_child (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *parent,
+                               gint          n)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (tree_model);
+
+  iter->stamp = 0;
+
+  if (parent)
+    return FALSE;
+
+  if (n < 0 || n >= csv_store->n_rows)
+    return FALSE;
+
+  iter->stamp = csv_store->stamp;
+  iter_set_row (iter, n);
+
+  return TRUE;
+}
+
+static gboolean
+lazy_csv_store_iter_parent (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter,
+                            GtkTreeIter  *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+/* Fulfill the LazyBlockSource requirements. The mapping and the
+   index are not changed, so concurrent fetches are fine. */
+static void
+lazy_csv_store_fetch_block (LazyBlockSource *source,
+                            LazyBlock       *block)
+{
+  LazyCsvStore *csv_store = LAZY_CSV_STORE (source);
+  GString *scratch = g_string_new (NULL);
+  gint64 row_end, row;
+  gint col_end, col;
+
+  g_rw_lock_reader_lock (&csv_store->index_lock);
+  row_end = MIN (block->row0 + block->n_rows, csv_store->n_rows);
+  col_end = MIN ((guint) (block->col0 + block->n_cols), csv_store->n_columns);
+
+  for (row = block->row0; row < row_end; row++)
+    {
+      const gchar *p, *end, *field;
+      gsize len;
+      gboolean quoted;
+
+      row_bounds (csv_store, row, &p, &end);
+      for (col = 0; p && col < col_end; col++)
+        {
+          p = scan_field (p, end, csv_store->delimiter, &field, &len, &quoted);
+          if (col >= block->col0)
+            {
+              field = field_string (field, &len, quoted, scratch);
+              lazy_block_set (block, row, col, field, len);
+            }
+        }
+    }
+  g_rw_lock_reader_unlock (&csv_store->index_lock);
+  g_string_free (scratch, TRUE);
+}
+
+/* Called on the main thread, which is the only writer */
+static gint64
+lazy_csv_store_get_n_rows (LazyBlockSource *source)
+{
+  return LAZY_CSV_STORE (source)->n_rows;
+}
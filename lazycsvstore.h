@@ -0,0 +1,56 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_CSV_STORE_H__
+#define __LAZY_CSV_STORE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_CSV_STORE             (lazy_csv_store_get_type ())
+#define LAZY_CSV_STORE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_CSV_STORE, LazyCsvStore))
+#define LAZY_CSV_STORE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_CSV_STORE, LazyCsvStoreClass))
+#define IS_LAZY_CSV_STORE(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_CSV_STORE))
+#define IS_LAZY_CSV_STORE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_CSV_STORE))
+#define LAZY_CSV_STORE_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_CSV_STORE, LazyCsvStoreClass))
+
+typedef struct _LazyCsvStore           LazyCsvStore;
+typedef struct _LazyCsvStoreClass      LazyCsvStoreClass;
+
+struct _LazyCsvStoreClass
+{
+  GObjectClass parent_class;
+
+};
+
+GType         lazy_csv_store_get_type         (void) G_GNUC_CONST;
+
+LazyCsvStore *lazy_csv_store_new              (const gchar   *filename,
+                                               gchar          delimiter,
+                                               gboolean       has_header,
+                                               GError       **error);
+
+void          lazy_csv_store_set_follow       (LazyCsvStore  *csv_store,
+                                               gboolean       follow);
+gdouble       lazy_csv_store_get_progress     (LazyCsvStore  *csv_store);
+gchar        *lazy_csv_store_get_column_title (LazyCsvStore  *csv_store,
+                                               gint           column);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_CSV_STORE_H__ */
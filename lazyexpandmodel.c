@@ -0,0 +1,1121 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The expand model shows a hierarchical child model as a flat list of
+   its visible rows: the top level rows and, after each expanded row,
+   its children. The view stays a list view, rows of the expand model
+   are inserted and deleted as rows are expanded and collapsed.
+
+   Nothing is read from the child before it is shown. The children of
+   a row are only counted when it is expanded and their cells are only
+   fetched when they become visible.
+
+   The visible rows are kept as segments, runs of consecutive children
+   of one parent, in a treap ordered by position with the number of
+   rows in each subtree. Expanding a row splits the segment of the row
+   and inserts one segment for all its children, collapsing cuts out
+   the range of its descendants and joins the two halves again. Finding
+   the row at a position and both changes take O(log n) in the number
+   of expanded rows, independent of how many children were shown.
+   The position of a child row is found in the same treap, comparing
+   it with a segment through their closest common expanded row.
+
+   The cells are fetched through GtkTreeModel calls on the child, with
+   the async fetch of the view on a worker thread. This requires a
+   child whose iters persist and which may be read from other threads,
+   as LazyStore. Keep the async fetch of the view off for children like
+   GtkTreeStore. */
+
+#include <gtk/gtk.h>
+#include "lazyexpandmodel.h"
+#include "lazyblocksource.h"
+
+/* Indentation per level and the expanders of the first column */
+#define INDENT          "  "
+#define EXPANDER_CLOSED "\xe2\x96\xb8 "   /* ▸ */
+#define EXPANDER_OPEN   "\xe2\x96\xbe "   /* ▾ */
+#define EXPANDER_NONE   "  "
+
+typedef struct _Node    Node;
+typedef struct _Segment Segment;
+
+/* An expanded row, or the root whose children are the top level */
+struct _Node
+{
+  Node *parent;          /* NULL for the root */
+  GtkTreeIter iter;      /* Of the child model, unset for the root */
+  gint64 index;          /* Among the children of the parent */
+  gint depth;            /* Of the children, 0 for the root */
+  gint64 n_children;
+  gint64 n_visible;      /* Shown descendants */
+  GHashTable *expanded;  /* Index -> expanded child Node */
+};
+
+/* A run of consecutive children of one node */
+struct _Segment
+{
+  Node *node;
+  gint64 first;          /* Index of the first row among the children */
+  gint64 count;
+  gint64 size;           /* Rows in this subtree of the treap */
+  guint priority;
+  Segment *left;
+  Segment *right;
+};
+
+struct _LazyExpandModel
+{
+  GObject parent;
+
+  /* private */
+  GtkTreeModel *child;
+  gboolean tree;         /* The child has more than a top level */
+  Node *root;
+  Segment *segments;     /* The treap */
+  /* Taken for writing while the segments change, worker threads
+     fetching blocks hold it for reading */
+  GRWLock lock;
+  gint stamp;
+};
+
+/* The row id is 64 bit, see lazystore.c */
+static inline gint64
+iter_get_row (GtkTreeIter *iter)
+{
+  return (gint64) (((guint64) GPOINTER_TO_UINT (iter->user_data2) << 32) |
+                   GPOINTER_TO_UINT (iter->user_data));
+}
+
+static inline void
+iter_set_row (GtkTreeIter *iter,
+              gint64       row)
+{
+  iter->user_data = GUINT_TO_POINTER ((guint) ((guint64) row & 0xffffffff));
+  iter->user_data2 = GUINT_TO_POINTER ((guint) ((guint64) row >> 32));
+}
+
+static void         lazy_expand_model_tree_model_init (GtkTreeModelIface *iface);
+static GtkTreeModelFlags lazy_expand_model_get_flags  (GtkTreeModel      *tree_model);
+static gint         lazy_expand_model_get_n_columns   (GtkTreeModel      *tree_model);
+static GType        lazy_expand_model_get_column_type (GtkTreeModel      *tree_model,
+                                                       gint               index);
+static gboolean     lazy_expand_model_get_iter        (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreePath       *path);
+static GtkTreePath *lazy_expand_model_get_path        (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static void         lazy_expand_model_get_value       (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       gint               column,
+                                                       GValue            *value);
+static gboolean     lazy_expand_model_iter_next       (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_expand_model_iter_previous   (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_expand_model_iter_children   (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent);
+static gboolean     lazy_expand_model_iter_has_child  (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gint         lazy_expand_model_iter_n_children (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_expand_model_iter_nth_child  (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent,
+                                                       gint               n);
+static gboolean     lazy_expand_model_iter_parent     (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *child);
+
+static void         lazy_expand_model_block_source_init (LazyBlockSourceInterface *iface);
+static void         lazy_expand_model_fetch_block     (LazyBlockSource   *source,
+                                                       LazyBlock         *block);
+static gint64       lazy_expand_model_get_n_rows      (LazyBlockSource   *source);
+
+static void         lazy_expand_model_finalize        (GObject           *object);
+
+G_DEFINE_TYPE_WITH_CODE (LazyExpandModel, lazy_expand_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                lazy_expand_model_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (TYPE_LAZY_BLOCK_SOURCE,
+                                                lazy_expand_model_block_source_init))
+
+
+/* The treap of segments */
+
+static inline gint64
+segment_size (Segment *segment)
+{
+  return segment ? segment->size : 0;
+}
+
+static inline void
+segment_update (Segment *segment)
+{
+  segment->size = segment_size (segment->left) + segment->count +
+    segment_size (segment->right);
+}
+
+static Segment *
+segment_new (Node   *node,
+             gint64  first,
+             gint64  count)
+{
+  Segment *segment = g_slice_new0 (Segment);
+
+  segment->node = node;
+  segment->first = first;
+  segment->count = count;
+  segment->size = count;
+  segment->priority = g_random_int ();
+  return segment;
+}
+
+static void
+segments_free (Segment *segment)
+{
+  if (segment == NULL)
+    return;
+  segments_free (segment->left);
+  segments_free (segment->right);
+  g_slice_free (Segment, segment);
+}
+
+/* All rows of a, then all rows of b */
+static Segment *
+segments_join (Segment *a,
+               Segment *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (a->priority > b->priority)
+    {
+      a->right = segments_join (a->right, b);
+      segment_update (a);
+      return a;
+    }
+  b->left = segments_join (a, b->left);
+  segment_update (b);
+  return b;
+}
+
+/* The first n rows to a, the rest to b. A segment across the cut
+   is cut in two. */
+static void
+segments_split (Segment  *segment,
+                gint64    n,
+                Segment **a,
+                Segment **b)
+{
+  gint64 left;
+
+  if (segment == NULL)
+    {
+      *a = *b = NULL;
+      return;
+    }
+
+  left = segment_size (segment->left);
+  if (n <= left)
+    {
+      segments_split (segment->left, n, a, &segment->left);
+      segment_update (segment);
+      *b = segment;
+    }
+  else if (n >= left + segment->count)
+    {
+      segments_split (segment->right, n - left - segment->count, &segment->right, b);
+      segment_update (segment);
+      *a = segment;
+    }
+  else
+    {
+      gint64 head = n - left;
+      Segment *tail = segment_new (segment->node, segment->first + head,
+                                   segment->count - head);
+      Segment *right = segment->right;
+
+      /* The head stays, the tail is joined to the right subtree by
+         its own priority */
+      segment->right = NULL;
+      segment->count = head;
+      segment_update (segment);
+      *a = segment;
+      *b = segments_join (tail, right);
+    }
+}
+
+/* The segment holding the row and the offset of the row in it */
+static Segment *
+segments_find (Segment *segment,
+               gint64   row,
+               gint64  *offset)
+{
+  while (segment)
+    {
+      gint64 left = segment_size (segment->left);
+
+      if (row < left)
+        segment = segment->left;
+      else if (row < left + segment->count)
+        {
+          *offset = row - left;
+          return segment;
+        }
+      else
+        {
+          row -= left + segment->count;
+          segment = segment->right;
+        }
+    }
+  return NULL;
+}
+
+/* Where the child index of node is shown relative to the segment:
+   negative before it, 0 in it, positive after it. Both are moved up
+   to their closest common node first. */
+static gint
+segment_compare (Segment *segment,
+                 Node    *node,
+                 gint64   index)
+{
+  Node *other = segment->node;
+  gint64 first = segment->first;
+  gint64 last = segment->first + segment->count - 1;
+  gboolean below = FALSE, other_below = FALSE;
+
+  while (node->depth > other->depth)
+    {
+      index = node->index;
+      node = node->parent;
+      below = TRUE;
+    }
+  while (other->depth > node->depth)
+    {
+      first = last = other->index;
+      other = other->parent;
+      other_below = TRUE;
+    }
+  while (node != other)
+    {
+      index = node->index;
+      node = node->parent;
+      below = TRUE;
+      first = last = other->index;
+      other = other->parent;
+      other_below = TRUE;
+    }
+
+  if (index < first)
+    return -1;
+  if (index > last)
+    return 1;
+  /* Descendants follow their ancestor row */
+  if (below)
+    return 1;
+  return other_below ? -1 : 0;
+}
+
+/* The row the child index of node is shown at, -1 if it is hidden */
+static gint64
+segments_position (Segment *segment,
+                   Node    *node,
+                   gint64   index)
+{
+  gint64 position = 0;
+
+  while (segment)
+    {
+      gint cmp = segment_compare (segment, node, index);
+
+      if (cmp < 0)
+        segment = segment->left;
+      else if (cmp == 0)
+        return position + segment_size (segment->left) + index - segment->first;
+      else
+        {
+          position += segment_size (segment->left) + segment->count;
+          segment = segment->right;
+        }
+    }
+  return -1;
+}
+
+static Segment *
+segments_last (Segment *segment)
+{
+  while (segment && segment->right)
+    segment = segment->right;
+  return segment;
+}
+
+/* Join a and b and merge the segments at the seam if they continue
+   the same children */
+static Segment *
+segments_join_merged (Segment *a,
+                      Segment *b)
+{
+  Segment *last = segments_last (a);
+  Segment *first = b;
+  Segment *rest;
+
+  while (first && first->left)
+    first = first->left;
+  if (last && first && last->node == first->node &&
+      last->first + last->count == first->first)
+    {
+      gint64 count = first->count;
+
+      segments_split (b, count, &first, &rest);
+      segments_free (first);
+      segments_split (a, segment_size (a) - last->count, &a, &last);
+      last->count += count;
+      segment_update (last);
+      b = segments_join (last, rest);
+    }
+  return segments_join (a, b);
+}
+
+
+/* Expanded rows */
+
+static Node *
+node_new (Node              *parent,
+          const GtkTreeIter *iter,
+          gint64             index,
+          gint64             n_children)
+{
+  Node *node = g_slice_new0 (Node);
+
+  node->parent = parent;
+  if (iter)
+    node->iter = *iter;
+  node->index = index;
+  node->depth = parent ? parent->depth + 1 : 0;
+  node->n_children = n_children;
+  node->n_visible = n_children;
+  return node;
+}
+
+static void
+node_free (Node *node)
+{
+  if (node->expanded)
+    {
+      GHashTableIter iter;
+      gpointer value;
+
+      g_hash_table_iter_init (&iter, node->expanded);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        node_free (value);
+      g_hash_table_destroy (node->expanded);
+    }
+  g_slice_free (Node, node);
+}
+
+static Node *
+node_get_expanded (Node   *node,
+                   gint64  index)
+{
+  if (node->expanded == NULL)
+    return NULL;
+  return g_hash_table_lookup (node->expanded, &index);
+}
+
+/* The row as a child of its parent node */
+static Node *
+find_row (LazyExpandModel *expand_model,
+          gint64           row,
+          gint64          *index)
+{
+  gint64 offset;
+  Segment *segment = segments_find (expand_model->segments, row, &offset);
+
+  if (segment == NULL)
+    return NULL;
+  *index = segment->first + offset;
+  return segment->node;
+}
+
+static gboolean
+get_child_iter (LazyExpandModel *expand_model,
+                Node            *node,
+                gint64           index,
+                GtkTreeIter     *child_iter)
+{
+  /* GtkTreeModel can only address gint children */
+  if (index > G_MAXINT)
+    return FALSE;
+  return gtk_tree_model_iter_nth_child (expand_model->child, child_iter,
+                                        node->parent ? &node->iter : NULL,
+                                        index);
+}
+
+/* Forget all expanded rows and show the top level of the child */
+static void
+reset (LazyExpandModel *expand_model)
+{
+  gint64 n_rows = lazy_block_n_rows (expand_model->child);
+
+  g_rw_lock_writer_lock (&expand_model->lock);
+  segments_free (expand_model->segments);
+  if (expand_model->root)
+    node_free (expand_model->root);
+  expand_model->root = node_new (NULL, NULL, -1, n_rows);
+  expand_model->segments = n_rows > 0 ? segment_new (expand_model->root, 0, n_rows) : NULL;
+  g_rw_lock_writer_unlock (&expand_model->lock);
+}
+
+
+static void
+lazy_expand_model_class_init (LazyExpandModelClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->finalize = lazy_expand_model_finalize;
+}
+
+static void
+lazy_expand_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = lazy_expand_model_get_flags;
+  iface->get_n_columns = lazy_expand_model_get_n_columns;
+  iface->get_column_type = lazy_expand_model_get_column_type;
+  iface->get_iter = lazy_expand_model_get_iter;
+  iface->get_path = lazy_expand_model_get_path;
+  iface->get_value = lazy_expand_model_get_value;
+  iface->iter_next = lazy_expand_model_iter_next;
+  iface->iter_previous = lazy_expand_model_iter_previous;
+  iface->iter_children = lazy_expand_model_iter_children;
+  iface->iter_has_child = lazy_expand_model_iter_has_child;
+  iface->iter_n_children = lazy_expand_model_iter_n_children;
+  iface->iter_nth_child = lazy_expand_model_iter_nth_child;
+  iface->iter_parent = lazy_expand_model_iter_parent;
+}
+
+static void
+lazy_expand_model_block_source_init (LazyBlockSourceInterface *iface)
+{
+  iface->fetch_block = lazy_expand_model_fetch_block;
+  iface->get_n_rows = lazy_expand_model_get_n_rows;
+}
+
+static void
+lazy_expand_model_init (LazyExpandModel *expand_model)
+{
+  expand_model->stamp = g_random_int ();
+  g_rw_lock_init (&expand_model->lock);
+}
+
+static void
+lazy_expand_model_finalize (GObject *object)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (object);
+
+  if (expand_model->child)
+    {
+      g_signal_handlers_disconnect_by_data (expand_model->child, expand_model);
+      g_object_unref (expand_model->child);
+    }
+  segments_free (expand_model->segments);
+  if (expand_model->root)
+    node_free (expand_model->root);
+  g_rw_lock_clear (&expand_model->lock);
+
+  G_OBJECT_CLASS (lazy_expand_model_parent_class)->finalize (object);
+}
+
+
+/* Changes of the child */
+
+/* Rows appended to the top level continue the last segment or follow
+   it, everything else collapses all rows */
+static void
+child_rows_inserted_cb (LazyBlockSource *child,
+                        gint64           row,
+                        gint64           n_rows,
+                        LazyExpandModel *expand_model)
+{
+  Node *root = expand_model->root;
+  gint64 position;
+  Segment *last;
+
+  if (row != root->n_children)
+    {
+      lazy_expand_model_collapse_all (expand_model);
+      return;
+    }
+
+  g_rw_lock_writer_lock (&expand_model->lock);
+  position = segment_size (expand_model->segments);
+  last = segments_last (expand_model->segments);
+  if (last && last->node == root && last->first + last->count == row)
+    {
+      Segment *segment;
+
+      /* The last segment is on the right spine */
+      last->count += n_rows;
+      for (segment = expand_model->segments; segment; segment = segment->right)
+        segment->size += n_rows;
+    }
+  else
+    expand_model->segments = segments_join (expand_model->segments,
+                                            segment_new (root, row, n_rows));
+  root->n_children += n_rows;
+  root->n_visible += n_rows;
+  g_rw_lock_writer_unlock (&expand_model->lock);
+
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (expand_model), position, n_rows);
+}
+
+static void
+child_changed_cb (GObject         *child,
+                  LazyExpandModel *expand_model)
+{
+  lazy_expand_model_collapse_all (expand_model);
+}
+
+/* A changed child row is announced at the row it is shown at, rows
+   below a collapsed row are not shown */
+static void
+child_row_changed_cb (GtkTreeModel    *child,
+                      GtkTreePath     *child_path,
+                      GtkTreeIter     *child_iter,
+                      LazyExpandModel *expand_model)
+{
+  gint depth = gtk_tree_path_get_depth (child_path);
+  gint *indices = gtk_tree_path_get_indices (child_path);
+  Node *node = expand_model->root;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  gint64 row;
+  gint i;
+
+  for (i = 0; node && i < depth - 1; i++)
+    node = node_get_expanded (node, indices[i]);
+  if (node == NULL || depth < 1)
+    return;
+  row = segments_position (expand_model->segments, node, indices[depth - 1]);
+  if (row < 0 || row > G_MAXINT)
+    return;
+
+  path = gtk_tree_path_new_from_indices ((gint) row, -1);
+  iter.stamp = expand_model->stamp;
+  iter_set_row (&iter, row);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (expand_model), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+LazyExpandModel *
+lazy_expand_model_new (GtkTreeModel *child_model)
+{
+  LazyExpandModel *expand_model;
+  GtkTreeModelFlags flags;
+
+  g_return_val_if_fail (GTK_IS_TREE_MODEL (child_model), NULL);
+
+  flags = gtk_tree_model_get_flags (child_model);
+  g_return_val_if_fail (flags & GTK_TREE_MODEL_ITERS_PERSIST, NULL);
+
+  expand_model = g_object_new (TYPE_LAZY_EXPAND_MODEL, NULL);
+  expand_model->child = g_object_ref (child_model);
+  expand_model->tree = !(flags & GTK_TREE_MODEL_LIST_ONLY);
+  reset (expand_model);
+
+  if (IS_LAZY_BLOCK_SOURCE (child_model))
+    {
+      g_signal_connect (child_model, "rows-inserted",
+                        G_CALLBACK (child_rows_inserted_cb), expand_model);
+      g_signal_connect (child_model, "rows-deleted",
+                        G_CALLBACK (child_changed_cb), expand_model);
+      g_signal_connect (child_model, "reordered",
+                        G_CALLBACK (child_changed_cb), expand_model);
+      g_signal_connect (child_model, "reset",
+                        G_CALLBACK (child_changed_cb), expand_model);
+    }
+  else
+    {
+      g_signal_connect (child_model, "row-inserted",
+                        G_CALLBACK (child_changed_cb), expand_model);
+      g_signal_connect (child_model, "row-deleted",
+                        G_CALLBACK (child_changed_cb), expand_model);
+      g_signal_connect (child_model, "rows-reordered",
+                        G_CALLBACK (child_changed_cb), expand_model);
+      g_signal_connect (child_model, "row-has-child-toggled",
+                        G_CALLBACK (child_changed_cb), expand_model);
+    }
+  g_signal_connect (child_model, "row-changed",
+                    G_CALLBACK (child_row_changed_cb), expand_model);
+
+  return expand_model;
+}
+
+GtkTreeModel *
+lazy_expand_model_get_model (LazyExpandModel *expand_model)
+{
+  g_return_val_if_fail (IS_LAZY_EXPAND_MODEL (expand_model), NULL);
+
+  return expand_model->child;
+}
+
+/* Show the children of the row after it. Their number is asked from
+   the child now, their cells when they are drawn. */
+gboolean
+lazy_expand_model_expand_row (LazyExpandModel *expand_model,
+                              gint64           row)
+{
+  Node *parent, *node, *ancestor;
+  GtkTreeIter child_iter;
+  Segment *a, *b;
+  gint64 index;
+  gint n_children;
+
+  g_return_val_if_fail (IS_LAZY_EXPAND_MODEL (expand_model), FALSE);
+
+  parent = find_row (expand_model, row, &index);
+  if (parent == NULL)
+    return FALSE;
+  if (node_get_expanded (parent, index))
+    return TRUE;
+  if (!get_child_iter (expand_model, parent, index, &child_iter))
+    return FALSE;
+  n_children = gtk_tree_model_iter_n_children (expand_model->child, &child_iter);
+  if (n_children <= 0)
+    return FALSE;
+
+  node = node_new (parent, &child_iter, index, n_children);
+
+  g_rw_lock_writer_lock (&expand_model->lock);
+  if (parent->expanded == NULL)
+    parent->expanded = g_hash_table_new (g_int64_hash, g_int64_equal);
+  g_hash_table_insert (parent->expanded, &node->index, node);
+  segments_split (expand_model->segments, row + 1, &a, &b);
+  expand_model->segments = segments_join (segments_join (a, segment_new (node, 0, n_children)), b);
+  for (ancestor = parent; ancestor; ancestor = ancestor->parent)
+    ancestor->n_visible += n_children;
+  g_rw_lock_writer_unlock (&expand_model->lock);
+
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (expand_model), row + 1, n_children);
+  return TRUE;
+}
+
+/* Hide all descendants of the row */
+gboolean
+lazy_expand_model_collapse_row (LazyExpandModel *expand_model,
+                                gint64           row)
+{
+  Node *parent, *node, *ancestor;
+  Segment *a, *b, *descendants;
+  gint64 index, n_visible;
+
+  g_return_val_if_fail (IS_LAZY_EXPAND_MODEL (expand_model), FALSE);
+
+  parent = find_row (expand_model, row, &index);
+  if (parent == NULL)
+    return FALSE;
+  node = node_get_expanded (parent, index);
+  if (node == NULL)
+    return FALSE;
+  n_visible = node->n_visible;
+
+  g_rw_lock_writer_lock (&expand_model->lock);
+  segments_split (expand_model->segments, row + 1, &a, &b);
+  segments_split (b, n_visible, &descendants, &b);
+  segments_free (descendants);
+  /* The row was split from its following siblings on expanding */
+  expand_model->segments = segments_join_merged (a, b);
+  for (ancestor = parent; ancestor; ancestor = ancestor->parent)
+    ancestor->n_visible -= n_visible;
+  g_hash_table_remove (parent->expanded, &index);
+  node_free (node);
+  g_rw_lock_writer_unlock (&expand_model->lock);
+
+  lazy_block_source_rows_deleted (LAZY_BLOCK_SOURCE (expand_model), row + 1, n_visible);
+  return TRUE;
+}
+
+gboolean
+lazy_expand_model_toggle_row (LazyExpandModel *expand_model,
+                              gint64           row)
+{
+  g_return_val_if_fail (IS_LAZY_EXPAND_MODEL (expand_model), FALSE);
+
+  if (lazy_expand_model_row_expanded (expand_model, row))
+    return lazy_expand_model_collapse_row (expand_model, row);
+  return lazy_expand_model_expand_row (expand_model, row);
+}
+
+void
+lazy_expand_model_collapse_all (LazyExpandModel *expand_model)
+{
+  g_return_if_fail (IS_LAZY_EXPAND_MODEL (expand_model));
+
+  reset (expand_model);
+  lazy_block_source_reset (LAZY_BLOCK_SOURCE (expand_model));
+}
+
+gboolean
+lazy_expand_model_row_expanded (LazyExpandModel *expand_model,
+                                gint64           row)
+{
+  Node *parent;
+  gint64 index;
+
+  g_return_val_if_fail (IS_LAZY_EXPAND_MODEL (expand_model), FALSE);
+
+  parent = find_row (expand_model, row, &index);
+  return parent && node_get_expanded (parent, index);
+}
+
+/* The level of the row in the child, 0 for the top level, -1 for
+   rows out of range */
+gint
+lazy_expand_model_get_depth (LazyExpandModel *expand_model,
+                             gint64           row)
+{
+  Node *parent;
+  gint64 index;
+
+  g_return_val_if_fail (IS_LAZY_EXPAND_MODEL (expand_model), -1);
+
+  parent = find_row (expand_model, row, &index);
+  return parent ? parent->depth : -1;
+}
+
+gboolean
+lazy_expand_model_convert_row_to_child_iter (LazyExpandModel *expand_model,
+                                             gint64           row,
+                                             GtkTreeIter     *child_iter)
+{
+  Node *parent;
+  gint64 index;
+
+  g_return_val_if_fail (IS_LAZY_EXPAND_MODEL (expand_model), FALSE);
+  g_return_val_if_fail (child_iter != NULL, FALSE);
+
+  parent = find_row (expand_model, row, &index);
+  return parent && get_child_iter (expand_model, parent, index, child_iter);
+}
+
+
+/* Fulfill the GtkTreeModel requirements */
+static GtkTreeModelFlags
+lazy_expand_model_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+lazy_expand_model_get_n_columns (GtkTreeModel *tree_model)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+
+  return gtk_tree_model_get_n_columns (expand_model->child);
+}
+
+static GType
+lazy_expand_model_get_column_type (GtkTreeModel *tree_model,
+                                   gint          index)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+
+  return gtk_tree_model_get_column_type (expand_model->child, index);
+}
+
+static gboolean
+lazy_expand_model_get_iter (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter,
+                            GtkTreePath  *path)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+  gint i;
+
+  i = gtk_tree_path_get_indices (path)[0];
+  if (i < 0 || i >= lazy_expand_model_get_n_rows (LAZY_BLOCK_SOURCE (expand_model)))
+    return FALSE;
+
+  iter->stamp = expand_model->stamp;
+  iter_set_row (iter, i);
+  return TRUE;
+}
+
+static GtkTreePath *
+lazy_expand_model_get_path (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter)
+{
+  GtkTreePath *path;
+  gint64 row = iter_get_row (iter);
+
+  /* Paths can only address gint rows */
+  if (row > G_MAXINT)
+    return NULL;
+
+  path = gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, row);
+  return path;
+}
+
+/* The plain value of the child, the tree decoration of the first
+   column is only added to fetched blocks */
+static void
+lazy_expand_model_get_value (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             gint          column,
+                             GValue       *value)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+  GtkTreeIter child_iter;
+
+  if (lazy_expand_model_convert_row_to_child_iter (expand_model, iter_get_row (iter), &child_iter))
+    gtk_tree_model_get_value (expand_model->child, &child_iter, column, value);
+  else
+    g_value_init (value, gtk_tree_model_get_column_type (expand_model->child, column));
+}
+
+static gboolean
+lazy_expand_model_iter_next (GtkTreeModel  *tree_model,
+                             GtkTreeIter   *iter)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+  gint64 row = iter_get_row (iter) + 1;
+
+  iter_set_row (iter, row);
+  if (row >= lazy_expand_model_get_n_rows (LAZY_BLOCK_SOURCE (expand_model)))
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+lazy_expand_model_iter_previous (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+  gint64 row = iter_get_row (iter);
+
+  g_return_val_if_fail (expand_model->stamp == iter->stamp, FALSE);
+
+  if (row == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  iter_set_row (iter, row - 1);
+  return TRUE;
+}
+
+static gboolean
+lazy_expand_model_iter_children (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter,
+                                 GtkTreeIter  *parent)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+
+  /* this is a list, nodes have no children */
+  if (parent || lazy_expand_model_get_n_rows (LAZY_BLOCK_SOURCE (expand_model)) == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->stamp = expand_model->stamp;
+  iter_set_row (iter, 0);
+  return TRUE;
+}
+
+static gboolean
+lazy_expand_model_iter_has_child (GtkTreeModel *tree_model,
+                                  GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+lazy_expand_model_iter_n_children (GtkTreeModel *tree_model,
+                                   GtkTreeIter  *iter)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+
+  if (iter == NULL)
+    return MIN (lazy_expand_model_get_n_rows (LAZY_BLOCK_SOURCE (expand_model)), G_MAXINT);
+
+  g_return_val_if_fail (expand_model->stamp == iter->stamp, -1);
+  return 0;
+}
+
+static gboolean
+lazy_expand_model_iter_nth_child (GtkTreeModel *tree_model,
+                                  GtkTreeIter  *iter,
+                                  GtkTreeIter  *parent,
+                                  gint          n)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (tree_model);
+
+  iter->stamp = 0;
+  if (parent)
+    return FALSE;
+  if (n < 0 || n >= lazy_expand_model_get_n_rows (LAZY_BLOCK_SOURCE (expand_model)))
+    return FALSE;
+
+  iter->stamp = expand_model->stamp;
+  iter_set_row (iter, n);
+  return TRUE;
+}
+
+static gboolean
+lazy_expand_model_iter_parent (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+/* Fulfill the LazyBlockSource requirements */
+
+/* Indentation and expander in front of the first column */
+static void
+set_first_cell (LazyExpandModel *expand_model,
+                LazyBlock       *block,
+                gint64           row,
+                Node            *node,
+                gint64           index,
+                GtkTreeIter     *child_iter,
+                const gchar     *text)
+{
+  GString *cell;
+  gint i;
+
+  if (!expand_model->tree)
+    {
+      lazy_block_set (block, row, 0, text ? text : "", -1);
+      return;
+    }
+
+  cell = g_string_new (NULL);
+  for (i = 0; i < node->depth; i++)
+    g_string_append (cell, INDENT);
+  if (node_get_expanded (node, index))
+    g_string_append (cell, EXPANDER_OPEN);
+  else if (child_iter && gtk_tree_model_iter_has_child (expand_model->child, child_iter))
+    g_string_append (cell, EXPANDER_CLOSED);
+  else
+    g_string_append (cell, EXPANDER_NONE);
+  if (text)
+    g_string_append (cell, text);
+  lazy_block_set (block, row, 0, cell->str, cell->len);
+  g_string_free (cell, TRUE);
+}
+
+/* n rows of the block from the children of node starting at index */
+static void
+fetch_run (LazyExpandModel *expand_model,
+           LazyBlock       *block,
+           gint64           row,
+           Node            *node,
+           gint64           index,
+           gint64           n)
+{
+  GtkTreeIter child_iter;
+  gboolean valid;
+  gint64 r;
+  gint c;
+
+  /* The top level of a block source is fetched in one piece */
+  if (node->parent == NULL && IS_LAZY_BLOCK_SOURCE (expand_model->child))
+    {
+      LazyBlock *child_block = lazy_block_new ();
+
+      lazy_block_reset (child_block, index, n, block->col0, block->n_cols);
+      lazy_block_source_fetch_block (LAZY_BLOCK_SOURCE (expand_model->child), child_block);
+      for (r = 0; r < n; r++)
+        for (c = block->col0; c < block->col0 + block->n_cols; c++)
+          {
+            const gchar *text = lazy_block_get (child_block, index + r, c);
+
+            if (c > 0)
+              lazy_block_set (block, row + r, c, text, -1);
+            else
+              {
+                valid = get_child_iter (expand_model, node, index + r, &child_iter);
+                set_first_cell (expand_model, block, row + r, node, index + r,
+                                valid ? &child_iter : NULL, text);
+              }
+          }
+      lazy_block_free (child_block);
+      return;
+    }
+
+  valid = get_child_iter (expand_model, node, index, &child_iter);
+  for (r = 0; valid && r < n; r++)
+    {
+      for (c = block->col0; c < block->col0 + block->n_cols; c++)
+        {
+          GValue val = G_VALUE_INIT;
+          GValue text = G_VALUE_INIT;
+
+          gtk_tree_model_get_value (expand_model->child, &child_iter, c, &val);
+          /* Other types are shown the way GValue transforms them */
+          g_value_init (&text, G_TYPE_STRING);
+          if (!g_value_transform (&val, &text))
+            g_value_set_string (&text, NULL);
+          if (c > 0)
+            lazy_block_set (block, row + r, c, g_value_get_string (&text), -1);
+          else
+            set_first_cell (expand_model, block, row + r, node, index + r,
+                            &child_iter, g_value_get_string (&text));
+          g_value_unset (&text);
+          g_value_unset (&val);
+        }
+      valid = gtk_tree_model_iter_next (expand_model->child, &child_iter);
+    }
+}
+
+static void
+lazy_expand_model_fetch_block (LazyBlockSource *source,
+                               LazyBlock       *block)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (source);
+  gint64 row = block->row0;
+  gint64 row_end;
+
+  g_rw_lock_reader_lock (&expand_model->lock);
+  row_end = MIN (block->row0 + block->n_rows, segment_size (expand_model->segments));
+  while (row < row_end)
+    {
+      gint64 offset, n;
+      Segment *segment = segments_find (expand_model->segments, row, &offset);
+
+      /* One run per segment in the block */
+      n = MIN (segment->count - offset, row_end - row);
+      fetch_run (expand_model, block, row, segment->node, segment->first + offset, n);
+      row += n;
+    }
+  g_rw_lock_reader_unlock (&expand_model->lock);
+}
+
+static gint64
+lazy_expand_model_get_n_rows (LazyBlockSource *source)
+{
+  LazyExpandModel *expand_model = LAZY_EXPAND_MODEL (source);
+
+  return expand_model->root->n_visible;
+}
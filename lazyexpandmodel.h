@@ -0,0 +1,63 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_EXPAND_MODEL_H__
+#define __LAZY_EXPAND_MODEL_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_EXPAND_MODEL            (lazy_expand_model_get_type ())
+#define LAZY_EXPAND_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_EXPAND_MODEL, LazyExpandModel))
+#define LAZY_EXPAND_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_EXPAND_MODEL, LazyExpandModelClass))
+#define IS_LAZY_EXPAND_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_EXPAND_MODEL))
+#define IS_LAZY_EXPAND_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_EXPAND_MODEL))
+#define LAZY_EXPAND_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_EXPAND_MODEL, LazyExpandModelClass))
+
+typedef struct _LazyExpandModel          LazyExpandModel;
+typedef struct _LazyExpandModelClass     LazyExpandModelClass;
+
+struct _LazyExpandModelClass
+{
+  GObjectClass parent_class;
+
+};
+
+GType            lazy_expand_model_get_type      (void) G_GNUC_CONST;
+
+LazyExpandModel *lazy_expand_model_new           (GtkTreeModel    *child_model);
+
+GtkTreeModel    *lazy_expand_model_get_model     (LazyExpandModel *expand_model);
+gboolean         lazy_expand_model_expand_row    (LazyExpandModel *expand_model,
+                                                  gint64           row);
+gboolean         lazy_expand_model_collapse_row  (LazyExpandModel *expand_model,
+                                                  gint64           row);
+gboolean         lazy_expand_model_toggle_row    (LazyExpandModel *expand_model,
+                                                  gint64           row);
+void             lazy_expand_model_collapse_all  (LazyExpandModel *expand_model);
+gboolean         lazy_expand_model_row_expanded  (LazyExpandModel *expand_model,
+                                                  gint64           row);
+gint             lazy_expand_model_get_depth     (LazyExpandModel *expand_model,
+                                                  gint64           row);
+gboolean         lazy_expand_model_convert_row_to_child_iter (LazyExpandModel *expand_model,
+                                                  gint64           row,
+                                                  GtkTreeIter     *child_iter);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_EXPAND_MODEL_H__ */
@@ -0,0 +1,459 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The fetcher retrieves cells from a block source on a thread pool
+   such that a slow source does not block the main loop. Cells are
+   fetched in chunks of LAZY_FETCHER_CHUNK_ROWS x
+   LAZY_FETCHER_CHUNK_COLS. A chunk is either pending, i.e. queued or
+   running on a worker, or ready and kept in an LRU list.
+
+   All bookkeeping happens on the main thread. The workers only call
+   the fetch_block method of the source, so the source must allow
+   concurrent fetch_block calls. Finished chunks are handed back
+   through a mutex protected queue which is drained from an idle
+   handler. Pending chunks which are no longer wanted are marked
+   cancelled; a worker skips the fetch of a cancelled chunk and the
+   main thread drops it when it comes back. The newest requests are
+   served first, prefetch requests only after all requests for cells
+   which are drawn.
+
+   A prefetched chunk counts as a hit when it is ready the first time
+   it is requested for drawing. Any chunk which is requested for
+   drawing the first time and is not ready counts as a miss. */
+
+#include <gtk/gtk.h>
+#include "lazyfetcher.h"
+
+typedef struct _Chunk Chunk;
+
+typedef enum
+{
+  CHUNK_PENDING,
+  CHUNK_READY
+} ChunkState;
+
+struct _Chunk
+{
+  gint64 chunk_row;
+  gint chunk_col;
+  ChunkState state;
+  gint cancelled;   /* atomic, set by the main thread */
+  guint64 seq;      /* request order, newest is served first */
+  gboolean prefetch;/* Requested ahead of time */
+  gboolean used;    /* Requested for drawing */
+  LazyBlock *block; /* Filled by the worker */
+  GList link;       /* In the pending queue or in the lru queue */
+};
+
+struct _LazyFetcher
+{
+  LazyBlockSource *source;
+  GThreadPool *pool;
+  guint max_chunks;
+  LazyFetcherReadyFunc ready_func;
+  gpointer user_data;
+
+  GHashTable *chunks;   /* Chunk -> Chunk, pending and ready */
+  GQueue pending;
+  GQueue lru;           /* Ready chunks, head is most recent */
+  guint64 seq;
+  Chunk *last;          /* Chunk of the last lookup */
+
+  /* Prefetch statistics */
+  guint64 prefetch_hits;
+  guint64 prefetch_misses;
+
+  /* Chunks coming back from the workers */
+  GMutex done_lock;
+  GQueue done;
+  guint done_idle;
+};
+
+static guint
+chunk_hash (gconstpointer key)
+{
+  const Chunk *chunk = key;
+
+  return (guint) (chunk->chunk_row ^ (chunk->chunk_row >> 32)) * 31 +
+         (guint) chunk->chunk_col * 2654435761u;
+}
+
+static gboolean
+chunk_equal (gconstpointer a,
+             gconstpointer b)
+{
+  const Chunk *ca = a;
+  const Chunk *cb = b;
+
+  return ca->chunk_row == cb->chunk_row && ca->chunk_col == cb->chunk_col;
+}
+
+static void
+chunk_free (Chunk *chunk)
+{
+  lazy_block_free (chunk->block);
+  g_slice_free (Chunk, chunk);
+}
+
+static gboolean done_idle_cb (gpointer user_data);
+
+/* Runs on a worker thread */
+static void
+fetch_func (gpointer data,
+            gpointer user_data)
+{
+  Chunk *chunk = data;
+  LazyFetcher *fetcher = user_data;
+
+  if (!g_atomic_int_get (&chunk->cancelled))
+    {
+      chunk->block = lazy_block_new ();
+      lazy_block_reset (chunk->block,
+                        chunk->chunk_row * LAZY_FETCHER_CHUNK_ROWS,
+                        LAZY_FETCHER_CHUNK_ROWS,
+                        chunk->chunk_col * LAZY_FETCHER_CHUNK_COLS,
+                        LAZY_FETCHER_CHUNK_COLS);
+      lazy_block_source_fetch_block (fetcher->source, chunk->block);
+    }
+
+  /* lazy_fetcher_free joins the pool before it removes the idle
+     source, so the fetcher is alive here */
+  g_mutex_lock (&fetcher->done_lock);
+  g_queue_push_tail (&fetcher->done, chunk);
+  if (fetcher->done_idle == 0)
+    fetcher->done_idle = g_idle_add_full (G_PRIORITY_DEFAULT, done_idle_cb,
+                                          fetcher, NULL);
+  g_mutex_unlock (&fetcher->done_lock);
+}
+
+/* Serve the newest request first, older ones are likely scrolled
+   away already */
+static gint
+chunk_compare (gconstpointer a,
+               gconstpointer b,
+               gpointer      user_data)
+{
+  const Chunk *ca = a;
+  const Chunk *cb = b;
+
+  if (ca->prefetch != cb->prefetch)
+    return ca->prefetch ? 1 : -1;
+  return ca->seq < cb->seq ? 1 : (ca->seq > cb->seq ? -1 : 0);
+}
+
+static void
+remove_chunk (LazyFetcher *fetcher,
+              Chunk       *chunk)
+{
+  if (fetcher->last == chunk)
+    fetcher->last = NULL;
+  g_hash_table_remove (fetcher->chunks, chunk);
+  if (chunk->state == CHUNK_PENDING)
+    {
+      /* The worker still owns it, it is freed when it comes back */
+      g_queue_unlink (&fetcher->pending, &chunk->link);
+      g_atomic_int_set (&chunk->cancelled, TRUE);
+    }
+  else
+    {
+      g_queue_unlink (&fetcher->lru, &chunk->link);
+      chunk_free (chunk);
+    }
+}
+
+static void
+evict (LazyFetcher *fetcher)
+{
+  while (fetcher->lru.length > fetcher->max_chunks)
+    remove_chunk (fetcher, fetcher->lru.tail->data);
+}
+
+static gboolean
+done_idle_cb (gpointer user_data)
+{
+  LazyFetcher *fetcher = user_data;
+  GQueue done;
+  Chunk *chunk;
+
+  g_mutex_lock (&fetcher->done_lock);
+  done = fetcher->done;
+  g_queue_init (&fetcher->done);
+  fetcher->done_idle = 0;
+  g_mutex_unlock (&fetcher->done_lock);
+
+  while ((chunk = g_queue_pop_head (&done)))
+    {
+      if (g_atomic_int_get (&chunk->cancelled))
+        {
+          chunk_free (chunk);
+          continue;
+        }
+
+      g_queue_unlink (&fetcher->pending, &chunk->link);
+      chunk->state = CHUNK_READY;
+      g_queue_push_head_link (&fetcher->lru, &chunk->link);
+      if (fetcher->ready_func)
+        fetcher->ready_func (chunk->chunk_row * LAZY_FETCHER_CHUNK_ROWS,
+                             LAZY_FETCHER_CHUNK_ROWS,
+                             chunk->chunk_col * LAZY_FETCHER_CHUNK_COLS,
+                             LAZY_FETCHER_CHUNK_COLS,
+                             fetcher->user_data);
+    }
+  evict (fetcher);
+
+  return G_SOURCE_REMOVE;
+}
+
+LazyFetcher *
+lazy_fetcher_new (LazyBlockSource      *source,
+                  guint                 n_threads,
+                  guint                 max_chunks,
+                  LazyFetcherReadyFunc  ready_func,
+                  gpointer              user_data)
+{
+  LazyFetcher *fetcher;
+
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (source), NULL);
+
+  fetcher = g_slice_new0 (LazyFetcher);
+  fetcher->source = g_object_ref (source);
+  fetcher->max_chunks = MAX (max_chunks, 1);
+  fetcher->ready_func = ready_func;
+  fetcher->user_data = user_data;
+  fetcher->chunks = g_hash_table_new (chunk_hash, chunk_equal);
+  g_queue_init (&fetcher->pending);
+  g_queue_init (&fetcher->lru);
+  g_mutex_init (&fetcher->done_lock);
+  g_queue_init (&fetcher->done);
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+  fetcher->pool = g_thread_pool_new (fetch_func, fetcher, n_threads, FALSE, NULL);
+  g_thread_pool_set_sort_function (fetcher->pool, chunk_compare, NULL);
+
+  return fetcher;
+}
+
+void
+lazy_fetcher_free (LazyFetcher *fetcher)
+{
+  Chunk *chunk;
+
+  if (fetcher == NULL)
+    return;
+
+  /* Cancel everything, the workers then return quickly */
+  lazy_fetcher_invalidate_all (fetcher);
+  g_thread_pool_free (fetcher->pool, FALSE, TRUE);
+
+  if (fetcher->done_idle)
+    g_source_remove (fetcher->done_idle);
+  while ((chunk = g_queue_pop_head (&fetcher->done)))
+    chunk_free (chunk);
+
+  g_hash_table_destroy (fetcher->chunks);
+  g_mutex_clear (&fetcher->done_lock);
+  g_object_unref (fetcher->source);
+  g_slice_free (LazyFetcher, fetcher);
+}
+
+static Chunk *
+find_chunk (LazyFetcher *fetcher,
+            gint64       chunk_row,
+            gint         chunk_col)
+{
+  Chunk key;
+
+  if (fetcher->last &&
+      fetcher->last->chunk_row == chunk_row &&
+      fetcher->last->chunk_col == chunk_col)
+    return fetcher->last;
+
+  key.chunk_row = chunk_row;
+  key.chunk_col = chunk_col;
+  return g_hash_table_lookup (fetcher->chunks, &key);
+}
+
+static void
+request_area (LazyFetcher *fetcher,
+              gint64       row0,
+              gint64       row_end,
+              gint         col0,
+              gint         col_end,
+              gboolean     prefetch)
+{
+  gint64 cr;
+  gint cc;
+
+  if (row_end <= row0 || col_end <= col0)
+    return;
+
+  for (cr = row0 / LAZY_FETCHER_CHUNK_ROWS;
+       cr <= (row_end - 1) / LAZY_FETCHER_CHUNK_ROWS; cr++)
+    for (cc = col0 / LAZY_FETCHER_CHUNK_COLS;
+         cc <= (col_end - 1) / LAZY_FETCHER_CHUNK_COLS; cc++)
+      {
+        Chunk *chunk = find_chunk (fetcher, cr, cc);
+
+        if (chunk)
+          {
+            if (!prefetch && !chunk->used)
+              {
+                chunk->used = TRUE;
+                if (chunk->state == CHUNK_READY && chunk->prefetch)
+                  fetcher->prefetch_hits++;
+                else if (chunk->state == CHUNK_PENDING)
+                  fetcher->prefetch_misses++;
+              }
+            continue;
+          }
+
+        chunk = g_slice_new0 (Chunk);
+        chunk->chunk_row = cr;
+        chunk->chunk_col = cc;
+        chunk->state = CHUNK_PENDING;
+        chunk->seq = ++fetcher->seq;
+        chunk->prefetch = prefetch;
+        chunk->used = !prefetch;
+        chunk->link.data = chunk;
+        g_hash_table_insert (fetcher->chunks, chunk, chunk);
+        g_queue_push_tail_link (&fetcher->pending, &chunk->link);
+        g_thread_pool_push (fetcher->pool, chunk, NULL);
+        if (!prefetch)
+          fetcher->prefetch_misses++;
+      }
+}
+
+/* Queue all chunks of the cell area which are neither ready nor
+   pending. Use this for cells which are about to be drawn. */
+void
+lazy_fetcher_request_area (LazyFetcher *fetcher,
+                           gint64       row0,
+                           gint64       row_end,
+                           gint         col0,
+                           gint         col_end)
+{
+  request_area (fetcher, row0, row_end, col0, col_end, FALSE);
+}
+
+/* Like lazy_fetcher_request_area for cells which are expected to be
+   drawn soon. These requests are served after all others. */
+void
+lazy_fetcher_prefetch_area (LazyFetcher *fetcher,
+                            gint64       row0,
+                            gint64       row_end,
+                            gint         col0,
+                            gint         col_end)
+{
+  request_area (fetcher, row0, row_end, col0, col_end, TRUE);
+}
+
+void
+lazy_fetcher_get_prefetch_stats (LazyFetcher *fetcher,
+                                 guint64     *hits,
+                                 guint64     *misses)
+{
+  if (hits)
+    *hits = fetcher->prefetch_hits;
+  if (misses)
+    *misses = fetcher->prefetch_misses;
+}
+
+/* Cancel all pending chunks outside the cell area. Call this with the
+   visible area such that rows which scrolled off are not fetched. */
+void
+lazy_fetcher_retain_area (LazyFetcher *fetcher,
+                          gint64       row0,
+                          gint64       row_end,
+                          gint         col0,
+                          gint         col_end)
+{
+  GList *l, *next;
+
+  for (l = fetcher->pending.head; l; l = next)
+    {
+      Chunk *chunk = l->data;
+      gint64 r0 = chunk->chunk_row * LAZY_FETCHER_CHUNK_ROWS;
+      gint c0 = chunk->chunk_col * LAZY_FETCHER_CHUNK_COLS;
+
+      next = l->next;
+      if (r0 >= row_end || r0 + LAZY_FETCHER_CHUNK_ROWS <= row0 ||
+          c0 >= col_end || c0 + LAZY_FETCHER_CHUNK_COLS <= col0)
+        remove_chunk (fetcher, chunk);
+    }
+}
+
+/* Returns the cell string if its chunk is ready. ready tells whether
+   the chunk is there, a ready chunk may still have no string for the
+   cell if the source does not provide one. */
+const gchar *
+lazy_fetcher_lookup (LazyFetcher *fetcher,
+                     gint64       row,
+                     gint         col,
+                     gboolean    *ready)
+{
+  Chunk *chunk = find_chunk (fetcher,
+                             row / LAZY_FETCHER_CHUNK_ROWS,
+                             col / LAZY_FETCHER_CHUNK_COLS);
+
+  if (chunk == NULL || chunk->state != CHUNK_READY)
+    {
+      if (ready)
+        *ready = FALSE;
+      return NULL;
+    }
+
+  if (fetcher->last != chunk)
+    {
+      g_queue_unlink (&fetcher->lru, &chunk->link);
+      g_queue_push_head_link (&fetcher->lru, &chunk->link);
+      fetcher->last = chunk;
+    }
+  if (ready)
+    *ready = TRUE;
+  return lazy_block_get (chunk->block, row, col);
+}
+
+/* Drop ready and cancel pending chunks of the rows, e.g. because the
+   model changed them */
+void
+lazy_fetcher_invalidate_rows (LazyFetcher *fetcher,
+                              gint64       row0,
+                              gint64       row_end)
+{
+  GHashTableIter iter;
+  gpointer key;
+  GSList *doomed = NULL, *l;
+
+  g_hash_table_iter_init (&iter, fetcher->chunks);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      Chunk *chunk = key;
+      gint64 r0 = chunk->chunk_row * LAZY_FETCHER_CHUNK_ROWS;
+
+      if (r0 < row_end && row0 < r0 + LAZY_FETCHER_CHUNK_ROWS)
+        doomed = g_slist_prepend (doomed, chunk);
+    }
+  for (l = doomed; l; l = l->next)
+    remove_chunk (fetcher, l->data);
+  g_slist_free (doomed);
+}
+
+void
+lazy_fetcher_invalidate_all (LazyFetcher *fetcher)
+{
+  lazy_fetcher_invalidate_rows (fetcher, 0, G_MAXINT64);
+}
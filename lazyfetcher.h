@@ -0,0 +1,76 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_FETCHER_H__
+#define __LAZY_FETCHER_H__
+
+#include <gtk/gtk.h>
+#include "lazyblocksource.h"
+
+G_BEGIN_DECLS
+
+/* Cells are fetched in chunks of this size */
+#define LAZY_FETCHER_CHUNK_ROWS 32
+#define LAZY_FETCHER_CHUNK_COLS 16
+
+typedef struct _LazyFetcher LazyFetcher;
+
+/* Called on the main loop when the cells of the area arrived */
+typedef void (* LazyFetcherReadyFunc) (gint64   row0,
+                                       gint     n_rows,
+                                       gint     col0,
+                                       gint     n_cols,
+                                       gpointer user_data);
+
+LazyFetcher  *lazy_fetcher_new             (LazyBlockSource      *source,
+                                            guint                 n_threads,
+                                            guint                 max_chunks,
+                                            LazyFetcherReadyFunc  ready_func,
+                                            gpointer              user_data);
+void          lazy_fetcher_free            (LazyFetcher          *fetcher);
+
+void          lazy_fetcher_request_area    (LazyFetcher          *fetcher,
+                                            gint64                row0,
+                                            gint64                row_end,
+                                            gint                  col0,
+                                            gint                  col_end);
+void          lazy_fetcher_prefetch_area   (LazyFetcher          *fetcher,
+                                            gint64                row0,
+                                            gint64                row_end,
+                                            gint                  col0,
+                                            gint                  col_end);
+void          lazy_fetcher_retain_area     (LazyFetcher          *fetcher,
+                                            gint64                row0,
+                                            gint64                row_end,
+                                            gint                  col0,
+                                            gint                  col_end);
+const gchar  *lazy_fetcher_lookup          (LazyFetcher          *fetcher,
+                                            gint64                row,
+                                            gint                  col,
+                                            gboolean             *ready);
+
+void          lazy_fetcher_invalidate_rows (LazyFetcher          *fetcher,
+                                            gint64                row0,
+                                            gint64                row_end);
+void          lazy_fetcher_invalidate_all  (LazyFetcher          *fetcher);
+
+void          lazy_fetcher_get_prefetch_stats (LazyFetcher       *fetcher,
+                                            guint64              *hits,
+                                            guint64              *misses);
+
+G_END_DECLS
+
+#endif /* __LAZY_FETCHER_H__ */
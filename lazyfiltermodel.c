@@ -0,0 +1,429 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The filter model shows the rows of a block source which match a
+   LazySearch, in the order of the source. The model holds no rows of
+   its own, row n is the n-th match of the search. Matches found by
+   the running search are appended as rows-inserted, a new query
+   replaces all rows with one reset. */
+
+#include <gtk/gtk.h>
+#include "lazyfiltermodel.h"
+#include "lazyblocksource.h"
+
+struct _LazyFilterModel
+{
+  GObject parent;
+
+  /* private */
+  LazySearch *search;
+  GtkTreeModel *child;
+  gint stamp;
+};
+
+/* The row id is 64 bit, see lazystore.c */
+static inline gint64
+iter_get_row (GtkTreeIter *iter)
+{
+  return (gint64) (((guint64) GPOINTER_TO_UINT (iter->user_data2) << 32) |
+                   GPOINTER_TO_UINT (iter->user_data));
+}
+
+static inline void
+iter_set_row (GtkTreeIter *iter,
+              gint64       row)
+{
+  iter->user_data = GUINT_TO_POINTER ((guint) ((guint64) row & 0xffffffff));
+  iter->user_data2 = GUINT_TO_POINTER ((guint) ((guint64) row >> 32));
+}
+
+static void         lazy_filter_model_tree_model_init (GtkTreeModelIface *iface);
+static GtkTreeModelFlags lazy_filter_model_get_flags  (GtkTreeModel      *tree_model);
+static gint         lazy_filter_model_get_n_columns   (GtkTreeModel      *tree_model);
+static GType        lazy_filter_model_get_column_type (GtkTreeModel      *tree_model,
+                                                       gint               index);
+static gboolean     lazy_filter_model_get_iter        (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreePath       *path);
+static GtkTreePath *lazy_filter_model_get_path        (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static void         lazy_filter_model_get_value       (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       gint               column,
+                                                       GValue            *value);
+static gboolean     lazy_filter_model_iter_next       (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_filter_model_iter_previous   (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_filter_model_iter_children   (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent);
+static gboolean     lazy_filter_model_iter_has_child  (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gint         lazy_filter_model_iter_n_children (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter);
+static gboolean     lazy_filter_model_iter_nth_child  (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *parent,
+                                                       gint               n);
+static gboolean     lazy_filter_model_iter_parent     (GtkTreeModel      *tree_model,
+                                                       GtkTreeIter       *iter,
+                                                       GtkTreeIter       *child);
+
+static void         lazy_filter_model_block_source_init (LazyBlockSourceInterface *iface);
+static void         lazy_filter_model_fetch_block     (LazyBlockSource   *source,
+                                                       LazyBlock         *block);
+static gint64       lazy_filter_model_get_n_rows      (LazyBlockSource   *source);
+
+static void         lazy_filter_model_finalize        (GObject           *object);
+
+G_DEFINE_TYPE_WITH_CODE (LazyFilterModel, lazy_filter_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                lazy_filter_model_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (TYPE_LAZY_BLOCK_SOURCE,
+                                                lazy_filter_model_block_source_init))
+
+
+static void
+lazy_filter_model_class_init (LazyFilterModelClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->finalize = lazy_filter_model_finalize;
+}
+
+static void
+lazy_filter_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = lazy_filter_model_get_flags;
+  iface->get_n_columns = lazy_filter_model_get_n_columns;
+  iface->get_column_type = lazy_filter_model_get_column_type;
+  iface->get_iter = lazy_filter_model_get_iter;
+  iface->get_path = lazy_filter_model_get_path;
+  iface->get_value = lazy_filter_model_get_value;
+  iface->iter_next = lazy_filter_model_iter_next;
+  iface->iter_previous = lazy_filter_model_iter_previous;
+  iface->iter_children = lazy_filter_model_iter_children;
+  iface->iter_has_child = lazy_filter_model_iter_has_child;
+  iface->iter_n_children = lazy_filter_model_iter_n_children;
+  iface->iter_nth_child = lazy_filter_model_iter_nth_child;
+  iface->iter_parent = lazy_filter_model_iter_parent;
+}
+
+static void
+lazy_filter_model_block_source_init (LazyBlockSourceInterface *iface)
+{
+  iface->fetch_block = lazy_filter_model_fetch_block;
+  iface->get_n_rows = lazy_filter_model_get_n_rows;
+}
+
+static void
+lazy_filter_model_init (LazyFilterModel *filter_model)
+{
+  filter_model->stamp = g_random_int ();
+}
+
+static void
+lazy_filter_model_finalize (GObject *object)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (object);
+
+  if (filter_model->search)
+    {
+      g_signal_handlers_disconnect_by_data (filter_model->search, filter_model);
+      g_signal_handlers_disconnect_by_data (filter_model->child, filter_model);
+      g_object_unref (filter_model->search);
+    }
+
+  G_OBJECT_CLASS (lazy_filter_model_parent_class)->finalize (object);
+}
+
+
+/* Changes of the search and the child */
+
+static void
+matches_added_cb (LazySearch      *search,
+                  gint64           position,
+                  gint64           n_matches,
+                  LazyFilterModel *filter_model)
+{
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (filter_model), position, n_matches);
+}
+
+static void
+cleared_cb (LazySearch      *search,
+            LazyFilterModel *filter_model)
+{
+  lazy_block_source_reset (LAZY_BLOCK_SOURCE (filter_model));
+}
+
+static void
+child_row_changed_cb (GtkTreeModel    *child,
+                      GtkTreePath     *child_path,
+                      GtkTreeIter     *child_iter,
+                      LazyFilterModel *filter_model)
+{
+  gint64 row = lazy_search_get_match_position (filter_model->search,
+                                               gtk_tree_path_get_indices (child_path)[0]);
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  if (row < 0 || row > G_MAXINT)
+    return;
+  path = gtk_tree_path_new_from_indices ((gint) row, -1);
+  iter.stamp = filter_model->stamp;
+  iter_set_row (&iter, row);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (filter_model), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+/* Deleted child rows and new orders of the child restart the search,
+   which resets the filter model */
+LazyFilterModel *
+lazy_filter_model_new (LazySearch *search)
+{
+  LazyFilterModel *filter_model;
+
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), NULL);
+
+  filter_model = g_object_new (TYPE_LAZY_FILTER_MODEL, NULL);
+  filter_model->search = g_object_ref (search);
+  filter_model->child = lazy_search_get_model (search);
+  g_signal_connect (search, "matches-added",
+                    G_CALLBACK (matches_added_cb), filter_model);
+  g_signal_connect (search, "cleared",
+                    G_CALLBACK (cleared_cb), filter_model);
+  g_signal_connect (filter_model->child, "row-changed",
+                    G_CALLBACK (child_row_changed_cb), filter_model);
+
+  return filter_model;
+}
+
+LazySearch *
+lazy_filter_model_get_search (LazyFilterModel *filter_model)
+{
+  g_return_val_if_fail (IS_LAZY_FILTER_MODEL (filter_model), NULL);
+
+  return filter_model->search;
+}
+
+gint64
+lazy_filter_model_convert_row_to_child_row (LazyFilterModel *filter_model,
+                                            gint64           row)
+{
+  g_return_val_if_fail (IS_LAZY_FILTER_MODEL (filter_model), -1);
+
+  return lazy_search_get_match (filter_model->search, row);
+}
+
+
+/* Fulfill the GtkTreeModel requirements */
+static GtkTreeModelFlags
+lazy_filter_model_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+lazy_filter_model_get_n_columns (GtkTreeModel *tree_model)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+
+  return gtk_tree_model_get_n_columns (filter_model->child);
+}
+
+static GType
+lazy_filter_model_get_column_type (GtkTreeModel *tree_model,
+                                   gint          index)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+
+  return gtk_tree_model_get_column_type (filter_model->child, index);
+}
+
+static gboolean
+lazy_filter_model_get_iter (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter,
+                            GtkTreePath  *path)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+  gint i;
+
+  i = gtk_tree_path_get_indices (path)[0];
+  if (i < 0 || i >= lazy_filter_model_get_n_rows (LAZY_BLOCK_SOURCE (filter_model)))
+    return FALSE;
+
+  iter->stamp = filter_model->stamp;
+  iter_set_row (iter, i);
+  return TRUE;
+}
+
+static GtkTreePath *
+lazy_filter_model_get_path (GtkTreeModel *tree_model,
+                            GtkTreeIter  *iter)
+{
+  GtkTreePath *path;
+  gint64 row = iter_get_row (iter);
+
+  /* Paths can only address gint rows */
+  if (row > G_MAXINT)
+    return NULL;
+
+  path = gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, row);
+  return path;
+}
+
+static void
+lazy_filter_model_get_value (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             gint          column,
+                             GValue       *value)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+  GtkTreeIter child_iter;
+  gint64 row;
+
+  row = lazy_search_get_match (filter_model->search, iter_get_row (iter));
+  if (row >= 0 && row <= G_MAXINT &&
+      gtk_tree_model_iter_nth_child (filter_model->child, &child_iter, NULL, row))
+    gtk_tree_model_get_value (filter_model->child, &child_iter, column, value);
+  else
+    g_value_init (value, gtk_tree_model_get_column_type (filter_model->child, column));
+}
+
+static gboolean
+lazy_filter_model_iter_next (GtkTreeModel  *tree_model,
+                             GtkTreeIter   *iter)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+  gint64 row = iter_get_row (iter) + 1;
+
+  iter_set_row (iter, row);
+  if (row >= lazy_filter_model_get_n_rows (LAZY_BLOCK_SOURCE (filter_model)))
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+lazy_filter_model_iter_previous (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+  gint64 row = iter_get_row (iter);
+
+  g_return_val_if_fail (filter_model->stamp == iter->stamp, FALSE);
+
+  if (row == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  iter_set_row (iter, row - 1);
+  return TRUE;
+}
+
+static gboolean
+lazy_filter_model_iter_children (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter,
+                                 GtkTreeIter  *parent)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+
+  /* this is a list, nodes have no children */
+  if (parent || lazy_filter_model_get_n_rows (LAZY_BLOCK_SOURCE (filter_model)) == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->stamp = filter_model->stamp;
+  iter_set_row (iter, 0);
+  return TRUE;
+}
+
+static gboolean
+lazy_filter_model_iter_has_child (GtkTreeModel *tree_model,
+                                  GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+lazy_filter_model_iter_n_children (GtkTreeModel *tree_model,
+                                   GtkTreeIter  *iter)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+
+  if (iter == NULL)
+    return MIN (lazy_search_get_n_matches (filter_model->search), G_MAXINT);
+
+  g_return_val_if_fail (filter_model->stamp == iter->stamp, -1);
+  return 0;
+}
+
+static gboolean
+lazy_filter_model_iter_nth_child (GtkTreeModel *tree_model,
+                                  GtkTreeIter  *iter,
+                                  GtkTreeIter  *parent,
+                                  gint          n)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (tree_model);
+
+  iter->stamp = 0;
+  if (parent)
+    return FALSE;
+  if (n < 0 || n >= lazy_filter_model_get_n_rows (LAZY_BLOCK_SOURCE (filter_model)))
+    return FALSE;
+
+  iter->stamp = filter_model->stamp;
+  iter_set_row (iter, n);
+  return TRUE;
+}
+
+static gboolean
+lazy_filter_model_iter_parent (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+/* Fulfill the LazyBlockSource requirements */
+static void
+lazy_filter_model_fetch_block (LazyBlockSource *source,
+                               LazyBlock       *block)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (source);
+  gint64 *rows = g_new (gint64, block->n_rows);
+
+  lazy_search_get_matches (filter_model->search, block->row0, block->n_rows, rows);
+  lazy_block_source_fetch_rows (LAZY_BLOCK_SOURCE (filter_model->child), block, rows);
+  g_free (rows);
+}
+
+static gint64
+lazy_filter_model_get_n_rows (LazyBlockSource *source)
+{
+  LazyFilterModel *filter_model = LAZY_FILTER_MODEL (source);
+
+  return lazy_search_get_n_matches (filter_model->search);
+}
@@ -0,0 +1,52 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_FILTER_MODEL_H__
+#define __LAZY_FILTER_MODEL_H__
+
+#include <gtk/gtk.h>
+#include "lazysearch.h"
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_FILTER_MODEL            (lazy_filter_model_get_type ())
+#define LAZY_FILTER_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_FILTER_MODEL, LazyFilterModel))
+#define LAZY_FILTER_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_FILTER_MODEL, LazyFilterModelClass))
+#define IS_LAZY_FILTER_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_FILTER_MODEL))
+#define IS_LAZY_FILTER_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_FILTER_MODEL))
+#define LAZY_FILTER_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_FILTER_MODEL, LazyFilterModelClass))
+
+typedef struct _LazyFilterModel          LazyFilterModel;
+typedef struct _LazyFilterModelClass     LazyFilterModelClass;
+
+struct _LazyFilterModelClass
+{
+  GObjectClass parent_class;
+
+};
+
+GType            lazy_filter_model_get_type      (void) G_GNUC_CONST;
+
+LazyFilterModel *lazy_filter_model_new           (LazySearch      *search);
+
+LazySearch      *lazy_filter_model_get_search    (LazyFilterModel *filter_model);
+gint64           lazy_filter_model_convert_row_to_child_row (LazyFilterModel *filter_model,
+                                                  gint64           row);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_FILTER_MODEL_H__ */
@@ -0,0 +1,388 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* A LazyRowSet is a compressed set of row numbers, laid out like a
+   roaring bitmap. The rows are split by their upper bits into
+   containers of 65536 rows. A container with few rows keeps them as
+   a sorted array of the lower 16 bits, a container with more than
+   ARRAY_MAX rows switches to a bitmap of 8 KiB. Containers are kept
+   sorted together with the number of rows before each, so the n-th
+   row and the rank of a row are found by binary search.
+
+   Adding rows in ascending order, the way search results arrive, only
+   touches the last container. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "lazyrowset.h"
+
+#define CONTAINER_BITS 16
+#define CONTAINER_ROWS (1 << CONTAINER_BITS)
+/* An array container is not larger than a bitmap */
+#define ARRAY_MAX 4096
+#define BITMAP_WORDS (CONTAINER_ROWS / 64)
+
+typedef struct _Container Container;
+
+struct _Container
+{
+  gint64 key;       /* row >> CONTAINER_BITS */
+  gint64 rank;      /* Rows in the containers before */
+  guint count;
+  guint capacity;   /* Of array */
+  guint16 *array;   /* Sorted, NULL for a bitmap container */
+  guint64 *bitmap;
+};
+
+struct _LazyRowSet
+{
+  GArray *containers;   /* Container, sorted by key */
+  gint64 count;
+};
+
+static inline guint
+popcount64 (guint64 word)
+{
+#ifdef __GNUC__
+  return __builtin_popcountll (word);
+#else
+  guint count = 0;
+
+  for (; word; word &= word - 1)
+    count++;
+  return count;
+#endif
+}
+
+/* The index of the lowest set bit, word must not be 0 */
+static inline guint
+lowest_bit64 (guint64 word)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll (word);
+#else
+  guint i = 0;
+
+  for (; !(word & 1); word >>= 1)
+    i++;
+  return i;
+#endif
+}
+
+LazyRowSet *
+lazy_row_set_new (void)
+{
+  LazyRowSet *set = g_slice_new0 (LazyRowSet);
+
+  set->containers = g_array_new (FALSE, FALSE, sizeof (Container));
+  return set;
+}
+
+void
+lazy_row_set_clear (LazyRowSet *set)
+{
+  guint i;
+
+  for (i = 0; i < set->containers->len; i++)
+    {
+      Container *c = &g_array_index (set->containers, Container, i);
+
+      g_free (c->array);
+      g_free (c->bitmap);
+    }
+  g_array_set_size (set->containers, 0);
+  set->count = 0;
+}
+
+void
+lazy_row_set_free (LazyRowSet *set)
+{
+  if (set == NULL)
+    return;
+  lazy_row_set_clear (set);
+  g_array_free (set->containers, TRUE);
+  g_slice_free (LazyRowSet, set);
+}
+
+gint64
+lazy_row_set_get_count (LazyRowSet *set)
+{
+  return set->count;
+}
+
+gsize
+lazy_row_set_get_bytes (LazyRowSet *set)
+{
+  gsize bytes = set->containers->len * sizeof (Container);
+  guint i;
+
+  for (i = 0; i < set->containers->len; i++)
+    {
+      Container *c = &g_array_index (set->containers, Container, i);
+
+      bytes += c->bitmap ? BITMAP_WORDS * sizeof (guint64) : c->capacity * sizeof (guint16);
+    }
+  return bytes;
+}
+
+/* The index of the first container with a key >= key */
+static guint
+find_container (LazyRowSet *set,
+                gint64      key)
+{
+  guint lo = 0, hi = set->containers->len;
+
+  /* Rows are mostly added at the end */
+  if (hi && g_array_index (set->containers, Container, hi - 1).key < key)
+    return hi;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (g_array_index (set->containers, Container, mid).key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* The index of the first array entry >= low */
+static guint
+array_lower_bound (Container *c,
+                   guint16    low)
+{
+  guint lo = 0, hi = c->count;
+
+  if (hi && c->array[hi - 1] < low)
+    return hi;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (c->array[mid] < low)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+static void
+array_to_bitmap (Container *c)
+{
+  guint i;
+
+  c->bitmap = g_new0 (guint64, BITMAP_WORDS);
+  for (i = 0; i < c->count; i++)
+    c->bitmap[c->array[i] / 64] |= G_GUINT64_CONSTANT (1) << (c->array[i] % 64);
+  g_clear_pointer (&c->array, g_free);
+  c->capacity = 0;
+}
+
+/* Returns TRUE if the row was not in the container */
+static gboolean
+container_add (Container *c,
+               guint16    low)
+{
+  guint i;
+
+  if (c->bitmap)
+    {
+      guint64 bit = G_GUINT64_CONSTANT (1) << (low % 64);
+
+      if (c->bitmap[low / 64] & bit)
+        return FALSE;
+      c->bitmap[low / 64] |= bit;
+      c->count++;
+      return TRUE;
+    }
+
+  i = array_lower_bound (c, low);
+  if (i < c->count && c->array[i] == low)
+    return FALSE;
+
+  if (c->count == ARRAY_MAX)
+    {
+      array_to_bitmap (c);
+      return container_add (c, low);
+    }
+  if (c->count == c->capacity)
+    {
+      c->capacity = MIN (MAX (c->capacity * 2, 4), ARRAY_MAX);
+      c->array = g_renew (guint16, c->array, c->capacity);
+    }
+  memmove (c->array + i + 1, c->array + i, (c->count - i) * sizeof (guint16));
+  c->array[i] = low;
+  c->count++;
+  return TRUE;
+}
+
+void
+lazy_row_set_add (LazyRowSet *set,
+                  gint64      row)
+{
+  gint64 key = row >> CONTAINER_BITS;
+  guint i = find_container (set, key);
+  Container *c;
+
+  g_return_if_fail (row >= 0);
+
+  if (i == set->containers->len ||
+      g_array_index (set->containers, Container, i).key != key)
+    {
+      Container new_container = { 0, };
+
+      new_container.key = key;
+      if (i > 0)
+        {
+          Container *prev = &g_array_index (set->containers, Container, i - 1);
+
+          new_container.rank = prev->rank + prev->count;
+        }
+      g_array_insert_val (set->containers, i, new_container);
+    }
+
+  c = &g_array_index (set->containers, Container, i);
+  if (!container_add (c, row & (CONTAINER_ROWS - 1)))
+    return;
+  set->count++;
+  for (i = i + 1; i < set->containers->len; i++)
+    g_array_index (set->containers, Container, i).rank++;
+}
+
+gboolean
+lazy_row_set_contains (LazyRowSet *set,
+                       gint64      row)
+{
+  gint64 key = row >> CONTAINER_BITS;
+  guint i = find_container (set, key);
+  guint16 low = row & (CONTAINER_ROWS - 1);
+  Container *c;
+  guint j;
+
+  if (row < 0 || i == set->containers->len)
+    return FALSE;
+  c = &g_array_index (set->containers, Container, i);
+  if (c->key != key)
+    return FALSE;
+  if (c->bitmap)
+    return (c->bitmap[low / 64] >> (low % 64)) & 1;
+  j = array_lower_bound (c, low);
+  return j < c->count && c->array[j] == low;
+}
+
+/* The n-th row of the set, counted from 0, or -1 */
+gint64
+lazy_row_set_nth (LazyRowSet *set,
+                  gint64      n)
+{
+  guint lo = 0, hi = set->containers->len;
+  Container *c;
+  guint word;
+  gint64 left;
+
+  if (n < 0 || n >= set->count)
+    return -1;
+
+  /* The last container with rank <= n */
+  while (hi - lo > 1)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (g_array_index (set->containers, Container, mid).rank <= n)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  c = &g_array_index (set->containers, Container, lo);
+  left = n - c->rank;
+
+  if (c->array)
+    return (c->key << CONTAINER_BITS) | c->array[left];
+
+  for (word = 0; word < BITMAP_WORDS; word++)
+    {
+      guint64 bits = c->bitmap[word];
+      guint count = popcount64 (bits);
+
+      if (left < count)
+        {
+          for (; left > 0; left--)
+            bits &= bits - 1;
+          return (c->key << CONTAINER_BITS) | (word * 64 + lowest_bit64 (bits));
+        }
+      left -= count;
+    }
+  g_assert_not_reached ();
+  return -1;
+}
+
+/* The number of rows in the set which are smaller than row */
+gint64
+lazy_row_set_rank (LazyRowSet *set,
+                   gint64      row)
+{
+  gint64 key = row >> CONTAINER_BITS;
+  guint i = find_container (set, key);
+  guint16 low = row & (CONTAINER_ROWS - 1);
+  Container *c;
+  gint64 rank;
+  guint word;
+
+  if (row <= 0)
+    return 0;
+  if (i == set->containers->len)
+    return set->count;
+  c = &g_array_index (set->containers, Container, i);
+  if (c->key != key)
+    return c->rank;
+
+  if (c->array)
+    return c->rank + array_lower_bound (c, low);
+
+  rank = c->rank;
+  for (word = 0; word < low / 64u; word++)
+    rank += popcount64 (c->bitmap[word]);
+  if (low % 64)
+    rank += popcount64 (c->bitmap[low / 64] & ((G_GUINT64_CONSTANT (1) << (low % 64)) - 1));
+  return rank;
+}
+
+/* The smallest row of the set >= row, or -1 */
+gint64
+lazy_row_set_next (LazyRowSet *set,
+                   gint64      row)
+{
+  gint64 rank = lazy_row_set_rank (set, MAX (row, 0));
+
+  return rank < set->count ? lazy_row_set_nth (set, rank) : -1;
+}
+
+/* The largest row of the set <= row, or -1 */
+gint64
+lazy_row_set_previous (LazyRowSet *set,
+                       gint64      row)
+{
+  gint64 rank;
+
+  if (row < 0)
+    return -1;
+  rank = lazy_row_set_rank (set, row + 1);
+  return rank > 0 ? lazy_row_set_nth (set, rank - 1) : -1;
+}
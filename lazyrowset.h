@@ -0,0 +1,48 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_ROW_SET_H__
+#define __LAZY_ROW_SET_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LazyRowSet LazyRowSet;
+
+LazyRowSet *lazy_row_set_new       (void);
+void        lazy_row_set_free      (LazyRowSet *set);
+
+void        lazy_row_set_add       (LazyRowSet *set,
+                                    gint64      row);
+void        lazy_row_set_clear     (LazyRowSet *set);
+gboolean    lazy_row_set_contains  (LazyRowSet *set,
+                                    gint64      row);
+gint64      lazy_row_set_get_count (LazyRowSet *set);
+gsize       lazy_row_set_get_bytes (LazyRowSet *set);
+
+gint64      lazy_row_set_nth       (LazyRowSet *set,
+                                    gint64      n);
+gint64      lazy_row_set_rank      (LazyRowSet *set,
+                                    gint64      row);
+gint64      lazy_row_set_next      (LazyRowSet *set,
+                                    gint64      row);
+gint64      lazy_row_set_previous  (LazyRowSet *set,
+                                    gint64      row);
+
+G_END_DECLS
+
+#endif /* __LAZY_ROW_SET_H__ */
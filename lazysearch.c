@@ -0,0 +1,844 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* LazySearch finds the rows of a block source with a cell containing
+   a substring or matching a regular expression. The rows are split
+   into chunks which are fetched and scanned on a thread pool. The
+   matching rows of the finished chunks are added to a LazyRowSet on
+   the main loop in row order and announced with matches-added, so
+   the first matches show up while the rest is still scanned.
+
+   A new query cancels the running one. Its queued chunks are skipped
+   and results arriving late are dropped. Rows appended to the model
+   after the search started and changed cells are not searched again,
+   changes of the row order and rows inserted or deleted before the
+   end of the searched rows start the search over.
+
+   Case sensitive substrings are searched in the raw bytes of the
+   cells, with SSE2 16 candidate positions are tested at once by
+   comparing the first and the last byte of the needle. Everything
+   else goes through GRegex, which may be used from several threads.
+
+   Columns which the source keeps dictionary encoded are not searched
+   cell by cell. The query is evaluated once per distinct string when
+   the search starts, the tasks then only look up the codes of the
+   cells, see lazy_block_source_fetch_codes. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "lazysearch.h"
+#include "lazyblocksource.h"
+#include "lazyrowset.h"
+
+/* Cells fetched and scanned per task */
+#define SEARCH_CHUNK_CELLS (256 * 1024)
+
+/* Properties */
+enum {
+  PROP_0,
+  PROP_SEARCHING,
+  PROP_PROGRESS,
+  PROP_N_MATCHES,
+  LAST_PROP,
+};
+
+/* Signals */
+enum {
+  MATCHES_ADDED,
+  CLEARED,
+  LAST_SIGNAL
+};
+
+static GParamSpec *properties[LAST_PROP];
+static guint signals[LAST_SIGNAL];
+
+typedef struct _SearchRun SearchRun;
+typedef struct _SearchTask SearchTask;
+typedef struct _CodeColumn CodeColumn;
+
+/* The query evaluated for the strings of a dictionary encoded
+   column */
+struct _CodeColumn
+{
+  guint8 *matches;      /* By code, NULL if the column is text */
+  guint n_codes;
+  gboolean any;         /* Whether any string matches */
+};
+
+/* One query over the rows of the model. The run is shared by the
+   search, the queued tasks and the idle handler. */
+struct _SearchRun
+{
+  gint ref_count;
+  LazySearch *search;   /* NULL when cancelled, main thread only */
+  gint cancelled;
+
+  LazyBlockSource *source;
+  gint n_columns;
+  gchar *needle;        /* Plain substring or NULL */
+  gsize needle_len;
+  GRegex *regex;        /* Otherwise */
+
+  /* Per column, NULL if no column is dictionary encoded. The other
+     columns are between text_col0 and text_col_end. */
+  CodeColumn *code_columns;
+  gint text_col0;
+  gint text_col_end;
+
+  gint64 n_rows;
+  gint chunk_rows;
+  guint n_chunks;
+  guint next_chunk;     /* Next chunk to add to the matches */
+
+  GMutex lock;
+  GArray **results;     /* Matching rows per chunk, guarded by lock */
+  guint idle;           /* Guarded by lock */
+};
+
+struct _SearchTask
+{
+  SearchRun *run;
+  guint chunk;
+};
+
+struct _LazySearch
+{
+  GObject parent;
+
+  /* private */
+  GtkTreeModel *model;
+  GThreadPool *pool;
+  SearchRun *run;       /* The running query or NULL */
+  gint64 n_searched;    /* Rows covered by the query, later ones are appended */
+
+  /* Rows of the finished chunks. The lock is taken for reading by the
+     fetch threads of filter models. */
+  LazyRowSet *matches;
+  GRWLock lock;
+
+  gchar *query;
+  LazySearchFlags flags;
+  GRegex *regex;        /* The compiled query unless plain substring */
+};
+
+static void         lazy_search_finalize     (GObject      *object);
+static void         lazy_search_get_property (GObject      *object,
+                                              guint         prop_id,
+                                              GValue       *value,
+                                              GParamSpec   *pspec);
+static void         search_func              (gpointer      data,
+                                              gpointer      user_data);
+
+G_DEFINE_TYPE (LazySearch, lazy_search, G_TYPE_OBJECT)
+
+
+static void
+lazy_search_class_init (LazySearchClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->get_property = lazy_search_get_property;
+  o_class->finalize = lazy_search_finalize;
+
+  properties[PROP_SEARCHING] =
+    g_param_spec_boolean ("searching",
+                          "Searching",
+                          "Whether rows are still being scanned",
+                          FALSE,
+                          G_PARAM_READABLE);
+  properties[PROP_PROGRESS] =
+    g_param_spec_double ("progress",
+                         "Progress",
+                         "Scanned fraction of the rows",
+                         0.0, 1.0, 1.0,
+                         G_PARAM_READABLE);
+  properties[PROP_N_MATCHES] =
+    g_param_spec_int64 ("n-matches",
+                        "Matches",
+                        "Number of matching rows found so far",
+                        0, G_MAXINT64, 0,
+                        G_PARAM_READABLE);
+  g_object_class_install_properties (o_class, LAST_PROP, properties);
+
+  /* Emitted with the position of the first new match in the list of
+     matches and the number of new matches, they are always added at
+     the end */
+  signals[MATCHES_ADDED] =
+    g_signal_new ("matches-added",
+                  TYPE_LAZY_SEARCH,
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 2,
+                  G_TYPE_INT64, G_TYPE_INT64);
+
+  /* Emitted when the matches were dropped for a new query */
+  signals[CLEARED] =
+    g_signal_new ("cleared",
+                  TYPE_LAZY_SEARCH,
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 0);
+}
+
+static void
+lazy_search_init (LazySearch *search)
+{
+  search->matches = lazy_row_set_new ();
+  g_rw_lock_init (&search->lock);
+  search->pool = g_thread_pool_new (search_func, search,
+                                    g_get_num_processors (), FALSE, NULL);
+}
+
+static void cancel_run (LazySearch *search);
+
+static void
+lazy_search_finalize (GObject *object)
+{
+  LazySearch *search = LAZY_SEARCH (object);
+
+  cancel_run (search);
+  /* The queued tasks of the cancelled run return at once */
+  g_thread_pool_free (search->pool, FALSE, TRUE);
+  if (search->model)
+    {
+      g_signal_handlers_disconnect_by_data (search->model, search);
+      g_object_unref (search->model);
+    }
+  lazy_row_set_free (search->matches);
+  g_rw_lock_clear (&search->lock);
+  g_free (search->query);
+  if (search->regex)
+    g_regex_unref (search->regex);
+
+  G_OBJECT_CLASS (lazy_search_parent_class)->finalize (object);
+}
+
+static void
+lazy_search_get_property (GObject    *object,
+                          guint       prop_id,
+                          GValue     *value,
+                          GParamSpec *pspec)
+{
+  LazySearch *search = LAZY_SEARCH (object);
+
+  switch (prop_id)
+    {
+    case PROP_SEARCHING:
+      g_value_set_boolean (value, lazy_search_get_searching (search));
+      break;
+    case PROP_PROGRESS:
+      g_value_set_double (value, lazy_search_get_progress (search));
+      break;
+    case PROP_N_MATCHES:
+      g_value_set_int64 (value, lazy_search_get_n_matches (search));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+
+/* Matching */
+
+/* Whether the needle occurs in the haystack of len bytes */
+static gboolean
+find_substring (const gchar *haystack,
+                gsize        len,
+                const gchar *needle,
+                gsize        needle_len)
+{
+  gsize i = 0;
+
+  if (needle_len > len)
+    return FALSE;
+
+#ifdef __SSE2__
+  {
+    const __m128i first = _mm_set1_epi8 (needle[0]);
+    const __m128i last = _mm_set1_epi8 (needle[needle_len - 1]);
+
+    for (; i + needle_len - 1 + 16 <= len; i += 16)
+      {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (haystack + i));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (haystack + i + needle_len - 1));
+        guint mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (a, first),
+                                                       _mm_cmpeq_epi8 (b, last)));
+
+        while (mask)
+          {
+            gint bit = g_bit_nth_lsf (mask, -1);
+
+            if (memcmp (haystack + i + bit, needle, needle_len) == 0)
+              return TRUE;
+            mask &= mask - 1;
+          }
+      }
+  }
+#endif
+  for (; i + needle_len <= len; i++)
+    if (haystack[i] == needle[0] && memcmp (haystack + i, needle, needle_len) == 0)
+      return TRUE;
+  return FALSE;
+}
+
+static inline gboolean
+cell_matches (SearchRun   *run,
+              const gchar *cell)
+{
+  if (run->needle)
+    return find_substring (cell, strlen (cell), run->needle, run->needle_len);
+  return g_regex_match (run->regex, cell, 0, NULL);
+}
+
+static SearchRun *
+run_ref (SearchRun *run)
+{
+  g_atomic_int_inc (&run->ref_count);
+  return run;
+}
+
+static void
+run_unref (SearchRun *run)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&run->ref_count))
+    return;
+
+  for (i = 0; i < run->n_chunks; i++)
+    if (run->results[i])
+      g_array_free (run->results[i], TRUE);
+  g_free (run->results);
+  if (run->code_columns)
+    for (i = 0; i < (guint) run->n_columns; i++)
+      g_free (run->code_columns[i].matches);
+  g_free (run->code_columns);
+  g_free (run->needle);
+  if (run->regex)
+    g_regex_unref (run->regex);
+  g_object_unref (run->source);
+  g_mutex_clear (&run->lock);
+  g_slice_free (SearchRun, run);
+}
+
+/* Add the results of the chunks which are complete in row order */
+static gboolean
+add_matches_cb (gpointer user_data)
+{
+  SearchRun *run = user_data;
+  LazySearch *search = run->search;
+  GPtrArray *ready = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+  gint64 first;
+  guint i, j;
+
+  g_mutex_lock (&run->lock);
+  run->idle = 0;
+  while (run->next_chunk < run->n_chunks && run->results[run->next_chunk])
+    {
+      g_ptr_array_add (ready, run->results[run->next_chunk]);
+      run->results[run->next_chunk] = NULL;
+      run->next_chunk++;
+    }
+  g_mutex_unlock (&run->lock);
+
+  if (search == NULL)
+    {
+      g_ptr_array_unref (ready);
+      run_unref (run);
+      return G_SOURCE_REMOVE;
+    }
+
+  first = lazy_row_set_get_count (search->matches);
+  g_rw_lock_writer_lock (&search->lock);
+  for (i = 0; i < ready->len; i++)
+    {
+      GArray *rows = g_ptr_array_index (ready, i);
+
+      for (j = 0; j < rows->len; j++)
+        lazy_row_set_add (search->matches, g_array_index (rows, gint64, j));
+    }
+  g_rw_lock_writer_unlock (&search->lock);
+  g_ptr_array_unref (ready);
+
+  if (lazy_row_set_get_count (search->matches) > first)
+    {
+      g_signal_emit (search, signals[MATCHES_ADDED], 0,
+                     first, lazy_row_set_get_count (search->matches) - first);
+      g_object_notify_by_pspec (G_OBJECT (search), properties[PROP_N_MATCHES]);
+    }
+  if (run->next_chunk == run->n_chunks)
+    {
+      search->run = NULL;
+      run->search = NULL;
+      run_unref (run);
+      g_object_notify_by_pspec (G_OBJECT (search), properties[PROP_SEARCHING]);
+    }
+  g_object_notify_by_pspec (G_OBJECT (search), properties[PROP_PROGRESS]);
+
+  run_unref (run);
+  return G_SOURCE_REMOVE;
+}
+
+/* Mark the rows with a matching code in a dictionary encoded column.
+   Returns FALSE if a column lost its dictionary since the run
+   started. */
+static gboolean
+match_codes (SearchRun *run,
+             gint64     row0,
+             gint       n_rows,
+             guint8    *matched)
+{
+  guint16 *codes = g_new (guint16, n_rows);
+  gboolean ok = TRUE;
+  gint col, i;
+
+  for (col = 0; ok && col < run->n_columns; col++)
+    {
+      const CodeColumn *code_column = &run->code_columns[col];
+
+      if (code_column->matches == NULL || !code_column->any)
+        continue;
+      ok = lazy_block_source_fetch_codes (run->source, col, row0, n_rows, codes);
+      for (i = 0; ok && i < n_rows; i++)
+        if (codes[i] >= code_column->n_codes)
+          ok = FALSE;
+        else
+          matched[i] |= code_column->matches[codes[i]];
+    }
+  g_free (codes);
+  return ok;
+}
+
+/* Mark the rows with a matching cell in the text columns, or in all
+   columns */
+static void
+match_text (SearchRun *run,
+            gint64     row0,
+            gint       n_rows,
+            gboolean   all_columns,
+            guint8    *matched)
+{
+  gint col0 = all_columns ? 0 : run->text_col0;
+  gint col_end = all_columns ? run->n_columns : run->text_col_end;
+  LazyBlock *block;
+  gint i, col;
+
+  block = lazy_block_new ();
+  lazy_block_reset (block, row0, n_rows, col0, col_end - col0);
+  lazy_block_source_fetch_block (run->source, block);
+  for (i = 0; i < n_rows; i++)
+    for (col = col0; !matched[i] && col < col_end; col++)
+      {
+        const gchar *cell;
+
+        if (!all_columns && run->code_columns && run->code_columns[col].matches)
+          continue;
+        cell = lazy_block_get (block, row0 + i, col);
+        if (cell && cell_matches (run, cell))
+          matched[i] = TRUE;
+      }
+  lazy_block_free (block);
+}
+
+/* Runs on a worker thread */
+static void
+search_func (gpointer data,
+             gpointer user_data)
+{
+  SearchTask *task = data;
+  SearchRun *run = task->run;
+  gint64 row0 = (gint64) task->chunk * run->chunk_rows;
+  gint n_rows = MIN (run->chunk_rows, run->n_rows - row0);
+  gboolean all_columns = FALSE;
+  guint8 *matched;
+  GArray *rows;
+  gint i;
+
+  if (g_atomic_int_get (&run->cancelled))
+    goto done;
+
+  matched = g_new0 (guint8, n_rows);
+  if (run->code_columns)
+    all_columns = !match_codes (run, row0, n_rows, matched);
+  if (all_columns || run->text_col0 < run->text_col_end)
+    match_text (run, row0, n_rows, all_columns, matched);
+  rows = g_array_new (FALSE, FALSE, sizeof (gint64));
+  for (i = 0; i < n_rows; i++)
+    if (matched[i])
+      {
+        gint64 row = row0 + i;
+
+        g_array_append_val (rows, row);
+      }
+  g_free (matched);
+
+  g_mutex_lock (&run->lock);
+  run->results[task->chunk] = rows;
+  if (run->idle == 0)
+    run->idle = g_idle_add (add_matches_cb, run_ref (run));
+  g_mutex_unlock (&run->lock);
+
+ done:
+  run_unref (run);
+  g_slice_free (SearchTask, task);
+}
+
+/* Drop the running query, late results are ignored */
+static void
+cancel_run (LazySearch *search)
+{
+  SearchRun *run = search->run;
+
+  if (run == NULL)
+    return;
+  g_atomic_int_set (&run->cancelled, TRUE);
+  run->search = NULL;
+  search->run = NULL;
+  run_unref (run);
+}
+
+/* Evaluate the query for the strings of the dictionary encoded
+   columns, on the main thread before the tasks are queued */
+static void
+evaluate_dictionaries (SearchRun *run)
+{
+  gboolean coded = FALSE;
+  gint col;
+  guint code;
+
+  run->code_columns = g_new0 (CodeColumn, run->n_columns);
+  run->text_col0 = run->n_columns;
+  run->text_col_end = 0;
+  for (col = 0; col < run->n_columns; col++)
+    {
+      CodeColumn *code_column = &run->code_columns[col];
+      GPtrArray *dictionary = lazy_block_source_dup_dictionary (run->source, col);
+
+      if (dictionary == NULL)
+        {
+          run->text_col0 = MIN (run->text_col0, col);
+          run->text_col_end = col + 1;
+          continue;
+        }
+      /* Code 0 is the empty cell, which never matches */
+      code_column->n_codes = dictionary->len;
+      code_column->matches = g_new0 (guint8, dictionary->len);
+      for (code = 1; code < dictionary->len; code++)
+        if (cell_matches (run, g_ptr_array_index (dictionary, code)))
+          code_column->matches[code] = code_column->any = TRUE;
+      g_ptr_array_unref (dictionary);
+      coded = TRUE;
+    }
+  if (!coded)
+    g_clear_pointer (&run->code_columns, g_free);
+}
+
+/* Scan the rows for the query */
+static void
+start_run (LazySearch *search)
+{
+  SearchRun *run;
+  guint i;
+
+  run = g_slice_new0 (SearchRun);
+  run->ref_count = 1;
+  run->search = search;
+  run->source = g_object_ref (LAZY_BLOCK_SOURCE (search->model));
+  run->n_columns = gtk_tree_model_get_n_columns (search->model);
+  if (search->regex)
+    run->regex = g_regex_ref (search->regex);
+  else
+    {
+      run->needle = g_strdup (search->query);
+      run->needle_len = strlen (search->query);
+    }
+  run->n_rows = lazy_block_source_get_n_rows (run->source);
+  run->chunk_rows = MAX (SEARCH_CHUNK_CELLS / MAX (run->n_columns, 1), 1);
+  run->n_chunks = (run->n_rows + run->chunk_rows - 1) / run->chunk_rows;
+  run->results = g_new0 (GArray *, run->n_chunks);
+  g_mutex_init (&run->lock);
+  search->run = run;
+  search->n_searched = run->n_rows;
+  evaluate_dictionaries (run);
+
+  if (run->n_chunks == 0 || run->n_columns == 0)
+    {
+      cancel_run (search);
+      return;
+    }
+
+  for (i = 0; i < run->n_chunks; i++)
+    {
+      SearchTask *task = g_slice_new (SearchTask);
+
+      task->run = run_ref (run);
+      task->chunk = i;
+      g_thread_pool_push (search->pool, task, NULL);
+    }
+}
+
+/* Clear the matches and search again with the current query */
+static void
+restart (LazySearch *search)
+{
+  gboolean was_searching = search->run != NULL;
+
+  cancel_run (search);
+  g_rw_lock_writer_lock (&search->lock);
+  lazy_row_set_clear (search->matches);
+  g_rw_lock_writer_unlock (&search->lock);
+  g_signal_emit (search, signals[CLEARED], 0);
+
+  search->n_searched = 0;
+  if (search->query && *search->query)
+    start_run (search);
+
+  g_object_freeze_notify (G_OBJECT (search));
+  g_object_notify_by_pspec (G_OBJECT (search), properties[PROP_N_MATCHES]);
+  g_object_notify_by_pspec (G_OBJECT (search), properties[PROP_PROGRESS]);
+  if (was_searching != (search->run != NULL))
+    g_object_notify_by_pspec (G_OBJECT (search), properties[PROP_SEARCHING]);
+  g_object_thaw_notify (G_OBJECT (search));
+}
+
+/* Changes of the model */
+
+static void
+model_changed_cb (GtkTreeModel *model,
+                  LazySearch   *search)
+{
+  restart (search);
+}
+
+static void
+rows_inserted_cb (LazyBlockSource *source,
+                  gint64           row,
+                  gint64           n_rows,
+                  LazySearch      *search)
+{
+  /* Appended rows are not searched */
+  if (row < search->n_searched)
+    restart (search);
+}
+
+static void
+rows_deleted_cb (LazyBlockSource *source,
+                 gint64           row,
+                 gint64           n_rows,
+                 LazySearch      *search)
+{
+  restart (search);
+}
+
+
+/* Public API */
+
+LazySearch *
+lazy_search_new (GtkTreeModel *model)
+{
+  LazySearch *search;
+
+  g_return_val_if_fail (GTK_IS_TREE_MODEL (model), NULL);
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (model), NULL);
+
+  search = g_object_new (TYPE_LAZY_SEARCH, NULL);
+  search->model = g_object_ref (model);
+  g_signal_connect (model, "reordered",
+                    G_CALLBACK (model_changed_cb), search);
+  g_signal_connect (model, "reset",
+                    G_CALLBACK (model_changed_cb), search);
+  g_signal_connect (model, "rows-inserted",
+                    G_CALLBACK (rows_inserted_cb), search);
+  g_signal_connect (model, "rows-deleted",
+                    G_CALLBACK (rows_deleted_cb), search);
+
+  return search;
+}
+
+GtkTreeModel *
+lazy_search_get_model (LazySearch *search)
+{
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), NULL);
+
+  return search->model;
+}
+
+/* Search for rows with a cell containing query, or matching it as a
+   regular expression with LAZY_SEARCH_REGEX. An empty query matches
+   nothing. Returns FALSE with error set if the regular expression is
+   invalid, the previous query stays in effect then. */
+gboolean
+lazy_search_set_query (LazySearch      *search,
+                       const gchar     *query,
+                       LazySearchFlags  flags,
+                       GError         **error)
+{
+  GRegex *regex = NULL;
+
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), FALSE);
+
+  if (query == NULL)
+    query = "";
+  if (search->query && search->flags == flags && strcmp (search->query, query) == 0)
+    return TRUE;
+
+  if (*query && flags)
+    {
+      GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE;
+      gchar *pattern;
+
+      if (flags & LAZY_SEARCH_IGNORE_CASE)
+        compile_flags |= G_REGEX_CASELESS;
+      if (flags & LAZY_SEARCH_REGEX)
+        pattern = g_strdup (query);
+      else
+        pattern = g_regex_escape_string (query, -1);
+      regex = g_regex_new (pattern, compile_flags, 0, error);
+      g_free (pattern);
+      if (regex == NULL)
+        return FALSE;
+    }
+
+  g_free (search->query);
+  search->query = g_strdup (query);
+  search->flags = flags;
+  if (search->regex)
+    g_regex_unref (search->regex);
+  search->regex = regex;
+
+  restart (search);
+  return TRUE;
+}
+
+gboolean
+lazy_search_get_searching (LazySearch *search)
+{
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), FALSE);
+
+  return search->run != NULL;
+}
+
+gdouble
+lazy_search_get_progress (LazySearch *search)
+{
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), 1.0);
+
+  if (search->run == NULL)
+    return 1.0;
+  return (gdouble) search->run->next_chunk / search->run->n_chunks;
+}
+
+/* The functions below may also be called from fetch threads */
+
+gint64
+lazy_search_get_n_matches (LazySearch *search)
+{
+  gint64 n;
+
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), 0);
+
+  g_rw_lock_reader_lock (&search->lock);
+  n = lazy_row_set_get_count (search->matches);
+  g_rw_lock_reader_unlock (&search->lock);
+  return n;
+}
+
+/* The row of the n-th match or -1 */
+gint64
+lazy_search_get_match (LazySearch *search,
+                       gint64      n)
+{
+  gint64 row;
+
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), -1);
+
+  g_rw_lock_reader_lock (&search->lock);
+  row = lazy_row_set_nth (search->matches, n);
+  g_rw_lock_reader_unlock (&search->lock);
+  return row;
+}
+
+/* The rows of the matches n .. n + n_matches - 1, -1 past the end */
+void
+lazy_search_get_matches (LazySearch *search,
+                         gint64      n,
+                         gint        n_matches,
+                         gint64     *rows)
+{
+  gint i;
+
+  g_return_if_fail (IS_LAZY_SEARCH (search));
+
+  g_rw_lock_reader_lock (&search->lock);
+  rows[0] = n_matches > 0 ? lazy_row_set_nth (search->matches, n) : -1;
+  for (i = 1; i < n_matches; i++)
+    rows[i] = rows[i - 1] < 0 ? -1 : lazy_row_set_next (search->matches, rows[i - 1] + 1);
+  g_rw_lock_reader_unlock (&search->lock);
+}
+
+/* The position of row in the matches or -1 if it does not match */
+gint64
+lazy_search_get_match_position (LazySearch *search,
+                                gint64      row)
+{
+  gint64 position = -1;
+
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), -1);
+
+  g_rw_lock_reader_lock (&search->lock);
+  if (lazy_row_set_contains (search->matches, row))
+    position = lazy_row_set_rank (search->matches, row);
+  g_rw_lock_reader_unlock (&search->lock);
+  return position;
+}
+
+/* The first matching row after row or -1 */
+gint64
+lazy_search_find_next (LazySearch *search,
+                       gint64      row)
+{
+  gint64 next;
+
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), -1);
+
+  g_rw_lock_reader_lock (&search->lock);
+  next = lazy_row_set_next (search->matches, row + 1);
+  g_rw_lock_reader_unlock (&search->lock);
+  return next;
+}
+
+/* The last matching row before row or -1 */
+gint64
+lazy_search_find_previous (LazySearch *search,
+                           gint64      row)
+{
+  gint64 previous;
+
+  g_return_val_if_fail (IS_LAZY_SEARCH (search), -1);
+
+  g_rw_lock_reader_lock (&search->lock);
+  previous = lazy_row_set_previous (search->matches, row - 1);
+  g_rw_lock_reader_unlock (&search->lock);
+  return previous;
+}
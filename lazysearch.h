@@ -0,0 +1,75 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_SEARCH_H__
+#define __LAZY_SEARCH_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_SEARCH                (lazy_search_get_type ())
+#define LAZY_SEARCH(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_SEARCH, LazySearch))
+#define LAZY_SEARCH_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_SEARCH, LazySearchClass))
+#define IS_LAZY_SEARCH(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_SEARCH))
+#define IS_LAZY_SEARCH_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_SEARCH))
+#define LAZY_SEARCH_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_SEARCH, LazySearchClass))
+
+typedef struct _LazySearch             LazySearch;
+typedef struct _LazySearchClass        LazySearchClass;
+
+struct _LazySearchClass
+{
+  GObjectClass parent_class;
+
+};
+
+typedef enum
+{
+  LAZY_SEARCH_REGEX       = 1 << 0,
+  LAZY_SEARCH_IGNORE_CASE = 1 << 1
+} LazySearchFlags;
+
+GType         lazy_search_get_type          (void) G_GNUC_CONST;
+
+LazySearch   *lazy_search_new               (GtkTreeModel    *model);
+GtkTreeModel *lazy_search_get_model         (LazySearch      *search);
+
+gboolean      lazy_search_set_query         (LazySearch      *search,
+                                             const gchar     *query,
+                                             LazySearchFlags  flags,
+                                             GError         **error);
+gboolean      lazy_search_get_searching     (LazySearch      *search);
+gdouble       lazy_search_get_progress      (LazySearch      *search);
+
+gint64        lazy_search_get_n_matches     (LazySearch      *search);
+gint64        lazy_search_get_match         (LazySearch      *search,
+                                             gint64           n);
+void          lazy_search_get_matches       (LazySearch      *search,
+                                             gint64           n,
+                                             gint             n_matches,
+                                             gint64          *rows);
+gint64        lazy_search_get_match_position (LazySearch     *search,
+                                             gint64           row);
+gint64        lazy_search_find_next         (LazySearch      *search,
+                                             gint64           row);
+gint64        lazy_search_find_previous     (LazySearch      *search,
+                                             gint64           row);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_SEARCH_H__ */
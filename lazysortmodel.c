@@ -0,0 +1,1384 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The sort model shows the rows of a block source in the order of
+   one column without copying the cells. The order is a permutation
+   of the child rows which is built on worker threads:
+
+   1. The column is fetched in blocks and each cell becomes a sort
+      key, the first 8 bytes of the string or the number if all cells
+      of the column are numbers. Sources with typed columns hand out
+      the numbers without text, see lazy_block_source_fetch_numbers.
+      For dictionary encoded columns the keys of the distinct strings
+      are made once and the cells only hand out their codes.
+   2. Every thread sorts its part of the keys.
+   3. The sorted parts are merged pairwise, one thread per pair.
+
+   Until the new order is complete the previous order is shown. The
+   finished order is swapped in under the write lock and announced
+   with one reordered signal. Strings are compared byte wise and not
+   by the collation of the locale.
+
+   Rows appended to the child stay at the end in child order until
+   the next sort. Other structural changes of the child drop the
+   order and sort again. A finished order can be saved to a file and
+   loaded instead of sorting. */
+
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+#include <math.h>
+#include <string.h>
+#include "lazysortmodel.h"
+#include "lazyblocksource.h"
+
+/* Rows fetched from the child per block while extracting keys */
+#define SORT_BLOCK_ROWS 4096
+/* Fewer rows per thread are not worth a thread */
+#define SORT_MIN_ROWS (64 * 1024)
+/* Order files start with this magic and the order header */
+#define ORDER_MAGIC "LAZYSORT"
+#define ORDER_HEADER_SIZE 24
+
+/* Properties */
+enum {
+  PROP_0,
+  PROP_SORTING,
+  LAST_PROP,
+};
+
+static GParamSpec *properties[LAST_PROP];
+
+typedef struct _Order Order;
+typedef struct _SortKey SortKey;
+typedef struct _SortJob SortJob;
+typedef struct _SortTask SortTask;
+
+/* A permutation of the first n_rows child rows, sorted by column */
+struct _Order
+{
+  gint column;
+  GtkSortType sort_type;
+  gint64 n_rows;
+  guint32 *rows;       /* Sorted position -> child row */
+  guint32 *positions;  /* Child row -> sorted position */
+  GMappedFile *file;   /* Owns rows if loaded from a file */
+};
+
+struct _SortKey
+{
+  guint64 key;
+  const gchar *string;  /* Full string for equal keys, NULL for numbers */
+  guint32 row;
+};
+
+/* A sort running on its own thread. The job owns itself, it is freed
+   on the main loop when the thread is done. */
+struct _SortJob
+{
+  LazySortModel *sort_model;  /* NULL if the result is not wanted */
+  LazyBlockSource *child;
+  gint column;
+  GtkSortType order;
+  gint64 n_rows;
+  guint n_threads;
+  gint cancelled;
+  GThread *thread;
+
+  SortKey *keys;
+  SortKey *tmp;
+  GStringChunk **strings;   /* Per thread */
+
+  /* The strings of a dictionary encoded column or NULL, with their
+     keys and whether they are numbers by code */
+  GPtrArray *dictionary;
+  guint64 *code_keys;
+  guint8 *code_numeric;
+
+  gboolean *numeric;        /* Per thread */
+  gboolean all_numeric;
+  Order *result;
+};
+
+/* A part of a parallel step */
+struct _SortTask
+{
+  SortJob *job;
+  guint part;
+  gint64 start;
+  gint64 mid;     /* Start of the second run when merging */
+  gint64 end;
+};
+
+struct _LazySortModel
+{
+  GObject parent;
+
+  /* private */
+  GtkTreeModel *child;
+  gint stamp;
+
+  /* The current order, NULL for child order */
+  Order *order;
+  GRWLock lock;
+
+  gint sort_column;
+  GtkSortType sort_order;
+  SortJob *job;
+};
+
+/* The row id is 64 bit, see lazystore.c */
+static inline gint64
+iter_get_row (GtkTreeIter *iter)
+{
+  return (gint64) (((guint64) GPOINTER_TO_UINT (iter->user_data2) << 32) |
+                   GPOINTER_TO_UINT (iter->user_data));
+}
+
+static inline void
+iter_set_row (GtkTreeIter *iter,
+              gint64       row)
+{
+  iter->user_data = GUINT_TO_POINTER ((guint) ((guint64) row & 0xffffffff));
+  iter->user_data2 = GUINT_TO_POINTER ((guint) ((guint64) row >> 32));
+}
+
+static void         lazy_sort_model_tree_model_init (GtkTreeModelIface *iface);
+static GtkTreeModelFlags lazy_sort_model_get_flags  (GtkTreeModel      *tree_model);
+static gint         lazy_sort_model_get_n_columns   (GtkTreeModel      *tree_model);
+static GType        lazy_sort_model_get_column_type (GtkTreeModel      *tree_model,
+                                                     gint               index);
+static gboolean     lazy_sort_model_get_iter        (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter,
+                                                     GtkTreePath       *path);
+static GtkTreePath *lazy_sort_model_get_path        (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter);
+static void         lazy_sort_model_get_value       (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter,
+                                                     gint               column,
+                                                     GValue            *value);
+static gboolean     lazy_sort_model_iter_next       (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter);
+static gboolean     lazy_sort_model_iter_previous   (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter);
+static gboolean     lazy_sort_model_iter_children   (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter,
+                                                     GtkTreeIter       *parent);
+static gboolean     lazy_sort_model_iter_has_child  (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter);
+static gint         lazy_sort_model_iter_n_children (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter);
+static gboolean     lazy_sort_model_iter_nth_child  (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter,
+                                                     GtkTreeIter       *parent,
+                                                     gint               n);
+static gboolean     lazy_sort_model_iter_parent     (GtkTreeModel      *tree_model,
+                                                     GtkTreeIter       *iter,
+                                                     GtkTreeIter       *child);
+
+static void         lazy_sort_model_sortable_init   (GtkTreeSortableIface *iface);
+static gboolean     lazy_sort_model_get_sort_column_id (GtkTreeSortable *sortable,
+                                                     gint              *sort_column_id,
+                                                     GtkSortType       *order);
+static void         lazy_sort_model_set_sort_column_id (GtkTreeSortable *sortable,
+                                                     gint               sort_column_id,
+                                                     GtkSortType        order);
+static void         lazy_sort_model_set_sort_func   (GtkTreeSortable   *sortable,
+                                                     gint               sort_column_id,
+                                                     GtkTreeIterCompareFunc func,
+                                                     gpointer           data,
+                                                     GDestroyNotify     destroy);
+static void         lazy_sort_model_set_default_sort_func (GtkTreeSortable *sortable,
+                                                     GtkTreeIterCompareFunc func,
+                                                     gpointer           data,
+                                                     GDestroyNotify     destroy);
+static gboolean     lazy_sort_model_has_default_sort_func (GtkTreeSortable *sortable);
+
+static void         lazy_sort_model_block_source_init (LazyBlockSourceInterface *iface);
+static void         lazy_sort_model_fetch_block     (LazyBlockSource   *source,
+                                                     LazyBlock         *block);
+static gint64       lazy_sort_model_get_n_rows      (LazyBlockSource   *source);
+
+static void         lazy_sort_model_finalize        (GObject           *object);
+static void         lazy_sort_model_get_property    (GObject           *object,
+                                                     guint              prop_id,
+                                                     GValue            *value,
+                                                     GParamSpec        *pspec);
+
+G_DEFINE_TYPE_WITH_CODE (LazySortModel, lazy_sort_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                lazy_sort_model_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_SORTABLE,
+                                                lazy_sort_model_sortable_init)
+                         G_IMPLEMENT_INTERFACE (TYPE_LAZY_BLOCK_SOURCE,
+                                                lazy_sort_model_block_source_init))
+
+
+static void
+lazy_sort_model_class_init (LazySortModelClass *class)
+{
+  GObjectClass *o_class = (GObjectClass *) class;
+
+  o_class->get_property = lazy_sort_model_get_property;
+  o_class->finalize = lazy_sort_model_finalize;
+
+  properties[PROP_SORTING] =
+    g_param_spec_boolean ("sorting",
+                          "Sorting",
+                          "Whether a new order is being built",
+                          FALSE,
+                          G_PARAM_READABLE);
+  g_object_class_install_properties (o_class, LAST_PROP, properties);
+}
+
+static void
+lazy_sort_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = lazy_sort_model_get_flags;
+  iface->get_n_columns = lazy_sort_model_get_n_columns;
+  iface->get_column_type = lazy_sort_model_get_column_type;
+  iface->get_iter = lazy_sort_model_get_iter;
+  iface->get_path = lazy_sort_model_get_path;
+  iface->get_value = lazy_sort_model_get_value;
+  iface->iter_next = lazy_sort_model_iter_next;
+  iface->iter_previous = lazy_sort_model_iter_previous;
+  iface->iter_children = lazy_sort_model_iter_children;
+  iface->iter_has_child = lazy_sort_model_iter_has_child;
+  iface->iter_n_children = lazy_sort_model_iter_n_children;
+  iface->iter_nth_child = lazy_sort_model_iter_nth_child;
+  iface->iter_parent = lazy_sort_model_iter_parent;
+}
+
+static void
+lazy_sort_model_sortable_init (GtkTreeSortableIface *iface)
+{
+  iface->get_sort_column_id = lazy_sort_model_get_sort_column_id;
+  iface->set_sort_column_id = lazy_sort_model_set_sort_column_id;
+  iface->set_sort_func = lazy_sort_model_set_sort_func;
+  iface->set_default_sort_func = lazy_sort_model_set_default_sort_func;
+  iface->has_default_sort_func = lazy_sort_model_has_default_sort_func;
+}
+
+static void
+lazy_sort_model_block_source_init (LazyBlockSourceInterface *iface)
+{
+  iface->fetch_block = lazy_sort_model_fetch_block;
+  iface->get_n_rows = lazy_sort_model_get_n_rows;
+}
+
+static void
+lazy_sort_model_init (LazySortModel *sort_model)
+{
+  g_rw_lock_init (&sort_model->lock);
+  sort_model->stamp = g_random_int ();
+  sort_model->sort_column = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  sort_model->sort_order = GTK_SORT_ASCENDING;
+}
+
+static gboolean cancel_job (LazySortModel *sort_model);
+static void order_free (Order         *order);
+
+static void
+lazy_sort_model_finalize (GObject *object)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (object);
+
+  cancel_job (sort_model);
+  if (sort_model->child)
+    {
+      g_signal_handlers_disconnect_by_data (sort_model->child, sort_model);
+      g_object_unref (sort_model->child);
+    }
+  order_free (sort_model->order);
+  g_rw_lock_clear (&sort_model->lock);
+
+  G_OBJECT_CLASS (lazy_sort_model_parent_class)->finalize (object);
+}
+
+static void
+lazy_sort_model_get_property (GObject    *object,
+                              guint       prop_id,
+                              GValue     *value,
+                              GParamSpec *pspec)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (object);
+
+  switch (prop_id)
+    {
+    case PROP_SORTING:
+      g_value_set_boolean (value, lazy_sort_model_get_sorting (sort_model));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+
+/* Orders */
+
+static void
+order_free (Order *order)
+{
+  if (order == NULL)
+    return;
+  if (order->file)
+    g_mapped_file_unref (order->file);
+  else
+    g_free (order->rows);
+  g_free (order->positions);
+  g_slice_free (Order, order);
+}
+
+static inline gint64
+order_child_row (Order  *order,
+                 gint64  row)
+{
+  return order && row < order->n_rows ? order->rows[row] : row;
+}
+
+static inline gint64
+order_position (Order  *order,
+                gint64  child_row)
+{
+  return order && child_row < order->n_rows ? order->positions[child_row] : child_row;
+}
+
+/* Install the new order and announce it. Plain GtkTreeModel users get
+   the new_order array if somebody listens. */
+static void
+set_order (LazySortModel *sort_model,
+           Order         *order)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (sort_model);
+  Order *old;
+  gint64 n_rows = lazy_block_source_get_n_rows (LAZY_BLOCK_SOURCE (sort_model));
+
+  g_rw_lock_writer_lock (&sort_model->lock);
+  old = sort_model->order;
+  sort_model->order = order;
+  g_rw_lock_writer_unlock (&sort_model->lock);
+
+  sort_model->stamp++;
+  lazy_block_source_reordered (LAZY_BLOCK_SOURCE (sort_model));
+
+  if (n_rows > 0 && n_rows <= G_MAXINT &&
+      g_signal_has_handler_pending (sort_model,
+                                    g_signal_lookup ("rows-reordered", GTK_TYPE_TREE_MODEL),
+                                    0, FALSE))
+    {
+      GtkTreePath *path = gtk_tree_path_new ();
+      gint *new_order = g_new (gint, n_rows);
+      gint64 i;
+
+      for (i = 0; i < n_rows; i++)
+        new_order[i] = order_position (old, order_child_row (order, i));
+      gtk_tree_model_rows_reordered (model, path, NULL, new_order);
+      g_free (new_order);
+      gtk_tree_path_free (path);
+    }
+  order_free (old);
+}
+
+/* Child changes other than appended rows invalidate the order. It is
+   dropped without new_order as it does not match the child anymore. */
+static void
+drop_order (LazySortModel *sort_model)
+{
+  Order *old;
+
+  if (cancel_job (sort_model))
+    g_object_notify_by_pspec (G_OBJECT (sort_model), properties[PROP_SORTING]);
+  g_rw_lock_writer_lock (&sort_model->lock);
+  old = sort_model->order;
+  sort_model->order = NULL;
+  g_rw_lock_writer_unlock (&sort_model->lock);
+  order_free (old);
+}
+
+
+/* Sorting */
+
+/* A prefix of the string which sorts like strcmp */
+static inline guint64
+string_key (const gchar *string)
+{
+  guint64 key = 0;
+  gint i;
+
+  for (i = 0; i < 8 && string[i]; i++)
+    key |= (guint64) (guchar) string[i] << (56 - 8 * i);
+  return key;
+}
+
+/* The bits of a double as unsigned integer which sorts like the
+   double */
+static inline guint64
+number_key (gdouble number)
+{
+  union { gdouble d; guint64 u; } bits;
+
+  bits.d = number;
+  return (bits.u & G_GUINT64_CONSTANT (0x8000000000000000)) ?
+         ~bits.u : bits.u | G_GUINT64_CONSTANT (0x8000000000000000);
+}
+
+static gboolean
+is_number (const gchar *string)
+{
+  gchar *end;
+
+  g_ascii_strtod (string, &end);
+  return end != string && *end == '\0';
+}
+
+/* Equal cells keep the child order in both directions */
+static gint
+compare_keys (gconstpointer a,
+              gconstpointer b,
+              gpointer      user_data)
+{
+  const SortKey *ka = a;
+  const SortKey *kb = b;
+  SortJob *job = user_data;
+  gint result;
+
+  if (ka->key != kb->key)
+    result = ka->key < kb->key ? -1 : 1;
+  else if (ka->string == kb->string)
+    result = 0;     /* The same dictionary string or both empty */
+  else if (ka->string && kb->string)
+    result = strcmp (ka->string, kb->string);
+  else
+    result = (ka->string != NULL) - (kb->string != NULL);
+
+  if (result == 0)
+    return ka->row < kb->row ? -1 : ka->row > kb->row;
+  return job->order == GTK_SORT_DESCENDING ? -result : result;
+}
+
+/* Run func on one thread per task and wait for all of them */
+static void
+run_tasks (SortTask    *tasks,
+           guint        n_tasks,
+           GThreadFunc  func)
+{
+  GThread **threads = g_new (GThread *, n_tasks);
+  guint i;
+
+  for (i = 0; i < n_tasks; i++)
+    threads[i] = g_thread_new ("lazy-sort", func, &tasks[i]);
+  for (i = 0; i < n_tasks; i++)
+    g_thread_join (threads[i]);
+  g_free (threads);
+}
+
+/* Make keys from the codes of a dictionary encoded column, the
+   strings stay in the dictionary. Returns FALSE if the column lost
+   its dictionary since the job started. */
+static gboolean
+extract_codes (SortJob  *job,
+               gint64    row,
+               gint      n,
+               guint16  *codes,
+               gboolean *numeric)
+{
+  gint64 r;
+
+  if (!lazy_block_source_fetch_codes (job->child, job->column, row, n, codes))
+    return FALSE;
+  for (r = 0; r < n; r++)
+    if (codes[r] >= job->dictionary->len)
+      return FALSE;
+
+  for (r = 0; r < n; r++)
+    {
+      SortKey *key = &job->keys[row + r];
+      guint16 code = codes[r];
+
+      key->row = row + r;
+      key->key = job->code_keys[code];
+      key->string = code ? g_ptr_array_index (job->dictionary, code) : NULL;
+      *numeric = *numeric && job->code_numeric[code];
+    }
+  return TRUE;
+}
+
+/* Fetch the cells of the part and make them keys */
+static gpointer
+extract_func (gpointer data)
+{
+  SortTask *task = data;
+  SortJob *job = task->job;
+  GStringChunk *strings = g_string_chunk_new (64 * 1024);
+  LazyBlock *block = lazy_block_new ();
+  gdouble *numbers = g_new (gdouble, SORT_BLOCK_ROWS);
+  guint16 *codes = job->dictionary ? g_new (guint16, SORT_BLOCK_ROWS) : NULL;
+  gboolean numeric = TRUE;
+  gint64 row, r;
+
+  for (row = task->start; row < task->end; row += SORT_BLOCK_ROWS)
+    {
+      gint n = MIN (SORT_BLOCK_ROWS, task->end - row);
+
+      if (g_atomic_int_get (&job->cancelled))
+        break;
+
+      /* Native numbers need no text and no parsing */
+      if (lazy_block_source_fetch_numbers (job->child, job->column, row, n, numbers))
+        {
+          for (r = row; r < row + n; r++)
+            {
+              SortKey *key = &job->keys[r];
+
+              key->row = r;
+              key->key = isnan (numbers[r - row]) ? 0 : number_key (numbers[r - row]);
+              key->string = NULL;
+            }
+          continue;
+        }
+      if (codes && extract_codes (job, row, n, codes, &numeric))
+        continue;
+
+      lazy_block_reset (block, row, n, job->column, 1);
+      lazy_block_source_fetch_block (job->child, block);
+      for (r = row; r < row + n; r++)
+        {
+          const gchar *string = lazy_block_get (block, r, job->column);
+          SortKey *key = &job->keys[r];
+
+          key->row = r;
+          key->key = 0;
+          key->string = NULL;
+          if (string == NULL)
+            continue;
+          key->key = string_key (string);
+          key->string = g_string_chunk_insert (strings, string);
+          if (numeric && *string)
+            numeric = is_number (string);
+        }
+    }
+
+  lazy_block_free (block);
+  g_free (numbers);
+  g_free (codes);
+  job->strings[task->part] = strings;
+  job->numeric[task->part] = numeric;
+  return NULL;
+}
+
+static gpointer
+sort_func (gpointer data)
+{
+  SortTask *task = data;
+  SortJob *job = task->job;
+  gint64 r;
+
+  if (job->all_numeric)
+    for (r = task->start; r < task->end; r++)
+      {
+        SortKey *key = &job->keys[r];
+
+        /* Empty cells come first, native numbers have their key */
+        if (key->string)
+          key->key = *key->string ? number_key (g_ascii_strtod (key->string, NULL)) : 0;
+        key->string = NULL;
+      }
+  g_qsort_with_data (job->keys + task->start, task->end - task->start,
+                     sizeof (SortKey), compare_keys, job);
+  return NULL;
+}
+
+/* Merge the sorted runs [start, mid) and [mid, end) of keys into tmp */
+static gpointer
+merge_func (gpointer data)
+{
+  SortTask *task = data;
+  SortJob *job = task->job;
+  SortKey *a = job->keys + task->start;
+  SortKey *a_end = job->keys + task->mid;
+  SortKey *b = a_end;
+  SortKey *b_end = job->keys + task->end;
+  SortKey *out = job->tmp + task->start;
+  guint count = 0;
+
+  while (a < a_end && b < b_end)
+    {
+      if ((++count & 0xffff) == 0 && g_atomic_int_get (&job->cancelled))
+        return NULL;
+      *out++ = compare_keys (b, a, job) < 0 ? *b++ : *a++;
+    }
+  memcpy (out, a, (a_end - a) * sizeof (SortKey));
+  out += a_end - a;
+  memcpy (out, b, (b_end - b) * sizeof (SortKey));
+  return NULL;
+}
+
+static gpointer
+build_func (gpointer data)
+{
+  SortTask *task = data;
+  Order *order = task->job->result;
+  SortKey *keys = task->job->keys;
+  gint64 i;
+
+  for (i = task->start; i < task->end; i++)
+    {
+      order->rows[i] = keys[i].row;
+      order->positions[keys[i].row] = i;
+    }
+  return NULL;
+}
+
+static void
+job_free (SortJob *job)
+{
+  guint i;
+
+  if (job->strings)
+    for (i = 0; i < job->n_threads; i++)
+      if (job->strings[i])
+        g_string_chunk_free (job->strings[i]);
+  g_free (job->strings);
+  g_free (job->numeric);
+  if (job->dictionary)
+    g_ptr_array_unref (job->dictionary);
+  g_free (job->code_keys);
+  g_free (job->code_numeric);
+  g_free (job->keys);
+  g_free (job->tmp);
+  order_free (job->result);
+  g_object_unref (job->child);
+  g_slice_free (SortJob, job);
+}
+
+/* Runs on the main loop when the sort thread is done */
+static gboolean
+sort_done_cb (gpointer user_data)
+{
+  SortJob *job = user_data;
+  LazySortModel *sort_model = job->sort_model;
+
+  g_thread_join (job->thread);
+  if (sort_model)
+    {
+      sort_model->job = NULL;
+      /* No result if the memory was not sufficient */
+      if (job->result)
+        set_order (sort_model, job->result);
+      job->result = NULL;
+      g_object_notify_by_pspec (G_OBJECT (sort_model), properties[PROP_SORTING]);
+    }
+  job_free (job);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+sort_thread (gpointer data)
+{
+  SortJob *job = data;
+  SortTask *tasks = g_new0 (SortTask, job->n_threads);
+  gint64 *bounds = g_new (gint64, job->n_threads + 1);
+  guint n_runs = job->n_threads;
+  guint i;
+
+  job->keys = g_try_new (SortKey, job->n_rows);
+  job->tmp = g_try_new (SortKey, job->n_rows);
+  if (job->keys == NULL || job->tmp == NULL)
+    {
+      g_warning ("Not enough memory to sort %" G_GINT64_FORMAT " rows", job->n_rows);
+      g_atomic_int_set (&job->cancelled, TRUE);
+      goto done;
+    }
+
+  for (i = 0; i <= job->n_threads; i++)
+    bounds[i] = job->n_rows * i / job->n_threads;
+  for (i = 0; i < job->n_threads; i++)
+    {
+      tasks[i].job = job;
+      tasks[i].part = i;
+      tasks[i].start = bounds[i];
+      tasks[i].end = bounds[i + 1];
+    }
+
+  run_tasks (tasks, job->n_threads, extract_func);
+  if (g_atomic_int_get (&job->cancelled))
+    goto done;
+  job->all_numeric = TRUE;
+  for (i = 0; i < job->n_threads; i++)
+    job->all_numeric = job->all_numeric && job->numeric[i];
+
+  run_tasks (tasks, job->n_threads, sort_func);
+
+  /* Pairwise merges of the sorted runs until one run is left */
+  while (n_runs > 1 && !g_atomic_int_get (&job->cancelled))
+    {
+      guint n_pairs = n_runs / 2;
+      SortKey *swap;
+
+      for (i = 0; i < n_pairs; i++)
+        {
+          tasks[i].start = bounds[2 * i];
+          tasks[i].mid = bounds[2 * i + 1];
+          tasks[i].end = bounds[2 * i + 2];
+        }
+      run_tasks (tasks, n_pairs, merge_func);
+      /* An odd run is moved as it is */
+      if (n_runs % 2)
+        memcpy (job->tmp + bounds[n_runs - 1], job->keys + bounds[n_runs - 1],
+                (bounds[n_runs] - bounds[n_runs - 1]) * sizeof (SortKey));
+
+      for (i = 0; i <= n_pairs; i++)
+        bounds[i] = bounds[2 * i];
+      if (n_runs % 2)
+        bounds[n_pairs + 1] = bounds[n_runs];
+      n_runs = n_pairs + n_runs % 2;
+      swap = job->keys;
+      job->keys = job->tmp;
+      job->tmp = swap;
+    }
+  if (g_atomic_int_get (&job->cancelled))
+    goto done;
+
+  job->result = g_slice_new0 (Order);
+  job->result->column = job->column;
+  job->result->sort_type = job->order;
+  job->result->n_rows = job->n_rows;
+  job->result->rows = g_new (guint32, job->n_rows);
+  job->result->positions = g_new (guint32, job->n_rows);
+  for (i = 0; i < job->n_threads; i++)
+    {
+      tasks[i].start = job->n_rows * i / job->n_threads;
+      tasks[i].end = job->n_rows * (i + 1) / job->n_threads;
+    }
+  run_tasks (tasks, job->n_threads, build_func);
+
+ done:
+  /* Give the memory back before the main loop gets to it */
+  g_clear_pointer (&job->keys, g_free);
+  g_clear_pointer (&job->tmp, g_free);
+  for (i = 0; i < job->n_threads; i++)
+    g_clear_pointer (&job->strings[i], g_string_chunk_free);
+  g_free (tasks);
+  g_free (bounds);
+  g_idle_add (sort_done_cb, job);
+  return NULL;
+}
+
+/* The result of a running sort is not wanted anymore. The job cleans
+   up after itself. Returns whether a sort was running. */
+static gboolean
+cancel_job (LazySortModel *sort_model)
+{
+  if (sort_model->job == NULL)
+    return FALSE;
+  g_atomic_int_set (&sort_model->job->cancelled, TRUE);
+  sort_model->job->sort_model = NULL;
+  sort_model->job = NULL;
+  return TRUE;
+}
+
+/* Build the order of the sort column in the background. The current
+   order is shown until the new one is installed. */
+static void
+start_sort (LazySortModel *sort_model)
+{
+  LazyBlockSource *child = LAZY_BLOCK_SOURCE (sort_model->child);
+  gint64 n_rows = lazy_block_source_get_n_rows (child);
+  SortJob *job;
+
+  if (cancel_job (sort_model))
+    g_object_notify_by_pspec (G_OBJECT (sort_model), properties[PROP_SORTING]);
+
+  if (sort_model->sort_column < 0)
+    {
+      if (sort_model->order)
+        set_order (sort_model, NULL);
+      return;
+    }
+  if (n_rows == 0)
+    return;
+  if (n_rows > G_MAXUINT32)
+    {
+      g_warning ("Cannot sort more than %u rows", G_MAXUINT32);
+      return;
+    }
+
+  job = g_slice_new0 (SortJob);
+  job->sort_model = sort_model;
+  job->child = g_object_ref (child);
+  job->column = sort_model->sort_column;
+  job->order = sort_model->sort_order;
+  job->n_rows = n_rows;
+  job->n_threads = CLAMP (n_rows / SORT_MIN_ROWS, 1, g_get_num_processors ());
+  job->strings = g_new0 (GStringChunk *, job->n_threads);
+  job->numeric = g_new0 (gboolean, job->n_threads);
+  job->dictionary = lazy_block_source_dup_dictionary (child, job->column);
+  if (job->dictionary)
+    {
+      guint code;
+
+      /* Code 0 is the empty cell */
+      job->code_keys = g_new0 (guint64, job->dictionary->len);
+      job->code_numeric = g_new0 (guint8, job->dictionary->len);
+      job->code_numeric[0] = TRUE;
+      for (code = 1; code < job->dictionary->len; code++)
+        {
+          const gchar *string = g_ptr_array_index (job->dictionary, code);
+
+          job->code_keys[code] = string_key (string);
+          job->code_numeric[code] = *string == '\0' || is_number (string);
+        }
+    }
+  sort_model->job = job;
+  job->thread = g_thread_new ("lazy-sort", sort_thread, job);
+  g_object_notify_by_pspec (G_OBJECT (sort_model), properties[PROP_SORTING]);
+}
+
+
+/* Child changes */
+
+static void
+child_row_changed_cb (GtkTreeModel  *child,
+                      GtkTreePath   *child_path,
+                      GtkTreeIter   *child_iter,
+                      LazySortModel *sort_model)
+{
+  gint64 row = order_position (sort_model->order,
+                               gtk_tree_path_get_indices (child_path)[0]);
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  if (row > G_MAXINT)
+    return;
+  path = gtk_tree_path_new_from_indices ((gint) row, -1);
+  iter.stamp = sort_model->stamp;
+  iter_set_row (&iter, row);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (sort_model), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+/* Appended rows are behind the order and need no mapping */
+static void
+child_rows_inserted_cb (LazyBlockSource *child,
+                        gint64           row,
+                        gint64           n_rows,
+                        LazySortModel   *sort_model)
+{
+  gboolean appended = sort_model->order == NULL || row >= sort_model->order->n_rows;
+
+  if (!appended)
+    drop_order (sort_model);
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (sort_model), row, n_rows);
+  if (!appended)
+    {
+      lazy_block_source_reordered (LAZY_BLOCK_SOURCE (sort_model));
+      start_sort (sort_model);
+    }
+}
+
+static void
+child_rows_deleted_cb (LazyBlockSource *child,
+                       gint64           row,
+                       gint64           n_rows,
+                       LazySortModel   *sort_model)
+{
+  drop_order (sort_model);
+  lazy_block_source_rows_deleted (LAZY_BLOCK_SOURCE (sort_model), row, n_rows);
+  lazy_block_source_reordered (LAZY_BLOCK_SOURCE (sort_model));
+  start_sort (sort_model);
+}
+
+static void
+child_reordered_cb (LazyBlockSource *child,
+                    LazySortModel   *sort_model)
+{
+  drop_order (sort_model);
+  lazy_block_source_reordered (LAZY_BLOCK_SOURCE (sort_model));
+  start_sort (sort_model);
+}
+
+static void
+child_reset_cb (LazyBlockSource *child,
+                LazySortModel   *sort_model)
+{
+  drop_order (sort_model);
+  lazy_block_source_reset (LAZY_BLOCK_SOURCE (sort_model));
+  start_sort (sort_model);
+}
+
+/* The child must be a block source, the cells are fetched from it on
+   worker threads */
+LazySortModel *
+lazy_sort_model_new (GtkTreeModel *child_model)
+{
+  LazySortModel *sort_model;
+
+  g_return_val_if_fail (GTK_IS_TREE_MODEL (child_model), NULL);
+  g_return_val_if_fail (IS_LAZY_BLOCK_SOURCE (child_model), NULL);
+
+  sort_model = g_object_new (TYPE_LAZY_SORT_MODEL, NULL);
+  sort_model->child = g_object_ref (child_model);
+  g_signal_connect (child_model, "row-changed",
+                    G_CALLBACK (child_row_changed_cb), sort_model);
+  g_signal_connect (child_model, "rows-inserted",
+                    G_CALLBACK (child_rows_inserted_cb), sort_model);
+  g_signal_connect (child_model, "rows-deleted",
+                    G_CALLBACK (child_rows_deleted_cb), sort_model);
+  g_signal_connect (child_model, "reordered",
+                    G_CALLBACK (child_reordered_cb), sort_model);
+  g_signal_connect (child_model, "reset",
+                    G_CALLBACK (child_reset_cb), sort_model);
+
+  return sort_model;
+}
+
+GtkTreeModel *
+lazy_sort_model_get_model (LazySortModel *sort_model)
+{
+  g_return_val_if_fail (IS_LAZY_SORT_MODEL (sort_model), NULL);
+
+  return sort_model->child;
+}
+
+gint64
+lazy_sort_model_convert_row_to_child_row (LazySortModel *sort_model,
+                                          gint64         row)
+{
+  g_return_val_if_fail (IS_LAZY_SORT_MODEL (sort_model), -1);
+
+  return order_child_row (sort_model->order, row);
+}
+
+/* Whether a new order is being built in the background */
+gboolean
+lazy_sort_model_get_sorting (LazySortModel *sort_model)
+{
+  g_return_val_if_fail (IS_LAZY_SORT_MODEL (sort_model), FALSE);
+
+  return sort_model->job != NULL;
+}
+
+
+/* Order files
+
+   An order file holds the magic, the number of rows as guint64, the
+   sort column and the sort type as gint32 and then the child row of
+   every position as guint32, all in host byte order. Loading maps
+   the file, only the positions are computed. */
+
+gboolean
+lazy_sort_model_save_order (LazySortModel *sort_model,
+                            const gchar   *filename,
+                            GError       **error)
+{
+  GFile *file;
+  GFileOutputStream *stream;
+  Order *order;
+  gchar header[ORDER_HEADER_SIZE];
+  guint64 n_rows;
+  gint32 column, sort_order;
+  gboolean ok;
+
+  g_return_val_if_fail (IS_LAZY_SORT_MODEL (sort_model), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  order = sort_model->order;
+  if (order == NULL)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "The model is not sorted");
+      return FALSE;
+    }
+
+  /* While a new sort runs the shown order is still the previous one,
+     the sort column of the model is already the new one */
+  n_rows = order->n_rows;
+  column = order->column;
+  sort_order = order->sort_type;
+  memcpy (header, ORDER_MAGIC, 8);
+  memcpy (header + 8, &n_rows, 8);
+  memcpy (header + 16, &column, 4);
+  memcpy (header + 20, &sort_order, 4);
+
+  file = g_file_new_for_path (filename);
+  stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+  g_object_unref (file);
+  if (stream == NULL)
+    return FALSE;
+  ok = g_output_stream_write_all (G_OUTPUT_STREAM (stream), header, sizeof (header),
+                                  NULL, NULL, error) &&
+       g_output_stream_write_all (G_OUTPUT_STREAM (stream), order->rows,
+                                  n_rows * sizeof (guint32), NULL, NULL, error) &&
+       g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, error);
+  g_object_unref (stream);
+
+  return ok;
+}
+
+/* Use a saved order instead of sorting. The file must match the child,
+   rows appended since it was saved stay at the end. */
+gboolean
+lazy_sort_model_load_order (LazySortModel *sort_model,
+                            const gchar   *filename,
+                            GError       **error)
+{
+  GMappedFile *file;
+  const gchar *data;
+  Order *order;
+  guint64 n_rows, i;
+  gint32 column, sort_order;
+
+  g_return_val_if_fail (IS_LAZY_SORT_MODEL (sort_model), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (file == NULL)
+    return FALSE;
+  data = g_mapped_file_get_contents (file);
+
+  if (g_mapped_file_get_length (file) < ORDER_HEADER_SIZE ||
+      memcmp (data, ORDER_MAGIC, 8) != 0)
+    goto invalid;
+  memcpy (&n_rows, data + 8, 8);
+  memcpy (&column, data + 16, 4);
+  memcpy (&sort_order, data + 20, 4);
+  if (n_rows > G_MAXUINT32 ||
+      n_rows > (guint64) lazy_block_source_get_n_rows (LAZY_BLOCK_SOURCE (sort_model->child)) ||
+      g_mapped_file_get_length (file) != ORDER_HEADER_SIZE + n_rows * sizeof (guint32) ||
+      column < 0 || column >= gtk_tree_model_get_n_columns (sort_model->child))
+    goto invalid;
+
+  order = g_slice_new0 (Order);
+  order->column = column;
+  order->sort_type = sort_order == GTK_SORT_DESCENDING ?
+                     GTK_SORT_DESCENDING : GTK_SORT_ASCENDING;
+  order->n_rows = n_rows;
+  order->file = file;
+  order->rows = (guint32 *) (data + ORDER_HEADER_SIZE);
+  order->positions = g_new (guint32, n_rows);
+  memset (order->positions, 0xff, n_rows * sizeof (guint32));
+  for (i = 0; i < n_rows; i++)
+    {
+      guint32 row = order->rows[i];
+
+      /* Each child row exactly once */
+      if (row >= n_rows || order->positions[row] != G_MAXUINT32)
+        {
+          order_free (order);
+          g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                       "%s is not a valid order", filename);
+          return FALSE;
+        }
+      order->positions[row] = i;
+    }
+
+  if (cancel_job (sort_model))
+    g_object_notify_by_pspec (G_OBJECT (sort_model), properties[PROP_SORTING]);
+  sort_model->sort_column = order->column;
+  sort_model->sort_order = order->sort_type;
+  gtk_tree_sortable_sort_column_changed (GTK_TREE_SORTABLE (sort_model));
+  set_order (sort_model, order);
+  return TRUE;
+
+ invalid:
+  g_mapped_file_unref (file);
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+               "%s is not an order file of this model", filename);
+  return FALSE;
+}
+
+
+/* Fulfill the GtkTreeSortable requirements. The order is built on
+   worker threads, so compare functions are not supported. */
+static gboolean
+lazy_sort_model_get_sort_column_id (GtkTreeSortable *sortable,
+                                    gint            *sort_column_id,
+                                    GtkSortType     *order)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (sortable);
+
+  if (sort_column_id)
+    *sort_column_id = sort_model->sort_column;
+  if (order)
+    *order = sort_model->sort_order;
+  return sort_model->sort_column >= 0;
+}
+
+static void
+lazy_sort_model_set_sort_column_id (GtkTreeSortable *sortable,
+                                    gint             sort_column_id,
+                                    GtkSortType      order)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (sortable);
+
+  g_return_if_fail (sort_column_id < gtk_tree_model_get_n_columns (sort_model->child));
+
+  /* There is no default order besides the child order */
+  if (sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  if (sort_model->sort_column == sort_column_id && sort_model->sort_order == order)
+    return;
+
+  sort_model->sort_column = sort_column_id;
+  sort_model->sort_order = order;
+  gtk_tree_sortable_sort_column_changed (sortable);
+  start_sort (sort_model);
+}
+
+static void
+lazy_sort_model_set_sort_func (GtkTreeSortable        *sortable,
+                               gint                    sort_column_id,
+                               GtkTreeIterCompareFunc  func,
+                               gpointer                data,
+                               GDestroyNotify          destroy)
+{
+  g_warning ("LazySortModel does not support sort functions");
+  if (destroy)
+    destroy (data);
+}
+
+static void
+lazy_sort_model_set_default_sort_func (GtkTreeSortable        *sortable,
+                                       GtkTreeIterCompareFunc  func,
+                                       gpointer                data,
+                                       GDestroyNotify          destroy)
+{
+  g_warning ("LazySortModel does not support sort functions");
+  if (destroy)
+    destroy (data);
+}
+
+static gboolean
+lazy_sort_model_has_default_sort_func (GtkTreeSortable *sortable)
+{
+  return FALSE;
+}
+
+
+/* Fulfill the GtkTreeModel requirements */
+static GtkTreeModelFlags
+lazy_sort_model_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+lazy_sort_model_get_n_columns (GtkTreeModel *tree_model)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+
+  return gtk_tree_model_get_n_columns (sort_model->child);
+}
+
+static GType
+lazy_sort_model_get_column_type (GtkTreeModel *tree_model,
+                                 gint          index)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+
+  return gtk_tree_model_get_column_type (sort_model->child, index);
+}
+
+static gboolean
+lazy_sort_model_get_iter (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter,
+                          GtkTreePath  *path)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+  gint i;
+
+  i = gtk_tree_path_get_indices (path)[0];
+  if (i < 0 || i >= lazy_sort_model_get_n_rows (LAZY_BLOCK_SOURCE (sort_model)))
+    return FALSE;
+
+  iter->stamp = sort_model->stamp;
+  iter_set_row (iter, i);
+  return TRUE;
+}
+
+static GtkTreePath *
+lazy_sort_model_get_path (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter)
+{
+  GtkTreePath *path;
+  gint64 row = iter_get_row (iter);
+
+  /* Paths can only address gint rows */
+  if (row > G_MAXINT)
+    return NULL;
+
+  path = gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, row);
+  return path;
+}
+
+static void
+lazy_sort_model_get_value (GtkTreeModel *tree_model,
+                           GtkTreeIter  *iter,
+                           gint          column,
+                           GValue       *value)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+  GtkTreeIter child_iter;
+  gint64 row;
+
+  g_rw_lock_reader_lock (&sort_model->lock);
+  row = order_child_row (sort_model->order, iter_get_row (iter));
+  g_rw_lock_reader_unlock (&sort_model->lock);
+
+  if (row <= G_MAXINT &&
+      gtk_tree_model_iter_nth_child (sort_model->child, &child_iter, NULL, row))
+    gtk_tree_model_get_value (sort_model->child, &child_iter, column, value);
+  else
+    g_value_init (value, gtk_tree_model_get_column_type (sort_model->child, column));
+}
+
+static gboolean
+lazy_sort_model_iter_next (GtkTreeModel  *tree_model,
+                           GtkTreeIter   *iter)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+  gint64 row = iter_get_row (iter) + 1;
+
+  iter_set_row (iter, row);
+  if (row >= lazy_sort_model_get_n_rows (LAZY_BLOCK_SOURCE (sort_model)))
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+lazy_sort_model_iter_previous (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+  gint64 row = iter_get_row (iter);
+
+  g_return_val_if_fail (sort_model->stamp == iter->stamp, FALSE);
+
+  if (row == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+  iter_set_row (iter, row - 1);
+  return TRUE;
+}
+
+static gboolean
+lazy_sort_model_iter_children (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *parent)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+
+  /* this is a list, nodes have no children */
+  if (parent || lazy_sort_model_get_n_rows (LAZY_BLOCK_SOURCE (sort_model)) == 0)
+    {
+      iter->stamp = 0;
+      return FALSE;
+    }
+
+  iter->stamp = sort_model->stamp;
+  iter_set_row (iter, 0);
+  return TRUE;
+}
+
+static gboolean
+lazy_sort_model_iter_has_child (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+lazy_sort_model_iter_n_children (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+
+  if (iter == NULL)
+    return gtk_tree_model_iter_n_children (sort_model->child, NULL);
+
+  g_return_val_if_fail (sort_model->stamp == iter->stamp, -1);
+  return 0;
+}
+
+static gboolean
+lazy_sort_model_iter_nth_child (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter,
+                                GtkTreeIter  *parent,
+                                gint          n)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (tree_model);
+
+  iter->stamp = 0;
+  if (parent)
+    return FALSE;
+  if (n < 0 || n >= lazy_sort_model_get_n_rows (LAZY_BLOCK_SOURCE (sort_model)))
+    return FALSE;
+
+  iter->stamp = sort_model->stamp;
+  iter_set_row (iter, n);
+  return TRUE;
+}
+
+static gboolean
+lazy_sort_model_iter_parent (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             GtkTreeIter  *child)
+{
+  iter->stamp = 0;
+  return FALSE;
+}
+
+
+/* Fulfill the LazyBlockSource requirements */
+static void
+lazy_sort_model_fetch_block (LazyBlockSource *source,
+                             LazyBlock       *block)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (source);
+  LazyBlockSource *child = LAZY_BLOCK_SOURCE (sort_model->child);
+  gint64 *rows;
+  gint i;
+
+  g_rw_lock_reader_lock (&sort_model->lock);
+  if (sort_model->order == NULL)
+    {
+      lazy_block_source_fetch_block (child, block);
+      g_rw_lock_reader_unlock (&sort_model->lock);
+      return;
+    }
+
+  rows = g_new (gint64, block->n_rows);
+  for (i = 0; i < block->n_rows; i++)
+    rows[i] = order_child_row (sort_model->order, block->row0 + i);
+  lazy_block_source_fetch_rows (child, block, rows);
+  g_rw_lock_reader_unlock (&sort_model->lock);
+  g_free (rows);
+}
+
+static gint64
+lazy_sort_model_get_n_rows (LazyBlockSource *source)
+{
+  LazySortModel *sort_model = LAZY_SORT_MODEL (source);
+
+  return lazy_block_source_get_n_rows (LAZY_BLOCK_SOURCE (sort_model->child));
+}
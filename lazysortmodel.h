@@ -0,0 +1,59 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_SORT_MODEL_H__
+#define __LAZY_SORT_MODEL_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_LAZY_SORT_MODEL            (lazy_sort_model_get_type ())
+#define LAZY_SORT_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_LAZY_SORT_MODEL, LazySortModel))
+#define LAZY_SORT_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), TYPE_LAZY_SORT_MODEL, LazySortModelClass))
+#define IS_LAZY_SORT_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_LAZY_SORT_MODEL))
+#define IS_LAZY_SORT_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_SORT_MODEL))
+#define LAZY_SORT_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_SORT_MODEL, LazySortModelClass))
+
+typedef struct _LazySortModel          LazySortModel;
+typedef struct _LazySortModelClass     LazySortModelClass;
+
+struct _LazySortModelClass
+{
+  GObjectClass parent_class;
+
+};
+
+GType          lazy_sort_model_get_type        (void) G_GNUC_CONST;
+
+LazySortModel *lazy_sort_model_new             (GtkTreeModel  *child_model);
+
+GtkTreeModel  *lazy_sort_model_get_model       (LazySortModel *sort_model);
+gint64         lazy_sort_model_convert_row_to_child_row (LazySortModel *sort_model,
+                                                gint64         row);
+gboolean       lazy_sort_model_get_sorting     (LazySortModel *sort_model);
+
+gboolean       lazy_sort_model_save_order      (LazySortModel *sort_model,
+                                                const gchar   *filename,
+                                                GError       **error);
+gboolean       lazy_sort_model_load_order      (LazySortModel *sort_model,
+                                                const gchar   *filename,
+                                                GError       **error);
+
+G_END_DECLS
+
+
+#endif /* __LAZY_SORT_MODEL_H__ */
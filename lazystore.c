@@ -17,11 +17,17 @@
 /* This lazystore is an example for a treestore which does produce
    data on demand. No data is actually stored here. The main purpose
    is to provide a GktTreeModel Interface for the treeview to access
-   the data*/
+   the data.
+
+   With lazy_store_set_n_children every row gets that many children,
+   which are leaves. The block source only hands out the rows, the
+   children are reached through GtkTreeModel, e.g. by a
+   LazyExpandModel. */
 
 #include <gtk/gtk.h>
 #include <glib/gprintf.h>
 #include "lazystore.h"
+#include "lazyblocksource.h"
 
 struct _LazyStore
 {
@@ -29,10 +35,43 @@ struct _LazyStore
 
   /* private */
   guint n_columns;
-  guint n_rows;
+  gint64 n_rows;
+  gint n_children;  /* Per row */
   guint stamp;
+  guint latency;  /* Artificial delay per block fetch in microseconds */
 };
 
+/* The row id is 64 bit. It is split into the low and high 32 bits
+   such that it also fits into the iter on 32 bit platforms. */
+static inline gint64
+iter_get_row (GtkTreeIter *iter)
+{
+  return (gint64) (((guint64) GPOINTER_TO_UINT (iter->user_data2) << 32) |
+                   GPOINTER_TO_UINT (iter->user_data));
+}
+
+static inline void
+iter_set_row (GtkTreeIter *iter,
+              gint64       row)
+{
+  iter->user_data = GUINT_TO_POINTER ((guint) ((guint64) row & 0xffffffff));
+  iter->user_data2 = GUINT_TO_POINTER ((guint) ((guint64) row >> 32));
+}
+
+/* The index of a child in its row, -1 for the rows themselves */
+static inline gint
+iter_get_child (GtkTreeIter *iter)
+{
+  return GPOINTER_TO_INT (iter->user_data3) - 1;
+}
+
+static inline void
+iter_set_child (GtkTreeIter *iter,
+                gint         child)
+{
+  iter->user_data3 = GINT_TO_POINTER (child + 1);
+}
+
 
 /* GtkTreeModel Interface */
 static void         lazy_store_tree_model_init (GtkTreeModelIface *iface);
@@ -68,9 +107,17 @@ static gboolean     lazy_store_iter_parent     (GtkTreeModel      *tree_model,
                                                 GtkTreeIter       *iter,
                                                 GtkTreeIter       *child);
 
+/* LazyBlockSource Interface */
+static void         lazy_store_block_source_init (LazyBlockSourceInterface *iface);
+static void         lazy_store_fetch_block     (LazyBlockSource   *source,
+                                                LazyBlock         *block);
+static gint64       lazy_store_get_n_rows      (LazyBlockSource   *source);
+
 G_DEFINE_TYPE_WITH_CODE (LazyStore, lazy_store, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
-                                                lazy_store_tree_model_init))
+                                                lazy_store_tree_model_init)
+                         G_IMPLEMENT_INTERFACE (TYPE_LAZY_BLOCK_SOURCE,
+                                                lazy_store_block_source_init))
 
 
 static void
@@ -97,6 +144,13 @@ lazy_store_tree_model_init (GtkTreeModelIface *iface)
   iface->iter_parent = lazy_store_iter_parent;
 }
 
+static void
+lazy_store_block_source_init (LazyBlockSourceInterface *iface)
+{
+  iface->fetch_block = lazy_store_fetch_block;
+  iface->get_n_rows = lazy_store_get_n_rows;
+}
+
 static void
 lazy_store_init (LazyStore *lazy_store)
 {
@@ -112,11 +166,83 @@ lazy_store_new (void)
   return g_object_new (TYPE_LAZY_STORE, NULL);
 }
 
+/* A store with the given size. The number of rows may exceed the gint
+   range, GtkTreeModel users then only see the first G_MAXINT rows
+   while LazyBlockSource users see all of them. */
+LazyStore *
+lazy_store_new_with_size (guint  n_columns,
+                          gint64 n_rows)
+{
+  LazyStore *lazy_store;
+
+  g_return_val_if_fail (n_rows >= 0, NULL);
+
+  lazy_store = g_object_new (TYPE_LAZY_STORE, NULL);
+  lazy_store->n_columns = n_columns;
+  lazy_store->n_rows = n_rows;
+  return lazy_store;
+}
+
+/* Add rows at the end, e.g. to simulate a growing log. The rows are
+   announced with one rows-inserted emission. */
+void
+lazy_store_append_rows (LazyStore *lazy_store,
+                        gint64     n_rows)
+{
+  gint64 old_n_rows;
+
+  g_return_if_fail (IS_LAZY_STORE (lazy_store));
+  g_return_if_fail (n_rows >= 0);
+
+  old_n_rows = lazy_store->n_rows;
+  lazy_store->n_rows += n_rows;
+  lazy_block_source_rows_inserted (LAZY_BLOCK_SOURCE (lazy_store),
+                                   old_n_rows, n_rows);
+}
+
+/* Give every row n_children children. The children are generated
+   like the rows and only when asked for, a million children per row
+   cost nothing until they are shown. Set it before the store is
+   used. */
+void
+lazy_store_set_n_children (LazyStore *lazy_store,
+                           gint       n_children)
+{
+  g_return_if_fail (IS_LAZY_STORE (lazy_store));
+  g_return_if_fail (n_children >= 0);
+
+  lazy_store->n_children = n_children;
+}
+
+/* Delay every block fetch by the given time to simulate a slow
+   backend, e.g. a remote database. Block fetches may run on worker
+   threads, so the value is accessed atomically. */
+void
+lazy_store_set_latency (LazyStore *lazy_store,
+                        guint      microseconds)
+{
+  g_return_if_fail (IS_LAZY_STORE (lazy_store));
+
+  g_atomic_int_set (&lazy_store->latency, microseconds);
+}
+
+guint
+lazy_store_get_latency (LazyStore *lazy_store)
+{
+  g_return_val_if_fail (IS_LAZY_STORE (lazy_store), 0);
+
+  return g_atomic_int_get (&lazy_store->latency);
+}
+
 
 /* Fulfill the GtkTreeModel requirements */
 static GtkTreeModelFlags
 lazy_store_get_flags (GtkTreeModel *tree_model)
 {
+  LazyStore *lazy_store = LAZY_STORE (tree_model);
+
+  if (lazy_store->n_children)
+    return GTK_TREE_MODEL_ITERS_PERSIST;
   return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
 }
 
@@ -145,17 +271,22 @@ lazy_store_get_iter (GtkTreeModel *tree_model,
                      GtkTreePath  *path)
 {
   LazyStore *lazy_store = LAZY_STORE (tree_model);
+  gint depth = gtk_tree_path_get_depth (path);
+  gint *indices = gtk_tree_path_get_indices (path);
   gint i;
 
-  i = gtk_tree_path_get_indices (path)[0];
+  i = indices[0];
 
-  if (i >= lazy_store->n_rows)
+  if (i < 0 || i >= lazy_store->n_rows || depth > 2)
     {
       return FALSE;
     }
+  if (depth == 2 && (indices[1] < 0 || indices[1] >= lazy_store->n_children))
+    return FALSE;
 
   iter->stamp = lazy_store->stamp;
-  iter->user_data = (gpointer)(intptr_t)i;
+  iter_set_row (iter, i);
+  iter_set_child (iter, depth == 2 ? indices[1] : -1);
 
   return TRUE;
 }
@@ -167,11 +298,15 @@ lazy_store_get_path (GtkTreeModel *tree_model,
   LazyStore *lazy_store = LAZY_STORE (tree_model);
 
   GtkTreePath *path;
+  gint64 row = iter_get_row (iter);
 
-  if ((guint)(intptr_t)iter->user_data >= lazy_store->n_rows)
+  /* Paths can only address gint rows */
+  if (row >= lazy_store->n_rows || row > G_MAXINT)
     return NULL;
   path = gtk_tree_path_new ();
-  gtk_tree_path_append_index (path, (gulong)iter->user_data);
+  gtk_tree_path_append_index (path, row);
+  if (iter_get_child (iter) >= 0)
+    gtk_tree_path_append_index (path, iter_get_child (iter));
   return path;
 }
 
@@ -183,13 +318,17 @@ lazy_store_get_value (GtkTreeModel *tree_model,
 {
   LazyStore *lazy_store = LAZY_STORE (tree_model);
   gchar string[100];
+  gint64 row = iter_get_row (iter);
+  gint child = iter_get_child (iter);
 
   g_return_if_fail (column < lazy_store->n_columns);
-  //printf("%s - row: %d, col: %d\n", __FUNCTION__,(gint) iter->user_data,column);
-  g_return_if_fail ((guint)(intptr_t)iter->user_data < lazy_store->n_rows);
+  g_return_if_fail (row < lazy_store->n_rows);
 
   g_value_init (value, G_TYPE_STRING);
-  g_sprintf(string,"Row: %d, Column: %d",(gint)(intptr_t)iter->user_data,column);
+  if (child >= 0)
+    g_sprintf (string, "Row: %" G_GINT64_FORMAT ".%d, Column: %d", row, child, column);
+  else
+    g_sprintf(string,"Row: %" G_GINT64_FORMAT ", Column: %d",row,column);
   g_value_set_string (value, string);
 }
 
@@ -198,10 +337,23 @@ lazy_store_iter_next (GtkTreeModel  *tree_model,
                       GtkTreeIter   *iter)
 {
   LazyStore *lazy_store = LAZY_STORE (tree_model);
+  gint64 row = iter_get_row (iter) + 1;
+  gint child = iter_get_child (iter);
+
+  if (child >= 0)
+    {
+      iter_set_child (iter, child + 1);
+      if (child + 1 >= lazy_store->n_children)
+        {
+          iter->stamp = 0;
+          return FALSE;
+        }
+      return TRUE;
+    }
 
-  iter->user_data++;
+  iter_set_row (iter, row);
 
-  if ((guint)(intptr_t)iter->user_data >= lazy_store->n_rows)
+  if (row >= lazy_store->n_rows)
     {
       iter->stamp = 0;
       return FALSE;
@@ -215,15 +367,23 @@ lazy_store_iter_previous (GtkTreeModel *tree_model,
 {
   LazyStore *lazy_store = LAZY_STORE (tree_model);
 
+  gint64 row = iter_get_row (iter);
+  gint child = iter_get_child (iter);
+
   g_return_val_if_fail (lazy_store->stamp == iter->stamp, FALSE);
 
-  if (iter->user_data == 0)
+  if (child > 0)
+    {
+      iter_set_child (iter, child - 1);
+      return TRUE;
+    }
+  if (row == 0 || child == 0)
     {
       iter->stamp = 0;
       return FALSE;
     }
 
-  iter->user_data--;
+  iter_set_row (iter, row - 1);
 
   return TRUE;
 }
@@ -235,17 +395,14 @@ lazy_store_iter_children (GtkTreeModel *tree_model,
 {
   LazyStore *lazy_store = (LazyStore *) tree_model;
 
-  /* this is a list, nodes have no children */
   if (parent)
-    {
-      iter->stamp = 0;
-      return FALSE;
-    }
+    return lazy_store_iter_nth_child (tree_model, iter, parent, 0);
 
   if (lazy_store->n_rows > 0)
     {
       iter->stamp = lazy_store->stamp;
-      iter->user_data = 0;
+      iter_set_row (iter, 0);
+      iter_set_child (iter, -1);
       return TRUE;
     }
   else
@@ -259,7 +416,9 @@ static gboolean
 lazy_store_iter_has_child (GtkTreeModel *tree_model,
                            GtkTreeIter  *iter)
 {
-  return FALSE;
+  LazyStore *lazy_store = LAZY_STORE (tree_model);
+
+  return iter_get_child (iter) < 0 && lazy_store->n_children > 0;
 }
 
 static gint
@@ -268,12 +427,13 @@ lazy_store_iter_n_children (GtkTreeModel *tree_model,
 {
   LazyStore *lazy_store = LAZY_STORE (tree_model);
 
+  /* GtkTreeModel is limited to gint rows */
   if (iter == NULL)
-    return lazy_store->n_rows;
+    return MIN (lazy_store->n_rows, G_MAXINT);
 
   g_return_val_if_fail (lazy_store->stamp == iter->stamp, -1);
 
-  return 0;
+  return iter_get_child (iter) < 0 ? lazy_store->n_children : 0;
 }
 
 static gboolean
@@ -287,13 +447,22 @@ lazy_store_iter_nth_child (GtkTreeModel *tree_model,
   iter->stamp = 0;
 
   if (parent)
-    return FALSE;
+    {
+      /* The children are leaves */
+      if (iter_get_child (parent) >= 0 || n < 0 || n >= lazy_store->n_children)
+        return FALSE;
+      iter->stamp = lazy_store->stamp;
+      iter_set_row (iter, iter_get_row (parent));
+      iter_set_child (iter, n);
+      return TRUE;
+    }
 
-  if (n >= lazy_store->n_rows)
+  if (n < 0 || n >= lazy_store->n_rows)
     return FALSE;
 
   iter->stamp = lazy_store->stamp;
-  iter->user_data = (gpointer)(intptr_t)n;
+  iter_set_row (iter, n);
+  iter_set_child (iter, -1);
 
   return TRUE;
 }
@@ -303,7 +472,47 @@ lazy_store_iter_parent (GtkTreeModel *tree_model,
                         GtkTreeIter  *iter,
                         GtkTreeIter  *child)
 {
+  LazyStore *lazy_store = LAZY_STORE (tree_model);
+
   iter->stamp = 0;
-  return FALSE;
+  if (iter_get_child (child) < 0)
+    return FALSE;
+
+  iter->stamp = lazy_store->stamp;
+  iter_set_row (iter, iter_get_row (child));
+  iter_set_child (iter, -1);
+  return TRUE;
 }
 
+
+/* Fulfill the LazyBlockSource requirements */
+static void
+lazy_store_fetch_block (LazyBlockSource *source,
+                        LazyBlock       *block)
+{
+  LazyStore *lazy_store = LAZY_STORE (source);
+  gchar string[100];
+  gint64 row_end, row;
+  gint col_end, col;
+  guint latency = g_atomic_int_get (&lazy_store->latency);
+
+  if (latency)
+    g_usleep (latency);
+
+  row_end = MIN (block->row0 + block->n_rows, lazy_store->n_rows);
+  col_end = MIN ((guint) (block->col0 + block->n_cols), lazy_store->n_columns);
+
+  for (row = block->row0; row < row_end; row++)
+    for (col = block->col0; col < col_end; col++)
+      {
+        gint len = g_snprintf (string, sizeof (string),
+                               "Row: %" G_GINT64_FORMAT ", Column: %d", row, col);
+        lazy_block_set (block, row, col, string, len);
+      }
+}
+
+static gint64
+lazy_store_get_n_rows (LazyBlockSource *source)
+{
+  return LAZY_STORE (source)->n_rows;
+}
@@ -40,6 +40,16 @@ struct _LazyStoreClass
 GType         lazy_store_get_type         (void) G_GNUC_CONST;
 
 LazyStore    *lazy_store_new              (void);
+LazyStore    *lazy_store_new_with_size    (guint   n_columns,
+                                           gint64  n_rows);
+
+void          lazy_store_append_rows      (LazyStore *lazy_store,
+                                           gint64     n_rows);
+void          lazy_store_set_n_children   (LazyStore *lazy_store,
+                                           gint       n_children);
+void          lazy_store_set_latency      (LazyStore *lazy_store,
+                                           guint      microseconds);
+guint         lazy_store_get_latency      (LazyStore *lazy_store);
 
 G_END_DECLS
 
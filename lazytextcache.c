@@ -0,0 +1,205 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The text cache keeps shaped PangoLayouts for cell strings. Tables
+   often repeat the same values, so a layout which was shaped for one
+   cell can be shown again in other cells and in later frames without
+   running Pango again. The cache is bound to the PangoContext and
+   thereby to the font it was created with, the key is (text, width).
+   Clear the cache when the font changes. */
+
+#include <gtk/gtk.h>
+#include <string.h>
+#include "lazytextcache.h"
+
+/* Rough memory cost of a shaped layout on top of the text */
+#define LAYOUT_BYTES     512
+#define LAYOUT_CHAR_BYTES 24
+
+typedef struct _Entry Entry;
+
+struct _Entry
+{
+  gchar *text;
+  gint width;
+  PangoLayout *layout;
+  gsize bytes;
+  GList link;     /* Position in the lru queue, head is most recent */
+};
+
+struct _LazyTextCache
+{
+  PangoContext *context;
+  gsize max_bytes;
+  gsize bytes;
+
+  GHashTable *entries;  /* Entry -> Entry */
+  GQueue lru;
+
+  guint64 hits;
+  guint64 misses;
+};
+
+static guint
+entry_hash (gconstpointer key)
+{
+  const Entry *entry = key;
+
+  return g_str_hash (entry->text) ^ (guint) entry->width * 2654435761u;
+}
+
+static gboolean
+entry_equal (gconstpointer a,
+             gconstpointer b)
+{
+  const Entry *ea = a;
+  const Entry *eb = b;
+
+  return ea->width == eb->width && strcmp (ea->text, eb->text) == 0;
+}
+
+static void
+entry_free (gpointer data)
+{
+  Entry *entry = data;
+
+  g_object_unref (entry->layout);
+  g_free (entry->text);
+  g_slice_free (Entry, entry);
+}
+
+LazyTextCache *
+lazy_text_cache_new (PangoContext *context,
+                     gsize         max_bytes)
+{
+  LazyTextCache *cache;
+
+  g_return_val_if_fail (context != NULL, NULL);
+
+  cache = g_slice_new0 (LazyTextCache);
+  cache->context = g_object_ref (context);
+  cache->max_bytes = max_bytes;
+  cache->entries = g_hash_table_new_full (entry_hash, entry_equal, NULL, entry_free);
+  g_queue_init (&cache->lru);
+
+  return cache;
+}
+
+void
+lazy_text_cache_free (LazyTextCache *cache)
+{
+  if (cache == NULL)
+    return;
+  g_hash_table_destroy (cache->entries);
+  g_object_unref (cache->context);
+  g_slice_free (LazyTextCache, cache);
+}
+
+static void
+remove_entry (LazyTextCache *cache,
+              Entry         *entry)
+{
+  cache->bytes -= entry->bytes;
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_hash_table_remove (cache->entries, entry);
+}
+
+/* Drop least recently used layouts until the cache fits into the
+   budget. The most recent layout always survives. */
+static void
+evict (LazyTextCache *cache)
+{
+  while (cache->lru.length > 1 && cache->bytes > cache->max_bytes)
+    remove_entry (cache, cache->lru.tail->data);
+}
+
+void
+lazy_text_cache_set_max_bytes (LazyTextCache *cache,
+                               gsize          max_bytes)
+{
+  cache->max_bytes = max_bytes;
+  evict (cache);
+}
+
+void
+lazy_text_cache_clear (LazyTextCache *cache)
+{
+  g_queue_init (&cache->lru);
+  g_hash_table_remove_all (cache->entries);
+  cache->bytes = 0;
+}
+
+/* Returns a layout showing text, ellipsized to width pixels. The
+   layout is owned by the cache and valid until the next lookup. */
+PangoLayout *
+lazy_text_cache_lookup (LazyTextCache *cache,
+                        const gchar   *text,
+                        gint           width)
+{
+  Entry key, *entry;
+  gsize len;
+
+  key.text = (gchar *) text;
+  key.width = width;
+  entry = g_hash_table_lookup (cache->entries, &key);
+  if (entry)
+    {
+      cache->hits++;
+      g_queue_unlink (&cache->lru, &entry->link);
+      g_queue_push_head_link (&cache->lru, &entry->link);
+      return entry->layout;
+    }
+
+  cache->misses++;
+  len = strlen (text);
+  entry = g_slice_new0 (Entry);
+  entry->text = g_strndup (text, len);
+  entry->width = width;
+  entry->layout = pango_layout_new (cache->context);
+  pango_layout_set_single_paragraph_mode (entry->layout, TRUE);
+  pango_layout_set_ellipsize (entry->layout, PANGO_ELLIPSIZE_END);
+  pango_layout_set_width (entry->layout, width * PANGO_SCALE);
+  pango_layout_set_text (entry->layout, entry->text, len);
+  /* Shape now, the layout is shown many times */
+  pango_layout_get_size (entry->layout, NULL, NULL);
+  entry->bytes = sizeof (Entry) + len + 1 + LAYOUT_BYTES + len * LAYOUT_CHAR_BYTES;
+  entry->link.data = entry;
+
+  g_hash_table_insert (cache->entries, entry, entry);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  cache->bytes += entry->bytes;
+  evict (cache);
+
+  return entry->layout;
+}
+
+guint64
+lazy_text_cache_get_hits (LazyTextCache *cache)
+{
+  return cache->hits;
+}
+
+guint64
+lazy_text_cache_get_misses (LazyTextCache *cache)
+{
+  return cache->misses;
+}
+
+gsize
+lazy_text_cache_get_bytes (LazyTextCache *cache)
+{
+  return cache->bytes;
+}
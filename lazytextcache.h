@@ -0,0 +1,44 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_TEXT_CACHE_H__
+#define __LAZY_TEXT_CACHE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LazyTextCache LazyTextCache;
+
+LazyTextCache   *lazy_text_cache_new            (PangoContext  *context,
+                                                 gsize          max_bytes);
+void             lazy_text_cache_free           (LazyTextCache *cache);
+
+void             lazy_text_cache_set_max_bytes  (LazyTextCache *cache,
+                                                 gsize          max_bytes);
+void             lazy_text_cache_clear          (LazyTextCache *cache);
+
+PangoLayout     *lazy_text_cache_lookup         (LazyTextCache *cache,
+                                                 const gchar   *text,
+                                                 gint           width);
+
+guint64          lazy_text_cache_get_hits       (LazyTextCache *cache);
+guint64          lazy_text_cache_get_misses     (LazyTextCache *cache);
+gsize            lazy_text_cache_get_bytes      (LazyTextCache *cache);
+
+G_END_DECLS
+
+#endif /* __LAZY_TEXT_CACHE_H__ */
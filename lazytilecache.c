@@ -0,0 +1,235 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The tile cache keeps already rendered parts of the view in fixed
+   size image surfaces. The tiles are addressed by (tile_row,
+   tile_col) in content coordinates, i.e. tile (r, c) covers the area
+   starting at (c * tile_width, r * tile_height). The least recently
+   used tiles are dropped when the memory budget is exceeded. */
+
+#include <gtk/gtk.h>
+#include "lazytilecache.h"
+
+typedef struct _Tile Tile;
+
+struct _Tile
+{
+  gint64 tile_row;
+  gint tile_col;
+  cairo_surface_t *surface;
+  GList link;     /* Position in the lru queue, head is most recent */
+};
+
+struct _LazyTileCache
+{
+  gint tile_width;
+  gint tile_height;
+  gsize tile_bytes;
+  gsize max_bytes;
+
+  GHashTable *tiles;  /* Tile -> Tile */
+  GQueue lru;
+};
+
+static guint
+tile_hash (gconstpointer key)
+{
+  const Tile *tile = key;
+
+  return (guint) (tile->tile_row ^ (tile->tile_row >> 32)) * 31 +
+         (guint) tile->tile_col * 2654435761u;
+}
+
+static gboolean
+tile_equal (gconstpointer a,
+            gconstpointer b)
+{
+  const Tile *ta = a;
+  const Tile *tb = b;
+
+  return ta->tile_row == tb->tile_row && ta->tile_col == tb->tile_col;
+}
+
+static void
+tile_free (gpointer data)
+{
+  Tile *tile = data;
+
+  cairo_surface_destroy (tile->surface);
+  g_slice_free (Tile, tile);
+}
+
+LazyTileCache *
+lazy_tile_cache_new (gint  tile_width,
+                     gint  tile_height,
+                     gsize max_bytes)
+{
+  LazyTileCache *cache;
+
+  g_return_val_if_fail (tile_width > 0 && tile_height > 0, NULL);
+
+  cache = g_slice_new0 (LazyTileCache);
+  cache->tile_width = tile_width;
+  cache->tile_height = tile_height;
+  /* ARGB32 surfaces */
+  cache->tile_bytes = (gsize) tile_width * tile_height * 4;
+  cache->max_bytes = max_bytes;
+  cache->tiles = g_hash_table_new_full (tile_hash, tile_equal, NULL, tile_free);
+  g_queue_init (&cache->lru);
+
+  return cache;
+}
+
+void
+lazy_tile_cache_free (LazyTileCache *cache)
+{
+  if (cache == NULL)
+    return;
+  g_hash_table_destroy (cache->tiles);
+  g_slice_free (LazyTileCache, cache);
+}
+
+gint
+lazy_tile_cache_get_tile_width (LazyTileCache *cache)
+{
+  return cache->tile_width;
+}
+
+gint
+lazy_tile_cache_get_tile_height (LazyTileCache *cache)
+{
+  return cache->tile_height;
+}
+
+static void
+remove_tile (LazyTileCache *cache,
+             Tile          *tile)
+{
+  g_queue_unlink (&cache->lru, &tile->link);
+  g_hash_table_remove (cache->tiles, tile);
+}
+
+/* Drop least recently used tiles until the cache fits into the budget.
+   The most recent tile always survives. */
+static void
+evict (LazyTileCache *cache)
+{
+  while (cache->lru.length > 1 &&
+         cache->lru.length * cache->tile_bytes > cache->max_bytes)
+    remove_tile (cache, cache->lru.tail->data);
+}
+
+void
+lazy_tile_cache_set_max_bytes (LazyTileCache *cache,
+                               gsize          max_bytes)
+{
+  cache->max_bytes = max_bytes;
+  evict (cache);
+}
+
+static Tile *
+find_tile (LazyTileCache *cache,
+           gint64         tile_row,
+           gint           tile_col)
+{
+  Tile key;
+
+  key.tile_row = tile_row;
+  key.tile_col = tile_col;
+  return g_hash_table_lookup (cache->tiles, &key);
+}
+
+gboolean
+lazy_tile_cache_contains (LazyTileCache *cache,
+                          gint64         tile_row,
+                          gint           tile_col)
+{
+  return find_tile (cache, tile_row, tile_col) != NULL;
+}
+
+/* Returns the tile surface or NULL. The surface is owned by the cache
+   and valid until the next insert or invalidate. */
+cairo_surface_t *
+lazy_tile_cache_lookup (LazyTileCache *cache,
+                        gint64         tile_row,
+                        gint           tile_col)
+{
+  Tile *tile = find_tile (cache, tile_row, tile_col);
+
+  if (tile == NULL)
+    return NULL;
+
+  g_queue_unlink (&cache->lru, &tile->link);
+  g_queue_push_head_link (&cache->lru, &tile->link);
+  return tile->surface;
+}
+
+/* Takes ownership of the surface */
+void
+lazy_tile_cache_insert (LazyTileCache   *cache,
+                        gint64           tile_row,
+                        gint             tile_col,
+                        cairo_surface_t *surface)
+{
+  Tile *tile = find_tile (cache, tile_row, tile_col);
+
+  if (tile)
+    remove_tile (cache, tile);
+
+  tile = g_slice_new0 (Tile);
+  tile->tile_row = tile_row;
+  tile->tile_col = tile_col;
+  tile->surface = surface;
+  tile->link.data = tile;
+  g_hash_table_insert (cache->tiles, tile, tile);
+  g_queue_push_head_link (&cache->lru, &tile->link);
+
+  evict (cache);
+}
+
+void
+lazy_tile_cache_invalidate_all (LazyTileCache *cache)
+{
+  g_queue_init (&cache->lru);
+  g_hash_table_remove_all (cache->tiles);
+}
+
+/* Drop all tiles which intersect the area given in content
+   coordinates */
+void
+lazy_tile_cache_invalidate_area (LazyTileCache *cache,
+                                 gint64         x,
+                                 gint64         y,
+                                 gint64         width,
+                                 gint64         height)
+{
+  GList *l, *next;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  for (l = cache->lru.head; l; l = next)
+    {
+      Tile *tile = l->data;
+      gint64 tx = (gint64) tile->tile_col * cache->tile_width;
+      gint64 ty = tile->tile_row * cache->tile_height;
+
+      next = l->next;
+      if (tx < x + width && x < tx + cache->tile_width &&
+          ty < y + height && y < ty + cache->tile_height)
+        remove_tile (cache, tile);
+    }
+}
@@ -0,0 +1,56 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_TILE_CACHE_H__
+#define __LAZY_TILE_CACHE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LazyTileCache LazyTileCache;
+
+LazyTileCache   *lazy_tile_cache_new             (gint           tile_width,
+                                                  gint           tile_height,
+                                                  gsize          max_bytes);
+void             lazy_tile_cache_free            (LazyTileCache *cache);
+
+gint             lazy_tile_cache_get_tile_width  (LazyTileCache *cache);
+gint             lazy_tile_cache_get_tile_height (LazyTileCache *cache);
+void             lazy_tile_cache_set_max_bytes   (LazyTileCache *cache,
+                                                  gsize          max_bytes);
+
+gboolean         lazy_tile_cache_contains        (LazyTileCache *cache,
+                                                  gint64         tile_row,
+                                                  gint           tile_col);
+cairo_surface_t *lazy_tile_cache_lookup          (LazyTileCache *cache,
+                                                  gint64         tile_row,
+                                                  gint           tile_col);
+void             lazy_tile_cache_insert          (LazyTileCache *cache,
+                                                  gint64         tile_row,
+                                                  gint           tile_col,
+                                                  cairo_surface_t *surface);
+
+void             lazy_tile_cache_invalidate_all  (LazyTileCache *cache);
+void             lazy_tile_cache_invalidate_area (LazyTileCache *cache,
+                                                  gint64         x,
+                                                  gint64         y,
+                                                  gint64         width,
+                                                  gint64         height);
+
+G_END_DECLS
+
+#endif /* __LAZY_TILE_CACHE_H__ */
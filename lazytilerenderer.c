@@ -0,0 +1,219 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The tile renderer draws tiles on a pool of threads. Pango objects
+   must not be shared between threads, so every render thread has its
+   own PangoContext on the font map of that thread, its own layout and
+   its own text cache. The contexts follow the font settings of the
+   widget context given with lazy_tile_renderer_set_style.
+
+   lazy_tile_renderer_run hands the tiles to the threads and returns
+   when all are rendered. The caller is blocked meanwhile, so the
+   render function may read state of the main thread which is not
+   changed while drawing. Anything which is changed by reading, like
+   caches with an LRU order, has to be copied for the tiles before. */
+
+#include <gtk/gtk.h>
+#include "lazytilerenderer.h"
+
+typedef struct _Worker Worker;
+
+/* The font settings of the widget */
+typedef struct
+{
+  guint serial;
+  PangoFontDescription *font;
+  PangoLanguage *language;
+  PangoDirection base_dir;
+  gdouble resolution;
+  cairo_font_options_t *font_options;
+  gsize text_cache_bytes;
+} Style;
+
+struct _LazyTileRenderer
+{
+  GThreadPool *pool;
+  Style style;
+
+  /* The running batch */
+  LazyTileRenderFunc func;
+  gpointer user_data;
+  GMutex lock;
+  GCond done;
+  guint pending;
+};
+
+/* What a render thread owns, kept until the thread exits */
+struct _Worker
+{
+  guint serial;
+  PangoContext *context;
+  PangoLayout *layout;
+  LazyTextCache *text_cache;
+};
+
+static void worker_free (Worker *worker);
+
+static GPrivate worker_key = G_PRIVATE_INIT ((GDestroyNotify) worker_free);
+static guint style_serial;
+
+static void
+worker_clear (Worker *worker)
+{
+  g_clear_pointer (&worker->text_cache, lazy_text_cache_free);
+  g_clear_object (&worker->layout);
+  g_clear_object (&worker->context);
+}
+
+static void
+worker_free (Worker *worker)
+{
+  worker_clear (worker);
+  g_slice_free (Worker, worker);
+}
+
+/* The worker of the calling thread, set up for the style */
+static Worker *
+get_worker (const Style *style)
+{
+  Worker *worker = g_private_get (&worker_key);
+
+  if (worker == NULL)
+    {
+      worker = g_slice_new0 (Worker);
+      g_private_set (&worker_key, worker);
+    }
+  if (worker->context && worker->serial == style->serial)
+    return worker;
+
+  worker_clear (worker);
+  /* The default font map is per thread */
+  worker->context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+  pango_context_set_font_description (worker->context, style->font);
+  pango_context_set_language (worker->context, style->language);
+  pango_context_set_base_dir (worker->context, style->base_dir);
+  pango_cairo_context_set_resolution (worker->context, style->resolution);
+  pango_cairo_context_set_font_options (worker->context, style->font_options);
+
+  /* Same setup as the layout of the view */
+  worker->layout = pango_layout_new (worker->context);
+  pango_layout_set_single_paragraph_mode (worker->layout, TRUE);
+  pango_layout_set_ellipsize (worker->layout, PANGO_ELLIPSIZE_END);
+  if (style->text_cache_bytes)
+    worker->text_cache = lazy_text_cache_new (worker->context, style->text_cache_bytes);
+  worker->serial = style->serial;
+  return worker;
+}
+
+/* Runs on a render thread */
+static void
+render_func (gpointer data,
+             gpointer user_data)
+{
+  LazyTileRenderer *renderer = user_data;
+  Worker *worker = get_worker (&renderer->style);
+
+  renderer->func (data, worker->layout, worker->text_cache, renderer->user_data);
+
+  g_mutex_lock (&renderer->lock);
+  if (--renderer->pending == 0)
+    g_cond_signal (&renderer->done);
+  g_mutex_unlock (&renderer->lock);
+}
+
+LazyTileRenderer *
+lazy_tile_renderer_new (guint n_threads)
+{
+  LazyTileRenderer *renderer;
+
+  renderer = g_slice_new0 (LazyTileRenderer);
+  g_mutex_init (&renderer->lock);
+  g_cond_init (&renderer->done);
+  /* Exclusive threads, the workers go away with the pool */
+  renderer->pool = g_thread_pool_new (render_func, renderer,
+                                      MAX (n_threads, 1), TRUE, NULL);
+  return renderer;
+}
+
+void
+lazy_tile_renderer_free (LazyTileRenderer *renderer)
+{
+  if (renderer == NULL)
+    return;
+
+  g_thread_pool_free (renderer->pool, TRUE, TRUE);
+  g_clear_pointer (&renderer->style.font, pango_font_description_free);
+  g_clear_pointer (&renderer->style.font_options, cairo_font_options_destroy);
+  g_mutex_clear (&renderer->lock);
+  g_cond_clear (&renderer->done);
+  g_slice_free (LazyTileRenderer, renderer);
+}
+
+/* Take over the font settings of the context, e.g. the one of the
+   widget. The threads set up their contexts again on their next
+   tile. */
+void
+lazy_tile_renderer_set_style (LazyTileRenderer *renderer,
+                              PangoContext     *context,
+                              gsize             text_cache_bytes)
+{
+  Style *style;
+  const cairo_font_options_t *font_options;
+
+  g_return_if_fail (renderer != NULL);
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+
+  style = &renderer->style;
+  g_clear_pointer (&style->font, pango_font_description_free);
+  g_clear_pointer (&style->font_options, cairo_font_options_destroy);
+  style->font = pango_font_description_copy (pango_context_get_font_description (context));
+  style->language = pango_context_get_language (context);
+  style->base_dir = pango_context_get_base_dir (context);
+  style->resolution = pango_cairo_context_get_resolution (context);
+  font_options = pango_cairo_context_get_font_options (context);
+  style->font_options = font_options ? cairo_font_options_copy (font_options)
+                                     : cairo_font_options_create ();
+  style->text_cache_bytes = text_cache_bytes;
+  /* Unique over all renderers, threads may be reused */
+  style->serial = g_atomic_int_add (&style_serial, 1) + 1;
+}
+
+/* Render all tiles on the render threads and wait for them */
+void
+lazy_tile_renderer_run (LazyTileRenderer   *renderer,
+                        GPtrArray          *tiles,
+                        LazyTileRenderFunc  func,
+                        gpointer            user_data)
+{
+  guint i;
+
+  g_return_if_fail (renderer != NULL);
+  g_return_if_fail (renderer->style.font != NULL);
+
+  if (tiles->len == 0)
+    return;
+
+  renderer->func = func;
+  renderer->user_data = user_data;
+  renderer->pending = tiles->len;
+  for (i = 0; i < tiles->len; i++)
+    g_thread_pool_push (renderer->pool, g_ptr_array_index (tiles, i), NULL);
+
+  g_mutex_lock (&renderer->lock);
+  while (renderer->pending)
+    g_cond_wait (&renderer->done, &renderer->lock);
+  g_mutex_unlock (&renderer->lock);
+}
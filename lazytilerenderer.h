@@ -0,0 +1,47 @@
+/* lazytree - a lazy treeview
+   Copyright (C) 2015 Friedrich Beckmann
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef __LAZY_TILE_RENDERER_H__
+#define __LAZY_TILE_RENDERER_H__
+
+#include <gtk/gtk.h>
+#include "lazytextcache.h"
+
+G_BEGIN_DECLS
+
+typedef struct _LazyTileRenderer LazyTileRenderer;
+
+/* Renders one tile on a render thread, with the layout and the text
+   cache of that thread. The text cache is NULL if disabled. */
+typedef void (* LazyTileRenderFunc) (gpointer       tile,
+                                     PangoLayout   *layout,
+                                     LazyTextCache *text_cache,
+                                     gpointer       user_data);
+
+LazyTileRenderer *lazy_tile_renderer_new       (guint              n_threads);
+void              lazy_tile_renderer_free      (LazyTileRenderer  *renderer);
+
+void              lazy_tile_renderer_set_style (LazyTileRenderer  *renderer,
+                                                PangoContext      *context,
+                                                gsize              text_cache_bytes);
+void              lazy_tile_renderer_run       (LazyTileRenderer  *renderer,
+                                                GPtrArray         *tiles,
+                                                LazyTileRenderFunc func,
+                                                gpointer           user_data);
+
+G_END_DECLS
+
+#endif /* __LAZY_TILE_RENDERER_H__ */
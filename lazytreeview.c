@@ -15,16 +15,68 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include <gtk/gtk.h>
+#include <string.h>
+#include <time.h>
 
 #include "lazytreeview.h"
+#include "lazyblocksource.h"
+#include "lazytilecache.h"
+#include "lazytextcache.h"
+#include "lazyaxis.h"
+#include "lazyfetcher.h"
+#include "lazycellcache.h"
+#include "lazytilerenderer.h"
+#include "lazycolumnsizer.h"
+
+/* Edge length of the tiles in pixels */
+#define TILE_SIZE 256
+/* Default memory budget of the tile cache in megabytes */
+#define TILE_CACHE_SIZE 64
+/* Default memory budget of the shaped text cache in megabytes */
+#define TEXT_CACHE_SIZE 4
+/* Horizontal text padding, same as the GtkCellRenderer default */
+#define TEXT_XPAD 2
+/* Bounds of automatic column widths, wider text is ellipsized */
+#define AUTO_WIDTH_MIN 24
+#define AUTO_WIDTH_MAX 600
+/* Content higher than this is scrolled in virtual coordinates */
+#define VIRTUAL_HEIGHT (1 << 26)
+/* Worker threads and kept chunks of the asynchronous fetcher */
+#define FETCH_THREADS 4
+#define FETCH_CHUNKS 256
+/* At most this many threads render tiles, by default one per core */
+#define RENDER_THREADS_MAX 16
+/* Default lookahead of the prefetcher in frames */
+#define PREFETCH_FRAMES 8
+/* The prefetched area reaches at most this many pages ahead */
+#define PREFETCH_MAX_PAGES 4
+/* A pause longer than this in microseconds resets the scroll velocity */
+#define VELOCITY_TIMEOUT 100000
+/* Assumed frame interval if the frame clock does not know better */
+#define FRAME_INTERVAL 16667
+/* Distance of the statistics overlay to the corner and its padding */
+#define STATS_MARGIN 8
+#define STATS_PADDING 6
 
 /* Properties */
 enum {
   PROP_0,
-  PROP_FRED,
+  PROP_CELL_CACHE_SIZE,
+  PROP_CELL_CACHE_HITS,
+  PROP_CELL_CACHE_MISSES,
+  PROP_COLLECT_STATS,
+  PROP_SHOW_STATS,
   LAST_PROP,
 };
 
+/* Signals */
+enum {
+  FRAME_DRAWN,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
 struct _LazyTreeView
 {
   GtkLayout parent;
@@ -45,11 +97,94 @@ struct _LazyTreeView
   /* Render Data */
   gint col_width;
   gint row_height;
+  LazyAxis *rows;
+  LazyAxis *columns;
   GtkCellRenderer *renderer;
-
-  /* Offsets derived from scrollers */
+  gboolean use_cell_renderer;
+
+  /* Column widths from a sample of the rows, NULL if disabled. Widths
+     set with lazy_tree_view_set_column_width are kept. */
+  gboolean auto_size;
+  LazyColumnSizer *column_sizer;
+  GHashTable *fixed_columns;
+
+  /* Text fast path */
+  PangoLayout *layout;
+  gint text_height;
+
+  /* Shaped layouts of recently shown strings, created on first use */
+  LazyTextCache *text_cache;
+  guint text_cache_size;
+
+  /* Cells of the visible area, fetched once per frame */
+  LazyBlock *block;
+
+  /* Strings of recently fetched cells, NULL if disabled */
+  LazyCellCache *cell_cache;
+  guint cell_cache_size;
+
+  /* Cells fetched on worker threads, NULL if fetching synchronously */
+  gboolean async_fetch;
+  LazyFetcher *fetcher;
+
+  /* Scroll velocity in pixels per microsecond for the prefetcher */
+  guint prefetch_frames;
+  gint64 last_frame_time;
+  gint last_x;
+  gint64 last_y;
+  gdouble velocity_x;
+  gdouble velocity_y;
+
+  /* Already rendered parts of the view, NULL if disabled */
+  LazyTileCache *tile_cache;
+
+  /* Missing tiles are rendered on render_threads threads, created on
+     first use. The cells of the tiles are copied to render_cells for
+     them. The style is handed over again when it changed. */
+  guint render_threads;
+  LazyTileRenderer *tile_renderer;
+  gboolean tile_renderer_style;
+  LazyBlock *render_cells;
+
+  /* Without tile cache the last frame is kept together with its
+     content position and the damage in frame coordinates. The spare
+     surface takes the moved frame when scrolling. */
+  cairo_surface_t *frame;
+  cairo_surface_t *spare_frame;
+  gint frame_x;
+  gint64 frame_y;
+  cairo_region_t *frame_damage;
+
+  /* Offsets derived from scrollers. The row offset is the logical 64
+     bit content position of the top of the view. */
   gint col_offset;
-  gint row_offset;
+  gint64 row_offset;
+
+  /* Vertical adjustment and its last seen value */
+  GtkAdjustment *vadj;
+  gdouble vadj_value;
+  gboolean vadj_syncing;
+
+  /* Model changes are applied once per frame. Row count changes
+     from the first moved row on, changed rows as damage in widget
+     coordinates clipped to the view. */
+  guint update_tick;
+  gint64 moved_from;
+  cairo_region_t *damage;
+  /* Largest row offset when the size was last applied */
+  gint64 last_max_offset;
+  /* Keep the view at the bottom while rows are appended */
+  gboolean follow;
+
+  /* Statistics of the frame being drawn and of the last frame. The
+     counters are cheap and always running, the timings are only
+     taken if stats_enabled. */
+  gboolean collect_stats;
+  gboolean show_stats;
+  gboolean stats_enabled;
+  LazyFrameStats stats;
+  LazyFrameStats last_stats;
+  PangoLayout *stats_layout;
 };
 
 struct _LazyTreeViewClass
@@ -59,22 +194,29 @@ struct _LazyTreeViewClass
 
 G_DEFINE_TYPE (LazyTreeView, lazy_tree_view, GTK_TYPE_LAYOUT)
 
-static void
-print_adj(const char *name, GtkAdjustment *adj)
+G_DEFINE_BOXED_TYPE (LazyFrameStats, lazy_frame_stats,
+                     lazy_frame_stats_copy, lazy_frame_stats_free)
+
+LazyFrameStats *
+lazy_frame_stats_copy (const LazyFrameStats *stats)
 {
-  if (adj == NULL)
-    printf("%s, adj is NULL\n", name);
-  else
-    printf("%s, value: %lf, lower: %lf, upper: %lf, page size: %lf, page incr: %lf, step incr %lf\n",
-           name,
-           gtk_adjustment_get_value (adj),
-           gtk_adjustment_get_lower (adj),
-           gtk_adjustment_get_upper (adj),
-           gtk_adjustment_get_page_size (adj),
-           gtk_adjustment_get_page_increment (adj),
-           gtk_adjustment_get_step_increment (adj));
+  LazyFrameStats *copy = g_new (LazyFrameStats, 1);
+
+  *copy = *stats;
+  return copy;
+}
+
+void
+lazy_frame_stats_free (LazyFrameStats *stats)
+{
+  g_free (stats);
 }
 
+static void vadjustment_notify_cb (GObject      *object,
+                                   GParamSpec   *pspec,
+                                   LazyTreeView *tree_view);
+static void update_column_sizer (LazyTreeView *tree_view);
+
 /* GObject Methods
  */
 
@@ -87,9 +229,17 @@ lazy_tree_view_set_property (GObject         *object,
   LazyTreeView *tree_view;
 
   tree_view = LAZY_TREE_VIEW (object);
-  printf("%s - prop_id %d\n", __FUNCTION__, prop_id);
   switch (prop_id)
     {
+    case PROP_CELL_CACHE_SIZE:
+      lazy_tree_view_set_cell_cache_size (tree_view, g_value_get_uint (value));
+      break;
+    case PROP_COLLECT_STATS:
+      lazy_tree_view_set_collect_stats (tree_view, g_value_get_boolean (value));
+      break;
+    case PROP_SHOW_STATS:
+      lazy_tree_view_set_show_stats (tree_view, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -105,9 +255,25 @@ lazy_tree_view_get_property (GObject    *object,
   LazyTreeView *tree_view;
 
   tree_view = LAZY_TREE_VIEW (object);
-  printf("%s - prop_id %d\n", __FUNCTION__, prop_id);
   switch (prop_id)
     {
+    case PROP_CELL_CACHE_SIZE:
+      g_value_set_uint (value, tree_view->cell_cache_size);
+      break;
+    case PROP_CELL_CACHE_HITS:
+      g_value_set_uint64 (value, tree_view->cell_cache ?
+                          lazy_cell_cache_get_hits (tree_view->cell_cache) : 0);
+      break;
+    case PROP_CELL_CACHE_MISSES:
+      g_value_set_uint64 (value, tree_view->cell_cache ?
+                          lazy_cell_cache_get_misses (tree_view->cell_cache) : 0);
+      break;
+    case PROP_COLLECT_STATS:
+      g_value_set_boolean (value, tree_view->collect_stats);
+      break;
+    case PROP_SHOW_STATS:
+      g_value_set_boolean (value, tree_view->show_stats);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -128,11 +294,6 @@ drag_begin_cb (GtkGestureDrag *gesture,
   vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (treeview));
   vadj_value = gtk_adjustment_get_value(vadj);
 
-  printf("%s - x: %lf, y: %lf, rx: %d, ry: %d, hadj: %lf, vadj: %lf\n",__FUNCTION__,
-         start_x, start_y,
-         treeview->red_x, treeview->red_y,
-         hadj_value, vadj_value);
-
   if (ABS(start_x + hadj_value - treeview->red_x ) < 5 &&
       ABS(start_y + vadj_value - treeview->red_y ) < 5)
     treeview->red_move = TRUE;
@@ -156,10 +317,6 @@ drag_update_cb (GtkGestureDrag *gesture,
     {
       gdouble startx, starty;
       gtk_gesture_drag_get_start_point (gesture, &startx, &starty);
-      printf("%s - x: %lf, y: %lf, ox: %lf, oy: %lf, hadj: %d, vadj: %d\n",__FUNCTION__,
-             startx, starty,
-             offset_x, offset_y,
-             hadj_value, vadj_value);
       treeview->red_x = startx + offset_x + hadj_value;
       treeview->red_y = starty + offset_y + vadj_value;
       gtk_widget_queue_draw (GTK_WIDGET (treeview));
@@ -172,8 +329,6 @@ drag_end_cb (GtkGestureDrag *gesture,
              gdouble         offset_y,
              LazyTreeView    *treeview)
 {
-  printf("%s - x: %d, y: %d\n",__FUNCTION__, treeview->red_x, treeview->red_y);
-
   if (treeview->red_move)
     {
       GtkWidget *button = gtk_button_new_with_label ("Moved the red rectangle");
@@ -187,37 +342,984 @@ drag_end_cb (GtkGestureDrag *gesture,
 }
 
 
+/* Frame statistics
+
+   Monotonic time in nanoseconds. Shaping a single cell takes about a
+   microsecond, too short for g_get_monotonic_time. */
+static gint64
+stats_clock (void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64) ts.tv_sec * G_GINT64_CONSTANT (1000000000) + ts.tv_nsec;
+#else
+  return g_get_monotonic_time () * 1000;
+#endif
+}
+
+/* The range of cells which intersect the area given in content
+   coordinates. The end values are exclusive. */
+static void
+cell_range (LazyTreeView *tree_view,
+            gint          x,
+            gint64        y,
+            gint          width,
+            gint          height,
+            gint64       *row0,
+            gint64       *row_end,
+            gint         *col0,
+            gint         *col_end)
+{
+  gint64 n_rows = lazy_axis_get_n (tree_view->rows);
+  gint n_cols = lazy_axis_get_n (tree_view->columns);
+
+  *row0 = lazy_axis_find (tree_view->rows, y);
+  *row_end = *row0;
+  if (height > 0)
+    *row_end = MIN (lazy_axis_find (tree_view->rows, y + height - 1) + 1, n_rows);
+  *col0 = lazy_axis_find (tree_view->columns, x);
+  *col_end = *col0;
+  if (width > 0)
+    *col_end = MIN (lazy_axis_find (tree_view->columns, (gint64) x + width - 1) + 1, n_cols);
+}
+
+/* Fetch the rows of the cell range which have cells missing in the
+   cell cache and add their cells to the cache. The block keeps the
+   fetched cells for this frame, in case the cache is too small for
+   them. If it is smaller than the range, the inserts may evict cells
+   which were hits, then the block is fetched for the whole range. */
+static void
+fetch_uncached (LazyTreeView *tree_view,
+                gint64        row0,
+                gint64        row_end,
+                gint          col0,
+                gint          col_end)
+{
+  LazyCellCache *cache = tree_view->cell_cache;
+  gint64 miss0 = -1, miss_end = -1, row;
+  gint col;
+
+  for (row = row0; row < row_end; row++)
+    for (col = col0; col < col_end; col++)
+      if (!lazy_cell_cache_lookup (cache, row, col))
+        {
+          if (miss0 < 0)
+            miss0 = row;
+          miss_end = row + 1;
+        }
+
+  if (miss0 < 0)
+    {
+      lazy_block_reset (tree_view->block, row0, 0, col0, 0);
+      return;
+    }
+
+  lazy_block_reset (tree_view->block, miss0, miss_end - miss0, col0, col_end - col0);
+  lazy_block_fetch (tree_view->model, tree_view->block);
+  tree_view->stats.n_fetches++;
+  for (row = miss0; row < miss_end; row++)
+    for (col = col0; col < col_end; col++)
+      {
+        const gchar *text;
+
+        if (!lazy_cell_cache_peek (cache, row, col, &text))
+          lazy_cell_cache_insert (cache, row, col,
+                                  lazy_block_get (tree_view->block, row, col));
+      }
+
+  /* Rows outside the block were all hits */
+  for (row = row0; row < row_end; row++)
+    for (col = col0; col < col_end; col++)
+      {
+        const gchar *text;
+
+        if (row >= miss0 && row < miss_end)
+          break;
+        if (!lazy_cell_cache_peek (cache, row, col, &text))
+          {
+            lazy_block_reset (tree_view->block, row0, row_end - row0, col0, col_end - col0);
+            lazy_block_fetch (tree_view->model, tree_view->block);
+            tree_view->stats.n_fetches++;
+            return;
+          }
+      }
+}
+
+/* Fetch all cells of the area into the block with one call. With the
+   asynchronous fetcher the missing cells are only requested, they
+   are drawn when they arrived. */
+static void
+fetch_cells (LazyTreeView *tree_view,
+             gint          x,
+             gint64        y,
+             gint          width,
+             gint          height)
+{
+  gint64 row0, row_end;
+  gint col0, col_end;
+
+  cell_range (tree_view, x, y, width, height, &row0, &row_end, &col0, &col_end);
+  if (tree_view->fetcher)
+    {
+      lazy_fetcher_request_area (tree_view->fetcher, row0, row_end, col0, col_end);
+      tree_view->stats.n_fetches++;
+      return;
+    }
+  if (tree_view->cell_cache)
+    {
+      fetch_uncached (tree_view, row0, row_end, col0, col_end);
+      return;
+    }
+  lazy_block_reset (tree_view->block, row0, row_end - row0, col0, col_end - col0);
+  lazy_block_fetch (tree_view->model, tree_view->block);
+  tree_view->stats.n_fetches++;
+}
+
+static void
+fetch_area (LazyTreeView *tree_view,
+            gint          x,
+            gint64        y,
+            gint          width,
+            gint          height)
+{
+  gint64 start;
+
+  if (!tree_view->stats_enabled)
+    {
+      fetch_cells (tree_view, x, y, width, height);
+      return;
+    }
+  start = stats_clock ();
+  fetch_cells (tree_view, x, y, width, height);
+  tree_view->stats.fetch_time += stats_clock () - start;
+}
+
+/* The text of a cell. ready is FALSE if the cell is still being
+   fetched. */
+static const gchar *
+cell_text (LazyTreeView *tree_view,
+           gint64        row,
+           gint          col,
+           gboolean     *ready)
+{
+  const gchar *text;
+
+  if (tree_view->fetcher)
+    return lazy_fetcher_lookup (tree_view->fetcher, row, col, ready);
+  *ready = TRUE;
+  if (tree_view->cell_cache &&
+      lazy_cell_cache_peek (tree_view->cell_cache, row, col, &text))
+    return text;
+  return lazy_block_get (tree_view->block, row, col);
+}
+
+/* A cell which is still being fetched is shown as a faint bar */
+static void
+render_placeholder (cairo_t  *cr,
+                    GdkRGBA  *color,
+                    gint      x,
+                    gint      y,
+                    gint      width,
+                    gint      height)
+{
+  cairo_save (cr);
+  cairo_set_source_rgba (cr, color->red, color->green, color->blue,
+                         color->alpha * 0.15);
+  cairo_rectangle (cr, x + TEXT_XPAD, y + height / 4,
+                   MAX (width - 2 * TEXT_XPAD, 0), height / 2);
+  cairo_fill (cr);
+  cairo_restore (cr);
+}
+
+/* The layout used for all text cells. It is created on first use and
+   dropped when the style changes. */
+static PangoLayout *
+get_text_layout (LazyTreeView *tree_view)
+{
+  if (tree_view->layout == NULL)
+    {
+      tree_view->layout = gtk_widget_create_pango_layout (GTK_WIDGET (tree_view), "Xg");
+      pango_layout_set_single_paragraph_mode (tree_view->layout, TRUE);
+      pango_layout_set_ellipsize (tree_view->layout, PANGO_ELLIPSIZE_END);
+      pango_layout_get_pixel_size (tree_view->layout, NULL, &tree_view->text_height);
+    }
+  return tree_view->layout;
+}
+
+static LazyTextCache *
+get_text_cache (LazyTreeView *tree_view)
+{
+  if (tree_view->text_cache == NULL)
+    tree_view->text_cache =
+      lazy_text_cache_new (gtk_widget_get_pango_context (GTK_WIDGET (tree_view)),
+                           (gsize) tree_view->text_cache_size * 1024 * 1024);
+  return tree_view->text_cache;
+}
+
+/* What the text fast path needs from the thread it runs on. The main
+   thread uses the layout and the text cache of the view and looks the
+   cells up, render threads have their own and take the cells copied
+   for them. */
+typedef struct
+{
+  PangoLayout *layout;
+  LazyTextCache *text_cache;  /* NULL if disabled */
+  GdkRGBA color;
+  gint text_height;
+  LazyBlock *cells;           /* Copied cells or NULL */
+  gboolean timed;
+  gint64 shape_time;
+} TextPass;
+
+/* The pass of the main thread */
+static void
+init_text_pass (LazyTreeView *tree_view,
+                TextPass     *pass)
+{
+  GtkStyleContext *context = gtk_widget_get_style_context (GTK_WIDGET (tree_view));
+
+  pass->layout = get_text_layout (tree_view);
+  pass->text_cache = tree_view->text_cache_size ? get_text_cache (tree_view) : NULL;
+  gtk_style_context_get_color (context, gtk_style_context_get_state (context), &pass->color);
+  pass->text_height = tree_view->text_height;
+  pass->cells = NULL;
+  pass->timed = tree_view->stats_enabled;
+  pass->shape_time = 0;
+}
+
+/* The text fast path. Every cell is drawn with the same layout, only
+   the text is exchanged. The padding and the vertical centering
+   follow GtkCellRendererText. Ellipsizing keeps the text inside the
+   cell so no clip is needed. Repeated strings are taken from the
+   text cache already shaped. Returns FALSE if placeholders were drawn
+   for cells which are still being fetched. */
+static gboolean
+render_text (LazyTreeView *tree_view,
+             TextPass     *pass,
+             cairo_t      *cr,
+             gint          x,
+             gint64        y,
+             gint64        row0,
+             gint64        row_end,
+             gint          col0,
+             gint          col_end)
+{
+  PangoLayout *layout = pass->layout;
+  gint64 row;
+  gint col;
+  gint row_y, col_x0;
+  gint layout_width = -1;
+  gboolean complete = TRUE;
+
+  gdk_cairo_set_source_rgba (cr, &pass->color);
+
+  row_y = lazy_axis_get_offset (tree_view->rows, row0) - y;
+  col_x0 = lazy_axis_get_offset (tree_view->columns, col0) - x;
+  for (row = row0; row < row_end; row++)
+    {
+      gint row_height = lazy_axis_get_size (tree_view->rows, row);
+      gint text_y = row_y + (row_height - pass->text_height) / 2;
+      gint col_x = col_x0;
+
+      for (col = col0; col < col_end; col++)
+        {
+          gboolean ready;
+          const gchar *text;
+          gint col_width = lazy_axis_get_size (tree_view->columns, col);
+          gint text_width = MAX (col_width - 2 * TEXT_XPAD, 0);
+          PangoLayout *cell_layout = layout;
+
+          if (pass->cells)
+            {
+              /* Cells which were not ready are missing in the copy */
+              text = lazy_block_get (pass->cells, row, col);
+              ready = text != NULL;
+            }
+          else
+            text = cell_text (tree_view, row, col, &ready);
+
+          if (!ready)
+            {
+              render_placeholder (cr, &pass->color, col_x, row_y, col_width, row_height);
+              complete = FALSE;
+            }
+          else if (text != NULL && *text != '\0')
+            {
+              gint64 start = pass->timed ? stats_clock () : 0;
+
+              if (pass->text_cache)
+                cell_layout = lazy_text_cache_lookup (pass->text_cache, text, text_width);
+              else
+                {
+                  if (text_width != layout_width)
+                    {
+                      pango_layout_set_width (layout, text_width * PANGO_SCALE);
+                      layout_width = text_width;
+                    }
+                  pango_layout_set_text (layout, text, -1);
+                }
+              if (pass->timed)
+                {
+                  /* Shape now, otherwise it is counted as painting */
+                  pango_layout_get_size (cell_layout, NULL, NULL);
+                  pass->shape_time += stats_clock () - start;
+                }
+              cairo_move_to (cr, col_x + TEXT_XPAD, text_y);
+              pango_cairo_show_layout (cr, cell_layout);
+            }
+          col_x += col_width;
+        }
+      row_y += row_height;
+    }
+  return complete;
+}
+
+/* Render the cells of the area. The origin of cr is at content
+   position (x, y). The cells must be fetched. Returns FALSE if some
+   cells are still being fetched. */
+static gboolean
+render_area (LazyTreeView *tree_view,
+             cairo_t      *cr,
+             gint          x,
+             gint64        y,
+             gint          width,
+             gint          height)
+{
+  gint64 row0, row_end, row;
+  gint col0, col_end, col;
+  GdkRectangle rect;
+  GdkRGBA color;
+  gboolean complete = TRUE;
+
+  cell_range (tree_view, x, y, width, height, &row0, &row_end, &col0, &col_end);
+  tree_view->stats.n_cells += (row_end - row0) * (col_end - col0);
+
+  if (!tree_view->use_cell_renderer)
+    {
+      TextPass pass;
+
+      init_text_pass (tree_view, &pass);
+      complete = render_text (tree_view, &pass, cr, x, y, row0, row_end, col0, col_end);
+      tree_view->stats.shape_time += pass.shape_time;
+      return complete;
+    }
+
+  if (tree_view->fetcher)
+    {
+      GtkStyleContext *context = gtk_widget_get_style_context (GTK_WIDGET (tree_view));
+      gtk_style_context_get_color (context, gtk_style_context_get_state (context), &color);
+    }
+
+  rect.y = lazy_axis_get_offset (tree_view->rows, row0) - y;
+  for (row = row0; row < row_end; row++)
+    {
+      rect.height = lazy_axis_get_size (tree_view->rows, row);
+      rect.x = lazy_axis_get_offset (tree_view->columns, col0) - x;
+      for (col = col0; col < col_end; col++)
+        {
+          gboolean ready;
+          const gchar *text = cell_text (tree_view, row, col, &ready);
+
+          rect.width = lazy_axis_get_size (tree_view->columns, col);
+          if (!ready)
+            {
+              render_placeholder (cr, &color, rect.x, rect.y, rect.width, rect.height);
+              complete = FALSE;
+              rect.x += rect.width;
+              continue;
+            }
+
+          g_object_set ( G_OBJECT (tree_view->renderer),
+                         "text", text, NULL);
+          gtk_cell_renderer_render (tree_view->renderer, cr, GTK_WIDGET (tree_view),
+                                    &rect, &rect,0);
+          rect.x += rect.width;
+        }
+      rect.y += rect.height;
+    }
+  return complete;
+}
+
+/* Parallel tile rendering
+
+   When several tiles are missing they are rendered on the render
+   threads, each with its own layout and text cache. The cell lookup
+   moves the cell cache and the fetcher in their LRU order, so the
+   cells of the missing tiles are copied on the main thread first and
+   the render threads only read the copy and the axes. Only the text
+   fast path runs there, GtkCellRenderer is bound to the widget. */
+
+typedef struct
+{
+  const TextPass *pass;
+  gint64 tile_row;
+  gint tile_col;
+  cairo_surface_t *surface;
+  gboolean complete;
+  guint64 n_cells;
+  gint64 shape_time;
+} RenderTile;
+
+static LazyTileRenderer *
+get_tile_renderer (LazyTreeView *tree_view)
+{
+  if (tree_view->tile_renderer == NULL)
+    {
+      tree_view->tile_renderer = lazy_tile_renderer_new (tree_view->render_threads);
+      tree_view->tile_renderer_style = FALSE;
+    }
+  if (!tree_view->tile_renderer_style)
+    {
+      lazy_tile_renderer_set_style (tree_view->tile_renderer,
+                                    gtk_widget_get_pango_context (GTK_WIDGET (tree_view)),
+                                    (gsize) tree_view->text_cache_size * 1024 * 1024);
+      tree_view->tile_renderer_style = TRUE;
+    }
+  return tree_view->tile_renderer;
+}
+
+/* Copy the cells of the area given in content coordinates, cells
+   which are still being fetched are left out */
+static void
+copy_cells (LazyTreeView *tree_view,
+            LazyBlock    *cells,
+            gint          x,
+            gint64        y,
+            gint          width,
+            gint          height)
+{
+  gint64 row0, row_end, row;
+  gint col0, col_end, col;
+
+  cell_range (tree_view, x, y, width, height, &row0, &row_end, &col0, &col_end);
+  lazy_block_reset (cells, row0, row_end - row0, col0, col_end - col0);
+  for (row = row0; row < row_end; row++)
+    for (col = col0; col < col_end; col++)
+      {
+        gboolean ready;
+        const gchar *text = cell_text (tree_view, row, col, &ready);
+
+        if (ready)
+          lazy_block_set (cells, row, col, text ? text : "", -1);
+      }
+}
+
+/* Runs on a render thread */
+static void
+render_tile_cb (gpointer       data,
+                PangoLayout   *layout,
+                LazyTextCache *text_cache,
+                gpointer       user_data)
+{
+  RenderTile *tile = data;
+  LazyTreeView *tree_view = user_data;
+  gint tw = lazy_tile_cache_get_tile_width (tree_view->tile_cache);
+  gint th = lazy_tile_cache_get_tile_height (tree_view->tile_cache);
+  TextPass pass = *tile->pass;
+  gint64 row0, row_end;
+  gint col0, col_end;
+  cairo_t *cr;
+
+  pass.layout = layout;
+  pass.text_cache = text_cache;
+  cell_range (tree_view, tile->tile_col * tw, tile->tile_row * th, tw, th,
+              &row0, &row_end, &col0, &col_end);
+  tile->n_cells = (row_end - row0) * (col_end - col0);
+  tile->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, tw, th);
+  cr = cairo_create (tile->surface);
+  tile->complete = render_text (tree_view, &pass, cr, tile->tile_col * tw, tile->tile_row * th,
+                                row0, row_end, col0, col_end);
+  cairo_destroy (cr);
+  tile->shape_time = pass.shape_time;
+}
+
+/* Render the tiles of the range which are not in the cache on the
+   render threads. Returns the rendered tiles by position in the
+   range, NULL for cached ones, or NULL if they are better rendered on
+   the main thread. */
+static RenderTile *
+render_tiles (LazyTreeView *tree_view,
+              gint64        tr0,
+              gint64        tr1,
+              gint          tc0,
+              gint          tc1)
+{
+  LazyTileCache *cache = tree_view->tile_cache;
+  gint tw = lazy_tile_cache_get_tile_width (cache);
+  gint th = lazy_tile_cache_get_tile_height (cache);
+  gint n_cols = tc1 - tc0 + 1;
+  RenderTile *tiles;
+  GPtrArray *missing;
+  TextPass pass;
+  gint64 tr;
+  gint tc;
+  guint i;
+
+  if (tree_view->render_threads <= 1 || tree_view->use_cell_renderer)
+    return NULL;
+
+  missing = g_ptr_array_new ();
+  tiles = g_new0 (RenderTile, (tr1 - tr0 + 1) * n_cols);
+  for (tr = tr0; tr <= tr1; tr++)
+    for (tc = tc0; tc <= tc1; tc++)
+      if (!lazy_tile_cache_contains (cache, tr, tc))
+        {
+          RenderTile *tile = &tiles[(tr - tr0) * n_cols + tc - tc0];
+
+          tile->pass = &pass;
+          tile->tile_row = tr;
+          tile->tile_col = tc;
+          g_ptr_array_add (missing, tile);
+        }
+  /* A single tile is not worth the handover */
+  if (missing->len < 2)
+    {
+      g_ptr_array_free (missing, TRUE);
+      g_free (tiles);
+      return NULL;
+    }
+
+  init_text_pass (tree_view, &pass);
+  copy_cells (tree_view, tree_view->render_cells, tc0 * tw, tr0 * th,
+              n_cols * tw, (tr1 - tr0 + 1) * th);
+  pass.cells = tree_view->render_cells;
+  lazy_tile_renderer_run (get_tile_renderer (tree_view), missing,
+                          render_tile_cb, tree_view);
+
+  for (i = 0; i < missing->len; i++)
+    {
+      RenderTile *tile = g_ptr_array_index (missing, i);
+
+      tree_view->stats.n_cells += tile->n_cells;
+      tree_view->stats.shape_time += tile->shape_time;
+    }
+  g_ptr_array_free (missing, TRUE);
+  return tiles;
+}
+
+/* Composite the visible tiles. Only tiles which are not in the cache
+   are rendered. The cells of all missing tiles are fetched with one
+   block fetch. Tiles with placeholders are not cached, they are
+   rendered again until all of their cells arrived. */
+static void
+draw_tiles (LazyTreeView *tree_view,
+            cairo_t      *cr,
+            gint          x,
+            gint64        y,
+            gint          width,
+            gint          height)
+{
+  LazyTileCache *cache = tree_view->tile_cache;
+  gint tw = lazy_tile_cache_get_tile_width (cache);
+  gint th = lazy_tile_cache_get_tile_height (cache);
+  gint64 tr0 = y / th;
+  gint64 tr1 = (y + height - 1) / th;
+  gint tc0 = x / tw;
+  gint tc1 = (x + width - 1) / tw;
+  gint64 miss_r0 = G_MAXINT64, miss_r1 = -1;
+  gint miss_c0 = G_MAXINT, miss_c1 = -1;
+  RenderTile *rendered = NULL;
+  gboolean refetched = FALSE;
+  gint64 tr;
+  gint tc;
+
+  /* The lookup moves the hits to the front of the LRU, so inserting
+     the missing tiles evicts other tiles first */
+  for (tr = tr0; tr <= tr1; tr++)
+    for (tc = tc0; tc <= tc1; tc++)
+      if (!lazy_tile_cache_lookup (cache, tr, tc))
+        {
+          miss_r0 = MIN (miss_r0, tr);
+          miss_r1 = MAX (miss_r1, tr);
+          miss_c0 = MIN (miss_c0, tc);
+          miss_c1 = MAX (miss_c1, tc);
+        }
+
+  if (miss_r1 >= 0)
+    {
+      fetch_area (tree_view, miss_c0 * tw, miss_r0 * th,
+                  (miss_c1 - miss_c0 + 1) * tw, (miss_r1 - miss_r0 + 1) * th);
+      rendered = render_tiles (tree_view, miss_r0, miss_r1, miss_c0, miss_c1);
+    }
+
+  for (tr = tr0; tr <= tr1; tr++)
+    for (tc = tc0; tc <= tc1; tc++)
+      {
+        cairo_surface_t *surface = lazy_tile_cache_lookup (cache, tr, tc);
+
+        if (surface)
+          tree_view->stats.tile_hits++;
+        else
+          {
+            RenderTile *tile = NULL;
+            gboolean missed = tr >= miss_r0 && tr <= miss_r1 && tc >= miss_c0 && tc <= miss_c1;
+            gboolean complete;
+
+            tree_view->stats.tile_misses++;
+            /* A cache smaller than the view may have evicted tiles of
+               the view while inserting. Their cells are outside the
+               fetched block, so they are fetched again, and the block
+               then no longer holds the missing tiles either. */
+            if (rendered && missed)
+              tile = &rendered[(tr - miss_r0) * (miss_c1 - miss_c0 + 1) + tc - miss_c0];
+            if (tile && tile->surface)
+              {
+                surface = tile->surface;
+                complete = tile->complete;
+              }
+            else
+              {
+                cairo_t *tile_cr;
+
+                if (!missed || refetched)
+                  {
+                    fetch_area (tree_view, tc * tw, tr * th, tw, th);
+                    refetched = TRUE;
+                  }
+                surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, tw, th);
+                tile_cr = cairo_create (surface);
+                complete = render_area (tree_view, tile_cr, tc * tw, tr * th, tw, th);
+                cairo_destroy (tile_cr);
+              }
+            if (complete)
+              lazy_tile_cache_insert (cache, tr, tc, surface);
+            else
+              {
+                cairo_set_source_surface (cr, surface, tc * tw - x, tr * th - y);
+                cairo_rectangle (cr, tc * tw - x, tr * th - y, tw, th);
+                cairo_fill (cr);
+                cairo_surface_destroy (surface);
+                continue;
+              }
+          }
+
+        cairo_set_source_surface (cr, surface, tc * tw - x, tr * th - y);
+        cairo_rectangle (cr, tc * tw - x, tr * th - y, tw, th);
+        cairo_fill (cr);
+      }
+  g_free (rendered);
+}
+
+/* Frame scrolling
+
+   Without tile cache a small scroll step would render the whole view
+   again. Instead the last frame is moved by the scroll delta and only
+   the strips which scrolled in and the damaged rows are rendered. GTK
+   paints once per frame clock cycle, so all adjustment changes of a
+   frame result in a single move. */
+
+static void
+drop_frame (LazyTreeView *tree_view)
+{
+  g_clear_pointer (&tree_view->frame, cairo_surface_destroy);
+  g_clear_pointer (&tree_view->spare_frame, cairo_surface_destroy);
+}
+
+/* Everything has to be rendered again */
+static void
+invalidate_all (LazyTreeView *tree_view)
+{
+  if (tree_view->tile_cache)
+    lazy_tile_cache_invalidate_all (tree_view->tile_cache);
+  drop_frame (tree_view);
+}
+
+/* Mark an area given in content coordinates to be rendered again */
+static void
+damage_frame (LazyTreeView *tree_view,
+              gint64        x,
+              gint64        y,
+              gint64        width,
+              gint64        height)
+{
+  cairo_rectangle_int_t rect;
+  gint64 x0, y0, x1, y1;
+
+  if (tree_view->frame == NULL)
+    return;
+
+  x0 = MAX (x - tree_view->frame_x, 0);
+  y0 = MAX (y - tree_view->frame_y, 0);
+  x1 = MIN (x - tree_view->frame_x + MIN (width, G_MAXINT), cairo_image_surface_get_width (tree_view->frame));
+  y1 = MIN (y - tree_view->frame_y + MIN (height, G_MAXINT), cairo_image_surface_get_height (tree_view->frame));
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  rect.x = x0;
+  rect.y = y0;
+  rect.width = x1 - x0;
+  rect.height = y1 - y0;
+  cairo_region_union_rectangle (tree_view->frame_damage, &rect);
+}
+
+/* Move the frame content by (dx, dy) and damage what scrolled in */
+static void
+scroll_frame (LazyTreeView *tree_view,
+              gint          dx,
+              gint          dy)
+{
+  gint width = cairo_image_surface_get_width (tree_view->frame);
+  gint height = cairo_image_surface_get_height (tree_view->frame);
+  cairo_surface_t *surface = tree_view->spare_frame;
+  cairo_rectangle_int_t rect = { 0, 0, width, height };
+  cairo_t *cr;
+
+  if (surface == NULL)
+    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  cr = cairo_create (surface);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface (cr, tree_view->frame, -dx, -dy);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+  tree_view->spare_frame = tree_view->frame;
+  tree_view->frame = surface;
+
+  cairo_region_translate (tree_view->frame_damage, -dx, -dy);
+  cairo_region_intersect_rectangle (tree_view->frame_damage, &rect);
+
+  if (dy)
+    {
+      rect.x = 0;
+      rect.y = dy > 0 ? height - dy : 0;
+      rect.width = width;
+      rect.height = ABS (dy);
+      cairo_region_union_rectangle (tree_view->frame_damage, &rect);
+    }
+  if (dx)
+    {
+      rect.x = dx > 0 ? width - dx : 0;
+      rect.y = 0;
+      rect.width = ABS (dx);
+      rect.height = height;
+      cairo_region_union_rectangle (tree_view->frame_damage, &rect);
+    }
+}
+
+/* Bring the frame to content position (x, y), render the damage and
+   paint it. The cells of the damage are fetched with one block
+   fetch. */
+static void
+draw_frame (LazyTreeView *tree_view,
+            cairo_t      *cr,
+            gint          x,
+            gint64        y,
+            gint          width,
+            gint          height)
+{
+  cairo_rectangle_int_t rect = { 0, 0, width, height };
+  gint64 dx = x - tree_view->frame_x;
+  gint64 dy = y - tree_view->frame_y;
+  cairo_t *frame_cr;
+  gint i, n;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  if (tree_view->frame == NULL ||
+      cairo_image_surface_get_width (tree_view->frame) != width ||
+      cairo_image_surface_get_height (tree_view->frame) != height ||
+      ABS (dx) >= width || ABS (dy) >= height)
+    {
+      drop_frame (tree_view);
+      tree_view->frame = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+      cairo_region_destroy (tree_view->frame_damage);
+      tree_view->frame_damage = cairo_region_create_rectangle (&rect);
+    }
+  else if (dx || dy)
+    scroll_frame (tree_view, dx, dy);
+  tree_view->frame_x = x;
+  tree_view->frame_y = y;
+
+  n = cairo_region_num_rectangles (tree_view->frame_damage);
+  if (n)
+    {
+      cairo_region_get_extents (tree_view->frame_damage, &rect);
+      fetch_area (tree_view, x + rect.x, y + rect.y, rect.width, rect.height);
+
+      frame_cr = cairo_create (tree_view->frame);
+      for (i = 0; i < n; i++)
+        {
+          cairo_region_get_rectangle (tree_view->frame_damage, i, &rect);
+          cairo_save (frame_cr);
+          cairo_rectangle (frame_cr, rect.x, rect.y, rect.width, rect.height);
+          cairo_clip (frame_cr);
+          cairo_set_operator (frame_cr, CAIRO_OPERATOR_CLEAR);
+          cairo_paint (frame_cr);
+          cairo_set_operator (frame_cr, CAIRO_OPERATOR_OVER);
+          cairo_translate (frame_cr, rect.x, rect.y);
+          /* Cells still being fetched are damaged again when they
+             arrive */
+          render_area (tree_view, frame_cr, x + rect.x, y + rect.y,
+                       rect.width, rect.height);
+          cairo_restore (frame_cr);
+        }
+      cairo_destroy (frame_cr);
+      cairo_region_destroy (tree_view->frame_damage);
+      tree_view->frame_damage = cairo_region_create ();
+    }
+
+  cairo_set_source_surface (cr, tree_view->frame, 0, 0);
+  cairo_paint (cr);
+}
+
+/* Scroll velocity and prefetching
+
+   The scroll velocity is measured between frames and smoothed. The
+   cells of the area which the view is expected to sweep within the
+   next prefetch_frames frames are requested after the visible cells,
+   so a fast flick finds them already fetched. */
+
 static void
-print_allocation (const char *msg, GtkAllocation *allocation)
+update_velocity (LazyTreeView *tree_view,
+                 gint          x,
+                 gint64        y)
 {
-  if (allocation)
-    printf("%s - x: %d, y: %d, width: %d, height: %d\n",
-           msg,
-           allocation->x,
-           allocation->y,
-           allocation->width,
-           allocation->height);
+  GdkFrameClock *clock = gtk_widget_get_frame_clock (GTK_WIDGET (tree_view));
+  gint64 now = clock ? gdk_frame_clock_get_frame_time (clock) : g_get_monotonic_time ();
+  gint64 dt = now - tree_view->last_frame_time;
+
+  /* Another draw in the same frame */
+  if (dt == 0)
+    return;
+
+  if (tree_view->last_frame_time == 0 || dt > VELOCITY_TIMEOUT)
+    {
+      tree_view->velocity_x = 0.0;
+      tree_view->velocity_y = 0.0;
+    }
   else
-    printf("%s - allocation is NULL\n",msg);
+    {
+      tree_view->velocity_x = (tree_view->velocity_x +
+                               (gdouble) (x - tree_view->last_x) / dt) / 2;
+      tree_view->velocity_y = (tree_view->velocity_y +
+                               (gdouble) (y - tree_view->last_y) / dt) / 2;
+    }
+  tree_view->last_frame_time = now;
+  tree_view->last_x = x;
+  tree_view->last_y = y;
+}
+
+/* The area covering the view now and after prefetch_frames frames */
+static void
+predict_area (LazyTreeView *tree_view,
+              gint          x,
+              gint64        y,
+              gint          width,
+              gint          height,
+              gint         *px,
+              gint64       *py,
+              gint         *pwidth,
+              gint         *pheight)
+{
+  GdkFrameClock *clock = gtk_widget_get_frame_clock (GTK_WIDGET (tree_view));
+  gint64 interval = FRAME_INTERVAL;
+  gdouble dx, dy;
+
+  if (clock)
+    gdk_frame_clock_get_refresh_info (clock, tree_view->last_frame_time,
+                                      &interval, NULL);
+  if (interval <= 0)
+    interval = FRAME_INTERVAL;
+
+  dx = tree_view->velocity_x * interval * tree_view->prefetch_frames;
+  dy = tree_view->velocity_y * interval * tree_view->prefetch_frames;
+  dx = CLAMP (dx, -PREFETCH_MAX_PAGES * width, PREFETCH_MAX_PAGES * width);
+  dy = CLAMP (dy, -PREFETCH_MAX_PAGES * height, PREFETCH_MAX_PAGES * height);
+
+  *px = MAX (dx < 0 ? x + (gint) dx : x, 0);
+  *py = MAX (dy < 0 ? y + (gint64) dy : y, 0);
+  *pwidth = x + width + (dx > 0 ? (gint) dx : 0) - *px;
+  *pheight = y + height + (dy > 0 ? (gint64) dy : 0) - *py;
+}
+
+/* Start the statistics of a frame. The cache counters run over many
+   frames, start keeps their values before the frame. */
+static void
+begin_stats (LazyTreeView   *tree_view,
+             LazyFrameStats *start)
+{
+  memset (&tree_view->stats, 0, sizeof (LazyFrameStats));
+  memset (start, 0, sizeof (LazyFrameStats));
+  if (tree_view->text_cache)
+    {
+      start->text_hits = lazy_text_cache_get_hits (tree_view->text_cache);
+      start->text_misses = lazy_text_cache_get_misses (tree_view->text_cache);
+    }
+  if (tree_view->cell_cache)
+    {
+      start->cell_hits = lazy_cell_cache_get_hits (tree_view->cell_cache);
+      start->cell_misses = lazy_cell_cache_get_misses (tree_view->cell_cache);
+    }
+  start->frame_time = stats_clock ();
 }
 
 static void
-print_widget (const char *msg, GtkWidget *widget)
+end_stats (LazyTreeView   *tree_view,
+           LazyFrameStats *start)
 {
-  printf("%s - realized: %d, visible: %d, mapped: %d, has-screen: %d, is-drawable: %d\n", msg,
-         gtk_widget_get_realized (widget),
-         gtk_widget_is_visible (widget),
-         gtk_widget_get_mapped (widget),
-         gtk_widget_has_screen (widget),
-         gtk_widget_is_drawable (widget));
+  LazyFrameStats *stats = &tree_view->stats;
+
+  stats->frame_time = stats_clock () - start->frame_time;
+  stats->paint_time = MAX (stats->frame_time - stats->fetch_time - stats->shape_time, 0);
+  /* The text cache may have been created during the frame */
+  if (tree_view->text_cache)
+    {
+      stats->text_hits = lazy_text_cache_get_hits (tree_view->text_cache) - start->text_hits;
+      stats->text_misses = lazy_text_cache_get_misses (tree_view->text_cache) - start->text_misses;
+    }
+  if (tree_view->cell_cache)
+    {
+      stats->cell_hits = lazy_cell_cache_get_hits (tree_view->cell_cache) - start->cell_hits;
+      stats->cell_misses = lazy_cell_cache_get_misses (tree_view->cell_cache) - start->cell_misses;
+    }
+  tree_view->last_stats = *stats;
 }
 
+/* The statistics of the last frame in the upper left corner. The
+   overlay is only updated when its area is drawn, a draw which only
+   covers other parts of the view leaves it as it was. */
 static void
-print_window (const char *msg, GdkWindow *window)
+draw_stats (LazyTreeView *tree_view,
+            cairo_t      *cr)
 {
-  printf("%s - visible: %d, viewable: %d\n", msg,
-         gdk_window_is_visible (window),
-         gdk_window_is_viewable (window));
+  LazyFrameStats *stats = &tree_view->last_stats;
+  gchar *text;
+  gint width, height;
+
+  if (tree_view->stats_layout == NULL)
+    tree_view->stats_layout = gtk_widget_create_pango_layout (GTK_WIDGET (tree_view), NULL);
+
+  text = g_strdup_printf ("frame %.2f ms\n"
+                          "fetch %.2f ms, %u calls\n"
+                          "shape %.2f ms\n"
+                          "paint %.2f ms\n"
+                          "%" G_GUINT64_FORMAT " cells\n"
+                          "tiles %u hits, %u misses\n"
+                          "text %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses\n"
+                          "cells %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses",
+                          stats->frame_time / 1e6,
+                          stats->fetch_time / 1e6, stats->n_fetches,
+                          stats->shape_time / 1e6,
+                          stats->paint_time / 1e6,
+                          stats->n_cells,
+                          stats->tile_hits, stats->tile_misses,
+                          stats->text_hits, stats->text_misses,
+                          stats->cell_hits, stats->cell_misses);
+  pango_layout_set_text (tree_view->stats_layout, text, -1);
+  g_free (text);
+  pango_layout_get_pixel_size (tree_view->stats_layout, &width, &height);
+
+  cairo_save (cr);
+  cairo_set_source_rgba (cr, 0.0, 0.0, 0.0, 0.7);
+  cairo_rectangle (cr, STATS_MARGIN, STATS_MARGIN,
+                   width + 2 * STATS_PADDING, height + 2 * STATS_PADDING);
+  cairo_fill (cr);
+  cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
+  cairo_move_to (cr, STATS_MARGIN + STATS_PADDING, STATS_MARGIN + STATS_PADDING);
+  pango_cairo_show_layout (cr, tree_view->stats_layout);
+  cairo_restore (cr);
 }
 
 static gboolean
@@ -232,6 +1334,13 @@ lazy_tree_view_draw (GtkWidget *widget,
   GtkAdjustment *vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (widget));
   gdouble hadj_value = 0.0;
   gdouble vadj_value = 0.0;
+  gboolean stats_enabled = tree_view->stats_enabled;
+  LazyFrameStats start;
+
+  if (stats_enabled)
+    begin_stats (tree_view, &start);
+  else
+    memset (&tree_view->stats, 0, sizeof (LazyFrameStats));
 
   if (hadj)
     hadj_value = gtk_adjustment_get_value(hadj);
@@ -263,55 +1372,73 @@ lazy_tree_view_draw (GtkWidget *widget,
   gtk_style_context_restore (context);
 
   /* Here we go */
-  {
-    GtkTreeIter iter;
-
-    guint total_width, total_height;
-    guint row;
-    gint y;
-    gboolean valid;
-    gtk_layout_get_size( GTK_LAYOUT (tree_view), &total_width, &total_height);
-
-    row = vadj_value / total_height * gtk_tree_model_iter_n_children (tree_view->model, NULL);
-
-    valid = gtk_tree_model_iter_nth_child (tree_view->model, &iter, NULL, row);
-    y = -vadj_value + row * tree_view->row_height;
-    while (valid && y < gtk_adjustment_get_page_size (vadj))
-      {
-        guint col = hadj_value / total_width * gtk_tree_model_get_n_columns(tree_view->model);
-        gint x = -hadj_value + col * tree_view->col_width;
-        for(;col < gtk_tree_model_get_n_columns(tree_view->model) && x < gtk_adjustment_get_page_size (hadj);col++, x+=tree_view->col_width)
-          {
-            GdkRectangle rect;
-            GValue val = G_VALUE_INIT;
-            rect.x = x;
-            rect.y = y;
-            rect.width  = tree_view->col_width;
-            rect.height = tree_view->row_height;
-
-            gtk_tree_model_get_value (tree_view->model, &iter, col, &val);
-            g_object_set ( G_OBJECT (tree_view->renderer),
-                           "text", g_value_get_string (&val), NULL);
-            gtk_cell_renderer_render (tree_view->renderer, cr, widget,
-                                      &rect, &rect,0);
-            g_value_unset (&val);
-          }
-        valid = gtk_tree_model_iter_next (tree_view->model, &iter);
-        y += tree_view->row_height;
-      }
-  }
+  if (tree_view->model)
+    {
+      gint x = hadj_value;
+      gint64 y = tree_view->row_offset;
+      gint width = gtk_widget_get_allocated_width (widget);
+      gint height = gtk_widget_get_allocated_height (widget);
+      gint px = x, pwidth = width, pheight = height;
+      gint64 py = y;
+      gint64 row0, row_end;
+      gint col0, col_end;
+
+      update_velocity (tree_view, x, y);
+      if (tree_view->fetcher)
+        {
+          /* Cancel requests for cells which scrolled off and are not
+             ahead of the view. The tiles extend beyond the view, so
+             keep their area. */
+          if (tree_view->prefetch_frames)
+            predict_area (tree_view, x, y, width, height, &px, &py, &pwidth, &pheight);
+          if (tree_view->tile_cache)
+            cell_range (tree_view, px - px % TILE_SIZE, py - py % TILE_SIZE,
+                        pwidth + TILE_SIZE * 2, pheight + TILE_SIZE * 2,
+                        &row0, &row_end, &col0, &col_end);
+          else
+            cell_range (tree_view, px, py, pwidth, pheight,
+                        &row0, &row_end, &col0, &col_end);
+          lazy_fetcher_retain_area (tree_view->fetcher, row0, row_end, col0, col_end);
+        }
+
+      if (tree_view->tile_cache)
+        draw_tiles (tree_view, cr, x, y, width, height);
+      else
+        draw_frame (tree_view, cr, x, y, width, height);
+
+      /* The visible rows are sampled first */
+      if (tree_view->column_sizer)
+        {
+          cell_range (tree_view, x, y, width, height, &row0, &row_end, &col0, &col_end);
+          lazy_column_sizer_sample_area (tree_view->column_sizer, row0, row_end, col0, col_end);
+        }
+
+      /* After the visible cells such that they are counted as
+         drawn and not as prefetched */
+      if (tree_view->fetcher && (px != x || py != y || pwidth != width || pheight != height))
+        {
+          cell_range (tree_view, px, py, pwidth, pheight, &row0, &row_end, &col0, &col_end);
+          lazy_fetcher_prefetch_area (tree_view->fetcher, row0, row_end, col0, col_end);
+        }
+    }
 
   /* Chain up */
   GTK_WIDGET_CLASS (lazy_tree_view_parent_class)->draw (widget, cr);
 
+  if (stats_enabled)
+    {
+      end_stats (tree_view, &start);
+      g_signal_emit (tree_view, signals[FRAME_DRAWN], 0, &tree_view->last_stats);
+      if (tree_view->show_stats)
+        draw_stats (tree_view, cr);
+    }
+
   return FALSE;
 }
 
 static void
 lazy_tree_view_init (LazyTreeView *treeview)
 {
-  printf("%s\n",__FUNCTION__);
-
   GtkWidget *button = gtk_button_new_with_label ("Move red rectangle with "
                                                  "upper left corner");
   gtk_layout_put ( GTK_LAYOUT (treeview), button, 200, 300);
@@ -329,8 +1456,56 @@ lazy_tree_view_init (LazyTreeView *treeview)
   /* Render Data */
   treeview->col_width = 200;
   treeview->row_height = 50;
+  treeview->rows = lazy_axis_new (0, treeview->row_height);
+  treeview->columns = lazy_axis_new (0, treeview->col_width);
 
   treeview->renderer = gtk_cell_renderer_text_new ();
+  treeview->use_cell_renderer = FALSE;
+  treeview->auto_size = FALSE;
+  treeview->column_sizer = NULL;
+  treeview->fixed_columns = g_hash_table_new (NULL, NULL);
+  treeview->layout = NULL;
+  treeview->text_cache = NULL;
+  treeview->text_cache_size = TEXT_CACHE_SIZE;
+  treeview->block = lazy_block_new ();
+  treeview->cell_cache = NULL;
+  treeview->cell_cache_size = 0;
+  treeview->async_fetch = FALSE;
+  treeview->fetcher = NULL;
+  treeview->prefetch_frames = PREFETCH_FRAMES;
+  treeview->last_frame_time = 0;
+  treeview->velocity_x = 0.0;
+  treeview->velocity_y = 0.0;
+  treeview->tile_cache = lazy_tile_cache_new (TILE_SIZE, TILE_SIZE,
+                                              TILE_CACHE_SIZE * 1024 * 1024);
+  treeview->render_threads = MIN (g_get_num_processors (), RENDER_THREADS_MAX);
+  treeview->tile_renderer = NULL;
+  treeview->tile_renderer_style = FALSE;
+  treeview->render_cells = lazy_block_new ();
+  treeview->frame = NULL;
+  treeview->spare_frame = NULL;
+  treeview->frame_x = 0;
+  treeview->frame_y = 0;
+  treeview->frame_damage = cairo_region_create ();
+
+  /* Scrolling */
+  treeview->row_offset = 0;
+  treeview->vadj = NULL;
+  treeview->vadj_value = 0.0;
+  treeview->vadj_syncing = FALSE;
+  treeview->update_tick = 0;
+  treeview->moved_from = G_MAXINT64;
+  treeview->damage = cairo_region_create ();
+  treeview->last_max_offset = 0;
+  treeview->follow = FALSE;
+  treeview->collect_stats = FALSE;
+  treeview->show_stats = FALSE;
+  treeview->stats_enabled = FALSE;
+  memset (&treeview->last_stats, 0, sizeof (LazyFrameStats));
+  treeview->stats_layout = NULL;
+  g_signal_connect (treeview, "notify::vadjustment",
+                    G_CALLBACK (vadjustment_notify_cb), treeview);
+  vadjustment_notify_cb (G_OBJECT (treeview), NULL, treeview);
 
   treeview->gesture = gtk_gesture_drag_new (GTK_WIDGET (treeview));
   gtk_event_controller_set_propagation_phase (GTK_EVENT_CONTROLLER (treeview->gesture),
@@ -343,6 +1518,60 @@ lazy_tree_view_init (LazyTreeView *treeview)
                     G_CALLBACK (drag_end_cb), treeview);
 }
 
+static void
+lazy_tree_view_finalize (GObject *object)
+{
+  LazyTreeView *tree_view = LAZY_TREE_VIEW (object);
+
+  if (tree_view->update_tick)
+    gtk_widget_remove_tick_callback (GTK_WIDGET (tree_view), tree_view->update_tick);
+  cairo_region_destroy (tree_view->damage);
+  if (tree_view->model)
+    g_signal_handlers_disconnect_by_data (tree_view->model, tree_view);
+  if (tree_view->vadj)
+    {
+      g_signal_handlers_disconnect_by_data (tree_view->vadj, tree_view);
+      g_object_unref (tree_view->vadj);
+    }
+  lazy_fetcher_free (tree_view->fetcher);
+  lazy_column_sizer_free (tree_view->column_sizer);
+  g_hash_table_destroy (tree_view->fixed_columns);
+  lazy_cell_cache_free (tree_view->cell_cache);
+  lazy_block_free (tree_view->block);
+  lazy_tile_cache_free (tree_view->tile_cache);
+  lazy_tile_renderer_free (tree_view->tile_renderer);
+  lazy_block_free (tree_view->render_cells);
+  drop_frame (tree_view);
+  cairo_region_destroy (tree_view->frame_damage);
+  g_clear_object (&tree_view->layout);
+  g_clear_object (&tree_view->stats_layout);
+  g_clear_pointer (&tree_view->text_cache, lazy_text_cache_free);
+  lazy_axis_free (tree_view->rows);
+  lazy_axis_free (tree_view->columns);
+
+  G_OBJECT_CLASS (lazy_tree_view_parent_class)->finalize (object);
+}
+
+static void
+lazy_tree_view_style_updated (GtkWidget *widget)
+{
+  LazyTreeView *tree_view = LAZY_TREE_VIEW (widget);
+
+  GTK_WIDGET_CLASS (lazy_tree_view_parent_class)->style_updated (widget);
+
+  /* Font or color may have changed */
+  g_clear_object (&tree_view->layout);
+  g_clear_object (&tree_view->stats_layout);
+  g_clear_pointer (&tree_view->text_cache, lazy_text_cache_free);
+  tree_view->tile_renderer_style = FALSE;
+  /* Measure again if the font changed */
+  if (tree_view->column_sizer &&
+      !pango_font_description_equal (lazy_column_sizer_get_font (tree_view->column_sizer),
+                                     pango_context_get_font_description (gtk_widget_get_pango_context (widget))))
+    update_column_sizer (tree_view);
+  invalidate_all (tree_view);
+}
+
 static void
 lazy_tree_view_class_init (LazyTreeViewClass *class)
 {
@@ -353,37 +1582,526 @@ lazy_tree_view_class_init (LazyTreeViewClass *class)
   widget_class = (GtkWidgetClass*) class;
 
   /* GObject signals */
-  //o_class->set_property = lazy_tree_view_set_property;
-  //o_class->get_property = lazy_tree_view_get_property;
+  o_class->set_property = lazy_tree_view_set_property;
+  o_class->get_property = lazy_tree_view_get_property;
+  o_class->finalize = lazy_tree_view_finalize;
+
+  g_object_class_install_property (o_class,
+                                   PROP_CELL_CACHE_SIZE,
+                                   g_param_spec_uint ("cell-cache-size",
+                                                      "Cell cache size",
+                                                      "Memory budget of the cell cache in megabytes, 0 disables it",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READWRITE));
+  g_object_class_install_property (o_class,
+                                   PROP_CELL_CACHE_HITS,
+                                   g_param_spec_uint64 ("cell-cache-hits",
+                                                        "Cell cache hits",
+                                                        "Number of cells found in the cell cache",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE));
+  g_object_class_install_property (o_class,
+                                   PROP_CELL_CACHE_MISSES,
+                                   g_param_spec_uint64 ("cell-cache-misses",
+                                                        "Cell cache misses",
+                                                        "Number of cells fetched from the model",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE));
+  g_object_class_install_property (o_class,
+                                   PROP_COLLECT_STATS,
+                                   g_param_spec_boolean ("collect-stats",
+                                                         "Collect stats",
+                                                         "Measure every frame and emit frame-drawn",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (o_class,
+                                   PROP_SHOW_STATS,
+                                   g_param_spec_boolean ("show-stats",
+                                                         "Show stats",
+                                                         "Show the statistics of the last frame over the view",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+
+  /* Emitted after each frame with its LazyFrameStats while the
+     statistics are collected */
+  signals[FRAME_DRAWN] =
+    g_signal_new ("frame-drawn",
+                  TYPE_LAZY_TREE_VIEW,
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 1,
+                  TYPE_LAZY_FRAME_STATS | G_SIGNAL_TYPE_STATIC_SCOPE);
 
   /* widget */
   //widget_class->map = lazy_tree_view_map;
   //widget_class->size_allocate = lazy_tree_view_size_allocate;
   widget_class->draw = lazy_tree_view_draw;
+  widget_class->style_updated = lazy_tree_view_style_updated;
   //widget_class->realize = lazy_tree_view_realize;
   //widget_class->get_preferred_width = lazy_tree_view_get_preferred_width;
   //widget_class->get_preferred_height = lazy_tree_view_get_preferred_height;
-
-  printf("%s\n",__FUNCTION__);
 }
 
 GtkWidget *
 lazy_tree_view_new (void)
 {
-  printf("%s\n",__FUNCTION__);
   return g_object_new (TYPE_LAZY_TREE_VIEW, NULL);
 }
 
 
-static void
-estimate_new_size (LazyTreeView *tree_view)
-{
-  gint n_cols = gtk_tree_model_get_n_columns(tree_view->model);
-  gint n_rows = gtk_tree_model_iter_n_children (tree_view->model, NULL);
+/* Virtual scrolling
 
-  gtk_layout_set_size (GTK_LAYOUT (tree_view),
-                       n_cols  * tree_view->col_width,
-                       n_rows  * tree_view->row_height);
+   When the content is higher than VIRTUAL_HEIGHT the vertical
+   adjustment only spans VIRTUAL_HEIGHT and row_offset holds the exact
+   64 bit content position. Small adjustment steps like wheel, keys or
+   page moves are applied relative to row_offset so they move by
+   exactly the same number of pixels as without virtual scrolling.
+   Large jumps, i.e. dragging the scrollbar, are mapped proportionally.
+   Afterwards the adjustment is set to the position matching
+   row_offset. */
+
+static gboolean
+is_virtual (LazyTreeView *tree_view)
+{
+  return lazy_axis_get_total (tree_view->rows) > VIRTUAL_HEIGHT;
+}
+
+static gdouble
+page_height (LazyTreeView *tree_view)
+{
+  return tree_view->vadj ? gtk_adjustment_get_page_size (tree_view->vadj) : 0.0;
+}
+
+/* The largest logical offset of the top of the view */
+static gint64
+max_row_offset (LazyTreeView *tree_view)
+{
+  return MAX (lazy_axis_get_total (tree_view->rows) - (gint64) page_height (tree_view), 0);
+}
+
+/* Move the adjustment to the position of row_offset */
+static void
+sync_vadjustment (LazyTreeView *tree_view)
+{
+  gdouble value;
+
+  if (tree_view->vadj == NULL)
+    return;
+
+  if (is_virtual (tree_view))
+    {
+      gint64 max = max_row_offset (tree_view);
+      value = max ? (gdouble) tree_view->row_offset / max *
+                    (VIRTUAL_HEIGHT - page_height (tree_view)) : 0.0;
+    }
+  else
+    value = tree_view->row_offset;
+
+  tree_view->vadj_syncing = TRUE;
+  gtk_adjustment_set_value (tree_view->vadj, value);
+  tree_view->vadj_syncing = FALSE;
+  tree_view->vadj_value = gtk_adjustment_get_value (tree_view->vadj);
+}
+
+static void
+vadj_value_changed_cb (GtkAdjustment *adj,
+                       LazyTreeView  *tree_view)
+{
+  gdouble value = gtk_adjustment_get_value (adj);
+  gdouble delta = value - tree_view->vadj_value;
+  gint64 max = max_row_offset (tree_view);
+
+  if (tree_view->vadj_syncing)
+    return;
+
+  tree_view->vadj_value = value;
+  if (!is_virtual (tree_view))
+    tree_view->row_offset = value;
+  else
+    {
+      if (ABS (delta) <= page_height (tree_view))
+        tree_view->row_offset = CLAMP (tree_view->row_offset + (gint64) delta, 0, max);
+      else
+        tree_view->row_offset = value / MAX (VIRTUAL_HEIGHT - page_height (tree_view), 1.0) * max;
+      sync_vadjustment (tree_view);
+    }
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+/* The page size changes with the allocation */
+static void
+vadj_changed_cb (GtkAdjustment *adj,
+                 LazyTreeView  *tree_view)
+{
+  if (is_virtual (tree_view) && !tree_view->vadj_syncing)
+    sync_vadjustment (tree_view);
+}
+
+static void
+vadjustment_notify_cb (GObject      *object,
+                       GParamSpec   *pspec,
+                       LazyTreeView *tree_view)
+{
+  GtkAdjustment *vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (tree_view));
+
+  if (vadj == tree_view->vadj)
+    return;
+  if (tree_view->vadj)
+    {
+      g_signal_handlers_disconnect_by_data (tree_view->vadj, tree_view);
+      g_object_unref (tree_view->vadj);
+    }
+  tree_view->vadj = vadj;
+  if (vadj == NULL)
+    return;
+  g_object_ref (vadj);
+  g_signal_connect (vadj, "value-changed",
+                    G_CALLBACK (vadj_value_changed_cb), tree_view);
+  g_signal_connect (vadj, "changed",
+                    G_CALLBACK (vadj_changed_cb), tree_view);
+  sync_vadjustment (tree_view);
+}
+
+/* The totals are kept up to date by the axes */
+static void
+estimate_new_size (LazyTreeView *tree_view)
+{
+  gint64 total_height = lazy_axis_get_total (tree_view->rows);
+
+  gtk_layout_set_size (GTK_LAYOUT (tree_view),
+                       MIN (lazy_axis_get_total (tree_view->columns), G_MAXUINT),
+                       is_virtual (tree_view) ? VIRTUAL_HEIGHT : total_height);
+  tree_view->row_offset = CLAMP (tree_view->row_offset, 0, max_row_offset (tree_view));
+  tree_view->last_max_offset = max_row_offset (tree_view);
+  sync_vadjustment (tree_view);
+}
+
+/* Drop all tiles right of x and below y, used when sizes shift the
+   content behind them. */
+static void
+invalidate_from (LazyTreeView *tree_view,
+                 gint64        x,
+                 gint64        y)
+{
+  if (tree_view->tile_cache)
+    lazy_tile_cache_invalidate_area (tree_view->tile_cache,
+                                     x, y, G_MAXINT64 - x, G_MAXINT64 - y);
+  damage_frame (tree_view, x, y, G_MAXINT64 - x, G_MAXINT64 - y);
+}
+
+/* Add the content rows [y0, y1) to the damage. Parts outside of the
+   view are dropped, they are drawn anyway when scrolled into view. */
+static void
+add_damage (LazyTreeView *tree_view,
+            gint64        y0,
+            gint64        y1)
+{
+  GtkWidget *widget = GTK_WIDGET (tree_view);
+  cairo_rectangle_int_t rect;
+
+  y0 = MAX (y0 - tree_view->row_offset, 0);
+  y1 = MIN (y1 - tree_view->row_offset, gtk_widget_get_allocated_height (widget));
+  if (y0 >= y1)
+    return;
+
+  rect.x = 0;
+  rect.y = y0;
+  rect.width = gtk_widget_get_allocated_width (widget);
+  rect.height = y1 - y0;
+  cairo_region_union_rectangle (tree_view->damage, &rect);
+}
+
+/* Apply the model changes collected since the last frame. A view which
+   was at the bottom stays there in follow mode. */
+static gboolean
+update_tick_cb (GtkWidget     *widget,
+                GdkFrameClock *frame_clock,
+                gpointer       user_data)
+{
+  LazyTreeView *tree_view = LAZY_TREE_VIEW (widget);
+  gint64 row = tree_view->moved_from;
+  gint64 row_offset = tree_view->row_offset;
+  gboolean at_bottom = row_offset >= tree_view->last_max_offset;
+  gint i, n;
+
+  tree_view->update_tick = 0;
+  tree_view->moved_from = G_MAXINT64;
+
+  if (row != G_MAXINT64)
+    {
+      gint64 y = lazy_axis_get_offset (tree_view->rows,
+                                       MIN (row, lazy_axis_get_n (tree_view->rows)));
+
+      if (tree_view->fetcher)
+        lazy_fetcher_invalidate_rows (tree_view->fetcher, row, G_MAXINT64);
+      invalidate_from (tree_view, 0, y);
+      /* Only the size changes for rows below the view */
+      estimate_new_size (tree_view);
+      if (tree_view->follow && at_bottom)
+        {
+          tree_view->row_offset = max_row_offset (tree_view);
+          sync_vadjustment (tree_view);
+        }
+      if (tree_view->row_offset != row_offset)
+        {
+          /* Everything moved */
+          cairo_region_destroy (tree_view->damage);
+          tree_view->damage = cairo_region_create ();
+          gtk_widget_queue_draw (widget);
+          return G_SOURCE_REMOVE;
+        }
+      add_damage (tree_view, y, G_MAXINT64);
+    }
+
+  n = cairo_region_num_rectangles (tree_view->damage);
+  for (i = 0; i < n; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (tree_view->damage, i, &rect);
+      gtk_widget_queue_draw_area (widget, rect.x, rect.y, rect.width, rect.height);
+    }
+  cairo_region_destroy (tree_view->damage);
+  tree_view->damage = cairo_region_create ();
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_update (LazyTreeView *tree_view)
+{
+  if (tree_view->update_tick == 0)
+    tree_view->update_tick =
+      gtk_widget_add_tick_callback (GTK_WIDGET (tree_view), update_tick_cb, NULL, NULL);
+}
+
+/* Model change notifications */
+static void
+row_changed_cb (GtkTreeModel *model,
+                GtkTreePath  *path,
+                GtkTreeIter  *iter,
+                LazyTreeView *tree_view)
+{
+  gint row = gtk_tree_path_get_indices (path)[0];
+  gint64 y0, y1;
+
+  if (tree_view->fetcher)
+    lazy_fetcher_invalidate_rows (tree_view->fetcher, row, row + 1);
+  if (tree_view->cell_cache)
+    lazy_cell_cache_row_changed (tree_view->cell_cache, row);
+  if (row >= lazy_axis_get_n (tree_view->rows))
+    return;
+
+  y0 = lazy_axis_get_offset (tree_view->rows, row);
+  y1 = y0 + lazy_axis_get_size (tree_view->rows, row);
+  if (tree_view->tile_cache)
+    lazy_tile_cache_invalidate_area (tree_view->tile_cache,
+                                     0, y0, G_MAXINT, y1 - y0);
+  damage_frame (tree_view, 0, y0, G_MAXINT, y1 - y0);
+  add_damage (tree_view, y0, y1);
+  queue_update (tree_view);
+}
+
+/* Rows from row on moved. Models may report thousands of rows per
+   second, so the costly part waits for the next frame. */
+static void
+rows_moved (LazyTreeView *tree_view,
+            gint64        row)
+{
+  tree_view->moved_from = MIN (tree_view->moved_from, row);
+  queue_update (tree_view);
+}
+
+static void
+row_inserted_cb (GtkTreeModel *model,
+                 GtkTreePath  *path,
+                 GtkTreeIter  *iter,
+                 LazyTreeView *tree_view)
+{
+  gint row = gtk_tree_path_get_indices (path)[0];
+
+  lazy_axis_insert (tree_view->rows, MIN (row, lazy_axis_get_n (tree_view->rows)));
+  if (tree_view->cell_cache)
+    lazy_cell_cache_row_inserted (tree_view->cell_cache, row);
+  rows_moved (tree_view, row);
+}
+
+/* Block sources announce a range of new rows at once */
+static void
+rows_inserted_cb (LazyBlockSource *source,
+                  gint64           row,
+                  gint64           n_rows,
+                  LazyTreeView    *tree_view)
+{
+  row = MIN (row, lazy_axis_get_n (tree_view->rows));
+  lazy_axis_insert_range (tree_view->rows, row, n_rows);
+  if (tree_view->cell_cache)
+    lazy_cell_cache_rows_inserted (tree_view->cell_cache, row, n_rows);
+  rows_moved (tree_view, row);
+}
+
+/* Likewise removed ranges, e.g. the rows of a collapsed node */
+static void
+rows_deleted_cb (LazyBlockSource *source,
+                 gint64           row,
+                 gint64           n_rows,
+                 LazyTreeView    *tree_view)
+{
+  gint64 n = lazy_axis_get_n (tree_view->rows);
+
+  if (row < n)
+    lazy_axis_remove_range (tree_view->rows, row, MIN (n_rows, n - row));
+  if (tree_view->cell_cache)
+    lazy_cell_cache_rows_deleted (tree_view->cell_cache, row, n_rows);
+  rows_moved (tree_view, row);
+}
+
+static void
+row_deleted_cb (GtkTreeModel *model,
+                GtkTreePath  *path,
+                LazyTreeView *tree_view)
+{
+  gint row = gtk_tree_path_get_indices (path)[0];
+
+  if (row < lazy_axis_get_n (tree_view->rows))
+    lazy_axis_remove (tree_view->rows, row);
+  if (tree_view->cell_cache)
+    lazy_cell_cache_row_deleted (tree_view->cell_cache, row);
+  rows_moved (tree_view, row);
+}
+
+static void
+rows_reordered_cb (GtkTreeModel *model,
+                   GtkTreePath  *path,
+                   GtkTreeIter  *iter,
+                   gint         *new_order,
+                   LazyTreeView *tree_view)
+{
+  if (tree_view->cell_cache)
+    lazy_cell_cache_clear (tree_view->cell_cache);
+  rows_moved (tree_view, 0);
+}
+
+/* Block sources announce a new order without new_order array */
+static void
+reordered_cb (LazyBlockSource *source,
+              LazyTreeView    *tree_view)
+{
+  rows_reordered_cb (GTK_TREE_MODEL (source), NULL, NULL, NULL, tree_view);
+}
+
+/* All rows were replaced, the row sizes start over */
+static void
+reset_cb (LazyBlockSource *source,
+          LazyTreeView    *tree_view)
+{
+  lazy_axis_free (tree_view->rows);
+  tree_view->rows = lazy_axis_new (lazy_block_source_get_n_rows (source),
+                                   tree_view->row_height);
+  if (tree_view->cell_cache)
+    lazy_cell_cache_clear (tree_view->cell_cache);
+  invalidate_all (tree_view);
+  rows_moved (tree_view, 0);
+}
+
+/* Called when a chunk of cells arrived. Only its area is redrawn. */
+static void
+fetch_ready_cb (gint64   row0,
+                gint     n_rows,
+                gint     col0,
+                gint     n_cols,
+                gpointer user_data)
+{
+  LazyTreeView *tree_view = user_data;
+  GtkWidget *widget = GTK_WIDGET (tree_view);
+  GtkAdjustment *hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (tree_view));
+  gint64 row_end = MIN (row0 + n_rows, lazy_axis_get_n (tree_view->rows));
+  gint col_end = MIN (col0 + n_cols, lazy_axis_get_n (tree_view->columns));
+  gint64 x0, x1, y0, y1;
+
+  if (row0 >= row_end || col0 >= col_end)
+    return;
+
+  x0 = lazy_axis_get_offset (tree_view->columns, col0);
+  x1 = lazy_axis_get_offset (tree_view->columns, col_end);
+  damage_frame (tree_view, x0, lazy_axis_get_offset (tree_view->rows, row0), x1 - x0,
+                lazy_axis_get_offset (tree_view->rows, row_end) -
+                lazy_axis_get_offset (tree_view->rows, row0));
+  if (hadj)
+    {
+      x0 -= (gint64) gtk_adjustment_get_value (hadj);
+      x1 -= (gint64) gtk_adjustment_get_value (hadj);
+    }
+  y0 = lazy_axis_get_offset (tree_view->rows, row0) - tree_view->row_offset;
+  y1 = lazy_axis_get_offset (tree_view->rows, row_end) - tree_view->row_offset;
+
+  x0 = MAX (x0, 0);
+  y0 = MAX (y0, 0);
+  x1 = MIN (x1, gtk_widget_get_allocated_width (widget));
+  y1 = MIN (y1, gtk_widget_get_allocated_height (widget));
+  if (x0 < x1 && y0 < y1)
+    gtk_widget_queue_draw_area (widget, x0, y0, x1 - x0, y1 - y0);
+}
+
+/* Automatic column widths
+
+   The sizer measures samples of the rows in the background and
+   reports the columns whose text got wider in batches. They are
+   applied together, so the view is laid out once per batch. */
+
+static void
+column_widths_cb (const gint *columns,
+                  const gint *widths,
+                  guint       n_columns,
+                  gpointer    user_data)
+{
+  LazyTreeView *tree_view = user_data;
+  gint64 x = G_MAXINT64;
+  guint i;
+
+  for (i = 0; i < n_columns; i++)
+    {
+      gint width = CLAMP (widths[i] + 2 * TEXT_XPAD, AUTO_WIDTH_MIN, AUTO_WIDTH_MAX);
+
+      if (columns[i] >= lazy_axis_get_n (tree_view->columns) ||
+          g_hash_table_lookup (tree_view->fixed_columns, GINT_TO_POINTER (columns[i] + 1)) ||
+          lazy_axis_get_size (tree_view->columns, columns[i]) == width)
+        continue;
+      /* Changes right of the leftmost one do not move it */
+      x = MIN (x, lazy_axis_get_offset (tree_view->columns, columns[i]));
+      lazy_axis_set_size (tree_view->columns, columns[i], width);
+    }
+  if (x == G_MAXINT64)
+    return;
+
+  invalidate_from (tree_view, x, 0);
+  estimate_new_size (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+static void
+update_column_sizer (LazyTreeView *tree_view)
+{
+  g_clear_pointer (&tree_view->column_sizer, lazy_column_sizer_free);
+  if (tree_view->auto_size && tree_view->model)
+    tree_view->column_sizer =
+      lazy_column_sizer_new (tree_view->model,
+                             gtk_widget_get_pango_context (GTK_WIDGET (tree_view)),
+                             column_widths_cb, tree_view);
+}
+
+/* The fetcher needs a block source, a plain GtkTreeModel may not be
+   accessed from other threads */
+static void
+update_fetcher (LazyTreeView *tree_view)
+{
+  g_clear_pointer (&tree_view->fetcher, lazy_fetcher_free);
+  if (tree_view->async_fetch && IS_LAZY_BLOCK_SOURCE (tree_view->model))
+    tree_view->fetcher = lazy_fetcher_new (LAZY_BLOCK_SOURCE (tree_view->model),
+                                           FETCH_THREADS, FETCH_CHUNKS,
+                                           fetch_ready_cb, tree_view);
 }
 
 void lazy_tree_view_set_model (LazyTreeView *tree_view,
@@ -391,7 +2109,406 @@ void lazy_tree_view_set_model (LazyTreeView *tree_view,
 {
   if (tree_view->model == model)
     return;
+  if (tree_view->model)
+    g_signal_handlers_disconnect_by_data (tree_view->model, tree_view);
   tree_view->model = model;
+  invalidate_all (tree_view);
+  if (tree_view->cell_cache)
+    lazy_cell_cache_clear (tree_view->cell_cache);
+  update_fetcher (tree_view);
+
+  /* Start over with default sizes */
+  lazy_axis_free (tree_view->rows);
+  lazy_axis_free (tree_view->columns);
+  tree_view->rows = lazy_axis_new (model ? lazy_block_n_rows (model) : 0,
+                                   tree_view->row_height);
+  tree_view->columns = lazy_axis_new (model ? gtk_tree_model_get_n_columns (model) : 0,
+                                      tree_view->col_width);
+  g_hash_table_remove_all (tree_view->fixed_columns);
+  update_column_sizer (tree_view);
+  if (model == NULL)
+    {
+      estimate_new_size (tree_view);
+      gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+      return;
+    }
+
+  g_signal_connect (model, "row-changed",
+                    G_CALLBACK (row_changed_cb), tree_view);
+  if (IS_LAZY_BLOCK_SOURCE (model))
+    {
+      g_signal_connect (model, "rows-inserted",
+                        G_CALLBACK (rows_inserted_cb), tree_view);
+      g_signal_connect (model, "rows-deleted",
+                        G_CALLBACK (rows_deleted_cb), tree_view);
+      g_signal_connect (model, "reordered",
+                        G_CALLBACK (reordered_cb), tree_view);
+      g_signal_connect (model, "reset",
+                        G_CALLBACK (reset_cb), tree_view);
+    }
+  else
+    {
+      g_signal_connect (model, "row-inserted",
+                        G_CALLBACK (row_inserted_cb), tree_view);
+      g_signal_connect (model, "rows-reordered",
+                        G_CALLBACK (rows_reordered_cb), tree_view);
+      g_signal_connect (model, "row-deleted",
+                        G_CALLBACK (row_deleted_cb), tree_view);
+    }
+  estimate_new_size (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+/* Set the memory budget of the tile cache. 0 disables the cache and
+   every cell is rendered in every frame. */
+void
+lazy_tree_view_set_tile_cache_size (LazyTreeView *tree_view,
+                                    guint         megabytes)
+{
+  gsize max_bytes = (gsize) megabytes * 1024 * 1024;
+
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  if (megabytes == 0)
+    g_clear_pointer (&tree_view->tile_cache, lazy_tile_cache_free);
+  else if (tree_view->tile_cache)
+    lazy_tile_cache_set_max_bytes (tree_view->tile_cache, max_bytes);
+  else
+    tree_view->tile_cache = lazy_tile_cache_new (TILE_SIZE, TILE_SIZE, max_bytes);
+  /* The frame is only kept without tile cache */
+  drop_frame (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+/* Render the cells with the GtkCellRendererText instead of the text
+   fast path. This is slower but honours the renderer properties. */
+void
+lazy_tree_view_set_use_cell_renderer (LazyTreeView *tree_view,
+                                      gboolean      use_cell_renderer)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  use_cell_renderer = use_cell_renderer != FALSE;
+  if (tree_view->use_cell_renderer == use_cell_renderer)
+    return;
+  tree_view->use_cell_renderer = use_cell_renderer;
+  invalidate_all (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+/* Render missing tiles on n_threads threads, each with its own
+   PangoContext. The default is one thread per core. 0 or 1 renders
+   on the main thread. Applies to the tile cache and the text fast
+   path only. */
+void
+lazy_tree_view_set_render_threads (LazyTreeView *tree_view,
+                                   guint         n_threads)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  n_threads = MIN (n_threads, RENDER_THREADS_MAX);
+  if (tree_view->render_threads == n_threads)
+    return;
+  tree_view->render_threads = n_threads;
+  /* Created again with the new size on first use */
+  g_clear_pointer (&tree_view->tile_renderer, lazy_tile_renderer_free);
+}
+
+/* Set the memory budget of the shaped text cache. 0 disables the
+   cache and every string is shaped whenever it is drawn. */
+void
+lazy_tree_view_set_text_cache_size (LazyTreeView *tree_view,
+                                    guint         megabytes)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  tree_view->text_cache_size = megabytes;
+  if (megabytes == 0)
+    g_clear_pointer (&tree_view->text_cache, lazy_text_cache_free);
+  else if (tree_view->text_cache)
+    lazy_text_cache_set_max_bytes (tree_view->text_cache,
+                                   (gsize) megabytes * 1024 * 1024);
+  /* The render threads take the new size with the style */
+  tree_view->tile_renderer_style = FALSE;
+}
+
+/* Set the memory budget of the cell cache. The cache keeps the
+   strings of fetched cells such that scrolling back to them does not
+   ask the model again. It should hold at least one screen of cells.
+   0 disables the cache. The counters are also available as the
+   cell-cache-hits and cell-cache-misses properties. */
+void
+lazy_tree_view_set_cell_cache_size (LazyTreeView *tree_view,
+                                    guint         megabytes)
+{
+  gsize max_bytes = (gsize) megabytes * 1024 * 1024;
+
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  if (tree_view->cell_cache_size == megabytes)
+    return;
+  tree_view->cell_cache_size = megabytes;
+  if (megabytes == 0)
+    g_clear_pointer (&tree_view->cell_cache, lazy_cell_cache_free);
+  else if (tree_view->cell_cache)
+    lazy_cell_cache_set_max_bytes (tree_view->cell_cache, max_bytes);
+  else
+    tree_view->cell_cache = lazy_cell_cache_new (max_bytes);
+  g_object_notify (G_OBJECT (tree_view), "cell-cache-size");
+}
+
+/* The hit and miss counters of the shaped text cache. The counters
+   restart when the cache is recreated after a style change. */
+void
+lazy_tree_view_get_text_cache_stats (LazyTreeView *tree_view,
+                                     guint64      *hits,
+                                     guint64      *misses)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  if (hits)
+    *hits = tree_view->text_cache ? lazy_text_cache_get_hits (tree_view->text_cache) : 0;
+  if (misses)
+    *misses = tree_view->text_cache ? lazy_text_cache_get_misses (tree_view->text_cache) : 0;
+}
+
+gint
+lazy_tree_view_get_row_height (LazyTreeView *tree_view,
+                               gint64        row)
+{
+  g_return_val_if_fail (IS_LAZY_TREE_VIEW (tree_view), 0);
+
+  return lazy_axis_get_size (tree_view->rows, row);
+}
+
+/* Change the height of one row. The rows below move, the update of
+   the size index is O(log n). */
+void
+lazy_tree_view_set_row_height (LazyTreeView *tree_view,
+                               gint64        row,
+                               gint          height)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+  g_return_if_fail (row >= 0 && row < lazy_axis_get_n (tree_view->rows));
+  g_return_if_fail (height >= 0);
+
+  if (lazy_axis_get_size (tree_view->rows, row) == height)
+    return;
+  lazy_axis_set_size (tree_view->rows, row, height);
+  invalidate_from (tree_view, 0, lazy_axis_get_offset (tree_view->rows, row));
   estimate_new_size (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
 }
 
+gint
+lazy_tree_view_get_column_width (LazyTreeView *tree_view,
+                                 gint          column)
+{
+  g_return_val_if_fail (IS_LAZY_TREE_VIEW (tree_view), 0);
+
+  return lazy_axis_get_size (tree_view->columns, column);
+}
+
+/* Change the width of one column. The columns to the right move, the
+   update of the size index is O(log n). */
+void
+lazy_tree_view_set_column_width (LazyTreeView *tree_view,
+                                 gint          column,
+                                 gint          width)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+  g_return_if_fail (column >= 0 && column < lazy_axis_get_n (tree_view->columns));
+  g_return_if_fail (width >= 0);
+
+  /* Not changed by auto sizing anymore */
+  g_hash_table_insert (tree_view->fixed_columns, GINT_TO_POINTER (column + 1),
+                       GINT_TO_POINTER (1));
+  if (lazy_axis_get_size (tree_view->columns, column) == width)
+    return;
+  lazy_axis_set_size (tree_view->columns, column, width);
+  invalidate_from (tree_view, lazy_axis_get_offset (tree_view->columns, column), 0);
+  estimate_new_size (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+/* Size the columns to their content. The widths are estimated in the
+   background from the visible rows, the first rows and random rows,
+   and grow as more rows are seen. */
+void
+lazy_tree_view_set_auto_size_columns (LazyTreeView *tree_view,
+                                      gboolean      auto_size)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  auto_size = auto_size != FALSE;
+  if (tree_view->auto_size == auto_size)
+    return;
+  tree_view->auto_size = auto_size;
+  update_column_sizer (tree_view);
+}
+
+/* Scroll such that row is at the top of the view. The logical offset
+   is exact also in virtual mode, so this lands on the row even
+   behind the gint range. Near the end the last page is shown. */
+void
+lazy_tree_view_scroll_to_row (LazyTreeView *tree_view,
+                              gint64        row)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+  g_return_if_fail (row >= 0);
+
+  tree_view->row_offset = CLAMP (lazy_axis_get_offset (tree_view->rows, row),
+                                 0, max_row_offset (tree_view));
+  sync_vadjustment (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+/* The cell at the widget position (x, y). Returns FALSE if there is
+   no cell, e.g. below the last row. */
+gboolean
+lazy_tree_view_get_cell_at_pos (LazyTreeView *tree_view,
+                                gdouble       x,
+                                gdouble       y,
+                                gint64       *row,
+                                gint         *col)
+{
+  GtkAdjustment *hadj;
+  gint64 content_x, content_y;
+
+  g_return_val_if_fail (IS_LAZY_TREE_VIEW (tree_view), FALSE);
+
+  if (tree_view->model == NULL || x < 0 || y < 0)
+    return FALSE;
+  hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (tree_view));
+  content_x = (gint64) x + (hadj ? (gint64) gtk_adjustment_get_value (hadj) : 0);
+  content_y = (gint64) y + tree_view->row_offset;
+  if (content_x >= lazy_axis_get_total (tree_view->columns) ||
+      content_y >= lazy_axis_get_total (tree_view->rows))
+    return FALSE;
+
+  if (row)
+    *row = lazy_axis_find (tree_view->rows, content_y);
+  if (col)
+    *col = lazy_axis_find (tree_view->columns, content_x);
+  return TRUE;
+}
+
+/* Fetch the cells on worker threads. Cells which are not there yet
+   are drawn as placeholders and the view stays responsive even if
+   the model is slow. The model must implement LazyBlockSource and
+   allow concurrent fetch_block calls, otherwise the cells are
+   fetched synchronously. */
+void
+lazy_tree_view_set_async_fetch (LazyTreeView *tree_view,
+                                gboolean      async_fetch)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  async_fetch = async_fetch != FALSE;
+  if (tree_view->async_fetch == async_fetch)
+    return;
+  tree_view->async_fetch = async_fetch;
+  update_fetcher (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+}
+
+/* Prefetch the cells which the view is expected to show within the
+   given number of frames at the current scroll speed. 0 disables
+   prefetching. This needs asynchronous fetching. */
+void
+lazy_tree_view_set_prefetch_frames (LazyTreeView *tree_view,
+                                    guint         frames)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  tree_view->prefetch_frames = frames;
+}
+
+/* A hit is a prefetched chunk of cells which was there when it was
+   first drawn. A miss is a chunk which had to be waited for. The
+   counters restart when the model or the fetch mode changes. */
+void
+lazy_tree_view_get_prefetch_stats (LazyTreeView *tree_view,
+                                   guint64      *hits,
+                                   guint64      *misses)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  if (tree_view->fetcher)
+    lazy_fetcher_get_prefetch_stats (tree_view->fetcher, hits, misses);
+  else
+    {
+      if (hits)
+        *hits = 0;
+      if (misses)
+        *misses = 0;
+    }
+}
+
+/* Keep the last row in view while rows are appended. Scrolling away
+   from the bottom pauses following, scrolling back resumes it. */
+void
+lazy_tree_view_set_follow (LazyTreeView *tree_view,
+                           gboolean      follow)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  tree_view->follow = follow != FALSE;
+  if (tree_view->follow)
+    {
+      tree_view->row_offset = max_row_offset (tree_view);
+      sync_vadjustment (tree_view);
+      gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+    }
+}
+
+static void
+update_stats_enabled (LazyTreeView *tree_view)
+{
+  tree_view->stats_enabled = tree_view->collect_stats || tree_view->show_stats;
+}
+
+/* Measure every frame and emit frame-drawn with its statistics. The
+   counters cost next to nothing, but the timings take two clock reads
+   per shaped cell, so they are off by default. */
+void
+lazy_tree_view_set_collect_stats (LazyTreeView *tree_view,
+                                  gboolean      collect_stats)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  collect_stats = collect_stats != FALSE;
+  if (tree_view->collect_stats == collect_stats)
+    return;
+  tree_view->collect_stats = collect_stats;
+  update_stats_enabled (tree_view);
+  g_object_notify (G_OBJECT (tree_view), "collect-stats");
+}
+
+/* Show the statistics of the last frame over the upper left corner
+   of the view. This collects the statistics as well. */
+void
+lazy_tree_view_set_show_stats (LazyTreeView *tree_view,
+                               gboolean      show_stats)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+
+  show_stats = show_stats != FALSE;
+  if (tree_view->show_stats == show_stats)
+    return;
+  tree_view->show_stats = show_stats;
+  update_stats_enabled (tree_view);
+  gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+  g_object_notify (G_OBJECT (tree_view), "show-stats");
+}
+
+/* The statistics of the last frame drawn while they were collected */
+void
+lazy_tree_view_get_frame_stats (LazyTreeView   *tree_view,
+                                LazyFrameStats *stats)
+{
+  g_return_if_fail (IS_LAZY_TREE_VIEW (tree_view));
+  g_return_if_fail (stats != NULL);
+
+  *stats = tree_view->last_stats;
+}
@@ -26,12 +26,83 @@
 #define IS_LAZY_TREE_VIEW_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), TYPE_LAZY_TREE_VIEW_CLASS))
 #define LAZY_TREE_VIEW_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_LAZY_TREE_VIEW, LazyTreeViewClass))
 
+#define TYPE_LAZY_FRAME_STATS          (lazy_frame_stats_get_type ())
+
 typedef struct _LazyTreeView         LazyTreeView;
 typedef struct _LazyTreeViewClass    LazyTreeViewClass;
+typedef struct _LazyFrameStats       LazyFrameStats;
+
+/* What drawing one frame cost, times in nanoseconds */
+struct _LazyFrameStats
+{
+  gint64  frame_time;   /* The whole draw of the view */
+  gint64  fetch_time;   /* Getting the cells from the model */
+  gint64  shape_time;   /* Laying out the text of the cells */
+  gint64  paint_time;   /* The rest, mostly painting */
+  guint64 n_cells;      /* Cells rendered */
+  guint   n_fetches;    /* Block fetches or requests to the fetcher */
+  guint   tile_hits;
+  guint   tile_misses;
+  guint64 text_hits;    /* Shaped text cache */
+  guint64 text_misses;
+  guint64 cell_hits;    /* Cell cache */
+  guint64 cell_misses;
+};
 
 GType                   lazy_tree_view_get_type     (void);
 GtkWidget              *lazy_tree_view_new          (void);
 void                    lazy_tree_view_set_model    (LazyTreeView *tree_view,
                                                      GtkTreeModel *model);
+void                    lazy_tree_view_set_tile_cache_size (LazyTreeView *tree_view,
+                                                     guint         megabytes);
+void                    lazy_tree_view_set_use_cell_renderer (LazyTreeView *tree_view,
+                                                     gboolean      use_cell_renderer);
+void                    lazy_tree_view_set_render_threads (LazyTreeView *tree_view,
+                                                     guint         n_threads);
+void                    lazy_tree_view_set_text_cache_size (LazyTreeView *tree_view,
+                                                     guint         megabytes);
+void                    lazy_tree_view_set_cell_cache_size (LazyTreeView *tree_view,
+                                                     guint         megabytes);
+void                    lazy_tree_view_get_text_cache_stats (LazyTreeView *tree_view,
+                                                     guint64      *hits,
+                                                     guint64      *misses);
+gint                    lazy_tree_view_get_row_height (LazyTreeView *tree_view,
+                                                     gint64        row);
+void                    lazy_tree_view_set_row_height (LazyTreeView *tree_view,
+                                                     gint64        row,
+                                                     gint          height);
+gint                    lazy_tree_view_get_column_width (LazyTreeView *tree_view,
+                                                     gint          column);
+void                    lazy_tree_view_set_column_width (LazyTreeView *tree_view,
+                                                     gint          column,
+                                                     gint          width);
+void                    lazy_tree_view_set_auto_size_columns (LazyTreeView *tree_view,
+                                                     gboolean      auto_size);
+void                    lazy_tree_view_scroll_to_row (LazyTreeView *tree_view,
+                                                     gint64        row);
+gboolean                lazy_tree_view_get_cell_at_pos (LazyTreeView *tree_view,
+                                                     gdouble       x,
+                                                     gdouble       y,
+                                                     gint64       *row,
+                                                     gint         *col);
+void                    lazy_tree_view_set_follow   (LazyTreeView *tree_view,
+                                                     gboolean      follow);
+void                    lazy_tree_view_set_async_fetch (LazyTreeView *tree_view,
+                                                     gboolean      async_fetch);
+void                    lazy_tree_view_set_prefetch_frames (LazyTreeView *tree_view,
+                                                     guint         frames);
+void                    lazy_tree_view_get_prefetch_stats (LazyTreeView *tree_view,
+                                                     guint64      *hits,
+                                                     guint64      *misses);
+void                    lazy_tree_view_set_collect_stats (LazyTreeView *tree_view,
+                                                     gboolean      collect_stats);
+void                    lazy_tree_view_set_show_stats (LazyTreeView *tree_view,
+                                                     gboolean      show_stats);
+void                    lazy_tree_view_get_frame_stats (LazyTreeView *tree_view,
+                                                     LazyFrameStats *stats);
+
+GType                   lazy_frame_stats_get_type   (void);
+LazyFrameStats         *lazy_frame_stats_copy       (const LazyFrameStats *stats);
+void                    lazy_frame_stats_free       (LazyFrameStats *stats);
 
 #endif /* __LAZY_TREE_VIEW_H */